@@ -34,6 +34,10 @@ fi
 
 RANDOM_FILE=`pwd`/${RANDOM_FILE_NAME}
 
+#push the seed to the module as seed 1, the rules refer to it by id
+#TS3INITD can be set to the path of ts3initd if it is not installed
+sudo ${TS3INITD:-ts3initd} --once --seed 1:${RANDOM_FILE} || { echo "could not push the seed, is ts3initd installed?"; exit -1; }
+
 #disable connection tracking for ts3 server
 sudo ${IPTABLES} -t raw -A PREROUTING -p udp --dport 9987 -j CT --notrack
 
@@ -47,10 +51,10 @@ sudo ${IPTABLES} -A INPUT -p tcp --dport 30033 -j TS3_TCP_TRAFFIC
 sudo ${IPTABLES} -A TS3_UDP_TRAFFIC -m set --match-set ts3_authorized${1} src -j TS3_UPDATE_AUTHORIZED
 
 #Allow 3.0.19 and up clients
-sudo ${IPTABLES} -A TS3_UDP_TRAFFIC -p udp -m ts3init_get_cookie --min-client 1459504131 -j TS3INIT_SET_COOKIE --random-seed-file ${RANDOM_FILE}
+sudo ${IPTABLES} -A TS3_UDP_TRAFFIC -p udp -m ts3init_get_cookie --min-client 1459504131 -j TS3INIT_SET_COOKIE --seed-id 1
 
 #add new connection if cookie is valid
-sudo ${IPTABLES} -A TS3_UDP_TRAFFIC -p udp -m ts3init_get_puzzle --check-cookie --random-seed-file ${RANDOM_FILE} -j TS3_ACCEPT_NEW
+sudo ${IPTABLES} -A TS3_UDP_TRAFFIC -p udp -m ts3init_get_puzzle --check-cookie --seed-id 1 -j TS3_ACCEPT_NEW
 
 #drop the rest
 sudo ${IPTABLES} -A TS3_UDP_TRAFFIC -j DROP
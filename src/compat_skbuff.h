@@ -35,4 +35,8 @@ static inline int skb_put_padto(struct sk_buff *skb, unsigned int len)
 }
 #endif
 
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3, 19, 0)
+#   define skb_ensure_writable(xskb, xlen) (skb_make_writable((xskb), (xlen)) ? 0 : -ENOMEM)
+#endif
+
 #endif /* COMPAT_SKBUFF_H */
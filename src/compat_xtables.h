@@ -87,6 +87,11 @@ static inline void proc_remove(struct proc_dir_entry *de)
 #   define ip_route_me_harder(xnet, xskb, xaddrtype) ip_route_me_harder((xskb), (xaddrtype))
 #endif
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+#   define ip6_route_me_harder(xnet, xskb) ip6_route_me_harder((xnet), (xskb)->sk, (xskb))
+#   define ip_route_me_harder(xnet, xskb, xaddrtype) ip_route_me_harder((xnet), (xskb)->sk, (xskb), (xaddrtype))
+#endif
+
 static inline struct net *par_net(const struct xt_action_param *par)
 {
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 10, 0)
@@ -20,6 +20,9 @@
 #include "ts3init_random_seed.h"
 #include "ts3init_target.h"
 
+#define param_act(t, s, f) xtables_param_act((t), "TS3INIT_GET_COOKIE", (s), (f))
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof(*(x)))
+
 static void ts3init_get_cookie_help(void)
 {
     printf("TS3INIT_GET_COOKIE takes no options\n\n");
@@ -35,19 +38,105 @@ static void ts3init_get_cookie_check(unsigned int flags)
 {
 }
 
+static void ts3init_get_cookie_v1_help(void)
+{
+    printf(
+        "TS3INIT_GET_COOKIE target options:\n"
+        "  --adaptive                   Count towards the handshake rate, and\n"
+        "                               reply with a reset under attack.\n"
+        "  --in-place                   Turn the received packet into the reset.\n"
+        "  --direct-xmit                Send the reset on the ingress device,\n"
+        "                               bypassing OUTPUT and POSTROUTING.\n");
+}
+
+static const struct option ts3init_get_cookie_v1_opts[] = {
+    {.name = "adaptive",    .has_arg = false, .val = '1'},
+    {.name = "in-place",    .has_arg = false, .val = '2'},
+    {.name = "direct-xmit", .has_arg = false, .val = '3'},
+    {NULL},
+};
+
+static int ts3init_get_cookie_v1_parse(int c, char **argv, int invert, unsigned int *flags,
+                                       const void *entry, struct xt_entry_target **target)
+{
+    struct xt_ts3init_get_cookie_tginfo *info = (void *)(*target)->data;
+    switch (c) {
+    case '1':
+        param_act(XTF_ONLY_ONCE, "--adaptive", info->specific_options & TARGET_GET_COOKIE_ADAPTIVE);
+        param_act(XTF_NO_INVERT, "--adaptive", invert);
+        info->specific_options |= TARGET_GET_COOKIE_ADAPTIVE;
+        return true;
+
+    case '2':
+        param_act(XTF_ONLY_ONCE, "--in-place", info->common_options & TARGET_COMMON_IN_PLACE);
+        param_act(XTF_NO_INVERT, "--in-place", invert);
+        info->common_options |= TARGET_COMMON_IN_PLACE;
+        return true;
+
+    case '3':
+        param_act(XTF_ONLY_ONCE, "--direct-xmit", info->common_options & TARGET_COMMON_DIRECT_XMIT);
+        param_act(XTF_NO_INVERT, "--direct-xmit", invert);
+        info->common_options |= TARGET_COMMON_DIRECT_XMIT;
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+static void ts3init_get_cookie_v1_save(const void *ip, const struct xt_entry_target *target)
+{
+    const struct xt_ts3init_get_cookie_tginfo *info = (const void *)target->data;
+    if (info->specific_options & TARGET_GET_COOKIE_ADAPTIVE)
+    {
+        printf(" --adaptive");
+    }
+    if (info->common_options & TARGET_COMMON_IN_PLACE)
+    {
+        printf(" --in-place");
+    }
+    if (info->common_options & TARGET_COMMON_DIRECT_XMIT)
+    {
+        printf(" --direct-xmit");
+    }
+}
+
+static void ts3init_get_cookie_v1_print(const void *ip, const struct xt_entry_target *target,
+                                        int numeric)
+{
+    printf(" -j TS3INIT_GET_COOKIE");
+    ts3init_get_cookie_v1_save(ip, target);
+}
+
 /* register and init */
-static struct xtables_target ts3init_get_cookie_tg_reg =
-{
-    .name          = "TS3INIT_GET_COOKIE",
-    .revision      = 0,
-    .family        = NFPROTO_UNSPEC,
-    .version       = XTABLES_VERSION,
-    .help          = ts3init_get_cookie_help,
-    .parse         = ts3init_get_cookie_parse,
-    .final_check   = ts3init_get_cookie_check,
+static struct xtables_target ts3init_get_cookie_tg_reg[] =
+{
+    {
+        .name          = "TS3INIT_GET_COOKIE",
+        .revision      = 0,
+        .family        = NFPROTO_UNSPEC,
+        .version       = XTABLES_VERSION,
+        .help          = ts3init_get_cookie_help,
+        .parse         = ts3init_get_cookie_parse,
+        .final_check   = ts3init_get_cookie_check,
+    },
+    {
+        .name          = "TS3INIT_GET_COOKIE",
+        .revision      = 1,
+        .family        = NFPROTO_UNSPEC,
+        .version       = XTABLES_VERSION,
+        .size          = XT_ALIGN(sizeof(struct xt_ts3init_get_cookie_tginfo)),
+        .userspacesize = XT_ALIGN(sizeof(struct xt_ts3init_get_cookie_tginfo)),
+        .help          = ts3init_get_cookie_v1_help,
+        .parse         = ts3init_get_cookie_v1_parse,
+        .print         = ts3init_get_cookie_v1_print,
+        .save          = ts3init_get_cookie_v1_save,
+        .final_check   = ts3init_get_cookie_check,
+        .extra_opts    = ts3init_get_cookie_v1_opts,
+    },
 };
 
 static __attribute__((constructor)) void ts3init_get_cookie_tg_ldr(void)
 {
-    xtables_register_target(&ts3init_get_cookie_tg_reg);
+    xtables_register_targets(ts3init_get_cookie_tg_reg, ARRAY_SIZE(ts3init_get_cookie_tg_reg));
 }
\ No newline at end of file
@@ -21,6 +21,7 @@
 #include "ts3init_target.h"
 
 #define param_act(t, s, f) xtables_param_act((t), "TS3INIT_SET_COOKIE", (s), (f))
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof(*(x)))
 
 static void ts3init_set_cookie_tg_help(void)
 {
@@ -29,7 +30,13 @@ static void ts3init_set_cookie_tg_help(void)
         "  --zero-random-sequence       Always return 0 as random sequence.\n"
         "  --random-seed <seed>         Seed is a %i byte hex number in.\n"
         "                               A source could be /dev/random.\n"
-        "  --random-seed-file <file>    Read the seed from a file.\n",
+        "  --random-seed-file <file>    Read the seed from a file.\n"
+        "  --in-place                   Turn the get_cookie packet into the reply.\n"
+        "  --direct-xmit                Send the reply on the ingress device,\n"
+        "                               bypassing OUTPUT and POSTROUTING.\n"
+        "  --shadow                     Only build the reply and count it, send\n"
+        "                               nothing and let the packet continue.\n"
+        "  --adaptive                   Act as --zero-random-sequence under attack.\n",
         RANDOM_SEED_LEN);
 }
 
@@ -37,6 +44,10 @@ static const struct option ts3init_set_cookie_tg_opts[] = {
     {.name = "zero-random-sequence", .has_arg = false, .val = '1'},
     {.name = "random-seed",          .has_arg = true,  .val = '2'},
     {.name = "random-seed-file",     .has_arg = true,  .val = '3'},
+    {.name = "in-place",             .has_arg = false, .val = '4'},
+    {.name = "direct-xmit",          .has_arg = false, .val = '5'},
+    {.name = "shadow",               .has_arg = false, .val = '6'},
+    {.name = "adaptive",             .has_arg = false, .val = '7'},
     {NULL},
 };
 
@@ -74,6 +85,30 @@ static int ts3init_set_cookie_tg_parse(int c, char **argv,
         *flags |= TARGET_SET_COOKIE_RANDOM_SEED_FROM_FILE;
         return true;
 
+    case '4':
+        param_act(XTF_ONLY_ONCE, "--in-place", info->common_options & TARGET_COMMON_IN_PLACE);
+        param_act(XTF_NO_INVERT, "--in-place", invert);
+        info->common_options |= TARGET_COMMON_IN_PLACE;
+        return true;
+
+    case '5':
+        param_act(XTF_ONLY_ONCE, "--direct-xmit", info->common_options & TARGET_COMMON_DIRECT_XMIT);
+        param_act(XTF_NO_INVERT, "--direct-xmit", invert);
+        info->common_options |= TARGET_COMMON_DIRECT_XMIT;
+        return true;
+
+    case '6':
+        param_act(XTF_ONLY_ONCE, "--shadow", info->common_options & TARGET_COMMON_SHADOW);
+        param_act(XTF_NO_INVERT, "--shadow", invert);
+        info->common_options |= TARGET_COMMON_SHADOW;
+        return true;
+
+    case '7':
+        param_act(XTF_ONLY_ONCE, "--adaptive", info->specific_options & TARGET_SET_COOKIE_ADAPTIVE);
+        param_act(XTF_NO_INVERT, "--adaptive", invert);
+        info->specific_options |= TARGET_SET_COOKIE_ADAPTIVE;
+        return true;
+
     default:
         return false;
     }
@@ -99,6 +134,22 @@ static void ts3init_set_cookie_tg_save(const void *ip, const struct xt_entry_tar
     {
         printf(" --random-seed-file \"%s\"", info->random_seed_path);
     }
+    if (info->common_options & TARGET_COMMON_IN_PLACE)
+    {
+        printf(" --in-place");
+    }
+    if (info->common_options & TARGET_COMMON_DIRECT_XMIT)
+    {
+        printf(" --direct-xmit");
+    }
+    if (info->common_options & TARGET_COMMON_SHADOW)
+    {
+        printf(" --shadow");
+    }
+    if (info->specific_options & TARGET_SET_COOKIE_ADAPTIVE)
+    {
+        printf(" --adaptive");
+    }
 }
 
 static void ts3init_set_cookie_tg_print(const void *ip, const struct xt_entry_target *target,
@@ -126,24 +177,189 @@ static void ts3init_set_cookie_tg_check(unsigned int flags)
     }
 }
 
+enum
+{
+    /* userspace only flag for revision 1 */
+    SET_COOKIE_V1_SEED_ID = 1 << 7
+};
+
+static void ts3init_set_cookie_tg_help_v1(void)
+{
+    printf(
+        "TS3INIT_SET_COOKIE target options:\n"
+        "  --zero-random-sequence       Always return 0 as random sequence.\n"
+        "  --seed-id n                  Use the runtime seed with id n.\n"
+        "  --port-table n               Use the seed of the destination port in the\n"
+        "                               port table with id n.\n"
+        "  --in-place                   Turn the get_cookie packet into the reply.\n"
+        "  --direct-xmit                Send the reply on the ingress device,\n"
+        "                               bypassing OUTPUT and POSTROUTING.\n"
+        "  --shadow                     Only build the reply and count it, send\n"
+        "                               nothing and let the packet continue.\n"
+        "  --adaptive                   Act as --zero-random-sequence under attack.\n");
+}
+
+static const struct option ts3init_set_cookie_tg_opts_v1[] = {
+    {.name = "zero-random-sequence", .has_arg = false, .val = '1'},
+    {.name = "seed-id",              .has_arg = true,  .val = '2'},
+    {.name = "in-place",             .has_arg = false, .val = '3'},
+    {.name = "direct-xmit",          .has_arg = false, .val = '4'},
+    {.name = "port-table",           .has_arg = true,  .val = '5'},
+    {.name = "shadow",               .has_arg = false, .val = '6'},
+    {.name = "adaptive",             .has_arg = false, .val = '7'},
+    {NULL},
+};
+
+static int ts3init_set_cookie_tg_parse_v1(int c, char **argv,
+                                          int invert, unsigned int *flags, const void *entry,
+                                          struct xt_entry_target **target)
+{
+    struct xt_ts3init_set_cookie_tginfo_v1 *info = (void *)(*target)->data;
+    unsigned int value;
+
+    switch (c) {
+    case '1':
+        param_act(XTF_ONLY_ONCE, "--zero-random-sequence", info->specific_options & TARGET_SET_COOKIE_ZERO_RANDOM_SEQUENCE);
+        param_act(XTF_NO_INVERT, "--zero-random-sequence", invert);
+        info->specific_options |= TARGET_SET_COOKIE_ZERO_RANDOM_SEQUENCE;
+        return true;
+
+    case '2':
+        param_act(XTF_ONLY_ONCE, "--seed-id", *flags & SET_COOKIE_V1_SEED_ID);
+        param_act(XTF_NO_INVERT, "--seed-id", invert);
+        if (!xtables_strtoui(optarg, NULL, &value, 0, UINT32_MAX))
+            xtables_error(PARAMETER_PROBLEM,
+                "TS3INIT_SET_COOKIE: invalid seed id");
+        info->seed_id = value;
+        *flags |= SET_COOKIE_V1_SEED_ID;
+        return true;
+
+    case '3':
+        param_act(XTF_ONLY_ONCE, "--in-place", info->common_options & TARGET_COMMON_IN_PLACE);
+        param_act(XTF_NO_INVERT, "--in-place", invert);
+        info->common_options |= TARGET_COMMON_IN_PLACE;
+        return true;
+
+    case '4':
+        param_act(XTF_ONLY_ONCE, "--direct-xmit", info->common_options & TARGET_COMMON_DIRECT_XMIT);
+        param_act(XTF_NO_INVERT, "--direct-xmit", invert);
+        info->common_options |= TARGET_COMMON_DIRECT_XMIT;
+        return true;
+
+    case '6':
+        param_act(XTF_ONLY_ONCE, "--shadow", info->common_options & TARGET_COMMON_SHADOW);
+        param_act(XTF_NO_INVERT, "--shadow", invert);
+        info->common_options |= TARGET_COMMON_SHADOW;
+        return true;
+
+    case '7':
+        param_act(XTF_ONLY_ONCE, "--adaptive", info->specific_options & TARGET_SET_COOKIE_ADAPTIVE);
+        param_act(XTF_NO_INVERT, "--adaptive", invert);
+        info->specific_options |= TARGET_SET_COOKIE_ADAPTIVE;
+        return true;
+
+    case '5':
+        param_act(XTF_ONLY_ONCE, "--port-table", info->specific_options & TARGET_SET_COOKIE_PORT_TABLE);
+        param_act(XTF_NO_INVERT, "--port-table", invert);
+        if (!xtables_strtoui(optarg, NULL, &value, 0, UINT32_MAX))
+            xtables_error(PARAMETER_PROBLEM,
+                "TS3INIT_SET_COOKIE: invalid port table id");
+        info->specific_options |= TARGET_SET_COOKIE_PORT_TABLE;
+        info->port_table_id = value;
+        *flags |= TARGET_SET_COOKIE_PORT_TABLE;
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+static void ts3init_set_cookie_tg_save_v1(const void *ip, const struct xt_entry_target *target)
+{
+    const struct xt_ts3init_set_cookie_tginfo_v1 *info = (const void *)target->data;
+    if (info->specific_options & TARGET_SET_COOKIE_ZERO_RANDOM_SEQUENCE)
+    {
+        printf(" --zero-random-sequence");
+    }
+    if (info->specific_options & TARGET_SET_COOKIE_PORT_TABLE)
+    {
+        printf(" --port-table %u", info->port_table_id);
+    }
+    else
+    {
+        printf(" --seed-id %u", info->seed_id);
+    }
+    if (info->common_options & TARGET_COMMON_IN_PLACE)
+    {
+        printf(" --in-place");
+    }
+    if (info->common_options & TARGET_COMMON_DIRECT_XMIT)
+    {
+        printf(" --direct-xmit");
+    }
+    if (info->common_options & TARGET_COMMON_SHADOW)
+    {
+        printf(" --shadow");
+    }
+    if (info->specific_options & TARGET_SET_COOKIE_ADAPTIVE)
+    {
+        printf(" --adaptive");
+    }
+}
+
+static void ts3init_set_cookie_tg_print_v1(const void *ip, const struct xt_entry_target *target,
+                                           int numeric)
+{
+    printf(" -j TS3INIT_SET_COOKIE");
+    ts3init_set_cookie_tg_save_v1(ip, target);
+}
+
+static void ts3init_set_cookie_tg_check_v1(unsigned int flags)
+{
+    bool seed_id = flags & SET_COOKIE_V1_SEED_ID;
+    bool port_table = flags & TARGET_SET_COOKIE_PORT_TABLE;
+    if (seed_id == port_table)
+    {
+        xtables_error(PARAMETER_PROBLEM,
+            "TS3INIT_SET_COOKIE: either --seed-id or --port-table "
+            "must be specified");
+    }
+}
+
 /* register and init */
-static struct xtables_target ts3init_set_cookie_tg_reg =
+static struct xtables_target ts3init_set_cookie_tg_reg[] =
 {
-    .name          = "TS3INIT_SET_COOKIE",
-    .revision      = 0,
-    .family        = NFPROTO_UNSPEC,
-    .version       = XTABLES_VERSION,
-    .size          = XT_ALIGN(sizeof(struct xt_ts3init_set_cookie_tginfo)),
-    .userspacesize = XT_ALIGN(sizeof(struct xt_ts3init_set_cookie_tginfo)),
-    .help          = ts3init_set_cookie_tg_help,
-    .parse         = ts3init_set_cookie_tg_parse,
-    .print         = ts3init_set_cookie_tg_print,
-    .save          = ts3init_set_cookie_tg_save,
-    .final_check   = ts3init_set_cookie_tg_check,
-    .extra_opts    = ts3init_set_cookie_tg_opts,
+    {
+        .name          = "TS3INIT_SET_COOKIE",
+        .revision      = 0,
+        .family        = NFPROTO_UNSPEC,
+        .version       = XTABLES_VERSION,
+        .size          = XT_ALIGN(sizeof(struct xt_ts3init_set_cookie_tginfo)),
+        .userspacesize = XT_ALIGN(sizeof(struct xt_ts3init_set_cookie_tginfo)),
+        .help          = ts3init_set_cookie_tg_help,
+        .parse         = ts3init_set_cookie_tg_parse,
+        .print         = ts3init_set_cookie_tg_print,
+        .save          = ts3init_set_cookie_tg_save,
+        .final_check   = ts3init_set_cookie_tg_check,
+        .extra_opts    = ts3init_set_cookie_tg_opts,
+    },
+    {
+        .name          = "TS3INIT_SET_COOKIE",
+        .revision      = 1,
+        .family        = NFPROTO_UNSPEC,
+        .version       = XTABLES_VERSION,
+        .size          = XT_ALIGN(sizeof(struct xt_ts3init_set_cookie_tginfo_v1)),
+        .userspacesize = offsetof(struct xt_ts3init_set_cookie_tginfo_v1, seed),
+        .help          = ts3init_set_cookie_tg_help_v1,
+        .parse         = ts3init_set_cookie_tg_parse_v1,
+        .print         = ts3init_set_cookie_tg_print_v1,
+        .save          = ts3init_set_cookie_tg_save_v1,
+        .final_check   = ts3init_set_cookie_tg_check_v1,
+        .extra_opts    = ts3init_set_cookie_tg_opts_v1,
+    }
 };
 
 static __attribute__((constructor)) void ts3init_set_cookie_tg_ldr(void)
 {
-    xtables_register_target(&ts3init_set_cookie_tg_reg);
+    xtables_register_targets(ts3init_set_cookie_tg_reg, ARRAY_SIZE(ts3init_set_cookie_tg_reg));
 }
@@ -0,0 +1,115 @@
+/*
+ *    "libxt_ts3init_set_puzzle" target extension for iptables
+ *    Niels Werensteijn <niels werensteijn [at] teamspeak com>, 2016-10-03
+ *
+ *    This program is free software; you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License; either version 2
+ *    or 3 of the License, as published by the Free Software Foundation.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <xtables.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include "ts3init_random_seed.h"
+#include "ts3init_target.h"
+
+#define param_act(t, s, f) xtables_param_act((t), "TS3INIT_SET_PUZZLE", (s), (f))
+
+static void ts3init_set_puzzle_tg_help(void)
+{
+    printf(
+        "TS3INIT_SET_PUZZLE target options:\n"
+        "  --in-place                   Turn the get_puzzle packet into the reply.\n"
+        "  --direct-xmit                Send the reply on the ingress device,\n"
+        "                               bypassing OUTPUT and POSTROUTING.\n"
+        "  --shadow                     Only build the reply and count it, send\n"
+        "                               nothing and let the packet continue.\n");
+}
+
+static const struct option ts3init_set_puzzle_tg_opts[] = {
+    {.name = "in-place",             .has_arg = false, .val = '1'},
+    {.name = "direct-xmit",          .has_arg = false, .val = '2'},
+    {.name = "shadow",               .has_arg = false, .val = '3'},
+    {NULL},
+};
+
+static int ts3init_set_puzzle_tg_parse(int c, char **argv,
+                                       int invert, unsigned int *flags, const void *entry,
+                                       struct xt_entry_target **target)
+{
+    struct xt_ts3init_set_puzzle_tginfo *info = (void *)(*target)->data;
+    switch (c) {
+    case '1':
+        param_act(XTF_ONLY_ONCE, "--in-place", info->common_options & TARGET_COMMON_IN_PLACE);
+        param_act(XTF_NO_INVERT, "--in-place", invert);
+        info->common_options |= TARGET_COMMON_IN_PLACE;
+        return true;
+
+    case '2':
+        param_act(XTF_ONLY_ONCE, "--direct-xmit", info->common_options & TARGET_COMMON_DIRECT_XMIT);
+        param_act(XTF_NO_INVERT, "--direct-xmit", invert);
+        info->common_options |= TARGET_COMMON_DIRECT_XMIT;
+        return true;
+
+    case '3':
+        param_act(XTF_ONLY_ONCE, "--shadow", info->common_options & TARGET_COMMON_SHADOW);
+        param_act(XTF_NO_INVERT, "--shadow", invert);
+        info->common_options |= TARGET_COMMON_SHADOW;
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+static void ts3init_set_puzzle_tg_save(const void *ip, const struct xt_entry_target *target)
+{
+    const struct xt_ts3init_set_puzzle_tginfo *info = (const void *)target->data;
+    if (info->common_options & TARGET_COMMON_IN_PLACE)
+    {
+        printf(" --in-place");
+    }
+    if (info->common_options & TARGET_COMMON_DIRECT_XMIT)
+    {
+        printf(" --direct-xmit");
+    }
+    if (info->common_options & TARGET_COMMON_SHADOW)
+    {
+        printf(" --shadow");
+    }
+}
+
+static void ts3init_set_puzzle_tg_print(const void *ip, const struct xt_entry_target *target,
+                                     int numeric)
+{
+    printf(" -j TS3INIT_SET_PUZZLE");
+    ts3init_set_puzzle_tg_save(ip, target);
+}
+
+/* register and init */
+static struct xtables_target ts3init_set_puzzle_tg_reg =
+{
+    .name          = "TS3INIT_SET_PUZZLE",
+    .revision      = 0,
+    .family        = NFPROTO_UNSPEC,
+    .version       = XTABLES_VERSION,
+    .size          = XT_ALIGN(sizeof(struct xt_ts3init_set_puzzle_tginfo)),
+    .userspacesize = XT_ALIGN(sizeof(struct xt_ts3init_set_puzzle_tginfo)),
+    .help          = ts3init_set_puzzle_tg_help,
+    .parse         = ts3init_set_puzzle_tg_parse,
+    .print         = ts3init_set_puzzle_tg_print,
+    .save          = ts3init_set_puzzle_tg_save,
+    .extra_opts    = ts3init_set_puzzle_tg_opts
+};
+
+static __attribute__((constructor)) void ts3init_set_puzzle_tg_ldr(void)
+{
+    xtables_register_target(&ts3init_set_puzzle_tg_reg);
+}
@@ -30,6 +30,8 @@ static void ts3init_help(void)
         "  --client                     Match ts3init client packets.\n"
         "  --server                     Match ts3init server packets.\n"
         "  --command <command>          Match packets with the specified command.\n"
+        "  --shadow                     Only count the result of the checks,\n"
+        "                               and always match.\n"
     );
 }
 
@@ -37,6 +39,7 @@ static const struct option ts3init_opts[] = {
     {.name = "client",            .has_arg = false, .val = '1'},
     {.name = "server",            .has_arg = false, .val = '2'},
     {.name = "command",           .has_arg = true,  .val = '3'},
+    {.name = "shadow",            .has_arg = false, .val = '4'},
     {NULL},
 };
 
@@ -73,6 +76,12 @@ static int ts3init_parse(int c, char **argv, int invert, unsigned int *flags,
         *flags |= CHK_TS3INIT_COMMAND;
         return true;
 
+    case '4':
+        param_act(XTF_ONLY_ONCE, "--shadow", info->common_options & CHK_COMMON_SHADOW);
+        param_act(XTF_NO_INVERT, "--shadow", invert);
+        info->common_options |= CHK_COMMON_SHADOW;
+        return true;
+
     default:
         return false;
     }
@@ -93,6 +102,10 @@ static void ts3init_save(const void *ip, const struct xt_entry_match *match)
     {
         printf(" --command %i", (int)info->command);
     }
+    if (info->common_options & CHK_COMMON_SHADOW)
+    {
+        printf(" --shadow");
+    }
 }
 
 static void ts3init_print(const void *ip, const struct xt_entry_match *match,
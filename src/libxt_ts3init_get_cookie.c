@@ -30,12 +30,18 @@ static void ts3init_get_cookie_help(void)
         "  --min-client n                The client needs to be at least version n.\n"
         "  --check-time sec              Check packet send time request.\n"
         "                                May be off by sec seconds.\n"
+        "  --shadow                      Only count the result of the checks,\n"
+        "                                and always match.\n"
+        "  --adaptive                    Count towards the handshake rate, and\n"
+        "                                use the attack profile under attack.\n"
     );
 }
 
 static const struct option ts3init_get_cookie_opts[] = {
     {.name = "min-client",   .has_arg = true,  .val = '1'},
     {.name = "check-time",   .has_arg = true,  .val = '2'},
+    {.name = "shadow",       .has_arg = false, .val = '4'},
+    {.name = "adaptive",     .has_arg = false, .val = '5'},
     {NULL},
 };
 
@@ -69,6 +75,18 @@ static int ts3init_get_cookie_parse(int c, char **argv, int invert, unsigned int
         info->max_utc_offset = time_offset;
         return true;
 
+    case '4':
+        param_act(XTF_ONLY_ONCE, "--shadow", info->common_options & CHK_COMMON_SHADOW);
+        param_act(XTF_NO_INVERT, "--shadow", invert);
+        info->common_options |= CHK_COMMON_SHADOW;
+        return true;
+
+    case '5':
+        param_act(XTF_ONLY_ONCE, "--adaptive", info->specific_options & CHK_GET_COOKIE_ADAPTIVE);
+        param_act(XTF_NO_INVERT, "--adaptive", invert);
+        info->specific_options |= CHK_GET_COOKIE_ADAPTIVE;
+        return true;
+
     default:
         return false;
     }
@@ -85,6 +103,14 @@ static void ts3init_get_cookie_save(const void *ip, const struct xt_entry_match
     {
         printf(" --check-time %u", info->max_utc_offset);
     }
+    if (info->common_options & CHK_COMMON_SHADOW)
+    {
+        printf(" --shadow");
+    }
+    if (info->specific_options & CHK_GET_COOKIE_ADAPTIVE)
+    {
+        printf(" --adaptive");
+    }
 }
 
 static void ts3init_get_cookie_print(const void *ip, const struct xt_entry_match *match,
@@ -94,6 +120,77 @@ static void ts3init_get_cookie_print(const void *ip, const struct xt_entry_match
     ts3init_get_cookie_save(ip, match);
 }
 
+static void ts3init_get_cookie_help_v1(void)
+{
+    printf(
+        "ts3init_get_cookie match options:\n"
+        "  --min-client n                The client needs to be at least version n.\n"
+        "  --check-time sec              Check packet send time request.\n"
+        "                                May be off by sec seconds.\n"
+        "  --port-table n                Only match ports in the port table with id n,\n"
+        "                                and apply the checks of their entries.\n"
+        "  --shadow                      Only count the result of the checks,\n"
+        "                                and always match.\n"
+        "  --adaptive                    Count towards the handshake rate, and\n"
+        "                                use the attack profile under attack.\n"
+    );
+}
+
+static const struct option ts3init_get_cookie_opts_v1[] = {
+    {.name = "min-client",   .has_arg = true,  .val = '1'},
+    {.name = "check-time",   .has_arg = true,  .val = '2'},
+    {.name = "port-table",   .has_arg = true,  .val = '3'},
+    {.name = "shadow",       .has_arg = false, .val = '4'},
+    {.name = "adaptive",     .has_arg = false, .val = '5'},
+    {NULL},
+};
+
+static int ts3init_get_cookie_parse_v1(int c, char **argv, int invert, unsigned int *flags,
+                           const void *entry, struct xt_entry_match **match)
+{
+    struct xt_ts3init_get_cookie_mtinfo_v1 *info = (void *)(*match)->data;
+    unsigned int value;
+
+    switch (c) {
+    case '1':
+    case '2':
+    case '4':
+    case '5':
+        /* revision 0 and 1 share the layout of these options */
+        return ts3init_get_cookie_parse(c, argv, invert, flags, entry, match);
+
+    case '3':
+        param_act(XTF_ONLY_ONCE, "--port-table", info->specific_options & CHK_GET_COOKIE_PORT_TABLE);
+        param_act(XTF_NO_INVERT, "--port-table", invert);
+        if (!xtables_strtoui(optarg, NULL, &value, 0, UINT32_MAX))
+            xtables_error(PARAMETER_PROBLEM,
+                "ts3init_get_cookie: invalid port table id");
+        info->specific_options |= CHK_GET_COOKIE_PORT_TABLE;
+        info->port_table_id = value;
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+static void ts3init_get_cookie_save_v1(const void *ip, const struct xt_entry_match *match)
+{
+    const struct xt_ts3init_get_cookie_mtinfo_v1 *info = (const void *)match->data;
+    ts3init_get_cookie_save(ip, match);
+    if (info->specific_options & CHK_GET_COOKIE_PORT_TABLE)
+    {
+        printf(" --port-table %u", info->port_table_id);
+    }
+}
+
+static void ts3init_get_cookie_print_v1(const void *ip, const struct xt_entry_match *match,
+                            int numeric)
+{
+    printf(" -m ts3init_get_cookie");
+    ts3init_get_cookie_save_v1(ip, match);
+}
+
 /* register and init */
 static struct xtables_match ts3init_mt_reg[] =
 {
@@ -123,6 +220,32 @@ static struct xtables_match ts3init_mt_reg[] =
         .save          = ts3init_get_cookie_save,
         .extra_opts    = ts3init_get_cookie_opts,
     },
+    {
+        .name          = "ts3init_get_cookie",
+        .revision      = 1,
+        .family        = NFPROTO_IPV4,
+        .version       = XTABLES_VERSION,
+        .size          = XT_ALIGN(sizeof(struct xt_ts3init_get_cookie_mtinfo_v1)),
+        .userspacesize = offsetof(struct xt_ts3init_get_cookie_mtinfo_v1, port_table),
+        .help          = ts3init_get_cookie_help_v1,
+        .parse         = ts3init_get_cookie_parse_v1,
+        .print         = ts3init_get_cookie_print_v1,
+        .save          = ts3init_get_cookie_save_v1,
+        .extra_opts    = ts3init_get_cookie_opts_v1,
+    },
+    {
+        .name          = "ts3init_get_cookie",
+        .revision      = 1,
+        .family        = NFPROTO_IPV6,
+        .version       = XTABLES_VERSION,
+        .size          = XT_ALIGN(sizeof(struct xt_ts3init_get_cookie_mtinfo_v1)),
+        .userspacesize = offsetof(struct xt_ts3init_get_cookie_mtinfo_v1, port_table),
+        .help          = ts3init_get_cookie_help_v1,
+        .parse         = ts3init_get_cookie_parse_v1,
+        .print         = ts3init_get_cookie_print_v1,
+        .save          = ts3init_get_cookie_save_v1,
+        .extra_opts    = ts3init_get_cookie_opts_v1,
+    },
 };
 
 static __attribute__((constructor)) void ts3init_mt_ldr(void)
@@ -31,7 +31,9 @@ static void ts3init_get_puzzle_help(void)
         "  --check-cookie               Check that the cookie was generated by same seed.\n"
         "  --random-seed <seed>         Seed is a %i byte hex number.\n"
         "                               A source could be /dev/random.\n"
-        "  --random-seed-file <file>    Read the seed from a file.\n",
+        "  --random-seed-file <file>    Read the seed from a file.\n"
+        "  --shadow                     Only count the result of the checks,\n"
+        "                               and always match.\n",
         RANDOM_SEED_LEN
 );
 }
@@ -41,6 +43,7 @@ static const struct option ts3init_get_puzzle_opts[] = {
     {.name = "check-cookie",      .has_arg = false, .val = '2'},
     {.name = "random-seed",       .has_arg = true,  .val = '3'},
     {.name = "random-seed-file",  .has_arg = true,  .val = '4'},
+    {.name = "shadow",            .has_arg = false, .val = '5'},
     {NULL},
 };
 
@@ -92,6 +95,12 @@ static int ts3init_get_puzzle_parse(int c, char **argv, int invert, unsigned int
         *flags |= CHK_GET_PUZZLE_RANDOM_SEED_FROM_FILE;
         return true;
 
+    case '5':
+        param_act(XTF_ONLY_ONCE, "--shadow", info->common_options & CHK_COMMON_SHADOW);
+        param_act(XTF_NO_INVERT, "--shadow", invert);
+        info->common_options |= CHK_COMMON_SHADOW;
+        return true;
+
     default:
         return false;
     }
@@ -121,6 +130,10 @@ static void ts3init_get_puzzle_save(const void *ip, const struct xt_entry_match
     {
         printf(" --random-seed-file \"%s\"", info->random_seed_path);
     }
+    if (info->common_options & CHK_COMMON_SHADOW)
+    {
+        printf(" --shadow");
+    }
 }
 
 static void ts3init_get_puzzle_print(const void *ip, const struct xt_entry_match *match,
@@ -151,6 +164,191 @@ static void ts3init_get_puzzle_check(unsigned int flags)
     }
 }
 
+enum
+{
+    /* userspace only flag for revision 1 */
+    GET_PUZZLE_V1_SEED_ID = 1 << 7
+};
+
+static void ts3init_get_puzzle_help_v1(void)
+{
+    printf(
+        "ts3init_get_puzzle match options:\n"
+        "  --min-client n               The client needs to be at least version n.\n"
+        "  --check-cookie               Check that the cookie was generated by same seed.\n"
+        "  --seed-id n                  Use the runtime seed with id n.\n"
+        "  --port-table n               Only match ports in the port table with id n,\n"
+        "                               and use the seeds of their entries.\n"
+        "  --max-skew n                 Also accept cookies made by a machine whose clock\n"
+        "                               is up to n seconds (at most 4) off.\n"
+        "  --reject-replay              Accept each cookie only once. Retransmits\n"
+        "                               after a lost reply are rejected as replays.\n"
+        "  --shadow                     Only count the result of the checks,\n"
+        "                               and always match.\n");
+}
+
+static const struct option ts3init_get_puzzle_opts_v1[] = {
+    {.name = "min-client",        .has_arg = true,  .val = '1'},
+    {.name = "check-cookie",      .has_arg = false, .val = '2'},
+    {.name = "seed-id",           .has_arg = true,  .val = '3'},
+    {.name = "port-table",        .has_arg = true,  .val = '4'},
+    {.name = "max-skew",          .has_arg = true,  .val = '5'},
+    {.name = "shadow",            .has_arg = false, .val = '6'},
+    {.name = "reject-replay",     .has_arg = false, .val = '7'},
+    {NULL},
+};
+
+static int ts3init_get_puzzle_parse_v1(int c, char **argv, int invert, unsigned int *flags,
+                           const void *entry, struct xt_entry_match **match)
+{
+    struct xt_ts3init_get_puzzle_mtinfo_v1 *info = (void *)(*match)->data;
+    unsigned int value;
+
+    switch (c) {
+    case '1':
+        param_act(XTF_ONLY_ONCE, "--min-client", info->common_options & CHK_COMMON_CLIENT_VERSION);
+        param_act(XTF_NO_INVERT, "--min-client", invert);
+        if (!xtables_strtoui(optarg, NULL, &value, 1, UINT32_MAX))
+            xtables_error(PARAMETER_PROBLEM,
+                "ts3init_get_puzzle: invalid min-client version");
+        info->common_options |= CHK_COMMON_CLIENT_VERSION;
+        info->min_client_version = value - CLIENT_VERSION_OFFSET;
+        return true;
+
+    case '2':
+        param_act(XTF_ONLY_ONCE, "--check-cookie", info->specific_options & CHK_GET_PUZZLE_CHECK_COOKIE);
+        param_act(XTF_NO_INVERT, "--check-cookie", invert);
+        info->specific_options |= CHK_GET_PUZZLE_CHECK_COOKIE;
+        *flags |= CHK_GET_PUZZLE_CHECK_COOKIE;
+        return true;
+
+    case '3':
+        param_act(XTF_ONLY_ONCE, "--seed-id", *flags & GET_PUZZLE_V1_SEED_ID);
+        param_act(XTF_NO_INVERT, "--seed-id", invert);
+        if (!xtables_strtoui(optarg, NULL, &value, 0, UINT32_MAX))
+            xtables_error(PARAMETER_PROBLEM,
+                "ts3init_get_puzzle: invalid seed id");
+        info->seed_id = value;
+        *flags |= GET_PUZZLE_V1_SEED_ID;
+        return true;
+
+    case '4':
+        param_act(XTF_ONLY_ONCE, "--port-table", info->specific_options & CHK_GET_PUZZLE_PORT_TABLE);
+        param_act(XTF_NO_INVERT, "--port-table", invert);
+        if (!xtables_strtoui(optarg, NULL, &value, 0, UINT32_MAX))
+            xtables_error(PARAMETER_PROBLEM,
+                "ts3init_get_puzzle: invalid port table id");
+        info->specific_options |= CHK_GET_PUZZLE_PORT_TABLE;
+        info->port_table_id = value;
+        *flags |= CHK_GET_PUZZLE_PORT_TABLE;
+        return true;
+
+    case '5':
+        param_act(XTF_ONLY_ONCE, "--max-skew", info->specific_options & CHK_GET_PUZZLE_MAX_SKEW);
+        param_act(XTF_NO_INVERT, "--max-skew", invert);
+        if (!xtables_strtoui(optarg, NULL, &value, 1, GET_PUZZLE_MAX_SKEW_LIMIT))
+            xtables_error(PARAMETER_PROBLEM,
+                "ts3init_get_puzzle: invalid max-skew, must be 1 to %d seconds",
+                GET_PUZZLE_MAX_SKEW_LIMIT);
+        info->specific_options |= CHK_GET_PUZZLE_MAX_SKEW;
+        info->max_skew = value;
+        *flags |= CHK_GET_PUZZLE_MAX_SKEW;
+        return true;
+
+    case '6':
+        param_act(XTF_ONLY_ONCE, "--shadow", info->common_options & CHK_COMMON_SHADOW);
+        param_act(XTF_NO_INVERT, "--shadow", invert);
+        info->common_options |= CHK_COMMON_SHADOW;
+        return true;
+
+    case '7':
+        param_act(XTF_ONLY_ONCE, "--reject-replay", info->specific_options & CHK_GET_PUZZLE_REJECT_REPLAY);
+        param_act(XTF_NO_INVERT, "--reject-replay", invert);
+        info->specific_options |= CHK_GET_PUZZLE_REJECT_REPLAY;
+        *flags |= CHK_GET_PUZZLE_REJECT_REPLAY;
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+static void ts3init_get_puzzle_save_v1(const void *ip, const struct xt_entry_match *match)
+{
+    const struct xt_ts3init_get_puzzle_mtinfo_v1 *info = (const void *)match->data;
+    if (info->common_options & CHK_COMMON_CLIENT_VERSION)
+    {
+        printf(" --min-client %u", info->min_client_version + CLIENT_VERSION_OFFSET);
+    }
+    if (info->specific_options & CHK_GET_PUZZLE_CHECK_COOKIE)
+    {
+        printf(" --check-cookie");
+    }
+    if (info->specific_options & CHK_GET_PUZZLE_PORT_TABLE)
+    {
+        printf(" --port-table %u", info->port_table_id);
+    }
+    else if (info->specific_options & CHK_GET_PUZZLE_CHECK_COOKIE)
+    {
+        printf(" --seed-id %u", info->seed_id);
+    }
+    if (info->specific_options & CHK_GET_PUZZLE_MAX_SKEW)
+    {
+        printf(" --max-skew %u", info->max_skew);
+    }
+    if (info->specific_options & CHK_GET_PUZZLE_REJECT_REPLAY)
+    {
+        printf(" --reject-replay");
+    }
+    if (info->common_options & CHK_COMMON_SHADOW)
+    {
+        printf(" --shadow");
+    }
+}
+
+static void ts3init_get_puzzle_print_v1(const void *ip, const struct xt_entry_match *match,
+                            int numeric)
+{
+    printf(" -m ts3init_get_puzzle");
+    ts3init_get_puzzle_save_v1(ip, match);
+}
+
+static void ts3init_get_puzzle_check_v1(unsigned int flags)
+{
+    bool check_cookie = flags & CHK_GET_PUZZLE_CHECK_COOKIE;
+    bool seed_id = flags & GET_PUZZLE_V1_SEED_ID;
+    bool port_table = flags & CHK_GET_PUZZLE_PORT_TABLE;
+    bool max_skew = flags & CHK_GET_PUZZLE_MAX_SKEW;
+    bool reject_replay = flags & CHK_GET_PUZZLE_REJECT_REPLAY;
+    if (seed_id && port_table)
+    {
+        xtables_error(PARAMETER_PROBLEM,
+            "ts3init_get_puzzle: --seed-id and --port-table "
+            "can not be specified at the same time");
+    }
+    if (seed_id && !check_cookie)
+    {
+        xtables_error(PARAMETER_PROBLEM,
+            "ts3init_get_puzzle: --seed-id requires --check-cookie");
+    }
+    if (check_cookie && !seed_id && !port_table)
+    {
+        xtables_error(PARAMETER_PROBLEM,
+            "ts3init_get_puzzle: --check-cookie requires either "
+            "--seed-id or --port-table");
+    }
+    if (max_skew && !check_cookie)
+    {
+        xtables_error(PARAMETER_PROBLEM,
+            "ts3init_get_puzzle: --max-skew requires --check-cookie");
+    }
+    if (reject_replay && !check_cookie)
+    {
+        xtables_error(PARAMETER_PROBLEM,
+            "ts3init_get_puzzle: --reject-replay requires --check-cookie");
+    }
+}
+
 /* register and init */
 static struct xtables_match ts3init_mt_reg[] =
 {
@@ -181,6 +379,34 @@ static struct xtables_match ts3init_mt_reg[] =
         .save          = ts3init_get_puzzle_save,
         .extra_opts    = ts3init_get_puzzle_opts,
         .final_check   = ts3init_get_puzzle_check,
+    },
+    {
+        .name          = "ts3init_get_puzzle",
+        .revision      = 1,
+        .family        = NFPROTO_IPV4,
+        .version       = XTABLES_VERSION,
+        .size          = XT_ALIGN(sizeof(struct xt_ts3init_get_puzzle_mtinfo_v1)),
+        .userspacesize = offsetof(struct xt_ts3init_get_puzzle_mtinfo_v1, seed),
+        .help          = ts3init_get_puzzle_help_v1,
+        .parse         = ts3init_get_puzzle_parse_v1,
+        .print         = ts3init_get_puzzle_print_v1,
+        .save          = ts3init_get_puzzle_save_v1,
+        .extra_opts    = ts3init_get_puzzle_opts_v1,
+        .final_check   = ts3init_get_puzzle_check_v1,
+    },
+    {
+        .name          = "ts3init_get_puzzle",
+        .revision      = 1,
+        .family        = NFPROTO_IPV6,
+        .version       = XTABLES_VERSION,
+        .size          = XT_ALIGN(sizeof(struct xt_ts3init_get_puzzle_mtinfo_v1)),
+        .userspacesize = offsetof(struct xt_ts3init_get_puzzle_mtinfo_v1, seed),
+        .help          = ts3init_get_puzzle_help_v1,
+        .parse         = ts3init_get_puzzle_parse_v1,
+        .print         = ts3init_get_puzzle_print_v1,
+        .save          = ts3init_get_puzzle_save_v1,
+        .extra_opts    = ts3init_get_puzzle_opts_v1,
+        .final_check   = ts3init_get_puzzle_check_v1,
     }
 };
 
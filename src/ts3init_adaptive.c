@@ -0,0 +1,135 @@
+/*
+ *    "ts3init" extension for Xtables
+ *
+ *    Description: A module to aid in ts3 spoof protection
+ *                 This is the "adaptive attack profile" related code
+ *
+ *    Authors:
+ *    Niels Werensteijn <niels werensteijn [at] teamspeak com>, 2016-10-03
+ *
+ *    This program is free software; you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License; either version 2
+ *    or 3 of the License, as published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/version.h>
+#include <linux/module.h>
+#include <linux/percpu.h>
+#include <linux/jiffies.h>
+#include <linux/hashtable.h>
+#include <net/net_namespace.h>
+#include <net/netns/generic.h>
+#include "ts3init_netlink.h"
+#include "ts3init_net.h"
+#include "ts3init_stats.h"
+#include "ts3init_adaptive.h"
+
+static unsigned int attack_enter_rate = 20000;
+module_param(attack_enter_rate, uint, 0644);
+MODULE_PARM_DESC(attack_enter_rate, "Handshake packets per second on one cpu that switch --adaptive rules to their attack profile, 0 never does (default 20000)");
+
+static unsigned int attack_leave_rate = 5000;
+module_param(attack_leave_rate, uint, 0644);
+MODULE_PARM_DESC(attack_leave_rate, "Handshake packets per second that all cpus must stay below to leave the attack profile (default 5000)");
+
+static unsigned int attack_hold_ms = 10000;
+module_param(attack_hold_ms, uint, 0644);
+MODULE_PARM_DESC(attack_hold_ms, "Milliseconds all cpus must stay below attack_leave_rate to leave the attack profile (default 10000)");
+
+unsigned int ts3init_attack_min_client;
+module_param_named(attack_min_client, ts3init_attack_min_client, uint, 0644);
+MODULE_PARM_DESC(attack_min_client, "Minimum client version of --adaptive get_cookie matches under attack, 0 keeps the one of the rule (default 0)");
+
+unsigned int ts3init_attack_max_utc_offset = 30;
+module_param_named(attack_max_utc_offset, ts3init_attack_max_utc_offset, uint, 0644);
+MODULE_PARM_DESC(attack_max_utc_offset, "Time tolerance in seconds of --adaptive get_cookie matches under attack, 0 keeps the one of the rule (default 30)");
+
+enum
+{
+    /* after this many empty windows the average is as good as 0 */
+    TS3INIT_ADAPTIVE_MAX_DECAY = 16,
+    /* bounds the rate to what fits the fixed point average */
+    TS3INIT_ADAPTIVE_MAX_COUNT = 1 << 22
+};
+
+/*
+ * Adds sample, in packets per second << TS3INIT_ADAPTIVE_RATE_SHIFT, to
+ * the average rate with a weight of 1/4.
+ */
+static inline unsigned int ts3init_adaptive_ewma(unsigned int rate, unsigned int sample)
+{
+    return rate - (rate >> 2) + (sample >> 2);
+}
+
+/*
+ * Ends the window of adaptive, the state of the current cpu, and updates
+ * the attack state of net with the new average. Called on the first
+ * packet after the window ended, so cpus without packets keep their old
+ * average until they see one; the attack ends without them.
+ */
+void ts3init_adaptive_update(const struct net *net, struct ts3init_adaptive *adaptive)
+{
+    struct ts3init_net *tn = ts3init_pernet(net);
+    unsigned long now = jiffies;
+    unsigned long windows = (now - adaptive->window_start) / TS3INIT_ADAPTIVE_WINDOW;
+    unsigned int count = min_t(unsigned int, adaptive->count, TS3INIT_ADAPTIVE_MAX_COUNT);
+    unsigned int rate, hold, enter_rate;
+
+    rate = ts3init_adaptive_ewma(adaptive->rate,
+        (count * TS3INIT_ADAPTIVE_WINDOWS_PER_SEC) << TS3INIT_ADAPTIVE_RATE_SHIFT);
+    if (windows > TS3INIT_ADAPTIVE_MAX_DECAY)
+        rate = 0;
+    else
+        for (; windows > 1; windows--)
+            rate = ts3init_adaptive_ewma(rate, 0);
+
+    adaptive->window_start = now;
+    adaptive->count = 0;
+    adaptive->rate = rate;
+    rate >>= TS3INIT_ADAPTIVE_RATE_SHIFT;
+
+    /* the attack ended, no cpu reached attack_leave_rate for attack_hold_ms */
+    if (READ_ONCE(tn->attacked) && !time_before(now, READ_ONCE(tn->attack_until)) &&
+        cmpxchg(&tn->attacked, 1, 0) == 1)
+    {
+        ts3init_stat_inc(net, TS3INIT_STAT_ATTACK_LEFT);
+        printk(KERN_INFO KBUILD_MODNAME ": attack ended, leaving the attack profile\n");
+    }
+
+    hold = max_t(unsigned int, msecs_to_jiffies(READ_ONCE(attack_hold_ms)),
+                 2 * TS3INIT_ADAPTIVE_WINDOW);
+    if (READ_ONCE(tn->attacked))
+    {
+        if (rate >= READ_ONCE(attack_leave_rate))
+            WRITE_ONCE(tn->attack_until, now + hold);
+        return;
+    }
+
+    enter_rate = READ_ONCE(attack_enter_rate);
+    if (enter_rate == 0 || rate < enter_rate)
+        return;
+
+    /* attack_until is set before attacked, see ts3init_under_attack */
+    WRITE_ONCE(tn->attack_until, now + hold);
+    smp_wmb();
+    if (cmpxchg(&tn->attacked, 0, 1) == 0)
+    {
+        ts3init_stat_inc(net, TS3INIT_STAT_ATTACK_ENTERED);
+        printk(KERN_INFO KBUILD_MODNAME ": %u handshakes per second on cpu %d, "
+               "switching to the attack profile\n", rate, smp_processor_id());
+    }
+}
+
+/*
+ * Sets up the attack state of a new network namespace.
+ */
+void ts3init_adaptive_net_init(struct ts3init_net *tn)
+{
+    int cpu;
+
+    tn->attacked = 0;
+    tn->attack_until = jiffies;
+    for_each_possible_cpu(cpu)
+        per_cpu_ptr(tn->adaptive, cpu)->window_start = jiffies;
+}
@@ -0,0 +1,57 @@
+#ifndef _TS3INIT_ADAPTIVE_H
+#define _TS3INIT_ADAPTIVE_H
+
+/*
+ * Rules with --adaptive switch to a stricter profile while their network
+ * namespace is under attack. The rate of handshake packets seen by those
+ * rules is measured per cpu, as an exponentially weighted moving average
+ * over windows of a tenth of a second. The namespace is under attack from
+ * when the average of one cpu reaches attack_enter_rate, until the
+ * averages of all cpus have stayed below attack_leave_rate for
+ * attack_hold_ms.
+ */
+enum
+{
+    TS3INIT_ADAPTIVE_WINDOWS_PER_SEC = 10,
+    TS3INIT_ADAPTIVE_WINDOW = HZ / TS3INIT_ADAPTIVE_WINDOWS_PER_SEC,
+    /* the average is kept in packets per second << TS3INIT_ADAPTIVE_RATE_SHIFT */
+    TS3INIT_ADAPTIVE_RATE_SHIFT = 4
+};
+
+struct ts3init_adaptive
+{
+    unsigned long window_start;
+    unsigned int count;
+    unsigned int rate;
+};
+
+/* The attack profile, the attack_min_client and attack_max_utc_offset module parameters */
+extern unsigned int ts3init_attack_min_client;
+extern unsigned int ts3init_attack_max_utc_offset;
+
+void ts3init_adaptive_update(const struct net *net, struct ts3init_adaptive *adaptive);
+void ts3init_adaptive_net_init(struct ts3init_net *tn);
+
+/*
+ * Counts a handshake packet seen by an --adaptive rule. Must be called
+ * with bottom halves disabled, as the packet path is.
+ */
+static inline void ts3init_adaptive_count(const struct net *net)
+{
+    struct ts3init_adaptive *adaptive = this_cpu_ptr(ts3init_pernet(net)->adaptive);
+
+    if (unlikely(time_after_eq(jiffies, adaptive->window_start + TS3INIT_ADAPTIVE_WINDOW)))
+        ts3init_adaptive_update(net, adaptive);
+    adaptive->count++;
+}
+
+/* Returns whether --adaptive rules of net use their attack profile. */
+static inline bool ts3init_under_attack(const struct net *net)
+{
+    const struct ts3init_net *tn = ts3init_pernet(net);
+
+    return unlikely(READ_ONCE(tn->attacked)) &&
+           time_before(jiffies, READ_ONCE(tn->attack_until));
+}
+
+#endif /* _TS3INIT_ADAPTIVE_H */
@@ -12,109 +12,164 @@
  *    or 3 of the License, as published by the Free Software Foundation.
  */
 #include <linux/kernel.h>
+#include <linux/version.h>
+#include <linux/init.h>
 #include <linux/skbuff.h>
 #include <linux/netfilter/x_tables.h>
 #include <linux/ip.h>
 #include <linux/ipv6.h>
 #include <linux/udp.h>
 #include <linux/time.h>
+#include <linux/timekeeping.h>
+#include <linux/timer.h>
 #include <linux/jiffies.h>
 #include <linux/percpu.h>
+#include <linux/rcupdate.h>
+#include <linux/hashtable.h>
+#include <net/net_namespace.h>
+#include <net/netns/generic.h>
+#include "ts3init_random_seed.h"
 #include "ts3init_cookie.h"
+#include "ts3init_seed.h"
+#include "ts3init_net.h"
 #include "ts3init_cache.h"
 
-struct ts3init_cache_t
-{
-    unsigned long                  saved_jiffies;
-    time_t                         unix_time;
-    struct xt_ts3init_cookie_cache cookie_cache;
-};        
+time_t ts3init_epoch __read_mostly;
 
-DEFINE_PER_CPU(struct ts3init_cache_t, ts3init_cache);
+static struct timer_list ts3init_epoch_timer;
 
-static inline void update_cache_time(unsigned long jifs,
-    struct ts3init_cache_t* cache)
+static inline void ts3init_coarse_real_time(struct timespec64 *ts)
 {
-    if (((long)jifs - (long)cache->saved_jiffies) >= HZ)
-    {
-        /* it's been 1 second sinds last time update.
-         * Get the new unix time and cache it*/
-       struct timeval tv;
-       cache->saved_jiffies = jifs;
-       do_gettimeofday(&tv);
-       cache->unix_time = tv.tv_sec;
-   }
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 18, 0)
+    ktime_get_coarse_real_ts64(ts);
+#else
+    *ts = current_kernel_time64();
+#endif
 }
 
-time_t ts3init_get_cached_unix_time(void)
+/*
+ * Updates the epoch and rearms the timer to fire just after
+ * the next second starts.
+ */
+static void ts3init_update_epoch(void)
 {
-    struct ts3init_cache_t* cache;
-    unsigned long jifs;
-    time_t current_unix_time;
+    struct timespec64 now;
+    unsigned long delay;
+
+    ts3init_coarse_real_time(&now);
+    WRITE_ONCE(ts3init_epoch, (time_t)now.tv_sec);
 
-    jifs = jiffies;
-            
-    cache = &get_cpu_var(ts3init_cache);
-            
-    update_cache_time(jifs, cache);
-            
-    current_unix_time = cache->unix_time;
-            
-    put_cpu_var(ts3init_cache);
-    
-    return current_unix_time;
+    delay = nsecs_to_jiffies(NSEC_PER_SEC - now.tv_nsec) + 1;
+    mod_timer(&ts3init_epoch_timer, jiffies + delay);
 }
 
-bool ts3init_get_cookie_seed_for_packet_index(u8 packet_index, const u8* random_seed, u64 (*cookie)[2])
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 15, 0)
+static void ts3init_epoch_timer_fn(struct timer_list *timer)
+#else
+static void ts3init_epoch_timer_fn(unsigned long data)
+#endif
 {
-    struct ts3init_cache_t* cache;
-    u64* result;
-    unsigned long jifs;
-    time_t current_unix_time;
-
-    jifs = jiffies;
-    cache = &get_cpu_var(ts3init_cache);
-
-    update_cache_time(jifs, cache);
+    ts3init_update_epoch();
+}
 
-    current_unix_time = cache->unix_time;
+/*
+ * Looks up the cookie seed for packet_index in cache, which belongs
+ * to the current cpu.
+ */
+static bool ts3init_cookie_seed_from_cache(struct xt_ts3init_cookie_cache *cache,
+                                           time_t current_unix_time, u8 packet_index,
+                                           const u8 *random_seed, u64 (*cookie)[2])
+{
+    u64* result;
 
     result = ts3init_get_cookie_seed(current_unix_time,
-             packet_index, &cache->cookie_cache, random_seed);
+             packet_index, cache, random_seed);
 
     if (result)
     {
         (*cookie)[0] = result[0];
         (*cookie)[1] = result[1];
     }
-    put_cpu_var(ts3init_cache);
     return result != NULL;
 }
 
-bool ts3init_get_current_cookie_seed(const u8* random_seed, u64 (*cookie)[2], u8 *packet_index)
+bool ts3init_get_cookie_seed_for_packet_index(const struct net *net, time_t current_unix_time,
+                                              u8 packet_index, const u8* random_seed,
+                                              u64 (*cookie)[2])
 {
-    struct ts3init_cache_t* cache;
-    u64* result;
-    unsigned long jifs;
+    struct xt_ts3init_cookie_cache __percpu *caches = ts3init_pernet(net)->cookie_cache;
+    bool result;
+
+    result = ts3init_cookie_seed_from_cache(get_cpu_ptr(caches), current_unix_time,
+                                            packet_index, random_seed, cookie);
+    put_cpu_ptr(caches);
+    return result;
+}
+
+bool ts3init_get_current_cookie_seed(const struct net *net, const u8* random_seed,
+                                     u64 (*cookie)[2], u8 *packet_index)
+{
+    struct xt_ts3init_cookie_cache __percpu *caches = ts3init_pernet(net)->cookie_cache;
     time_t current_unix_time;
+    bool result;
+
+    current_unix_time = ts3init_get_epoch();
+    *packet_index = current_unix_time % 8;
 
-    jifs = jiffies;
-    cache = &get_cpu_var(ts3init_cache);
+    result = ts3init_cookie_seed_from_cache(get_cpu_ptr(caches), current_unix_time,
+                                            *packet_index, random_seed, cookie);
+    put_cpu_ptr(caches);
+    return result;
+}
 
-    update_cache_time(jifs, cache);
+/*
+ * Looks up the cookie seed for packet_index in the caches of the
+ * current key of seed.
+ */
+static bool ts3init_cookie_seed_from_seed(const struct ts3init_seed *seed,
+                                          time_t current_unix_time, u8 packet_index,
+                                          u64 (*cookie)[2])
+{
+    const struct ts3init_seed_key *key;
+    bool result;
+
+    rcu_read_lock();
+    key = rcu_dereference(seed->key);
+    result = ts3init_cookie_seed_from_cache(get_cpu_ptr(key->cache), current_unix_time,
+                                            packet_index, key->random_seed, cookie);
+    put_cpu_ptr(key->cache);
+    rcu_read_unlock();
+    return result;
+}
+
+bool ts3init_seed_cookie_seed_for_packet_index(const struct ts3init_seed *seed,
+                                               time_t current_unix_time, u8 packet_index,
+                                               u64 (*cookie)[2])
+{
+    return ts3init_cookie_seed_from_seed(seed, current_unix_time, packet_index, cookie);
+}
+
+bool ts3init_seed_current_cookie_seed(const struct ts3init_seed *seed,
+                                      u64 (*cookie)[2], u8 *packet_index)
+{
+    time_t current_unix_time = ts3init_get_epoch();
 
-    current_unix_time = cache->unix_time;
-    
     *packet_index = current_unix_time % 8;
-    
-    result = ts3init_get_cookie_seed(current_unix_time,
-             *packet_index, &cache->cookie_cache, random_seed);
+    return ts3init_cookie_seed_from_seed(seed, current_unix_time, *packet_index, cookie);
+}
 
-    if (result)
-    {
-        (*cookie)[0] = result[0];
-        (*cookie)[1] = result[1];
-    }
-    put_cpu_var(ts3init_cache);
-    return result != NULL;
+int __init ts3init_cache_init(void)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 15, 0)
+    timer_setup(&ts3init_epoch_timer, ts3init_epoch_timer_fn, 0);
+#else
+    setup_timer(&ts3init_epoch_timer, ts3init_epoch_timer_fn, 0);
+#endif
+    ts3init_update_epoch();
+    return 0;
+}
+
+void ts3init_cache_exit(void)
+{
+    del_timer_sync(&ts3init_epoch_timer);
 }
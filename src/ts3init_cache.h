@@ -1,22 +1,43 @@
 #ifndef _TS3INIT_CACHE_H
 #define _TS3INIT_CACHE_H
 
+extern time_t ts3init_epoch;
+
 /*
- * Returns the current unix_time from cache, updated once every second.
+ * Returns the current unix time in seconds. This is the one clock used
+ * by all time checks, timestamps and cookie seed selection. It is
+ * updated by a timer at the start of every second.
  */
-time_t ts3init_get_cached_unix_time(void);
+static inline time_t ts3init_get_epoch(void)
+{
+    return READ_ONCE(ts3init_epoch);
+}
 
 
 /*
- * Returns the cookie seed for a packet_index. 
- * If the cookie seed is not in the cache, it will be generated using the random seed.
+ * Returns the cookie seed for a packet_index, as seen at current_unix_time.
+ * If the cookie seed is not in the cache of net, it will be generated using the random seed.
  */
-bool ts3init_get_cookie_seed_for_packet_index(u8 packet_index, const u8* random_seed, u64 (*cookie)[2]);
+bool ts3init_get_cookie_seed_for_packet_index(const struct net *net, time_t current_unix_time,
+                                              u8 packet_index, const u8* random_seed,
+                                              u64 (*cookie)[2]);
 
 /*
  * Returns the current cookie seed and packet_index.
- * If the cookie seed is not in the cache, it will be generated using the random seed.
+ * If the cookie seed is not in the cache of net, it will be generated using the random seed.
+ */
+bool ts3init_get_current_cookie_seed(const struct net *net, const u8* random_seed,
+                                     u64 (*cookie)[2], u8 *packet_index);
+
+/*
+ * Same as the functions above, for a seed configured at runtime.
+ * Uses the cookie seed caches of the seed.
  */
-bool ts3init_get_current_cookie_seed(const u8* random_seed, u64 (*cookie)[2], u8 *packet_index);
+struct ts3init_seed;
+bool ts3init_seed_cookie_seed_for_packet_index(const struct ts3init_seed *seed,
+                                               time_t current_unix_time, u8 packet_index,
+                                               u64 (*cookie)[2]);
+bool ts3init_seed_current_cookie_seed(const struct ts3init_seed *seed,
+                                      u64 (*cookie)[2], u8 *packet_index);
                 
 #endif /* _TS3INIT_CACHE_H */
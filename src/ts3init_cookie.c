@@ -25,6 +25,7 @@
 #include "siphash24.h"
 #include "ts3init_random_seed.h"
 #include "ts3init_cookie.h"
+#include "ts3init_profile.h"
 
 #ifndef HAS_CRYPTO_HASH_INFO
 #define TS3_SHA_512_NAME "sha512"
@@ -49,8 +50,10 @@ static void check_update_seed_cache(time_t time, __u8 index,
 {
     int ret;
     __le32 seed_hash_time;
+    u64 profile;
 
     if (time == cache->time[index]) return;
+    profile = ts3init_profile_start();
 
     /* We need to update the cache. */
     /* seed = sha512(random_seed[RANDOM_SEED_LEN] + __le32 time) */
@@ -58,7 +61,9 @@ static void check_update_seed_cache(time_t time, __u8 index,
     {
         SHASH_DESC_ON_STACK(shash, sha512_tfm);
         shash->tfm = sha512_tfm;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 1, 0)
         shash->flags = 0;
+#endif
 
         ret = crypto_shash_init(shash);
         if (ret != 0)
@@ -84,6 +89,16 @@ static void check_update_seed_cache(time_t time, __u8 index,
 
         cache->time[index] = time;
     }
+    ts3init_profile_end(TS3INIT_PROFILE_SEED_REFRESH, profile);
+}
+
+time_t ts3init_cookie_window(time_t current_time, __u8 packet_index)
+{
+    __u8 current_cache_index = (current_time % 8) / 4;
+    __u8 packet_cache_index = (packet_index % 8) / 4;
+    time_t current_cache_time = current_time & ~((time_t)3);
+
+    return current_cache_time - ((current_cache_index ^ packet_cache_index)*4);
 }
 
 __u64* ts3init_get_cookie_seed(time_t current_time, __u8 packet_index, 
@@ -91,27 +106,29 @@ __u64* ts3init_get_cookie_seed(time_t current_time, __u8 packet_index,
                 const __u8* random_seed)
 {
 
-    __u8 current_cache_index;
-    __u8 packet_cache_index;
-    time_t current_cache_time;
+    __u8 slot;
     time_t packet_cache_time;
 
     if (packet_index >= 8) return NULL;
 
-    current_cache_index = (current_time % 8) / 4;
-    packet_cache_index = packet_index / 4;
+    /* the cache may be shared by rules with different seeds */
+    if (memcmp(cache->random_seed, random_seed, RANDOM_SEED_LEN) != 0)
+    {
+        memcpy(cache->random_seed, random_seed, RANDOM_SEED_LEN);
+        memset(cache->time, 0, sizeof(cache->time));
+    }
 
     /* get cache time of packet */
-    current_cache_time = current_time & ~((time_t)3);
-    packet_cache_time = current_cache_time 
-        - ((current_cache_index ^ packet_cache_index)*4);
+    packet_cache_time = ts3init_cookie_window(current_time, packet_index);
 
     /* make sure the cache is up-to-date */
-    check_update_seed_cache(packet_cache_time, packet_cache_index, cache,
+    slot = (packet_cache_time / 4) % COOKIE_CACHE_SLOTS;
+    check_update_seed_cache(packet_cache_time, slot, cache,
         random_seed);
 
     /* return the proper seed */
-    return cache->seed64 + ((SIP_KEY_SIZE/sizeof(__u64)) * packet_index );
+    return cache->seed64 + (SHA512_SIZE/sizeof(__u64)) * slot
+        + (SIP_KEY_SIZE/sizeof(__u64)) * (packet_index % 4);
 }
 
 int ts3init_calculate_cookie_ipv6(const struct ipv6hdr *ip, const struct udphdr *udp, 
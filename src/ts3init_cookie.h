@@ -4,19 +4,33 @@
 enum
 {
     SHA512_SIZE = 64,
-    SIP_KEY_SIZE = 16
+    SIP_KEY_SIZE = 16,
+    /*
+     * A cookie seed is valid for 4 seconds. The cache holds 4 of them:
+     * the current and previous window, and the windows before and after
+     * those that cookies from clocks that are off may come from.
+     */
+    COOKIE_CACHE_SLOTS = 4
 };
 
 struct xt_ts3init_cookie_cache
 {
-    time_t time[2];
+    time_t time[COOKIE_CACHE_SLOTS];
+    /* the random seed the cached cookie seeds were made from */
+    __u8 random_seed[RANDOM_SEED_LEN];
     union
     {
-        __u8 seed8[SHA512_SIZE*2];
-        __u64 seed64[(SHA512_SIZE/sizeof(__u64))*2];
+        __u8 seed8[SHA512_SIZE*COOKIE_CACHE_SLOTS];
+        __u64 seed64[(SHA512_SIZE/sizeof(__u64))*COOKIE_CACHE_SLOTS];
     };
 };
 
+/*
+ * Returns the start of the 4 second window that a cookie with
+ * packet_index belongs to, as seen at current_time.
+ */
+time_t ts3init_cookie_window(time_t current_time, __u8 packet_index);
+
 /*
  * Returns the cookie seed that fits current_time and packet_index.
  * If the cookie seed is missing in cache it will be generated using 
@@ -7,6 +7,18 @@ enum
     TS3INIT_HEADER_SERVER_LENGTH = 12,
 };
 
+/*
+ * Sizes of the puzzle parts of the TS3INIT packets.
+ * The puzzle is the payload of COMMAND_SET_PUZZLE and starts with x.
+ * COMMAND_SOLVE_PUZZLE echoes the puzzle, followed by the solution.
+ */
+enum
+{
+    TS3INIT_PUZZLE_LENGTH   = 244,
+    TS3INIT_PUZZLE_X_LENGTH = 64,
+    TS3INIT_SOLUTION_LENGTH = 64,
+};
+
 /*
  * Magic number of a TS3INIT packet.
  */
@@ -23,11 +23,26 @@
 #include <linux/udp.h>
 #include <linux/time.h>
 #include <linux/percpu.h>
+#include <linux/hashtable.h>
+#include <asm/unaligned.h>
+#include <net/net_namespace.h>
+#include <net/netns/generic.h>
+#include "compat_xtables.h"
 #include "ts3init_random_seed.h"
 #include "ts3init_cookie.h"
 #include "ts3init_match.h"
 #include "ts3init_header.h"
 #include "ts3init_cache.h"
+#include "ts3init_puzzle.h"
+#include "ts3init_seed.h"
+#include "ts3init_port_table.h"
+#include "ts3init_netlink.h"
+#include "ts3init_net.h"
+#include "ts3init_stats.h"
+#include "ts3init_adaptive.h"
+#include "ts3init_replay.h"
+#include "ts3init_variant.h"
+#include "ts3init_profile.h"
 
 /* Magic number of a TS3INIT packet. */
 static const struct ts3_init_header_tag ts3init_header_tag_signature =
@@ -48,6 +63,27 @@ struct ts3_init_checked_server_header_data
 
 static const int ts3init_payload_sizes[] = { 16, 20, 20, 244, -1, 1 };
 
+/*
+ * Check that the client is at least min_client_version, if set.
+ */
+static inline bool check_client_version(const struct ts3_init_client_header* ts3_header,
+    __u32 min_client_version)
+{
+    if (min_client_version)
+    {
+        /* the client version is unaligned in the packet.
+         * load it byte for byte. big endian*/
+        const __u8* v = ts3_header->client_version;
+        __u32 packet_min_client_version =
+            ((__u32)v[0]) << 24 | ((__u32)v[1]) << 16 |
+            ((__u32)v[2]) <<  8 | ((__u32)v[3]);
+
+        if (packet_min_client_version < min_client_version)
+            return false;
+    }
+    return true;
+}
+
 /* 
  * Check that skb contains a valid TS3INIT client header.
  * Also initializes header_data, and checks client version.
@@ -76,19 +112,8 @@ static bool check_client_header(const struct sk_buff *skb, const struct xt_actio
     if (ts3_header->client_id != 0) return false;
     if (ts3_header->flags != 0x88) return false;
 
-    /* check min_client_version if needed */
-    if (min_client_version)
-    {
-        /* the client version is unaligned in the packet.
-         * load it byte for byte. big endian*/
-        __u8* v = ts3_header->client_version;
-        __u32 packet_min_client_version =
-            ((__u32)v[0]) << 24 | ((__u32)v[1]) << 16 |
-            ((__u32)v[1]) <<  8 | ((__u32)v[3]);
-
-        if (packet_min_client_version < min_client_version)
-            return false;
-    }
+    if (!check_client_version(ts3_header, min_client_version))
+        return false;
 
     header_data->udp = udp;
     header_data->ts3_header = ts3_header;
@@ -125,6 +150,24 @@ static bool check_server_header(const struct sk_buff *skb, const struct xt_actio
     return true;
 }
 
+/*
+ * Returns the port table entry for the destination port of a checked
+ * client packet, if the client version satisfies it. Otherwise NULL.
+ */
+static inline const struct ts3init_port_entry *
+check_port_entry(const struct ts3init_port_table *table,
+                 const struct ts3_init_checked_client_header_data* header_data)
+{
+    const struct ts3init_port_entry *entry;
+
+    entry = ts3init_port_table_lookup(table, be16_to_cpu(header_data->udp->dest));
+    if (entry == NULL)
+        return NULL;
+    if (!check_client_version(header_data->ts3_header, entry->min_client_version))
+        return NULL;
+    return entry;
+}
+
 static inline __u8* get_payload(const struct sk_buff *skb, const struct xt_action_param *par,
                          const struct ts3_init_checked_client_header_data* header_data,
                          __u8 *buf, size_t buf_size)
@@ -182,30 +225,70 @@ static int calculate_cookie(const struct sk_buff *skb, const struct xt_action_pa
 }
 
 /*
- * The 'ts3init_get_cookie' match handler.
+ * Variants of the 'ts3init_get_cookie' match handler.
+ */
+enum
+{
+    GET_COOKIE_VARIANT_MIN_CLIENT = 1 << 0,
+    GET_COOKIE_VARIANT_CHECK_TIME = 1 << 1,
+    GET_COOKIE_VARIANT_PORT_TABLE = 1 << 2,
+};
+
+static inline unsigned int
+ts3init_get_cookie_variant(const struct xt_ts3init_get_cookie_mtinfo *info)
+{
+    return (info->min_client_version ? GET_COOKIE_VARIANT_MIN_CLIENT : 0) |
+           ((info->specific_options & CHK_GET_COOKIE_CHECK_TIMESTAMP) ? GET_COOKIE_VARIANT_CHECK_TIME : 0) |
+           ((info->specific_options & CHK_GET_COOKIE_PORT_TABLE) ? GET_COOKIE_VARIANT_PORT_TABLE : 0);
+}
+
+/*
  * Checks that the packet is a valid COMMAND_GET_COOKIE.
+ * Revision 1 matchinfo starts with the same fields as revision 0.
  */
-static bool
-ts3init_get_cookie_mt(const struct sk_buff *skb, struct xt_action_param *par)
+static __always_inline enum ts3init_result
+ts3init_get_cookie_match(const struct sk_buff *skb, struct xt_action_param *par,
+                         __u32 min_client_version, __u32 max_utc_offset,
+                         const unsigned int variant)
 {
-    const struct xt_ts3init_get_cookie_mtinfo *info = par->matchinfo;
+    const struct ts3init_port_entry *entry = NULL;
     struct ts3_init_checked_client_header_data header_data;
+    u64 profile;
+    bool valid;
 
-    if (!check_client_header(skb, par, &header_data, info->min_client_version))
-        return false;
+    profile = ts3init_profile_start();
+    valid = check_client_header(skb, par, &header_data, 0);
+    ts3init_profile_end(TS3INIT_PROFILE_HEADER, profile);
+    if (!valid)
+        return TS3INIT_RESULT_HEADER;
+
+    if (header_data.ts3_header->command != COMMAND_GET_COOKIE) return TS3INIT_RESULT_HEADER;
 
-    if (header_data.ts3_header->command != COMMAND_GET_COOKIE) return false;
+    if ((variant & GET_COOKIE_VARIANT_MIN_CLIENT) &&
+        !check_client_version(header_data.ts3_header, min_client_version))
+        return TS3INIT_RESULT_CLIENT_VERSION;
 
-    if (info->specific_options & CHK_GET_COOKIE_CHECK_TIMESTAMP)
+    /* only valid in revision 1 */
+    if (variant & GET_COOKIE_VARIANT_PORT_TABLE)
+    {
+        const struct xt_ts3init_get_cookie_mtinfo_v1 *info_v1 = par->matchinfo;
+
+        entry = check_port_entry(info_v1->port_table, &header_data);
+        if (entry == NULL)
+            return TS3INIT_RESULT_PORT;
+    }
+
+    if ((variant & GET_COOKIE_VARIANT_CHECK_TIME) ||
+        (entry && (entry->options & TS3INIT_PORT_CHECK_TIME)))
     {
         __u8 *payload, payload_buf[ts3init_payload_sizes[COMMAND_GET_COOKIE]];
-        time_t current_unix_time, packet_unix_time;
+        time_t current_unix_time, packet_unix_time, offset;
 
         payload = get_payload(skb, par, &header_data, payload_buf, sizeof(payload_buf));
         if (!payload)
-            return false;
+            return TS3INIT_RESULT_HEADER;
 
-        current_unix_time = ts3init_get_cached_unix_time();
+        current_unix_time = ts3init_get_epoch();
 
         packet_unix_time =
             payload[0] << 24 |
@@ -213,10 +296,98 @@ ts3init_get_cookie_mt(const struct sk_buff *skb, struct xt_action_param *par)
             payload[2] << 8  |
             payload[3];
 
-        if (abs(current_unix_time - packet_unix_time) > info->max_utc_offset)
-            return false;
+        offset = abs(current_unix_time - packet_unix_time);
+        if (((variant & GET_COOKIE_VARIANT_CHECK_TIME) && offset > max_utc_offset) ||
+            (entry && (entry->options & TS3INIT_PORT_CHECK_TIME) &&
+             offset > entry->max_utc_offset))
+        {
+            ts3init_stat_inc(par_net(par), TS3INIT_STAT_TIME_INVALID);
+            return TS3INIT_RESULT_TIME;
+        }
     }
-    return true;
+    return TS3INIT_RESULT_MATCH;
+}
+
+/*
+ * Tightens the checks of an --adaptive get_cookie rule under attack: the
+ * higher client version and the lower time tolerance of the rule and of
+ * the attack profile apply.
+ */
+static void
+ts3init_get_cookie_attack_profile(__u32 *min_client_version, __u32 *max_utc_offset,
+                                  bool *check_time)
+{
+    unsigned int min_client = READ_ONCE(ts3init_attack_min_client);
+    unsigned int max_offset = READ_ONCE(ts3init_attack_max_utc_offset);
+
+    if (min_client > CLIENT_VERSION_OFFSET)
+        *min_client_version = max_t(__u32, *min_client_version, min_client - CLIENT_VERSION_OFFSET);
+    if (max_offset)
+    {
+        *max_utc_offset = *check_time ? min_t(__u32, *max_utc_offset, max_offset) : max_offset;
+        *check_time = true;
+    }
+}
+
+/*
+ * Runs the 'ts3init_get_cookie' match variant of the rule. An --adaptive
+ * rule checks with its attack profile under attack, which may add the
+ * client version and time checks to the variant.
+ */
+static bool
+ts3init_get_cookie_mt_variant(const struct sk_buff *skb, struct xt_action_param *par,
+                              unsigned int variant)
+{
+    const struct xt_ts3init_get_cookie_mtinfo *info = par->matchinfo;
+    __u32 min_client_version = info->min_client_version;
+    __u32 max_utc_offset = info->max_utc_offset;
+    const bool adaptive = info->specific_options & CHK_GET_COOKIE_ADAPTIVE;
+    const bool shadow = info->common_options & CHK_COMMON_SHADOW;
+    u64 start = ts3init_shadow_start(shadow);
+    enum ts3init_result result = TS3INIT_RESULT_HEADER;
+
+    if (unlikely(adaptive) && ts3init_under_attack(par_net(par)))
+    {
+        bool check_time = variant & GET_COOKIE_VARIANT_CHECK_TIME;
+
+        ts3init_get_cookie_attack_profile(&min_client_version, &max_utc_offset, &check_time);
+        variant |= (min_client_version ? GET_COOKIE_VARIANT_MIN_CLIENT : 0) |
+                   (check_time ? GET_COOKIE_VARIANT_CHECK_TIME : 0);
+    }
+
+#define GET_COOKIE_VARIANT(v) case v: \
+        result = ts3init_get_cookie_match(skb, par, min_client_version, max_utc_offset, v); break
+    switch (variant)
+    {
+        TS3INIT_VARIANTS_8(GET_COOKIE_VARIANT);
+    }
+#undef GET_COOKIE_VARIANT
+
+    /* every get cookie packet counts, also those the checks dropped */
+    if (unlikely(adaptive) && result != TS3INIT_RESULT_HEADER)
+        ts3init_adaptive_count(par_net(par));
+    return ts3init_shadow_match(par_net(par), shadow, result, start);
+}
+
+/*
+ * The 'ts3init_get_cookie' match handler of revision 0.
+ */
+static bool
+ts3init_get_cookie_mt(const struct sk_buff *skb, struct xt_action_param *par)
+{
+    return ts3init_get_cookie_mt_variant(skb, par, ts3init_get_cookie_variant(par->matchinfo));
+}
+
+/*
+ * The 'ts3init_get_cookie' match handler of revision 1, with the variant
+ * checkentry chose.
+ */
+static bool
+ts3init_get_cookie_mt_v1(const struct sk_buff *skb, struct xt_action_param *par)
+{
+    const struct xt_ts3init_get_cookie_mtinfo_v1 *info = par->matchinfo;
+
+    return ts3init_get_cookie_mt_variant(skb, par, info->variant);
 }
 
 /*
@@ -248,49 +419,293 @@ static int ts3init_get_cookie_mt_check(const struct xt_mtchk_param *par)
 }
 
 /*
- * The 'ts3init_get_cookie' match handler.
+ * Validates matchinfo recieved from userspace, and takes a reference
+ * to the port table.
+ */
+static int ts3init_get_cookie_mt_check_v1(const struct xt_mtchk_param *par)
+{
+    struct xt_ts3init_get_cookie_mtinfo_v1 *info = par->matchinfo;
+
+    if (! (par->family == NFPROTO_IPV4 || par->family == NFPROTO_IPV6))
+    {
+        printk(KERN_INFO KBUILD_MODNAME ": invalid protocol (only ipv4 and ipv6) for get_cookie\n");
+        return -EINVAL;
+    }
+
+    if (info->common_options & ~(CHK_COMMON_VALID_MASK))
+    {
+        printk(KERN_INFO KBUILD_MODNAME ": invalid (common) options for get_cookie\n");
+        return -EINVAL;
+    }
+
+    if (info->specific_options & ~(CHK_GET_COOKIE_V1_VALID_MASK))
+    {
+        printk(KERN_INFO KBUILD_MODNAME ": invalid (specific) options for get_cookie\n");
+        return -EINVAL;
+    }
+
+    info->port_table = NULL;
+    if (info->specific_options & CHK_GET_COOKIE_PORT_TABLE)
+    {
+        info->port_table = ts3init_port_table_get(par->net, info->port_table_id);
+        if (info->port_table == NULL)
+        {
+            printk(KERN_INFO KBUILD_MODNAME ": unknown port table %u for get_cookie\n", info->port_table_id);
+            return -ENOENT;
+        }
+    }
+
+    info->variant = ts3init_get_cookie_variant((const struct xt_ts3init_get_cookie_mtinfo *)info);
+    return 0;
+}
+
+static void ts3init_get_cookie_mt_destroy_v1(const struct xt_mtdtor_param *par)
+{
+    struct xt_ts3init_get_cookie_mtinfo_v1 *info = par->matchinfo;
+
+    if (info->port_table != NULL)
+        ts3init_port_table_put(info->port_table);
+}
+
+/*
+ * Returns the cookie seed for packet_index of a get_puzzle rule. With a
+ * port table, the seed of entry is used.
+ */
+static inline bool get_puzzle_cookie_seed(const struct xt_action_param *par,
+                                          const struct ts3init_port_entry *entry,
+                                          time_t current_unix_time, __u8 packet_index,
+                                          __u64 (*cookie_seed)[2])
+{
+    if (par->match->revision == 0)
+    {
+        const struct xt_ts3init_get_puzzle_mtinfo *info = par->matchinfo;
+        return ts3init_get_cookie_seed_for_packet_index(par_net(par), current_unix_time,
+                                                        packet_index, info->random_seed,
+                                                        cookie_seed);
+    }
+    else
+    {
+        const struct xt_ts3init_get_puzzle_mtinfo_v1 *info = par->matchinfo;
+        const struct ts3init_seed *seed = entry ? entry->seed : info->seed;
+
+        if (seed == NULL)
+            return false;
+        return ts3init_seed_cookie_seed_for_packet_index(seed, current_unix_time,
+                                                         packet_index, cookie_seed);
+    }
+}
+
+/*
+ * Checks the cookie in the payload of a COMMAND_GET_PUZZLE against the
+ * cookie seed selected at current_unix_time.
+ */
+static bool check_puzzle_cookie(const struct sk_buff *skb, const struct xt_action_param *par,
+                                const struct ts3_init_checked_client_header_data *header_data,
+                                const struct ts3init_port_entry *entry,
+                                const __u8 *payload, time_t current_unix_time)
+{
+    __u64 cookie_seed[2];
+    __u64 cookie, packet_cookie;
+    u64 profile;
+
+    profile = ts3init_profile_start();
+    if (get_puzzle_cookie_seed(par, entry, current_unix_time, payload[8], &cookie_seed) == false)
+        return false;
+    ts3init_profile_end(TS3INIT_PROFILE_COOKIE_SEED, profile);
+
+    /* use cookie_seed and ipaddress and port to create a hash
+     * (cookie) for this connection */
+    profile = ts3init_profile_start();
+    if (calculate_cookie(skb, par, header_data->udp, cookie_seed[0], cookie_seed[1], &cookie))
+        return false; /*something went wrong*/
+    ts3init_profile_end(TS3INIT_PROFILE_COOKIE, profile);
+
+    /* compare cookie with payload bytes 0-7. if equal, cookie
+     * is valid */
+
+    packet_cookie = (((u64)((payload)[0])) | ((u64)((payload)[1]) << 8) |
+       ((u64)((payload)[2]) << 16) | ((u64)((payload)[3]) << 24) |
+       ((u64)((payload)[4]) << 32) | ((u64)((payload)[5]) << 40) |
+       ((u64)((payload)[6]) << 48) | ((u64)((payload)[7]) << 56));
+
+    return packet_cookie == cookie;
+}
+
+/*
+ * A cookie made by a clock that is ahead of ours can come from the window
+ * 8 seconds after the one our clock selects for its packet_index (shift 8),
+ * one made by a clock that is behind from the window 8 seconds before it
+ * (shift -8). Returns true if a clock that is at most max_skew seconds off
+ * could have made a cookie that is still valid for it.
+ */
+static inline bool cookie_window_in_reach(time_t current_unix_time, int shift,
+                                          __u8 packet_index, __u16 max_skew)
+{
+    time_t window = ts3init_cookie_window(current_unix_time + shift, packet_index);
+
+    return current_unix_time + max_skew >= window + packet_index % 4 &&
+           current_unix_time <= window + 7 + max_skew;
+}
+
+/*
+ * Checks the cookie against the windows next to the one selected by our
+ * clock, for rules with --max-skew.
+ */
+static bool check_puzzle_cookie_skewed(const struct sk_buff *skb, const struct xt_action_param *par,
+                                       const struct ts3_init_checked_client_header_data *header_data,
+                                       const struct ts3init_port_entry *entry,
+                                       const __u8 *payload, time_t current_unix_time)
+{
+    const struct xt_ts3init_get_puzzle_mtinfo_v1 *info = par->matchinfo;
+
+    if (cookie_window_in_reach(current_unix_time, 8, payload[8], info->max_skew) &&
+        check_puzzle_cookie(skb, par, header_data, entry, payload, current_unix_time + 8))
+    {
+        ts3init_stat_inc(par_net(par), TS3INIT_STAT_COOKIE_SKEW_AHEAD);
+        return true;
+    }
+
+    if (cookie_window_in_reach(current_unix_time, -8, payload[8], info->max_skew) &&
+        check_puzzle_cookie(skb, par, header_data, entry, payload, current_unix_time - 8))
+    {
+        ts3init_stat_inc(par_net(par), TS3INIT_STAT_COOKIE_SKEW_BEHIND);
+        return true;
+    }
+    return false;
+}
+
+/*
+ * Variants of the 'ts3init_get_puzzle' match handler.
+ */
+enum
+{
+    GET_PUZZLE_VARIANT_MIN_CLIENT   = 1 << 0,
+    GET_PUZZLE_VARIANT_CHECK_COOKIE = 1 << 1,
+    GET_PUZZLE_VARIANT_PORT_TABLE   = 1 << 2,
+    GET_PUZZLE_VARIANT_MAX_SKEW     = 1 << 3,
+};
+
+static inline unsigned int
+ts3init_get_puzzle_variant(const struct xt_ts3init_get_puzzle_mtinfo *info)
+{
+    return (info->min_client_version ? GET_PUZZLE_VARIANT_MIN_CLIENT : 0) |
+           ((info->specific_options & CHK_GET_PUZZLE_CHECK_COOKIE) ? GET_PUZZLE_VARIANT_CHECK_COOKIE : 0) |
+           ((info->specific_options & CHK_GET_PUZZLE_PORT_TABLE) ? GET_PUZZLE_VARIANT_PORT_TABLE : 0) |
+           ((info->specific_options & CHK_GET_PUZZLE_MAX_SKEW) ? GET_PUZZLE_VARIANT_MAX_SKEW : 0);
+}
+
+/*
  * Checks that the packet is a valid COMMAND_GET_PUZZLE, and if the client
  * replied with the correct cookie.
+ * Revision 1 matchinfo starts with the same fields as revision 0.
  */
-static bool ts3init_get_puzzle_mt(const struct sk_buff *skb, struct xt_action_param *par)
+static __always_inline enum ts3init_result
+ts3init_get_puzzle_match(const struct sk_buff *skb, struct xt_action_param *par,
+                         const unsigned int variant)
 {
     const struct xt_ts3init_get_puzzle_mtinfo *info = par->matchinfo;
+    const struct ts3init_port_entry *entry = NULL;
     struct ts3_init_checked_client_header_data header_data;
+    u64 profile;
+    bool valid;
 
-    if (!check_client_header(skb, par, &header_data, info->min_client_version))
-        return false;
+    profile = ts3init_profile_start();
+    valid = check_client_header(skb, par, &header_data, 0);
+    ts3init_profile_end(TS3INIT_PROFILE_HEADER, profile);
+    if (!valid)
+        return TS3INIT_RESULT_HEADER;
 
-    if (header_data.ts3_header->command != COMMAND_GET_PUZZLE) return false;
+    if (header_data.ts3_header->command != COMMAND_GET_PUZZLE) return TS3INIT_RESULT_HEADER;
 
-    if (info->specific_options & CHK_GET_PUZZLE_CHECK_COOKIE)
+    if ((variant & GET_PUZZLE_VARIANT_MIN_CLIENT) &&
+        !check_client_version(header_data.ts3_header, info->min_client_version))
+        return TS3INIT_RESULT_CLIENT_VERSION;
+
+    /* only valid in revision 1 */
+    if (variant & GET_PUZZLE_VARIANT_PORT_TABLE)
+    {
+        const struct xt_ts3init_get_puzzle_mtinfo_v1 *info_v1 = par->matchinfo;
+
+        entry = check_port_entry(info_v1->port_table, &header_data);
+        if (entry == NULL)
+            return TS3INIT_RESULT_PORT;
+    }
+
+    if (variant & GET_PUZZLE_VARIANT_CHECK_COOKIE)
     {
         __u8 *payload, payload_buf[ts3init_payload_sizes[COMMAND_GET_PUZZLE]];
-        __u64 cookie_seed[2];
-        __u64 cookie, packet_cookie;
+        time_t current_unix_time = ts3init_get_epoch();
 
         payload = get_payload(skb, par, &header_data, payload_buf, sizeof(payload_buf));
         if (!payload)
-            return false;
+            return TS3INIT_RESULT_HEADER;
 
-        if (ts3init_get_cookie_seed_for_packet_index(payload[8], info->random_seed, &cookie_seed) == false)
-            return false;
+        /* CHK_GET_PUZZLE_MAX_SKEW is only valid in revision 1 */
+        if (!check_puzzle_cookie(skb, par, &header_data, entry, payload, current_unix_time) &&
+            !((variant & GET_PUZZLE_VARIANT_MAX_SKEW) &&
+              check_puzzle_cookie_skewed(skb, par, &header_data, entry, payload, current_unix_time)))
+        {
+            ts3init_stat_inc(par_net(par), TS3INIT_STAT_COOKIE_INVALID);
+            return TS3INIT_RESULT_COOKIE;
+        }
+        ts3init_stat_inc(par_net(par), TS3INIT_STAT_COOKIE_VALID);
 
-        /* use cookie_seed and ipaddress and port to create a hash
-         * (cookie) for this connection */
-        if (calculate_cookie(skb, par, header_data.udp, cookie_seed[0], cookie_seed[1], &cookie))
-            return false; /*something went wrong*/
+        /* CHK_GET_PUZZLE_REJECT_REPLAY is only valid in revision 1 */
+        if (unlikely(info->specific_options & CHK_GET_PUZZLE_REJECT_REPLAY))
+        {
+            const struct xt_ts3init_get_puzzle_mtinfo_v1 *info_v1 = par->matchinfo;
 
-        /* compare cookie with payload bytes 0-7. if equal, cookie
-         * is valid */
+            if (ts3init_replay_check(info_v1->replay, current_unix_time, get_unaligned_le64(payload)))
+            {
+                ts3init_stat_inc(par_net(par), TS3INIT_STAT_COOKIE_REPLAYED);
+                return TS3INIT_RESULT_REPLAY;
+            }
+        }
+    }
+    return TS3INIT_RESULT_MATCH;
+}
 
-        packet_cookie = (((u64)((payload)[0])) | ((u64)((payload)[1]) << 8) |
-           ((u64)((payload)[2]) << 16) | ((u64)((payload)[3]) << 24) |
-           ((u64)((payload)[4]) << 32) | ((u64)((payload)[5]) << 40) |
-           ((u64)((payload)[6]) << 48) | ((u64)((payload)[7]) << 56));
+/*
+ * Runs the 'ts3init_get_puzzle' match variant of the rule, timed as a whole.
+ */
+static bool
+ts3init_get_puzzle_mt_variant(const struct sk_buff *skb, struct xt_action_param *par,
+                              const unsigned int variant)
+{
+    const struct xt_ts3init_get_puzzle_mtinfo *info = par->matchinfo;
+    const bool shadow = info->common_options & CHK_COMMON_SHADOW;
+    u64 start = ts3init_shadow_start(shadow);
+    u64 profile = ts3init_profile_start();
+    enum ts3init_result result = TS3INIT_RESULT_HEADER;
 
-        if (packet_cookie != cookie) return false;
+#define GET_PUZZLE_VARIANT(v) case v: result = ts3init_get_puzzle_match(skb, par, v); break
+    switch (variant)
+    {
+        TS3INIT_VARIANTS_16(GET_PUZZLE_VARIANT);
     }
-    return true;
+#undef GET_PUZZLE_VARIANT
+
+    ts3init_profile_end(TS3INIT_PROFILE_GET_PUZZLE, profile);
+    return ts3init_shadow_match(par_net(par), shadow, result, start);
+}
+
+/*
+ * The 'ts3init_get_puzzle' match handler of revision 0.
+ */
+static bool ts3init_get_puzzle_mt(const struct sk_buff *skb, struct xt_action_param *par)
+{
+    return ts3init_get_puzzle_mt_variant(skb, par, ts3init_get_puzzle_variant(par->matchinfo));
+}
+
+/*
+ * The 'ts3init_get_puzzle' match handler of revision 1, with the variant
+ * checkentry chose.
+ */
+static bool ts3init_get_puzzle_mt_v1(const struct sk_buff *skb, struct xt_action_param *par)
+{
+    const struct xt_ts3init_get_puzzle_mtinfo_v1 *info = par->matchinfo;
+
+    return ts3init_get_puzzle_mt_variant(skb, par, info->variant);
 }
 
 /*
@@ -322,10 +737,175 @@ static int ts3init_get_puzzle_mt_check(const struct xt_mtchk_param *par)
 }
 
 /*
- * The 'ts3init' match handler.
- * Checks that the packet is a valid ts3init packet
+ * Validates matchinfo recieved from userspace, and takes a reference
+ * to the seed or the port table.
  */
-static bool ts3init_mt(const struct sk_buff *skb, struct xt_action_param *par)
+static int ts3init_get_puzzle_mt_check_v1(const struct xt_mtchk_param *par)
+{
+    struct xt_ts3init_get_puzzle_mtinfo_v1 *info = par->matchinfo;
+
+    if (! (par->family == NFPROTO_IPV4 || par->family == NFPROTO_IPV6))
+    {
+        printk(KERN_INFO KBUILD_MODNAME ": invalid protocol (only ipv4 and ipv6) for get_puzzle\n");
+        return -EINVAL;
+    }
+
+    if (info->common_options & ~(CHK_COMMON_VALID_MASK))
+    {
+        printk(KERN_INFO KBUILD_MODNAME ": invalid (common) options for get_puzzle\n");
+        return -EINVAL;
+    }
+
+    if (info->specific_options & ~(CHK_GET_PUZZLE_V1_VALID_MASK))
+    {
+        printk(KERN_INFO KBUILD_MODNAME ": invalid (specific) options for get_puzzle\n");
+        return -EINVAL;
+    }
+
+    if ((info->specific_options & CHK_GET_PUZZLE_MAX_SKEW) &&
+        (!(info->specific_options & CHK_GET_PUZZLE_CHECK_COOKIE) ||
+         info->max_skew > GET_PUZZLE_MAX_SKEW_LIMIT))
+    {
+        printk(KERN_INFO KBUILD_MODNAME ": invalid max-skew for get_puzzle\n");
+        return -EINVAL;
+    }
+
+    if ((info->specific_options & CHK_GET_PUZZLE_REJECT_REPLAY) &&
+        !(info->specific_options & CHK_GET_PUZZLE_CHECK_COOKIE))
+    {
+        printk(KERN_INFO KBUILD_MODNAME ": reject-replay requires check-cookie for get_puzzle\n");
+        return -EINVAL;
+    }
+
+    info->seed = NULL;
+    info->port_table = NULL;
+    info->replay = NULL;
+    if (info->specific_options & CHK_GET_PUZZLE_PORT_TABLE)
+    {
+        info->port_table = ts3init_port_table_get(par->net, info->port_table_id);
+        if (info->port_table == NULL)
+        {
+            printk(KERN_INFO KBUILD_MODNAME ": unknown port table %u for get_puzzle\n", info->port_table_id);
+            return -ENOENT;
+        }
+    }
+    else if (info->specific_options & CHK_GET_PUZZLE_CHECK_COOKIE)
+    {
+        info->seed = ts3init_seed_get(par->net, info->seed_id);
+        if (info->seed == NULL)
+        {
+            printk(KERN_INFO KBUILD_MODNAME ": unknown seed %u for get_puzzle\n", info->seed_id);
+            return -ENOENT;
+        }
+    }
+
+    /* every rule has its own filter, so --shadow rules do not fill the
+     * filter of the rule they shadow */
+    if (info->specific_options & CHK_GET_PUZZLE_REJECT_REPLAY)
+    {
+        info->replay = ts3init_replay_filter_alloc();
+        if (info->replay == NULL)
+        {
+            if (info->seed != NULL)
+                ts3init_seed_put(info->seed);
+            if (info->port_table != NULL)
+                ts3init_port_table_put(info->port_table);
+            return -ENOMEM;
+        }
+    }
+
+    info->variant = ts3init_get_puzzle_variant((const struct xt_ts3init_get_puzzle_mtinfo *)info);
+    return 0;
+}
+
+static void ts3init_get_puzzle_mt_destroy_v1(const struct xt_mtdtor_param *par)
+{
+    struct xt_ts3init_get_puzzle_mtinfo_v1 *info = par->matchinfo;
+
+    if (info->seed != NULL)
+        ts3init_seed_put(info->seed);
+    if (info->port_table != NULL)
+        ts3init_port_table_put(info->port_table);
+    ts3init_replay_filter_free(info->replay);
+}
+
+/*
+ * Checks that the packet is a valid COMMAND_SOLVE_PUZZLE, with the
+ * solution to a puzzle from the pool.
+ */
+static enum ts3init_result
+ts3init_solve_puzzle_match(const struct sk_buff *skb, struct xt_action_param *par)
+{
+    const struct xt_ts3init_solve_puzzle_mtinfo *info = par->matchinfo;
+    struct ts3_init_checked_client_header_data header_data;
+    __u8 *payload, payload_buf[TS3INIT_PUZZLE_LENGTH + TS3INIT_SOLUTION_LENGTH];
+
+    if (!check_client_header(skb, par, &header_data, 0))
+        return TS3INIT_RESULT_HEADER;
+
+    if (header_data.ts3_header->command != COMMAND_SOLVE_PUZZLE) return TS3INIT_RESULT_HEADER;
+
+    if (!check_client_version(header_data.ts3_header, info->min_client_version))
+        return TS3INIT_RESULT_CLIENT_VERSION;
+
+    payload = get_payload(skb, par, &header_data, payload_buf, sizeof(payload_buf));
+    if (!payload)
+        return TS3INIT_RESULT_HEADER;
+
+    if (!ts3init_puzzle_check(par_net(par), payload, payload + TS3INIT_PUZZLE_LENGTH))
+    {
+        ts3init_stat_inc(par_net(par), TS3INIT_STAT_PUZZLE_INVALID);
+        return TS3INIT_RESULT_PUZZLE;
+    }
+    ts3init_stat_inc(par_net(par), TS3INIT_STAT_PUZZLE_SOLVED);
+    return TS3INIT_RESULT_MATCH;
+}
+
+/*
+ * The 'ts3init_solve_puzzle' match handler.
+ */
+static bool ts3init_solve_puzzle_mt(const struct sk_buff *skb, struct xt_action_param *par)
+{
+    const struct xt_ts3init_solve_puzzle_mtinfo *info = par->matchinfo;
+    const bool shadow = info->common_options & CHK_COMMON_SHADOW;
+    u64 start = ts3init_shadow_start(shadow);
+
+    return ts3init_shadow_match(par_net(par), shadow, ts3init_solve_puzzle_match(skb, par), start);
+}
+
+/*
+ * Validates matchinfo recieved from userspace.
+ */
+static int ts3init_solve_puzzle_mt_check(const struct xt_mtchk_param *par)
+{
+    struct xt_ts3init_solve_puzzle_mtinfo *info = par->matchinfo;
+
+    if (! (par->family == NFPROTO_IPV4 || par->family == NFPROTO_IPV6))
+    {
+        printk(KERN_INFO KBUILD_MODNAME ": invalid protocol (only ipv4 and ipv6) for solve_puzzle\n");
+        return -EINVAL;
+    }
+
+    if (info->common_options & ~(CHK_COMMON_VALID_MASK))
+    {
+        printk(KERN_INFO KBUILD_MODNAME ": invalid (common) options for solve_puzzle\n");
+        return -EINVAL;
+    }
+
+    if (info->specific_options & ~(CHK_SOLVE_PUZZLE_VALID_MASK))
+    {
+        printk(KERN_INFO KBUILD_MODNAME ": invalid (specific) options for solve_puzzle\n");
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+/*
+ * Checks that the packet is a valid ts3init packet.
+ */
+static __always_inline enum ts3init_result
+ts3init_match(const struct sk_buff *skb, struct xt_action_param *par)
 {
     const struct xt_ts3init_mtinfo *info = par->matchinfo;
 
@@ -334,11 +914,11 @@ static bool ts3init_mt(const struct sk_buff *skb, struct xt_action_param *par)
         struct ts3_init_checked_client_header_data header_data;
 
         if (!check_client_header(skb, par, &header_data, 0))
-            return false;
+            return TS3INIT_RESULT_HEADER;
         if (info->specific_options & CHK_TS3INIT_COMMAND)
         {
             if (header_data.ts3_header->command != info->command)
-                return false;
+                return TS3INIT_RESULT_HEADER;
         }
     }
     else if (info->specific_options & CHK_TS3INIT_SERVER)
@@ -346,11 +926,11 @@ static bool ts3init_mt(const struct sk_buff *skb, struct xt_action_param *par)
         struct ts3_init_checked_server_header_data header_data;
 
         if (!check_server_header(skb, par, &header_data))
-            return false;
+            return TS3INIT_RESULT_HEADER;
         if (info->specific_options & CHK_TS3INIT_COMMAND)
         {
             if (header_data.ts3_header->command != info->command)
-                return false;
+                return TS3INIT_RESULT_HEADER;
         }
     }
     else
@@ -360,14 +940,26 @@ static bool ts3init_mt(const struct sk_buff *skb, struct xt_action_param *par)
 
         udp = skb_header_pointer(skb, par->thoff, sizeof(udp_buf), &udp_buf);
         if (!udp)
-            return false;
+            return TS3INIT_RESULT_HEADER;
         signature = skb_header_pointer(skb, par->thoff + sizeof(*udp),
                         sizeof(signature_buf), &signature_buf);
 
         if (!signature || *signature != ts3init_header_tag_signature.tag64)
-            return false;
+            return TS3INIT_RESULT_HEADER;
     }
-    return true;
+    return TS3INIT_RESULT_MATCH;
+}
+
+/*
+ * The 'ts3init' match handler.
+ */
+static bool ts3init_mt(const struct sk_buff *skb, struct xt_action_param *par)
+{
+    const struct xt_ts3init_mtinfo *info = par->matchinfo;
+    const bool shadow = info->common_options & CHK_COMMON_SHADOW;
+    u64 start = ts3init_shadow_start(shadow);
+    enum ts3init_result result = ts3init_match(skb, par);
+    return ts3init_shadow_match(par_net(par), shadow, result, start);
 }
 
 /*
@@ -414,6 +1006,28 @@ static struct xt_match ts3init_mt_reg[] __read_mostly =
         .checkentry = ts3init_get_cookie_mt_check,
         .me         = THIS_MODULE,
     },
+    {
+        .name       = "ts3init_get_cookie",
+        .revision   = 1,
+        .family     = NFPROTO_IPV4,
+        .proto      = IPPROTO_UDP,
+        .matchsize  = sizeof(struct xt_ts3init_get_cookie_mtinfo_v1),
+        .match      = ts3init_get_cookie_mt_v1,
+        .checkentry = ts3init_get_cookie_mt_check_v1,
+        .destroy    = ts3init_get_cookie_mt_destroy_v1,
+        .me         = THIS_MODULE,
+    },
+    {
+        .name       = "ts3init_get_cookie",
+        .revision   = 1,
+        .family     = NFPROTO_IPV6,
+        .proto      = IPPROTO_UDP,
+        .matchsize  = sizeof(struct xt_ts3init_get_cookie_mtinfo_v1),
+        .match      = ts3init_get_cookie_mt_v1,
+        .checkentry = ts3init_get_cookie_mt_check_v1,
+        .destroy    = ts3init_get_cookie_mt_destroy_v1,
+        .me         = THIS_MODULE,
+    },
     {
         .name       = "ts3init_get_puzzle",
         .revision   = 0,
@@ -434,6 +1048,48 @@ static struct xt_match ts3init_mt_reg[] __read_mostly =
         .checkentry = ts3init_get_puzzle_mt_check,
         .me         = THIS_MODULE,
     },
+    {
+        .name       = "ts3init_get_puzzle",
+        .revision   = 1,
+        .family     = NFPROTO_IPV4,
+        .proto      = IPPROTO_UDP,
+        .matchsize  = sizeof(struct xt_ts3init_get_puzzle_mtinfo_v1),
+        .match      = ts3init_get_puzzle_mt_v1,
+        .checkentry = ts3init_get_puzzle_mt_check_v1,
+        .destroy    = ts3init_get_puzzle_mt_destroy_v1,
+        .me         = THIS_MODULE,
+    },
+    {
+        .name       = "ts3init_get_puzzle",
+        .revision   = 1,
+        .family     = NFPROTO_IPV6,
+        .proto      = IPPROTO_UDP,
+        .matchsize  = sizeof(struct xt_ts3init_get_puzzle_mtinfo_v1),
+        .match      = ts3init_get_puzzle_mt_v1,
+        .checkentry = ts3init_get_puzzle_mt_check_v1,
+        .destroy    = ts3init_get_puzzle_mt_destroy_v1,
+        .me         = THIS_MODULE,
+    },
+    {
+        .name       = "ts3init_solve_puzzle",
+        .revision   = 0,
+        .family     = NFPROTO_IPV4,
+        .proto      = IPPROTO_UDP,
+        .matchsize  = sizeof(struct xt_ts3init_solve_puzzle_mtinfo),
+        .match      = ts3init_solve_puzzle_mt,
+        .checkentry = ts3init_solve_puzzle_mt_check,
+        .me         = THIS_MODULE,
+    },
+    {
+        .name       = "ts3init_solve_puzzle",
+        .revision   = 0,
+        .family     = NFPROTO_IPV6,
+        .proto      = IPPROTO_UDP,
+        .matchsize  = sizeof(struct xt_ts3init_solve_puzzle_mtinfo),
+        .match      = ts3init_solve_puzzle_mt,
+        .checkentry = ts3init_solve_puzzle_mt_check,
+        .me         = THIS_MODULE,
+    },
     {
         .name       = "ts3init",
         .revision   = 0,
@@ -455,3 +1111,7 @@ void ts3init_match_exit(void)
 {
     xt_unregister_matches(ts3init_mt_reg, ARRAY_SIZE(ts3init_mt_reg));
 }
+
+#ifdef TS3INIT_KUNIT_TEST
+#include "ts3init_match_test.c"
+#endif
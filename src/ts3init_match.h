@@ -1,20 +1,30 @@
 #ifndef _TS3INIT_MATCH_H
 #define _TS3INIT_MATCH_H
 
-/* Enums for get_cookie and get_puzzle matches */
+/*
+ * Enums for get_cookie and get_puzzle matches.
+ * With CHK_COMMON_SHADOW, the checks of the match are counted but do not
+ * change the verdict: the match always matches.
+ */
 enum
 {
     CHK_COMMON_CLIENT_VERSION = 1 << 0,
-    CHK_COMMON_VALID_MASK     = (1 << 1) -1,
+    CHK_COMMON_SHADOW         = 1 << 1,
+    CHK_COMMON_VALID_MASK     = (1 << 2) -1,
 
     CLIENT_VERSION_OFFSET     = 1356998400
 };
 
-/* Enums and structs for get_cookie */
+/*
+ * Enums and structs for get_cookie.
+ * With CHK_GET_COOKIE_ADAPTIVE, the rule counts towards the handshake
+ * rate of the namespace, and tightens its checks while under attack.
+ */
 enum
 { 
     CHK_GET_COOKIE_CHECK_TIMESTAMP = 1 << 0,
-    CHK_GET_COOKIE_VALID_MASK      = (1 << 1) -1
+    CHK_GET_COOKIE_ADAPTIVE        = 1 << 2,
+    CHK_GET_COOKIE_VALID_MASK      = CHK_GET_COOKIE_CHECK_TIMESTAMP | CHK_GET_COOKIE_ADAPTIVE
 };
 
 struct xt_ts3init_get_cookie_mtinfo
@@ -26,6 +36,33 @@ struct xt_ts3init_get_cookie_mtinfo
     __u32 max_utc_offset;
 };
 
+/*
+ * Enums and structs for get_cookie revision 1.
+ * Optionally takes the client version and time checks from the entry
+ * of the destination port in a port table.
+ */
+enum
+{
+    CHK_GET_COOKIE_PORT_TABLE      = 1 << 1,
+    CHK_GET_COOKIE_V1_VALID_MASK   = (1 << 3) -1
+};
+
+struct ts3init_port_table;
+
+struct xt_ts3init_get_cookie_mtinfo_v1
+{
+    __u8 common_options;
+    __u8 specific_options;
+    __u16 reserved1;
+    __u32 min_client_version;
+    __u32 max_utc_offset;
+    __u32 port_table_id;
+
+    /* Used internally by the kernel */
+    struct ts3init_port_table *port_table __attribute__((aligned(8)));
+    __u32 variant __attribute__((aligned(8)));
+};
+
 
 /* Enums and structs for get_puzzle */
 enum
@@ -46,6 +83,65 @@ struct xt_ts3init_get_puzzle_mtinfo
     char random_seed_path[RANDOM_SEED_PATH_MAX];
 };
 
+/*
+ * Enums and structs for get_puzzle revision 1.
+ * The seed is referenced by the id of a seed added through netlink, or
+ * taken from the entry of the destination port in a port table.
+ * With CHK_GET_PUZZLE_MAX_SKEW, cookies made by a machine whose clock
+ * is up to max_skew seconds ahead or behind are accepted too.
+ * With CHK_GET_PUZZLE_REJECT_REPLAY, a cookie is only accepted once.
+ */
+enum
+{
+    CHK_GET_PUZZLE_PORT_TABLE    = 1 << 3,
+    CHK_GET_PUZZLE_MAX_SKEW      = 1 << 4,
+    CHK_GET_PUZZLE_REJECT_REPLAY = 1 << 5,
+    CHK_GET_PUZZLE_V1_VALID_MASK = CHK_GET_PUZZLE_CHECK_COOKIE | CHK_GET_PUZZLE_PORT_TABLE |
+                                   CHK_GET_PUZZLE_MAX_SKEW | CHK_GET_PUZZLE_REJECT_REPLAY,
+};
+
+/*
+ * Up to 4 seconds, all windows a cookie can come from fit in the
+ * cookie seed cache.
+ */
+enum
+{
+    GET_PUZZLE_MAX_SKEW_LIMIT = 4
+};
+
+struct ts3init_seed;
+struct ts3init_replay_filter;
+
+struct xt_ts3init_get_puzzle_mtinfo_v1
+{
+    __u8 common_options;
+    __u8 specific_options;
+    __u16 max_skew;
+    __u32 min_client_version;
+    __u32 seed_id;
+    __u32 port_table_id;
+
+    /* Used internally by the kernel */
+    struct ts3init_seed *seed __attribute__((aligned(8)));
+    struct ts3init_port_table *port_table __attribute__((aligned(8)));
+    struct ts3init_replay_filter *replay __attribute__((aligned(8)));
+    __u32 variant __attribute__((aligned(8)));
+};
+
+/* Enums and structs for solve_puzzle */
+enum
+{
+    CHK_SOLVE_PUZZLE_VALID_MASK = (1 << 0) - 1,
+};
+
+struct xt_ts3init_solve_puzzle_mtinfo
+{
+    __u8 common_options;
+    __u8 specific_options;
+    __u16 reserved1;
+    __u32 min_client_version;
+};
+
 /* Enums and structs for generic ts3init */
 enum
 {
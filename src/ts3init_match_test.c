@@ -0,0 +1,286 @@
+/*
+ *    "ts3init" extension for Xtables
+ *
+ *    Description: KUnit tests and microbenchmarks of the match hot paths.
+ *                 Included at the end of ts3init_match.c, built with
+ *                 'make TS3INIT_KUNIT=1'.
+ *
+ *    This program is free software; you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License; either version 2
+ *    or 3 of the License, as published by the Free Software Foundation.
+ */
+
+#include <linux/ipv6.h>
+#include "ts3init_test.h"
+
+enum
+{
+    TEST_CLIENT_VERSION = 1459504131,
+    TEST_GET_COOKIE_LENGTH = TS3INIT_HEADER_CLIENT_LENGTH + 16
+};
+
+/* key of packet index 1 at TS3INIT_TEST_TIME, from the cookie.md seed */
+#define TEST_K0 0x0757929f36f8062fULL
+#define TEST_K1 0xa5e758ed4810f38fULL
+
+/*
+ * The siphash keys of packet index 0..7 at TS3INIT_TEST_TIME, as bytes of
+ * sha512(random_seed || le32 window).
+ */
+static const __u8 test_cookie_keys[8][SIP_KEY_SIZE] =
+{
+    { 0x7e, 0x20, 0x1e, 0xcd, 0x43, 0x26, 0x7d, 0xa3, 0xe2, 0x1e, 0x72, 0x7e, 0x08, 0xcd, 0xc3, 0x07 },
+    { 0x2f, 0x06, 0xf8, 0x36, 0x9f, 0x92, 0x57, 0x07, 0x8f, 0xf3, 0x10, 0x48, 0xed, 0x58, 0xe7, 0xa5 },
+    { 0x38, 0xa9, 0x47, 0xfd, 0xfa, 0xd6, 0xf8, 0x24, 0xfa, 0x8d, 0x51, 0xdd, 0x29, 0xfe, 0x67, 0x50 },
+    { 0x7b, 0x93, 0x06, 0xdd, 0xe9, 0x24, 0x65, 0x94, 0x02, 0x51, 0x17, 0xc7, 0x02, 0x64, 0x1f, 0x77 },
+    { 0xdc, 0x2d, 0x01, 0x5d, 0xc5, 0xc4, 0x53, 0xbf, 0xb9, 0x91, 0xe3, 0x1b, 0x64, 0x6f, 0x67, 0xee },
+    { 0xa0, 0xcf, 0xd2, 0x4f, 0x9c, 0x07, 0x77, 0x51, 0xff, 0xe9, 0x80, 0xac, 0x27, 0xc6, 0x8e, 0x20 },
+    { 0x24, 0x8c, 0xdb, 0x65, 0xd2, 0x85, 0x91, 0x3b, 0x54, 0x24, 0xef, 0xec, 0x92, 0x54, 0x79, 0xa1 },
+    { 0x07, 0xe6, 0xd4, 0x11, 0x47, 0xfc, 0xb2, 0x81, 0xb8, 0xd0, 0x23, 0x5a, 0xb4, 0x15, 0xb1, 0x1b },
+};
+
+static void test_get_cookie_packet(__u8 *packet)
+{
+    int i;
+
+    ts3init_test_client_header(packet, COMMAND_GET_COOKIE, TEST_CLIENT_VERSION);
+    for (i = TS3INIT_HEADER_CLIENT_LENGTH; i < TEST_GET_COOKIE_LENGTH; i++)
+        packet[i] = i;
+}
+
+static bool test_check_client_header(struct kunit *test, __u8 *packet,
+    unsigned int len, __u32 min_client_version)
+{
+    struct xt_action_param par = {};
+    struct ts3_init_checked_client_header_data header_data;
+    struct sk_buff *skb;
+    bool result;
+
+    skb = ts3init_test_skb_ipv4(test, &par, packet, len);
+    result = check_client_header(skb, &par, &header_data, min_client_version);
+    kfree_skb(skb);
+    return result;
+}
+
+static void ts3init_test_client_header_valid(struct kunit *test)
+{
+    __u8 packet[TEST_GET_COOKIE_LENGTH];
+
+    test_get_cookie_packet(packet);
+    KUNIT_EXPECT_TRUE(test, test_check_client_header(test, packet, sizeof(packet), 0));
+    KUNIT_EXPECT_TRUE(test, test_check_client_header(test, packet,
+        TS3INIT_HEADER_CLIENT_LENGTH, 0));
+}
+
+static void ts3init_test_client_header_invalid(struct kunit *test)
+{
+    __u8 packet[TEST_GET_COOKIE_LENGTH];
+
+    test_get_cookie_packet(packet);
+    KUNIT_EXPECT_FALSE(test, test_check_client_header(test, packet,
+        TS3INIT_HEADER_CLIENT_LENGTH - 1, 0));
+
+    test_get_cookie_packet(packet);
+    packet[7] = '2';
+    KUNIT_EXPECT_FALSE(test, test_check_client_header(test, packet, sizeof(packet), 0));
+
+    test_get_cookie_packet(packet);
+    packet[9] = 102;
+    KUNIT_EXPECT_FALSE(test, test_check_client_header(test, packet, sizeof(packet), 0));
+
+    test_get_cookie_packet(packet);
+    packet[11] = 1;
+    KUNIT_EXPECT_FALSE(test, test_check_client_header(test, packet, sizeof(packet), 0));
+
+    test_get_cookie_packet(packet);
+    packet[12] = 0x08;
+    KUNIT_EXPECT_FALSE(test, test_check_client_header(test, packet, sizeof(packet), 0));
+}
+
+static void ts3init_test_client_version(struct kunit *test)
+{
+    __u8 packet[TEST_GET_COOKIE_LENGTH];
+    __u32 version = TEST_CLIENT_VERSION - CLIENT_VERSION_OFFSET;
+
+    test_get_cookie_packet(packet);
+    KUNIT_EXPECT_TRUE(test, test_check_client_header(test, packet, sizeof(packet),
+        version));
+    KUNIT_EXPECT_FALSE(test, test_check_client_header(test, packet, sizeof(packet),
+        version + 1));
+
+    /* every byte of the version counts */
+    KUNIT_EXPECT_TRUE(test, test_check_client_header(test, packet, sizeof(packet),
+        version - 0x100));
+    KUNIT_EXPECT_FALSE(test, test_check_client_header(test, packet, sizeof(packet),
+        version + 0x100));
+    KUNIT_EXPECT_FALSE(test, test_check_client_header(test, packet, sizeof(packet),
+        version + 0x10000));
+}
+
+static void ts3init_test_get_payload(struct kunit *test)
+{
+    struct xt_action_param par = {};
+    struct ts3_init_checked_client_header_data header_data;
+    struct sk_buff *skb;
+    __u8 packet[TEST_GET_COOKIE_LENGTH], buf[17], *payload;
+
+    test_get_cookie_packet(packet);
+    skb = ts3init_test_skb_ipv4(test, &par, packet, sizeof(packet));
+    KUNIT_ASSERT_TRUE(test, check_client_header(skb, &par, &header_data, 0));
+
+    payload = get_payload(skb, &par, &header_data, buf, 16);
+    KUNIT_EXPECT_NOT_NULL(test, payload);
+    if (payload)
+        KUNIT_EXPECT_MEMEQ(test, payload, packet + TS3INIT_HEADER_CLIENT_LENGTH, 16);
+    KUNIT_EXPECT_NULL(test, get_payload(skb, &par, &header_data, buf, sizeof(buf)));
+    kfree_skb(skb);
+}
+
+static void ts3init_test_cookie_window(struct kunit *test)
+{
+    const time_t t = TS3INIT_TEST_TIME;
+
+    KUNIT_EXPECT_EQ(test, ts3init_cookie_window(t, 0), t);
+    KUNIT_EXPECT_EQ(test, ts3init_cookie_window(t, 3), t);
+    KUNIT_EXPECT_EQ(test, ts3init_cookie_window(t, 4), t - 4);
+    KUNIT_EXPECT_EQ(test, ts3init_cookie_window(t + 3, 7), t - 4);
+    KUNIT_EXPECT_EQ(test, ts3init_cookie_window(t + 4, 0), t);
+    KUNIT_EXPECT_EQ(test, ts3init_cookie_window(t + 4, 4), t + 4);
+    KUNIT_EXPECT_EQ(test, ts3init_cookie_window(t + 7, 2), t);
+}
+
+static void ts3init_test_cookie_seed(struct kunit *test)
+{
+    struct xt_ts3init_cookie_cache *cache;
+    __u8 random_seed[RANDOM_SEED_LEN];
+    __u64 *seed;
+    int i;
+
+    cache = kunit_kzalloc(test, sizeof(*cache), GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, cache);
+    ts3init_test_random_seed(random_seed);
+
+    for (i = 0; i < 8; i++)
+    {
+        seed = ts3init_get_cookie_seed(TS3INIT_TEST_TIME, i, cache, random_seed);
+        KUNIT_ASSERT_NOT_NULL(test, seed);
+        KUNIT_EXPECT_MEMEQ(test, seed, test_cookie_keys[i], SIP_KEY_SIZE);
+    }
+
+    /* later in the same windows, from the cache */
+    seed = ts3init_get_cookie_seed(TS3INIT_TEST_TIME + 3, 5, cache, random_seed);
+    KUNIT_ASSERT_NOT_NULL(test, seed);
+    KUNIT_EXPECT_MEMEQ(test, seed, test_cookie_keys[5], SIP_KEY_SIZE);
+
+    /* another random seed must not get the cached cookie seeds */
+    random_seed[0] ^= 1;
+    seed = ts3init_get_cookie_seed(TS3INIT_TEST_TIME, 1, cache, random_seed);
+    KUNIT_ASSERT_NOT_NULL(test, seed);
+    KUNIT_EXPECT_MEMNEQ(test, seed, test_cookie_keys[1], SIP_KEY_SIZE);
+
+    KUNIT_EXPECT_NULL(test, ts3init_get_cookie_seed(TS3INIT_TEST_TIME, 8, cache, random_seed));
+}
+
+static void ts3init_test_cookie_ipv4(struct kunit *test)
+{
+    struct iphdr ip = {};
+    struct udphdr udp = {};
+    __u64 cookie;
+
+    ip.saddr = htonl(TS3INIT_TEST_SADDR4);
+    ip.daddr = htonl(TS3INIT_TEST_DADDR4);
+    udp.source = htons(TS3INIT_TEST_SPORT);
+    udp.dest = htons(TS3INIT_TEST_DPORT);
+
+    KUNIT_EXPECT_EQ(test, ts3init_calculate_cookie_ipv4(&ip, &udp, TEST_K0, TEST_K1, &cookie), 0);
+    KUNIT_EXPECT_EQ(test, cookie, 0x8a2ec0dfe83a91d4ULL);
+}
+
+static void ts3init_test_cookie_ipv6(struct kunit *test)
+{
+    struct ipv6hdr ip = {};
+    struct udphdr udp = {};
+    __u64 cookie;
+
+    /* 2001:db8::1 and 2001:db8::2 */
+    ip.saddr.s6_addr32[0] = htonl(0x20010db8);
+    ip.saddr.s6_addr32[3] = htonl(1);
+    ip.daddr.s6_addr32[0] = htonl(0x20010db8);
+    ip.daddr.s6_addr32[3] = htonl(2);
+    udp.source = htons(TS3INIT_TEST_SPORT);
+    udp.dest = htons(TS3INIT_TEST_DPORT);
+
+    KUNIT_EXPECT_EQ(test, ts3init_calculate_cookie_ipv6(&ip, &udp, TEST_K0, TEST_K1, &cookie), 0);
+    KUNIT_EXPECT_EQ(test, cookie, 0xcb84efc16073f0ebULL);
+}
+
+/*
+ * Times the hot path of a valid get puzzle packet: the header check, the
+ * cached cookie seed lookup and the cookie. The results are printed, not
+ * checked, as they depend on the machine; compare them between builds.
+ */
+static void ts3init_test_bench_match(struct kunit *test)
+{
+    struct xt_action_param par = {};
+    struct ts3_init_checked_client_header_data header_data;
+    struct xt_ts3init_cookie_cache *cache;
+    struct sk_buff *skb;
+    __u8 packet[TEST_GET_COOKIE_LENGTH], random_seed[RANDOM_SEED_LEN];
+    __u64 cookie, sum = 0, *seed;
+    unsigned int i, valid = 0;
+    u64 start;
+
+    cache = kunit_kzalloc(test, sizeof(*cache), GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, cache);
+    ts3init_test_random_seed(random_seed);
+    test_get_cookie_packet(packet);
+    skb = ts3init_test_skb_ipv4(test, &par, packet, sizeof(packet));
+
+    start = ktime_get_ns();
+    for (i = 0; i < TS3INIT_TEST_BENCH_LOOPS; i++)
+        valid += check_client_header(skb, &par, &header_data, TEST_CLIENT_VERSION - CLIENT_VERSION_OFFSET);
+    ts3init_test_bench_report(test, "check_client_header", start, TS3INIT_TEST_BENCH_LOOPS);
+    KUNIT_EXPECT_EQ(test, valid, (unsigned int)TS3INIT_TEST_BENCH_LOOPS);
+
+    start = ktime_get_ns();
+    for (i = 0; i < TS3INIT_TEST_BENCH_LOOPS; i++)
+    {
+        seed = ts3init_get_cookie_seed(TS3INIT_TEST_TIME, i % 8, cache, random_seed);
+        sum += seed[0];
+    }
+    ts3init_test_bench_report(test, "ts3init_get_cookie_seed", start, TS3INIT_TEST_BENCH_LOOPS);
+
+    start = ktime_get_ns();
+    for (i = 0; i < TS3INIT_TEST_BENCH_LOOPS; i++)
+    {
+        ts3init_calculate_cookie_ipv4(ip_hdr(skb), header_data.udp, TEST_K0, i, &cookie);
+        sum += cookie;
+    }
+    ts3init_test_bench_report(test, "ts3init_calculate_cookie_ipv4", start, TS3INIT_TEST_BENCH_LOOPS);
+
+    /* keeps the loops from being optimized away */
+    kunit_info(test, "bench checksum %llx\n", sum);
+    kfree_skb(skb);
+}
+
+static struct kunit_case ts3init_match_test_cases[] =
+{
+    KUNIT_CASE(ts3init_test_client_header_valid),
+    KUNIT_CASE(ts3init_test_client_header_invalid),
+    KUNIT_CASE(ts3init_test_client_version),
+    KUNIT_CASE(ts3init_test_get_payload),
+    KUNIT_CASE(ts3init_test_cookie_window),
+    KUNIT_CASE(ts3init_test_cookie_seed),
+    KUNIT_CASE(ts3init_test_cookie_ipv4),
+    KUNIT_CASE(ts3init_test_cookie_ipv6),
+    KUNIT_CASE(ts3init_test_bench_match),
+    {}
+};
+
+static struct kunit_suite ts3init_match_test_suite =
+{
+    .name = "ts3init_match",
+    .test_cases = ts3init_match_test_cases,
+};
+
+kunit_test_suite(ts3init_match_test_suite);
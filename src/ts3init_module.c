@@ -25,10 +25,33 @@ void ts3init_match_exit(void);
 int ts3init_target_init(void) __init;
 void ts3init_target_exit(void);
 
+/* defined in ts3init_reply.c */
+int ts3init_reply_init(void) __init;
+void ts3init_reply_exit(void);
+
+/* defined in ts3init_cache.c */
+int ts3init_cache_init(void) __init;
+void ts3init_cache_exit(void);
+
+/* defined in ts3init_puzzle.c */
+int ts3init_puzzle_init(void) __init;
+
+/* defined in ts3init_net.c */
+int ts3init_net_init(void) __init;
+void ts3init_net_exit(void);
+
+/* defined in ts3init_netlink.c */
+int ts3init_netlink_init(void) __init;
+void ts3init_netlink_exit(void);
+
 /* defined in ts3init_cookie.c */
 int ts3init_cookie_init(void) __init;
 void ts3init_cookie_exit(void);
 
+/* defined in ts3init_profile.c */
+int ts3init_profile_init(void) __init;
+void ts3init_profile_exit(void);
+
 MODULE_AUTHOR("Niels Werensteijn <niels.werensteijn@teamspeak.com>");
 MODULE_DESCRIPTION("A module to aid in ts3 spoof protection");
 MODULE_LICENSE("GPL");
@@ -39,33 +62,72 @@ static int __init ts3init_init(void)
 {
     int error;
 
+    error = ts3init_profile_init();
+    if (error)
+        goto out0;
+
     error = ts3init_cookie_init();
     if (error)
         goto out1;
 
-    error = ts3init_match_init();
+    error = ts3init_cache_init();
     if (error)
         goto out2;
 
-    error = ts3init_target_init();
+    error = ts3init_puzzle_init();
+    if (error)
+        goto out3;
+
+    error = ts3init_net_init();
     if (error)
         goto out3;
 
+    error = ts3init_reply_init();
+    if (error)
+        goto out4;
+
+    error = ts3init_match_init();
+    if (error)
+        goto out5;
+
+    error = ts3init_target_init();
+    if (error)
+        goto out6;
+
+    error = ts3init_netlink_init();
+    if (error)
+        goto out7;
+
     return error;
 
-out3:
+out7:
+    ts3init_target_exit();
+out6:
     ts3init_match_exit();
+out5:
+    ts3init_reply_exit();
+out4:
+    ts3init_net_exit();
+out3:
+    ts3init_cache_exit();
 out2:
     ts3init_cookie_exit();
 out1:
+    ts3init_profile_exit();
+out0:
     return error;
 }
 
 static void __exit ts3init_exit(void)
 {
+    ts3init_netlink_exit();
     ts3init_target_exit();
     ts3init_match_exit();
+    ts3init_reply_exit();
+    ts3init_net_exit();
+    ts3init_cache_exit();
     ts3init_cookie_exit();
+    ts3init_profile_exit();
 }
 
 module_init(ts3init_init);
@@ -0,0 +1,106 @@
+/*
+ *    "ts3init" extension for Xtables
+ *
+ *    Description: A module to aid in ts3 spoof protection
+ *                 This is the "per network namespace state" related code
+ *
+ *    Authors:
+ *    Niels Werensteijn <niels werensteijn [at] teamspeak com>, 2016-10-03
+ *
+ *    This program is free software; you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License; either version 2
+ *    or 3 of the License, as published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/version.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/percpu.h>
+#include <linux/hashtable.h>
+#include <linux/rcupdate.h>
+#include <net/net_namespace.h>
+#include <net/netns/generic.h>
+#include "ts3init_random_seed.h"
+#include "ts3init_cookie.h"
+#include "ts3init_seed.h"
+#include "ts3init_port_table.h"
+#include "ts3init_puzzle.h"
+#include "ts3init_netlink.h"
+#include "ts3init_stats.h"
+#include "ts3init_adaptive.h"
+#include "ts3init_trusted.h"
+#include "ts3init_net.h"
+
+unsigned int ts3init_net_id __read_mostly;
+
+static void ts3init_net_free(struct ts3init_net *tn)
+{
+    int cpu;
+
+    if (tn->cookie_cache != NULL)
+    {
+        /* the cache holds values derived from the seeds */
+        for_each_possible_cpu(cpu)
+            memzero_explicit(per_cpu_ptr(tn->cookie_cache, cpu), sizeof(struct xt_ts3init_cookie_cache));
+        free_percpu(tn->cookie_cache);
+    }
+    free_percpu(tn->stats);
+    free_percpu(tn->adaptive);
+    free_percpu(tn->budget);
+}
+
+static int __net_init ts3init_net_ns_init(struct net *net)
+{
+    struct ts3init_net *tn = ts3init_pernet(net);
+
+    hash_init(tn->seeds);
+    hash_init(tn->port_tables);
+    tn->puzzles = NULL;
+    tn->cookie_cache = alloc_percpu(struct xt_ts3init_cookie_cache);
+    tn->stats = alloc_percpu(struct ts3init_stats);
+    tn->adaptive = alloc_percpu(struct ts3init_adaptive);
+    tn->budget = alloc_percpu(struct ts3init_budget);
+    if (tn->cookie_cache == NULL || tn->stats == NULL || tn->adaptive == NULL ||
+        tn->budget == NULL)
+    {
+        ts3init_net_free(tn);
+        return -ENOMEM;
+    }
+    ts3init_adaptive_net_init(tn);
+    ts3init_trusted_net_init(tn);
+    return 0;
+}
+
+static void __net_exit ts3init_net_ns_exit(struct net *net)
+{
+    struct ts3init_net *tn = ts3init_pernet(net);
+
+    /* port table entries hold references to seeds */
+    ts3init_port_table_net_exit(net);
+    ts3init_seed_net_exit(net);
+    ts3init_puzzle_net_exit(net);
+    ts3init_trusted_net_exit(net);
+    ts3init_net_free(tn);
+}
+
+static struct pernet_operations ts3init_net_ops =
+{
+    .init = ts3init_net_ns_init,
+    .exit = ts3init_net_ns_exit,
+    .id   = &ts3init_net_id,
+    .size = sizeof(struct ts3init_net),
+};
+
+int __init ts3init_net_init(void)
+{
+    return register_pernet_subsys(&ts3init_net_ops);
+}
+
+void ts3init_net_exit(void)
+{
+    unregister_pernet_subsys(&ts3init_net_ops);
+
+    /* wait for the rcu callbacks, they are part of this module */
+    rcu_barrier();
+}
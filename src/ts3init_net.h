@@ -0,0 +1,43 @@
+#ifndef _TS3INIT_NET_H
+#define _TS3INIT_NET_H
+
+struct xt_ts3init_cookie_cache;
+struct ts3init_puzzle_slot;
+struct ts3init_stats;
+struct ts3init_adaptive;
+struct ts3init_trusted_set;
+struct ts3init_budget;
+
+/*
+ * The state of the module in one network namespace. It is created with
+ * the namespace and released when the namespace goes away, so tenants
+ * in different namespaces share no seeds, caches or counters.
+ */
+struct ts3init_net
+{
+    /* seeds by id, see ts3init_seed.c */
+    DECLARE_HASHTABLE(seeds, 6);
+    /* port tables by id, see ts3init_port_table.c */
+    DECLARE_HASHTABLE(port_tables, 4);
+    /* puzzle pool, allocated when the first puzzle is added */
+    struct ts3init_puzzle_slot *puzzles;
+    /* cookie seeds of revision 0 rules */
+    struct xt_ts3init_cookie_cache __percpu *cookie_cache;
+    struct ts3init_stats __percpu *stats;
+    /* handshake rates and attack state of --adaptive rules, see ts3init_adaptive.c */
+    struct ts3init_adaptive __percpu *adaptive;
+    unsigned long attack_until;
+    int attacked;
+    /* trusted prefixes of ipv4 and ipv6, see ts3init_trusted.c */
+    struct ts3init_trusted_set __rcu *trusted[2];
+    struct ts3init_budget __percpu *budget;
+};
+
+extern unsigned int ts3init_net_id;
+
+static inline struct ts3init_net *ts3init_pernet(const struct net *net)
+{
+    return net_generic(net, ts3init_net_id);
+}
+
+#endif /* _TS3INIT_NET_H */
@@ -0,0 +1,547 @@
+/*
+ *    "ts3init" extension for Xtables
+ *
+ *    Description: A module to aid in ts3 spoof protection
+ *                 This is the "generic netlink interface" related code
+ *
+ *    Authors:
+ *    Niels Werensteijn <niels werensteijn [at] teamspeak com>, 2016-10-03
+ *
+ *    This program is free software; you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License; either version 2
+ *    or 3 of the License, as published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/version.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/skbuff.h>
+#include <linux/hashtable.h>
+#include <linux/in.h>
+#include <linux/in6.h>
+#include <linux/netfilter.h>
+#include <net/netlink.h>
+#include <net/genetlink.h>
+#include <net/net_namespace.h>
+#include <net/netns/generic.h>
+#include "ts3init_random_seed.h"
+#include "ts3init_header.h"
+#include "ts3init_puzzle.h"
+#include "ts3init_seed.h"
+#include "ts3init_port_table.h"
+#include "ts3init_match.h"
+#include "ts3init_reply.h"
+#include "ts3init_netlink.h"
+#include "ts3init_net.h"
+#include "ts3init_stats.h"
+#include "ts3init_trusted.h"
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 7, 0)
+#   define nla_put_u64_64bit(skb, type, value, padattr) nla_put_u64((skb), (type), (value))
+#endif
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 6, 0)
+#   define GENL_UNS_ADMIN_PERM GENL_ADMIN_PERM
+#endif
+
+enum
+{
+    TS3INIT_MCGRP_SEED
+};
+
+static struct genl_family ts3init_genl_family;
+
+static const struct nla_policy ts3init_genl_policy[TS3INIT_ATTR_MAX + 1] =
+{
+    [TS3INIT_ATTR_PUZZLE]   = { .type = NLA_BINARY, .len = TS3INIT_PUZZLE_LENGTH },
+    [TS3INIT_ATTR_SOLUTION] = { .type = NLA_BINARY, .len = TS3INIT_SOLUTION_LENGTH },
+    [TS3INIT_ATTR_SEED_ID]  = { .type = NLA_U32 },
+    [TS3INIT_ATTR_SEED]     = { .type = NLA_BINARY, .len = RANDOM_SEED_LEN },
+    [TS3INIT_ATTR_PARAM_XMIT_BATCH]      = { .type = NLA_U32 },
+    [TS3INIT_ATTR_PARAM_REPLY_POOL_SIZE] = { .type = NLA_U32 },
+    [TS3INIT_ATTR_PORT_TABLE_ID]  = { .type = NLA_U32 },
+    [TS3INIT_ATTR_PORT]           = { .type = NLA_U16 },
+    [TS3INIT_ATTR_MIN_CLIENT]     = { .type = NLA_U32 },
+    [TS3INIT_ATTR_MAX_UTC_OFFSET] = { .type = NLA_U32 },
+    [TS3INIT_ATTR_PREFIX]         = { .type = NLA_BINARY, .len = sizeof(struct in6_addr) },
+    [TS3INIT_ATTR_PREFIX_LEN]     = { .type = NLA_U8 },
+};
+
+/*
+ * Returns the attribute if it has exactly len bytes, or NULL.
+ */
+static inline const struct nlattr *
+ts3init_genl_attr(const struct genl_info *info, int type, int len)
+{
+    const struct nlattr *attr = info->attrs[type];
+
+    if (attr == NULL || nla_len(attr) != len)
+        return NULL;
+    return attr;
+}
+
+static int ts3init_genl_puzzle_add(struct sk_buff *skb, struct genl_info *info)
+{
+    const struct nlattr *puzzle, *solution;
+
+    puzzle = ts3init_genl_attr(info, TS3INIT_ATTR_PUZZLE, TS3INIT_PUZZLE_LENGTH);
+    solution = ts3init_genl_attr(info, TS3INIT_ATTR_SOLUTION, TS3INIT_SOLUTION_LENGTH);
+    if (puzzle == NULL || solution == NULL)
+        return -EINVAL;
+
+    return ts3init_puzzle_add(genl_info_net(info), nla_data(puzzle), nla_data(solution));
+}
+
+static int ts3init_genl_puzzle_flush(struct sk_buff *skb, struct genl_info *info)
+{
+    ts3init_puzzle_flush(genl_info_net(info));
+    return 0;
+}
+
+/*
+ * Tells the listeners of the seed group that a seed was added,
+ * replaced or removed. The seed itself is never sent.
+ */
+static void ts3init_genl_seed_notify(struct net *net, u8 cmd, u32 id)
+{
+    struct sk_buff *msg;
+    void *hdr;
+
+    msg = genlmsg_new(nla_total_size(sizeof(u32)), GFP_KERNEL);
+    if (msg == NULL)
+        return;
+
+    hdr = genlmsg_put(msg, 0, 0, &ts3init_genl_family, 0, cmd);
+    if (hdr == NULL || nla_put_u32(msg, TS3INIT_ATTR_SEED_ID, id))
+    {
+        nlmsg_free(msg);
+        return;
+    }
+    genlmsg_end(msg, hdr);
+    genlmsg_multicast_netns(&ts3init_genl_family, net, msg, 0, TS3INIT_MCGRP_SEED, GFP_KERNEL);
+}
+
+static int ts3init_genl_seed_set(struct sk_buff *skb, struct genl_info *info)
+{
+    const struct nlattr *id, *seed;
+    struct net *net = genl_info_net(info);
+    u8 cmd = info->genlhdr->cmd;
+    int error;
+
+    id = ts3init_genl_attr(info, TS3INIT_ATTR_SEED_ID, sizeof(u32));
+    seed = ts3init_genl_attr(info, TS3INIT_ATTR_SEED, RANDOM_SEED_LEN);
+    if (id == NULL || seed == NULL)
+        return -EINVAL;
+
+    if (cmd == TS3INIT_CMD_SEED_ADD)
+        error = ts3init_seed_add(net, nla_get_u32(id), nla_data(seed));
+    else
+        error = ts3init_seed_replace(net, nla_get_u32(id), nla_data(seed));
+
+    if (error == 0)
+        ts3init_genl_seed_notify(net, cmd, nla_get_u32(id));
+    return error;
+}
+
+static int ts3init_genl_seed_remove(struct sk_buff *skb, struct genl_info *info)
+{
+    const struct nlattr *id;
+    int error;
+
+    id = ts3init_genl_attr(info, TS3INIT_ATTR_SEED_ID, sizeof(u32));
+    if (id == NULL)
+        return -EINVAL;
+
+    error = ts3init_seed_remove(genl_info_net(info), nla_get_u32(id));
+    if (error == 0)
+        ts3init_genl_seed_notify(genl_info_net(info), TS3INIT_CMD_SEED_REMOVE, nla_get_u32(id));
+    return error;
+}
+
+static int ts3init_genl_port_table_change(struct sk_buff *skb, struct genl_info *info)
+{
+    const struct nlattr *id;
+
+    id = ts3init_genl_attr(info, TS3INIT_ATTR_PORT_TABLE_ID, sizeof(u32));
+    if (id == NULL)
+        return -EINVAL;
+
+    if (info->genlhdr->cmd == TS3INIT_CMD_PORT_TABLE_ADD)
+        return ts3init_port_table_add(genl_info_net(info), nla_get_u32(id));
+    else
+        return ts3init_port_table_remove(genl_info_net(info), nla_get_u32(id));
+}
+
+static int ts3init_genl_port_set(struct sk_buff *skb, struct genl_info *info)
+{
+    const struct nlattr *id, *port, *attr;
+    u32 seed_id = 0, min_client_version = 0, max_utc_offset = 0;
+    u8 options = 0;
+
+    id = ts3init_genl_attr(info, TS3INIT_ATTR_PORT_TABLE_ID, sizeof(u32));
+    port = ts3init_genl_attr(info, TS3INIT_ATTR_PORT, sizeof(u16));
+    if (id == NULL || port == NULL)
+        return -EINVAL;
+
+    attr = info->attrs[TS3INIT_ATTR_SEED_ID];
+    if (attr != NULL)
+    {
+        options |= TS3INIT_PORT_SEED;
+        seed_id = nla_get_u32(attr);
+    }
+
+    attr = info->attrs[TS3INIT_ATTR_MIN_CLIENT];
+    if (attr != NULL && nla_get_u32(attr) != 0)
+    {
+        if (nla_get_u32(attr) <= CLIENT_VERSION_OFFSET)
+            return -EINVAL;
+        min_client_version = nla_get_u32(attr) - CLIENT_VERSION_OFFSET;
+    }
+
+    attr = info->attrs[TS3INIT_ATTR_MAX_UTC_OFFSET];
+    if (attr != NULL)
+    {
+        options |= TS3INIT_PORT_CHECK_TIME;
+        max_utc_offset = nla_get_u32(attr);
+    }
+
+    return ts3init_port_table_set(genl_info_net(info), nla_get_u32(id), nla_get_u16(port),
+                                  options, seed_id, min_client_version, max_utc_offset);
+}
+
+static int ts3init_genl_port_clear(struct sk_buff *skb, struct genl_info *info)
+{
+    const struct nlattr *id, *port;
+
+    id = ts3init_genl_attr(info, TS3INIT_ATTR_PORT_TABLE_ID, sizeof(u32));
+    port = ts3init_genl_attr(info, TS3INIT_ATTR_PORT, sizeof(u16));
+    if (id == NULL || port == NULL)
+        return -EINVAL;
+
+    return ts3init_port_table_clear(genl_info_net(info), nla_get_u32(id), nla_get_u16(port));
+}
+
+/*
+ * Adds or removes the prefixes of the message in one change of the set.
+ * Each TS3INIT_ATTR_PREFIX is followed by its TS3INIT_ATTR_PREFIX_LEN,
+ * and all prefixes of a message are of one family.
+ */
+static int ts3init_genl_trusted_change(struct sk_buff *skb, struct genl_info *info)
+{
+    struct ts3init_trusted_prefix *prefixes;
+    const struct nlattr *attr, *prefix = NULL;
+    unsigned int count = 0;
+    u8 family = NFPROTO_UNSPEC;
+    int rem, error = 0;
+
+    nlmsg_for_each_attr(attr, info->nlhdr, GENL_HDRLEN, rem)
+    {
+        if (nla_type(attr) == TS3INIT_ATTR_PREFIX)
+            ++count;
+    }
+    if (count == 0)
+        return -EINVAL;
+    if (count > TS3INIT_TRUSTED_MAX_PREFIXES)
+        return -ENOSPC;
+
+    prefixes = ts3init_trusted_prefixes_alloc(count);
+    if (prefixes == NULL)
+        return -ENOMEM;
+
+    count = 0;
+    nlmsg_for_each_attr(attr, info->nlhdr, GENL_HDRLEN, rem)
+    {
+        if (nla_type(attr) == TS3INIT_ATTR_PREFIX)
+        {
+            u8 prefix_family;
+
+            /* the length of the address tells the family */
+            if (nla_len(attr) == sizeof(struct in_addr))
+                prefix_family = NFPROTO_IPV4;
+            else if (nla_len(attr) == sizeof(struct in6_addr))
+                prefix_family = NFPROTO_IPV6;
+            else
+                prefix_family = NFPROTO_UNSPEC;
+
+            if (prefix != NULL || prefix_family == NFPROTO_UNSPEC ||
+                (family != NFPROTO_UNSPEC && prefix_family != family))
+            {
+                error = -EINVAL;
+                break;
+            }
+            family = prefix_family;
+            prefix = attr;
+        }
+        else if (nla_type(attr) == TS3INIT_ATTR_PREFIX_LEN)
+        {
+            if (prefix == NULL || nla_len(attr) != sizeof(u8))
+            {
+                error = -EINVAL;
+                break;
+            }
+            error = ts3init_trusted_prefix_init(family, nla_data(prefix), nla_get_u8(attr),
+                                                &prefixes[count++]);
+            if (error)
+                break;
+            prefix = NULL;
+        }
+    }
+    if (error == 0 && prefix != NULL)
+        error = -EINVAL;
+
+    if (error == 0)
+    {
+        if (info->genlhdr->cmd == TS3INIT_CMD_TRUSTED_ADD)
+            error = ts3init_trusted_add(genl_info_net(info), family, prefixes, count);
+        else
+            error = ts3init_trusted_remove(genl_info_net(info), family, prefixes, count);
+    }
+    kvfree(prefixes);
+    return error;
+}
+
+static int ts3init_genl_trusted_flush(struct sk_buff *skb, struct genl_info *info)
+{
+    ts3init_trusted_flush(genl_info_net(info));
+    return 0;
+}
+
+static int ts3init_genl_param_set(struct sk_buff *skb, struct genl_info *info)
+{
+    const struct nlattr *attr;
+
+    /* the reply pools are shared by all namespaces */
+    if (!net_eq(genl_info_net(info), &init_net))
+        return -EPERM;
+
+    attr = info->attrs[TS3INIT_ATTR_PARAM_XMIT_BATCH];
+    if (attr != NULL)
+        ts3init_reply_set_xmit_batch(nla_get_u32(attr));
+
+    attr = info->attrs[TS3INIT_ATTR_PARAM_REPLY_POOL_SIZE];
+    if (attr != NULL)
+        ts3init_reply_set_pool_size(nla_get_u32(attr));
+
+    return 0;
+}
+
+static int ts3init_genl_param_get(struct sk_buff *skb, struct genl_info *info)
+{
+    struct sk_buff *msg;
+    void *hdr;
+
+    msg = genlmsg_new(2 * nla_total_size(sizeof(u32)), GFP_KERNEL);
+    if (msg == NULL)
+        return -ENOMEM;
+
+    hdr = genlmsg_put_reply(msg, info, &ts3init_genl_family, 0, TS3INIT_CMD_PARAM_GET);
+    if (hdr == NULL ||
+        nla_put_u32(msg, TS3INIT_ATTR_PARAM_XMIT_BATCH, ts3init_reply_get_xmit_batch()) ||
+        nla_put_u32(msg, TS3INIT_ATTR_PARAM_REPLY_POOL_SIZE, ts3init_reply_get_pool_size()))
+    {
+        nlmsg_free(msg);
+        return -EMSGSIZE;
+    }
+    genlmsg_end(msg, hdr);
+    return genlmsg_reply(msg, info);
+}
+
+static int ts3init_genl_put_stats(struct sk_buff *skb, struct netlink_callback *cb, int cpu)
+{
+    const struct ts3init_stats *stats = per_cpu_ptr(ts3init_pernet(sock_net(skb->sk))->stats, cpu);
+    struct nlattr *nest;
+    void *hdr;
+    int i;
+
+    hdr = genlmsg_put(skb, NETLINK_CB(cb->skb).portid, cb->nlh->nlmsg_seq,
+                      &ts3init_genl_family, NLM_F_MULTI, TS3INIT_CMD_STATS_GET);
+    if (hdr == NULL)
+        return -EMSGSIZE;
+
+    if (nla_put_u32(skb, TS3INIT_ATTR_CPU, cpu))
+        goto cancel;
+
+    nest = nla_nest_start(skb, TS3INIT_ATTR_STATS);
+    if (nest == NULL)
+        goto cancel;
+    for (i = TS3INIT_STAT_PAD + 1; i < __TS3INIT_STAT_MAX; ++i)
+    {
+        if (nla_put_u64_64bit(skb, i, READ_ONCE(stats->counters[i]), TS3INIT_STAT_PAD))
+            goto cancel;
+    }
+    nla_nest_end(skb, nest);
+
+    genlmsg_end(skb, hdr);
+    return 0;
+
+cancel:
+    genlmsg_cancel(skb, hdr);
+    return -EMSGSIZE;
+}
+
+static int ts3init_genl_stats_dump(struct sk_buff *skb, struct netlink_callback *cb)
+{
+    int cpu;
+
+    for (cpu = cb->args[0]; cpu < nr_cpu_ids; ++cpu)
+    {
+        if (!cpu_possible(cpu))
+            continue;
+        if (ts3init_genl_put_stats(skb, cb, cpu) < 0)
+            break;
+    }
+    cb->args[0] = cpu;
+    return skb->len;
+}
+
+/*
+ * The attribute policy is set per op before 5.2 and on the family since.
+ */
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 2, 0)
+#   define TS3INIT_GENL_OP_POLICY .policy = ts3init_genl_policy,
+#else
+#   define TS3INIT_GENL_OP_POLICY
+#endif
+
+/*
+ * Commands on the state of a namespace need CAP_NET_ADMIN in the user
+ * namespace that owns it. The module parameters are global and need it
+ * in the initial one.
+ */
+static const struct genl_ops ts3init_genl_ops[] =
+{
+    {
+        .cmd    = TS3INIT_CMD_PUZZLE_ADD,
+        .doit   = ts3init_genl_puzzle_add,
+        TS3INIT_GENL_OP_POLICY
+        .flags  = GENL_UNS_ADMIN_PERM,
+    },
+    {
+        .cmd    = TS3INIT_CMD_PUZZLE_FLUSH,
+        .doit   = ts3init_genl_puzzle_flush,
+        TS3INIT_GENL_OP_POLICY
+        .flags  = GENL_UNS_ADMIN_PERM,
+    },
+    {
+        .cmd    = TS3INIT_CMD_SEED_ADD,
+        .doit   = ts3init_genl_seed_set,
+        TS3INIT_GENL_OP_POLICY
+        .flags  = GENL_UNS_ADMIN_PERM,
+    },
+    {
+        .cmd    = TS3INIT_CMD_SEED_REPLACE,
+        .doit   = ts3init_genl_seed_set,
+        TS3INIT_GENL_OP_POLICY
+        .flags  = GENL_UNS_ADMIN_PERM,
+    },
+    {
+        .cmd    = TS3INIT_CMD_SEED_REMOVE,
+        .doit   = ts3init_genl_seed_remove,
+        TS3INIT_GENL_OP_POLICY
+        .flags  = GENL_UNS_ADMIN_PERM,
+    },
+    {
+        .cmd    = TS3INIT_CMD_PARAM_SET,
+        .doit   = ts3init_genl_param_set,
+        TS3INIT_GENL_OP_POLICY
+        .flags  = GENL_ADMIN_PERM,
+    },
+    {
+        .cmd    = TS3INIT_CMD_PARAM_GET,
+        .doit   = ts3init_genl_param_get,
+        TS3INIT_GENL_OP_POLICY
+        .flags  = GENL_ADMIN_PERM,
+    },
+    {
+        .cmd    = TS3INIT_CMD_STATS_GET,
+        .dumpit = ts3init_genl_stats_dump,
+        TS3INIT_GENL_OP_POLICY
+        .flags  = GENL_UNS_ADMIN_PERM,
+    },
+    {
+        .cmd    = TS3INIT_CMD_PORT_TABLE_ADD,
+        .doit   = ts3init_genl_port_table_change,
+        TS3INIT_GENL_OP_POLICY
+        .flags  = GENL_UNS_ADMIN_PERM,
+    },
+    {
+        .cmd    = TS3INIT_CMD_PORT_TABLE_REMOVE,
+        .doit   = ts3init_genl_port_table_change,
+        TS3INIT_GENL_OP_POLICY
+        .flags  = GENL_UNS_ADMIN_PERM,
+    },
+    {
+        .cmd    = TS3INIT_CMD_PORT_SET,
+        .doit   = ts3init_genl_port_set,
+        TS3INIT_GENL_OP_POLICY
+        .flags  = GENL_UNS_ADMIN_PERM,
+    },
+    {
+        .cmd    = TS3INIT_CMD_PORT_CLEAR,
+        .doit   = ts3init_genl_port_clear,
+        TS3INIT_GENL_OP_POLICY
+        .flags  = GENL_UNS_ADMIN_PERM,
+    },
+    {
+        .cmd    = TS3INIT_CMD_TRUSTED_ADD,
+        .doit   = ts3init_genl_trusted_change,
+        TS3INIT_GENL_OP_POLICY
+        .flags  = GENL_UNS_ADMIN_PERM,
+    },
+    {
+        .cmd    = TS3INIT_CMD_TRUSTED_REMOVE,
+        .doit   = ts3init_genl_trusted_change,
+        TS3INIT_GENL_OP_POLICY
+        .flags  = GENL_UNS_ADMIN_PERM,
+    },
+    {
+        .cmd    = TS3INIT_CMD_TRUSTED_FLUSH,
+        .doit   = ts3init_genl_trusted_flush,
+        TS3INIT_GENL_OP_POLICY
+        .flags  = GENL_UNS_ADMIN_PERM,
+    },
+};
+
+static const struct genl_multicast_group ts3init_genl_mcgrps[] =
+{
+    [TS3INIT_MCGRP_SEED] = { .name = TS3INIT_GENL_MCGRP_SEED },
+};
+
+static struct genl_family ts3init_genl_family =
+{
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 10, 0)
+    .id        = GENL_ID_GENERATE,
+#endif
+    .name      = TS3INIT_GENL_NAME,
+    .version   = TS3INIT_GENL_VERSION,
+    .maxattr   = TS3INIT_ATTR_MAX,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 2, 0)
+    .policy    = ts3init_genl_policy,
+#endif
+    .netnsok   = true,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 10, 0)
+    .module    = THIS_MODULE,
+    .ops       = ts3init_genl_ops,
+    .n_ops     = ARRAY_SIZE(ts3init_genl_ops),
+    .mcgrps    = ts3init_genl_mcgrps,
+    .n_mcgrps  = ARRAY_SIZE(ts3init_genl_mcgrps),
+#endif
+};
+
+int __init ts3init_netlink_init(void)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 10, 0)
+    return genl_register_family(&ts3init_genl_family);
+#else
+    return genl_register_family_with_ops_groups(&ts3init_genl_family, ts3init_genl_ops,
+                                                ts3init_genl_mcgrps);
+#endif
+}
+
+void ts3init_netlink_exit(void)
+{
+    genl_unregister_family(&ts3init_genl_family);
+}
@@ -0,0 +1,99 @@
+#ifndef _TS3INIT_NETLINK_H
+#define _TS3INIT_NETLINK_H
+
+/*
+ * The generic netlink family used to configure the module at runtime.
+ * All commands require CAP_NET_ADMIN, in the user namespace that owns the
+ * network namespace, or in the initial one for TS3INIT_CMD_PARAM_*.
+ */
+#define TS3INIT_GENL_NAME    "ts3init"
+#define TS3INIT_GENL_VERSION 1
+
+/* Multicast group for seed notifications (TS3INIT_CMD_SEED_*) */
+#define TS3INIT_GENL_MCGRP_SEED "seed"
+
+enum
+{
+    TS3INIT_CMD_UNSPEC,
+    TS3INIT_CMD_PUZZLE_ADD,     /* TS3INIT_ATTR_PUZZLE, TS3INIT_ATTR_SOLUTION */
+    TS3INIT_CMD_PUZZLE_FLUSH,
+    TS3INIT_CMD_SEED_ADD,       /* TS3INIT_ATTR_SEED_ID, TS3INIT_ATTR_SEED */
+    TS3INIT_CMD_SEED_REPLACE,   /* TS3INIT_ATTR_SEED_ID, TS3INIT_ATTR_SEED */
+    TS3INIT_CMD_SEED_REMOVE,    /* TS3INIT_ATTR_SEED_ID */
+    TS3INIT_CMD_PARAM_SET,      /* any of TS3INIT_ATTR_PARAM_* */
+    TS3INIT_CMD_PARAM_GET,      /* replies with all TS3INIT_ATTR_PARAM_* */
+    TS3INIT_CMD_STATS_GET,      /* dump, one message per cpu */
+    TS3INIT_CMD_PORT_TABLE_ADD,     /* TS3INIT_ATTR_PORT_TABLE_ID */
+    TS3INIT_CMD_PORT_TABLE_REMOVE,  /* TS3INIT_ATTR_PORT_TABLE_ID */
+    TS3INIT_CMD_PORT_SET,       /* TS3INIT_ATTR_PORT_TABLE_ID, TS3INIT_ATTR_PORT,
+                                   optional TS3INIT_ATTR_SEED_ID,
+                                   TS3INIT_ATTR_MIN_CLIENT and
+                                   TS3INIT_ATTR_MAX_UTC_OFFSET */
+    TS3INIT_CMD_PORT_CLEAR,     /* TS3INIT_ATTR_PORT_TABLE_ID, TS3INIT_ATTR_PORT */
+    TS3INIT_CMD_TRUSTED_ADD,    /* TS3INIT_ATTR_PREFIX, TS3INIT_ATTR_PREFIX_LEN,
+                                   repeated for each prefix of one family */
+    TS3INIT_CMD_TRUSTED_REMOVE, /* as TS3INIT_CMD_TRUSTED_ADD */
+    TS3INIT_CMD_TRUSTED_FLUSH,
+    __TS3INIT_CMD_MAX
+};
+#define TS3INIT_CMD_MAX (__TS3INIT_CMD_MAX - 1)
+
+enum
+{
+    TS3INIT_ATTR_UNSPEC,
+    TS3INIT_ATTR_PUZZLE,            /* binary, TS3INIT_PUZZLE_LENGTH bytes */
+    TS3INIT_ATTR_SOLUTION,          /* binary, TS3INIT_SOLUTION_LENGTH bytes */
+    TS3INIT_ATTR_SEED_ID,           /* u32 */
+    TS3INIT_ATTR_SEED,              /* binary, RANDOM_SEED_LEN bytes */
+    TS3INIT_ATTR_PARAM_XMIT_BATCH,  /* u32 */
+    TS3INIT_ATTR_PARAM_REPLY_POOL_SIZE, /* u32 */
+    TS3INIT_ATTR_CPU,               /* u32 */
+    TS3INIT_ATTR_STATS,             /* nested, TS3INIT_STAT_* as u64 */
+    TS3INIT_ATTR_PORT_TABLE_ID,     /* u32 */
+    TS3INIT_ATTR_PORT,              /* u16, host byte order */
+    TS3INIT_ATTR_MIN_CLIENT,        /* u32, client version as for --min-client */
+    TS3INIT_ATTR_MAX_UTC_OFFSET,    /* u32, seconds as for --check-time */
+    TS3INIT_ATTR_PREFIX,            /* binary, 4 bytes of ipv4 or 16 of ipv6 */
+    TS3INIT_ATTR_PREFIX_LEN,        /* u8, bits */
+    __TS3INIT_ATTR_MAX
+};
+#define TS3INIT_ATTR_MAX (__TS3INIT_ATTR_MAX - 1)
+
+/*
+ * Counters kept per cpu, dumped in TS3INIT_ATTR_STATS.
+ */
+enum
+{
+    TS3INIT_STAT_UNSPEC,
+    TS3INIT_STAT_PAD,
+    TS3INIT_STAT_REPLY_XMIT,            /* replies sent through the output path */
+    TS3INIT_STAT_REPLY_DIRECT_XMIT,     /* replies sent with --direct-xmit */
+    TS3INIT_STAT_REPLY_ALLOC_FAILED,
+    TS3INIT_STAT_TIME_INVALID,          /* get_cookie --check-time failed */
+    TS3INIT_STAT_COOKIE_VALID,          /* get_puzzle --check-cookie passed */
+    TS3INIT_STAT_COOKIE_INVALID,
+    TS3INIT_STAT_PUZZLE_POOL_EMPTY,
+    TS3INIT_STAT_PUZZLE_SOLVED,
+    TS3INIT_STAT_PUZZLE_INVALID,
+    TS3INIT_STAT_COOKIE_SKEW_AHEAD,     /* cookie valid only for a clock that is ahead */
+    TS3INIT_STAT_COOKIE_SKEW_BEHIND,    /* cookie valid only for a clock that is behind */
+    TS3INIT_STAT_SHADOW_EVALUATED,      /* packets checked by --shadow rules */
+    TS3INIT_STAT_SHADOW_MATCHED,        /* ... that would have matched, or been replied to */
+    TS3INIT_STAT_SHADOW_HEADER,         /* ... that are not the packet the rule is for */
+    TS3INIT_STAT_SHADOW_CLIENT_VERSION, /* ... that failed --min-client */
+    TS3INIT_STAT_SHADOW_PORT,           /* ... that failed the entry of --port-table */
+    TS3INIT_STAT_SHADOW_TIME,           /* ... that failed --check-time */
+    TS3INIT_STAT_SHADOW_COOKIE,         /* ... that failed --check-cookie, or had no seed */
+    TS3INIT_STAT_SHADOW_PUZZLE,         /* ... with a wrong solution, or an empty pool */
+    TS3INIT_STAT_SHADOW_NS,             /* nanoseconds spent in --shadow rules */
+    TS3INIT_STAT_ATTACK_ENTERED,        /* switches of --adaptive rules to their attack profile */
+    TS3INIT_STAT_ATTACK_LEFT,           /* ... and back */
+    TS3INIT_STAT_BUDGET_TRUSTED,        /* TS3INIT_SET_COOKIE replies to trusted sources beyond reply_budget */
+    TS3INIT_STAT_BUDGET_SHED,           /* TS3INIT_SET_COOKIE replies dropped over reply_budget */
+    TS3INIT_STAT_COOKIE_REPLAYED,       /* get_puzzle --reject-replay saw the cookie before, retransmits included */
+    TS3INIT_STAT_SHADOW_REPLAY,         /* packets --shadow rules would have dropped for --reject-replay */
+    __TS3INIT_STAT_MAX
+};
+#define TS3INIT_STAT_MAX (__TS3INIT_STAT_MAX - 1)
+
+#endif /* _TS3INIT_NETLINK_H */
@@ -0,0 +1,234 @@
+/*
+ *    "ts3init" extension for Xtables
+ *
+ *    Description: A module to aid in ts3 spoof protection
+ *                 This is the "per port settings of ts3 instances" related code
+ *
+ *    Authors:
+ *    Niels Werensteijn <niels werensteijn [at] teamspeak com>, 2016-10-03
+ *
+ *    This program is free software; you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License; either version 2
+ *    or 3 of the License, as published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/version.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/hashtable.h>
+#include <linux/rcupdate.h>
+#include <net/net_namespace.h>
+#include <net/netns/generic.h>
+#include "ts3init_random_seed.h"
+#include "ts3init_seed.h"
+#include "ts3init_port_table.h"
+#include "ts3init_net.h"
+
+/*
+ * The tables of a namespace are in ts3init_net.port_tables. They are
+ * changed under ts3init_port_table_mutex, and read under rcu.
+ */
+static DEFINE_MUTEX(ts3init_port_table_mutex);
+
+static struct ts3init_port_table *ts3init_port_table_find(struct net *net, u32 id)
+{
+    struct ts3init_port_table *table;
+
+    hash_for_each_possible(ts3init_pernet(net)->port_tables, table, node, id)
+    {
+        if (table->id == id)
+            return table;
+    }
+    return NULL;
+}
+
+static void ts3init_port_entry_free(struct ts3init_port_entry *entry)
+{
+    if (entry == NULL)
+        return;
+    if (entry->seed != NULL)
+        ts3init_seed_put(entry->seed);
+    kfree_rcu(entry, rcu);
+}
+
+static void ts3init_port_table_free(struct ts3init_port_table *table)
+{
+    int i, j;
+
+    for (i = 0; i < ARRAY_SIZE(table->chunks); ++i)
+    {
+        struct ts3init_port_chunk *chunk = rcu_dereference_protected(table->chunks[i], true);
+
+        if (chunk == NULL)
+            continue;
+        for (j = 0; j < ARRAY_SIZE(chunk->entries); ++j)
+            ts3init_port_entry_free(rcu_dereference_protected(chunk->entries[j], true));
+        kfree_rcu(chunk, rcu);
+    }
+    kfree_rcu(table, rcu);
+}
+
+int ts3init_port_table_add(struct net *net, u32 id)
+{
+    struct ts3init_port_table *table;
+    int error = 0;
+
+    table = kzalloc(sizeof(*table), GFP_KERNEL);
+    if (table == NULL)
+        return -ENOMEM;
+    table->id = id;
+
+    mutex_lock(&ts3init_port_table_mutex);
+    if (ts3init_port_table_find(net, id) != NULL)
+        error = -EEXIST;
+    else
+        hash_add_rcu(ts3init_pernet(net)->port_tables, &table->node, id);
+    mutex_unlock(&ts3init_port_table_mutex);
+
+    if (error)
+        kfree(table);
+    return error;
+}
+
+int ts3init_port_table_remove(struct net *net, u32 id)
+{
+    struct ts3init_port_table *table;
+    int error = 0;
+
+    mutex_lock(&ts3init_port_table_mutex);
+    table = ts3init_port_table_find(net, id);
+    if (table == NULL)
+        error = -ENOENT;
+    else if (table->users != 0)
+        error = -EBUSY;
+    else
+    {
+        hash_del_rcu(&table->node);
+        ts3init_port_table_free(table);
+    }
+    mutex_unlock(&ts3init_port_table_mutex);
+    return error;
+}
+
+/*
+ * Replaces the entry for port with entry, which may be NULL.
+ * Must be called with ts3init_port_table_mutex held.
+ */
+static int ts3init_port_table_swap(struct net *net, u32 id, u16 port,
+                                   struct ts3init_port_entry *entry)
+{
+    struct ts3init_port_table *table;
+    struct ts3init_port_chunk *chunk;
+    struct ts3init_port_entry *old_entry;
+
+    table = ts3init_port_table_find(net, id);
+    if (table == NULL)
+        return -ENOENT;
+
+    chunk = rcu_dereference_protected(table->chunks[port >> 8],
+                                      lockdep_is_held(&ts3init_port_table_mutex));
+    if (chunk == NULL)
+    {
+        if (entry == NULL)
+            return -ENOENT;
+        chunk = kzalloc(sizeof(*chunk), GFP_KERNEL);
+        if (chunk == NULL)
+            return -ENOMEM;
+        rcu_assign_pointer(table->chunks[port >> 8], chunk);
+    }
+
+    old_entry = rcu_dereference_protected(chunk->entries[port & 0xff],
+                                          lockdep_is_held(&ts3init_port_table_mutex));
+    if (old_entry == NULL && entry == NULL)
+        return -ENOENT;
+    rcu_assign_pointer(chunk->entries[port & 0xff], entry);
+    ts3init_port_entry_free(old_entry);
+    return 0;
+}
+
+int ts3init_port_table_set(struct net *net, u32 id, u16 port, u8 options, u32 seed_id,
+                           u32 min_client_version, u32 max_utc_offset)
+{
+    struct ts3init_port_entry *entry;
+    int error;
+
+    entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+    if (entry == NULL)
+        return -ENOMEM;
+    entry->options = options;
+    entry->min_client_version = min_client_version;
+    entry->max_utc_offset = max_utc_offset;
+
+    if (options & TS3INIT_PORT_SEED)
+    {
+        entry->seed = ts3init_seed_get(net, seed_id);
+        if (entry->seed == NULL)
+        {
+            kfree(entry);
+            return -ENOENT;
+        }
+    }
+
+    mutex_lock(&ts3init_port_table_mutex);
+    error = ts3init_port_table_swap(net, id, port, entry);
+    mutex_unlock(&ts3init_port_table_mutex);
+
+    if (error)
+    {
+        if (entry->seed != NULL)
+            ts3init_seed_put(entry->seed);
+        kfree(entry);
+    }
+    return error;
+}
+
+int ts3init_port_table_clear(struct net *net, u32 id, u16 port)
+{
+    int error;
+
+    mutex_lock(&ts3init_port_table_mutex);
+    error = ts3init_port_table_swap(net, id, port, NULL);
+    mutex_unlock(&ts3init_port_table_mutex);
+    return error;
+}
+
+struct ts3init_port_table *ts3init_port_table_get(struct net *net, u32 id)
+{
+    struct ts3init_port_table *table;
+
+    mutex_lock(&ts3init_port_table_mutex);
+    table = ts3init_port_table_find(net, id);
+    if (table != NULL)
+        ++table->users;
+    mutex_unlock(&ts3init_port_table_mutex);
+    return table;
+}
+
+void ts3init_port_table_put(struct ts3init_port_table *table)
+{
+    mutex_lock(&ts3init_port_table_mutex);
+    /* the namespace of a removed table went away before its last user */
+    if (--table->users == 0 && hlist_unhashed(&table->node))
+        ts3init_port_table_free(table);
+    mutex_unlock(&ts3init_port_table_mutex);
+}
+
+void ts3init_port_table_net_exit(struct net *net)
+{
+    struct ts3init_port_table *table;
+    struct hlist_node *tmp;
+    int bkt;
+
+    mutex_lock(&ts3init_port_table_mutex);
+    hash_for_each_safe(ts3init_pernet(net)->port_tables, bkt, tmp, table, node)
+    {
+        hash_del_rcu(&table->node);
+        /* tables in use are freed by ts3init_port_table_put() */
+        if (table->users == 0)
+            ts3init_port_table_free(table);
+    }
+    mutex_unlock(&ts3init_port_table_mutex);
+}
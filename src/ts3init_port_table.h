@@ -0,0 +1,99 @@
+#ifndef _TS3INIT_PORT_TABLE_H
+#define _TS3INIT_PORT_TABLE_H
+
+struct ts3init_seed;
+
+/* Options of a port table entry */
+enum
+{
+    TS3INIT_PORT_SEED       = 1 << 0,
+    TS3INIT_PORT_CHECK_TIME = 1 << 1,
+};
+
+/*
+ * The settings of one ts3 server instance, identified by its udp port.
+ * min_client_version is relative to CLIENT_VERSION_OFFSET, 0 accepts
+ * any client.
+ */
+struct ts3init_port_entry
+{
+    struct rcu_head         rcu;
+    struct ts3init_seed    *seed;
+    __u32                   min_client_version;
+    __u32                   max_utc_offset;
+    __u8                    options;
+};
+
+/*
+ * Ports are looked up in two levels of 256 entries each. The second
+ * level is only allocated for port ranges that are in use, so a table
+ * with a few hundred ports close together stays small.
+ */
+struct ts3init_port_chunk
+{
+    struct rcu_head                    rcu;
+    struct ts3init_port_entry __rcu   *entries[256];
+};
+
+struct ts3init_port_table
+{
+    struct hlist_node                  node;
+    struct rcu_head                    rcu;
+    u32                                id;
+    /* number of rules that use the table */
+    unsigned int                       users;
+    struct ts3init_port_chunk __rcu   *chunks[256];
+};
+
+/*
+ * Returns the entry for port, or NULL. Must be called under
+ * rcu_read_lock(), which is always held in the packet path.
+ */
+static inline const struct ts3init_port_entry *
+ts3init_port_table_lookup(const struct ts3init_port_table *table, u16 port)
+{
+    const struct ts3init_port_chunk *chunk = rcu_dereference(table->chunks[port >> 8]);
+
+    if (chunk == NULL)
+        return NULL;
+    return rcu_dereference(chunk->entries[port & 0xff]);
+}
+
+/*
+ * Adds an empty table. Returns -EEXIST if the id is in use.
+ */
+int ts3init_port_table_add(struct net *net, u32 id);
+
+/*
+ * Removes a table and all its entries. Returns -ENOENT if there is no
+ * table with this id, or -EBUSY if it is still used by a rule.
+ */
+int ts3init_port_table_remove(struct net *net, u32 id);
+
+/*
+ * Adds or replaces the entry for port. If options has TS3INIT_PORT_SEED,
+ * the entry uses the seed with id seed_id, which must exist. Returns
+ * -ENOENT if either the table or the seed does not exist.
+ */
+int ts3init_port_table_set(struct net *net, u32 id, u16 port, u8 options, u32 seed_id,
+                           u32 min_client_version, u32 max_utc_offset);
+
+/*
+ * Removes the entry for port. Returns -ENOENT if there is no such table
+ * or entry.
+ */
+int ts3init_port_table_clear(struct net *net, u32 id, u16 port);
+
+/*
+ * Returns the table with this id for use by a rule, or NULL.
+ * Must be paired with ts3init_port_table_put().
+ */
+struct ts3init_port_table *ts3init_port_table_get(struct net *net, u32 id);
+void ts3init_port_table_put(struct ts3init_port_table *table);
+
+/*
+ * Removes all tables of a namespace that goes away.
+ */
+void ts3init_port_table_net_exit(struct net *net);
+
+#endif /* _TS3INIT_PORT_TABLE_H */
@@ -0,0 +1,191 @@
+/*
+ *    "ts3init" extension for Xtables
+ *
+ *    Description: A module to aid in ts3 spoof protection
+ *                 This is the "per stage latency histograms" related code
+ *
+ *    Authors:
+ *    Niels Werensteijn <niels werensteijn [at] teamspeak com>, 2016-10-03
+ *
+ *    This program is free software; you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License; either version 2
+ *    or 3 of the License, as published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/version.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/percpu.h>
+#include <linux/bitops.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include "ts3init_profile.h"
+
+enum
+{
+    /*
+     * Bucket 0 counts 0 ns, bucket n [2^(n-1), 2^n) ns. The last bucket
+     * also counts everything above, about a second.
+     */
+    TS3INIT_PROFILE_BUCKETS = 32
+};
+
+struct ts3init_profile_histogram
+{
+    u64 count;
+    u64 sum_ns;
+    u64 buckets[TS3INIT_PROFILE_BUCKETS];
+};
+
+struct ts3init_profile
+{
+    struct ts3init_profile_histogram stages[TS3INIT_PROFILE_STAGES];
+};
+
+static const char *const ts3init_profile_stage_names[TS3INIT_PROFILE_STAGES] =
+{
+    [TS3INIT_PROFILE_GET_PUZZLE]   = "get_puzzle",
+    [TS3INIT_PROFILE_SET_COOKIE]   = "set_cookie",
+    [TS3INIT_PROFILE_RESET]        = "reset",
+    [TS3INIT_PROFILE_GET_COOKIE]   = "get_cookie",
+    [TS3INIT_PROFILE_SET_PUZZLE]   = "set_puzzle",
+    [TS3INIT_PROFILE_HEADER]       = "header",
+    [TS3INIT_PROFILE_COOKIE_SEED]  = "cookie_seed",
+    [TS3INIT_PROFILE_SEED_REFRESH] = "seed_refresh",
+    [TS3INIT_PROFILE_COOKIE]       = "cookie",
+    [TS3INIT_PROFILE_REPLY_ALLOC]  = "reply_alloc",
+    [TS3INIT_PROFILE_ROUTE]        = "route",
+    [TS3INIT_PROFILE_XMIT]         = "xmit",
+};
+
+DEFINE_STATIC_KEY_FALSE(ts3init_profile_enabled);
+
+static struct ts3init_profile __percpu *ts3init_profile;
+static struct dentry *ts3init_profile_dir;
+
+void ts3init_profile_record(enum ts3init_profile_stage stage, u64 ns)
+{
+    unsigned int bucket = min_t(unsigned int, fls64(ns), TS3INIT_PROFILE_BUCKETS - 1);
+
+    this_cpu_inc(ts3init_profile->stages[stage].count);
+    this_cpu_add(ts3init_profile->stages[stage].sum_ns, ns);
+    this_cpu_inc(ts3init_profile->stages[stage].buckets[bucket]);
+}
+
+static void ts3init_profile_reset(void)
+{
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+        memset(per_cpu_ptr(ts3init_profile, cpu), 0, sizeof(struct ts3init_profile));
+}
+
+/*
+ * Prints the histograms of all cpus together, one per stage that ran.
+ */
+static int ts3init_profile_show(struct seq_file *m, void *v)
+{
+    struct ts3init_profile_histogram total;
+    int stage, cpu, i, last;
+
+    for (stage = 0; stage < TS3INIT_PROFILE_STAGES; stage++)
+    {
+        memset(&total, 0, sizeof(total));
+        for_each_possible_cpu(cpu)
+        {
+            const struct ts3init_profile_histogram *h =
+                &per_cpu_ptr(ts3init_profile, cpu)->stages[stage];
+
+            total.count += h->count;
+            total.sum_ns += h->sum_ns;
+            for (i = 0; i < TS3INIT_PROFILE_BUCKETS; i++)
+                total.buckets[i] += h->buckets[i];
+        }
+        if (total.count == 0)
+            continue;
+
+        seq_printf(m, "%s: count %llu avg %llu ns\n", ts3init_profile_stage_names[stage],
+                   total.count, div64_u64(total.sum_ns, total.count));
+        for (last = TS3INIT_PROFILE_BUCKETS - 1; total.buckets[last] == 0; last--)
+            ;
+        for (i = 0; i <= last; i++)
+        {
+            if (i == 0)
+                seq_printf(m, "  %10s %10s ns %12llu\n", "0", "0", total.buckets[i]);
+            else
+                seq_printf(m, "  %10llu %10llu ns %12llu\n", 1ULL << (i - 1),
+                           (1ULL << i) - 1, total.buckets[i]);
+        }
+    }
+    return 0;
+}
+
+static int ts3init_profile_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, ts3init_profile_show, NULL);
+}
+
+/* Writing anything clears the histograms. */
+static ssize_t ts3init_profile_write(struct file *file, const char __user *buf,
+                                     size_t count, loff_t *ppos)
+{
+    ts3init_profile_reset();
+    return count;
+}
+
+static const struct file_operations ts3init_profile_fops =
+{
+    .owner   = THIS_MODULE,
+    .open    = ts3init_profile_open,
+    .read    = seq_read,
+    .write   = ts3init_profile_write,
+    .llseek  = seq_lseek,
+    .release = single_release,
+};
+
+static int ts3init_profile_enable_get(void *data, u64 *val)
+{
+    *val = static_key_enabled(&ts3init_profile_enabled);
+    return 0;
+}
+
+static int ts3init_profile_enable_set(void *data, u64 val)
+{
+    if (val)
+        static_branch_enable(&ts3init_profile_enabled);
+    else
+        static_branch_disable(&ts3init_profile_enabled);
+    return 0;
+}
+
+DEFINE_SIMPLE_ATTRIBUTE(ts3init_profile_enable_fops, ts3init_profile_enable_get,
+                        ts3init_profile_enable_set, "%llu\n");
+
+int __init ts3init_profile_init(void)
+{
+    ts3init_profile = alloc_percpu(struct ts3init_profile);
+    if (ts3init_profile == NULL)
+        return -ENOMEM;
+
+    /* the histograms are optional, the module works without debugfs */
+    ts3init_profile_dir = debugfs_create_dir(KBUILD_MODNAME, NULL);
+    if (IS_ERR_OR_NULL(ts3init_profile_dir))
+    {
+        printk(KERN_INFO KBUILD_MODNAME ": no debugfs, profiling is not available\n");
+        ts3init_profile_dir = NULL;
+        return 0;
+    }
+    debugfs_create_file("profile_enable", 0600, ts3init_profile_dir, NULL,
+                        &ts3init_profile_enable_fops);
+    debugfs_create_file("profile", 0600, ts3init_profile_dir, NULL,
+                        &ts3init_profile_fops);
+    return 0;
+}
+
+void ts3init_profile_exit(void)
+{
+    debugfs_remove_recursive(ts3init_profile_dir);
+    static_branch_disable(&ts3init_profile_enabled);
+    free_percpu(ts3init_profile);
+}
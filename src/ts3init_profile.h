@@ -0,0 +1,69 @@
+#ifndef _TS3INIT_PROFILE_H
+#define _TS3INIT_PROFILE_H
+
+#include <linux/version.h>
+#include <linux/jump_label.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)
+#   include <linux/sched/clock.h>
+#else
+#   include <linux/sched.h>
+#endif
+
+/*
+ * The stages of the hot paths that have a latency histogram in
+ * debugfs (xt_ts3init/profile). The first ones are whole handlers, the
+ * others are parts of them.
+ */
+enum ts3init_profile_stage
+{
+    TS3INIT_PROFILE_GET_PUZZLE,   /* ts3init_get_puzzle match */
+    TS3INIT_PROFILE_SET_COOKIE,   /* TS3INIT_SET_COOKIE target */
+    TS3INIT_PROFILE_RESET,        /* TS3INIT_RESET target */
+    TS3INIT_PROFILE_GET_COOKIE,   /* TS3INIT_GET_COOKIE target */
+    TS3INIT_PROFILE_SET_PUZZLE,   /* TS3INIT_SET_PUZZLE target */
+    TS3INIT_PROFILE_HEADER,       /* client header checks */
+    TS3INIT_PROFILE_COOKIE_SEED,  /* cookie seed lookup, with refresh */
+    TS3INIT_PROFILE_SEED_REFRESH, /* sha512 of a new cookie seed */
+    TS3INIT_PROFILE_COOKIE,       /* siphash of the cookie */
+    TS3INIT_PROFILE_REPLY_ALLOC,  /* reply from the pool, or allocated */
+    TS3INIT_PROFILE_ROUTE,        /* routing of a reply */
+    TS3INIT_PROFILE_XMIT,         /* sending a batch of queued replies */
+    TS3INIT_PROFILE_STAGES
+};
+
+#ifdef TS3INIT_NO_PROFILE
+
+/* for code shared with other modules, like xt_ts3init_selftest */
+static inline u64 ts3init_profile_start(void) { return 0; }
+static inline void ts3init_profile_end(enum ts3init_profile_stage stage, u64 start) { }
+
+#else
+
+DECLARE_STATIC_KEY_FALSE(ts3init_profile_enabled);
+
+void ts3init_profile_record(enum ts3init_profile_stage stage, u64 ns);
+
+/*
+ * Returns the start time of a stage, or 0 if profiling is off.
+ * Profiling is off until it is enabled in debugfs; until then the
+ * static key makes this and ts3init_profile_end a nop.
+ */
+static __always_inline u64 ts3init_profile_start(void)
+{
+    if (static_branch_unlikely(&ts3init_profile_enabled))
+        return local_clock();
+    return 0;
+}
+
+/*
+ * Adds the time since start to the histogram of stage.
+ */
+static __always_inline void ts3init_profile_end(enum ts3init_profile_stage stage, u64 start)
+{
+    if (static_branch_unlikely(&ts3init_profile_enabled) && start != 0)
+        ts3init_profile_record(stage, local_clock() - start);
+}
+
+#endif /* TS3INIT_NO_PROFILE */
+
+#endif /* _TS3INIT_PROFILE_H */
@@ -0,0 +1,279 @@
+/*
+ *    "ts3init" extension for Xtables
+ *
+ *    Description: A module to aid in ts3 spoof protection
+ *                 This is the "pool of precomputed puzzles" related code
+ *
+ *    Authors:
+ *    Niels Werensteijn <niels werensteijn [at] teamspeak com>, 2016-10-03
+ *
+ *    This program is free software; you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License; either version 2
+ *    or 3 of the License, as published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/version.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/percpu.h>
+#include <linux/seqlock.h>
+#include <linux/vmalloc.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <linux/log2.h>
+#include <linux/mutex.h>
+#include <linux/hashtable.h>
+#include <linux/jiffies.h>
+#include <net/net_namespace.h>
+#include <net/netns/generic.h>
+#include <crypto/algapi.h>
+#include "ts3init_header.h"
+#include "ts3init_puzzle.h"
+#include "ts3init_net.h"
+
+static unsigned int puzzle_pool_size = 1024;
+module_param(puzzle_pool_size, uint, 0444);
+MODULE_PARM_DESC(puzzle_pool_size, "Number of puzzles kept for TS3INIT_SET_PUZZLE, rounded up to a power of two (default 1024)");
+
+static unsigned int puzzle_lifetime = 20;
+module_param(puzzle_lifetime, uint, 0644);
+MODULE_PARM_DESC(puzzle_lifetime, "Seconds a client has to solve a puzzle handed out by TS3INIT_SET_PUZZLE (default 20)");
+
+/*
+ * The puzzles are kept in a table indexed by a hash of x, so that a
+ * solution can be checked with a single lookup. Puzzles are handed out
+ * from consecutive slots, each to one client at a time: a handed out
+ * puzzle is not handed out again, nor replaced by a new puzzle, until it
+ * is solved or its lifetime is over. A solved puzzle leaves the pool, so
+ * a solution cannot be replayed from another address.
+ *
+ * Slots are written from process context by the puzzle producer and
+ * from the packet path when a puzzle is handed out or solved, so the
+ * producer disables bottom halves. The packet path looks at a slot
+ * without the lock first, and only takes it to change the slot.
+ *
+ * Every network namespace has its own table, allocated when its first
+ * puzzle is added, so namespaces that do not use puzzles cost nothing.
+ */
+struct ts3init_puzzle_slot
+{
+    seqlock_t     lock;
+    bool          valid;
+    bool          handed_out;
+    /* jiffies until which a handed out puzzle can be solved */
+    unsigned long expires;
+    u8        puzzle[TS3INIT_PUZZLE_LENGTH];
+    u8        solution[TS3INIT_SOLUTION_LENGTH];
+};
+
+enum
+{
+    /* number of slots tried before the pool is considered empty */
+    TS3INIT_PUZZLE_PROBES = 8
+};
+
+static unsigned int ts3init_puzzle_mask __read_mostly;
+static u32 ts3init_puzzle_hash_seed __read_mostly;
+
+/* serializes the allocation of the pools */
+static DEFINE_MUTEX(ts3init_puzzle_mutex);
+
+static DEFINE_PER_CPU(unsigned int, ts3init_puzzle_next);
+
+/*
+ * Returns the pool of net, or NULL if no puzzle was added yet.
+ */
+static inline struct ts3init_puzzle_slot *ts3init_puzzle_pool(const struct net *net)
+{
+    /* pairs with smp_store_release() in ts3init_puzzle_add() */
+    return smp_load_acquire(&ts3init_pernet(net)->puzzles);
+}
+
+/*
+ * Returns true if the puzzle of slot was handed out and can still be solved.
+ */
+static inline bool ts3init_puzzle_pending(const struct ts3init_puzzle_slot *slot)
+{
+    return slot->handed_out && time_before(jiffies, slot->expires);
+}
+
+static inline struct ts3init_puzzle_slot *
+ts3init_puzzle_slot(struct ts3init_puzzle_slot *pool, const u8 *puzzle)
+{
+    u32 hash = jhash(puzzle, TS3INIT_PUZZLE_X_LENGTH, ts3init_puzzle_hash_seed);
+    return &pool[hash & ts3init_puzzle_mask];
+}
+
+static struct ts3init_puzzle_slot *ts3init_puzzle_pool_alloc(void)
+{
+    struct ts3init_puzzle_slot *pool;
+    unsigned int i;
+
+    pool = vzalloc((ts3init_puzzle_mask + 1) * sizeof(*pool));
+    if (pool == NULL)
+        return NULL;
+
+    for (i = 0; i <= ts3init_puzzle_mask; ++i)
+        seqlock_init(&pool[i].lock);
+    return pool;
+}
+
+int ts3init_puzzle_add(struct net *net, const u8 *puzzle, const u8 *solution)
+{
+    struct ts3init_puzzle_slot *pool, *slot;
+
+    pool = ts3init_puzzle_pool(net);
+    if (pool == NULL)
+    {
+        mutex_lock(&ts3init_puzzle_mutex);
+        pool = ts3init_pernet(net)->puzzles;
+        if (pool == NULL)
+        {
+            pool = ts3init_puzzle_pool_alloc();
+            if (pool != NULL)
+                smp_store_release(&ts3init_pernet(net)->puzzles, pool);
+        }
+        mutex_unlock(&ts3init_puzzle_mutex);
+        if (pool == NULL)
+            return -ENOMEM;
+    }
+
+    slot = ts3init_puzzle_slot(pool, puzzle);
+    write_seqlock_bh(&slot->lock);
+    if (slot->valid && ts3init_puzzle_pending(slot))
+    {
+        write_sequnlock_bh(&slot->lock);
+        return -EBUSY;
+    }
+    memcpy(slot->puzzle, puzzle, TS3INIT_PUZZLE_LENGTH);
+    memcpy(slot->solution, solution, TS3INIT_SOLUTION_LENGTH);
+    slot->valid = true;
+    slot->handed_out = false;
+    write_sequnlock_bh(&slot->lock);
+    return 0;
+}
+
+void ts3init_puzzle_flush(struct net *net)
+{
+    struct ts3init_puzzle_slot *pool = ts3init_puzzle_pool(net);
+    unsigned int i;
+
+    if (pool == NULL)
+        return;
+
+    for (i = 0; i <= ts3init_puzzle_mask; ++i)
+    {
+        struct ts3init_puzzle_slot *slot = &pool[i];
+
+        write_seqlock_bh(&slot->lock);
+        slot->valid = false;
+        write_sequnlock_bh(&slot->lock);
+    }
+}
+
+/*
+ * Returns true if the puzzle of slot can be handed out.
+ */
+static inline bool ts3init_puzzle_available(const struct ts3init_puzzle_slot *slot)
+{
+    return slot->valid && !ts3init_puzzle_pending(slot);
+}
+
+bool ts3init_puzzle_get(const struct net *net, u8 *puzzle)
+{
+    struct ts3init_puzzle_slot *pool = ts3init_puzzle_pool(net);
+    unsigned int index, probe, seq;
+    bool available;
+
+    if (pool == NULL)
+        return false;
+
+    index = this_cpu_inc_return(ts3init_puzzle_next);
+
+    for (probe = 0; probe < TS3INIT_PUZZLE_PROBES; ++probe, ++index)
+    {
+        struct ts3init_puzzle_slot *slot = &pool[index & ts3init_puzzle_mask];
+
+        do
+        {
+            seq = read_seqbegin(&slot->lock);
+            available = ts3init_puzzle_available(slot);
+        } while (read_seqretry(&slot->lock, seq));
+
+        if (!available)
+            continue;
+
+        /* another cpu may have handed it out in the meantime */
+        write_seqlock(&slot->lock);
+        available = ts3init_puzzle_available(slot);
+        if (available)
+        {
+            memcpy(puzzle, slot->puzzle, TS3INIT_PUZZLE_LENGTH);
+            slot->handed_out = true;
+            slot->expires = jiffies + READ_ONCE(puzzle_lifetime) * HZ;
+        }
+        write_sequnlock(&slot->lock);
+
+        if (available)
+        {
+            /* continue after this slot next time */
+            this_cpu_write(ts3init_puzzle_next, index);
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline bool ts3init_puzzle_solves(const struct ts3init_puzzle_slot *slot,
+                                         const u8 *puzzle, const u8 *solution)
+{
+    return slot->valid && ts3init_puzzle_pending(slot) &&
+        !crypto_memneq(slot->puzzle, puzzle, TS3INIT_PUZZLE_LENGTH) &&
+        !crypto_memneq(slot->solution, solution, TS3INIT_SOLUTION_LENGTH);
+}
+
+bool ts3init_puzzle_check(const struct net *net, const u8 *puzzle, const u8 *solution)
+{
+    struct ts3init_puzzle_slot *pool = ts3init_puzzle_pool(net);
+    struct ts3init_puzzle_slot *slot;
+    unsigned int seq;
+    bool match;
+
+    if (pool == NULL)
+        return false;
+
+    slot = ts3init_puzzle_slot(pool, puzzle);
+
+    do
+    {
+        seq = read_seqbegin(&slot->lock);
+        match = ts3init_puzzle_solves(slot, puzzle, solution);
+    } while (read_seqretry(&slot->lock, seq));
+
+    if (!match)
+        return false;
+
+    /* only one of the packets that carry the solution takes the puzzle */
+    write_seqlock(&slot->lock);
+    match = ts3init_puzzle_solves(slot, puzzle, solution);
+    if (match)
+        slot->valid = false;
+    write_sequnlock(&slot->lock);
+    return match;
+}
+
+void ts3init_puzzle_net_exit(struct net *net)
+{
+    vfree(ts3init_pernet(net)->puzzles);
+}
+
+int __init ts3init_puzzle_init(void)
+{
+    unsigned int size;
+
+    size = roundup_pow_of_two(clamp(puzzle_pool_size, 1U, 1U << 20));
+    ts3init_puzzle_mask = size - 1;
+    get_random_bytes(&ts3init_puzzle_hash_seed, sizeof(ts3init_puzzle_hash_seed));
+    return 0;
+}
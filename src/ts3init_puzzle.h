@@ -0,0 +1,36 @@
+#ifndef _TS3INIT_PUZZLE_H
+#define _TS3INIT_PUZZLE_H
+
+/*
+ * Adds a puzzle and its solution to the pool of net, replacing the
+ * puzzle that was in its slot. Returns -EBUSY if that puzzle was handed
+ * out and can still be solved, -ENOMEM if the pool could not be
+ * allocated.
+ */
+int ts3init_puzzle_add(struct net *net, const u8 *puzzle, const u8 *solution);
+
+/*
+ * Removes all puzzles from the pool of net.
+ */
+void ts3init_puzzle_flush(struct net *net);
+
+/*
+ * Copies a puzzle from the pool of net to puzzle, which is not handed
+ * out again for puzzle_lifetime seconds. Returns false if no puzzle is
+ * left to hand out.
+ */
+bool ts3init_puzzle_get(const struct net *net, u8 *puzzle);
+
+/*
+ * Returns true if puzzle was handed out from the pool of net less than
+ * puzzle_lifetime seconds ago and solution is its solution. The puzzle
+ * then leaves the pool, so a solution is only accepted once.
+ */
+bool ts3init_puzzle_check(const struct net *net, const u8 *puzzle, const u8 *solution);
+
+/*
+ * Releases the pool of a namespace that goes away.
+ */
+void ts3init_puzzle_net_exit(struct net *net);
+
+#endif /* _TS3INIT_PUZZLE_H */
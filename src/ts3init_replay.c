@@ -0,0 +1,147 @@
+/*
+ *    "ts3init" extension for Xtables
+ *
+ *    Description: A module to aid in ts3 spoof protection
+ *                 This is the "replayed cookie filter" related code
+ *
+ *    Authors:
+ *    Niels Werensteijn <niels werensteijn [at] teamspeak com>, 2016-10-03
+ *
+ *    This program is free software; you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License; either version 2
+ *    or 3 of the License, as published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/version.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/bitmap.h>
+#include <linux/bitops.h>
+#include <linux/spinlock.h>
+#include <linux/time.h>
+#include <net/net_namespace.h>
+#include "ts3init_cache.h"
+#include "ts3init_replay.h"
+
+static unsigned int replay_filter_bits = 20;
+module_param(replay_filter_bits, uint, 0644);
+MODULE_PARM_DESC(replay_filter_bits, "Log2 of the bits of each of the two replay filters of a --reject-replay rule, 10 to 22, used by rules added afterwards (default 20)");
+
+static inline unsigned long ts3init_replay_generation(time_t current_unix_time)
+{
+    return (unsigned long)current_unix_time / TS3INIT_REPLAY_PERIOD;
+}
+
+struct ts3init_replay_filter *ts3init_replay_filter_alloc(void)
+{
+    struct ts3init_replay_filter *filter;
+    unsigned int bits_log2 = clamp(READ_ONCE(replay_filter_bits), 10U,
+                                   (unsigned int)TS3INIT_REPLAY_MAX_BITS_LOG2);
+
+    filter = kzalloc(sizeof(*filter), GFP_KERNEL);
+    if (filter == NULL)
+        return NULL;
+
+    filter->bits[0] = vzalloc(BITS_TO_LONGS(1UL << bits_log2) * sizeof(unsigned long));
+    filter->bits[1] = vzalloc(BITS_TO_LONGS(1UL << bits_log2) * sizeof(unsigned long));
+    if (filter->bits[0] == NULL || filter->bits[1] == NULL)
+    {
+        ts3init_replay_filter_free(filter);
+        return NULL;
+    }
+
+    spin_lock_init(&filter->lock);
+    filter->bits_log2 = bits_log2;
+    filter->generation = ts3init_replay_generation(ts3init_get_epoch());
+    return filter;
+}
+
+void ts3init_replay_filter_free(struct ts3init_replay_filter *filter)
+{
+    if (filter == NULL)
+        return;
+    vfree(filter->bits[0]);
+    vfree(filter->bits[1]);
+    kfree(filter);
+}
+
+/*
+ * Starts generation, clearing the filter it takes over, and the previous
+ * one as well if generations were skipped. The clock going back keeps the
+ * filters as they are. A cpu that finds another one rotating goes on with
+ * the old generation. The filters are cleared here, in softirq, which
+ * TS3INIT_REPLAY_MAX_BITS_LOG2 keeps to two 512 KiB clears at most.
+ */
+static void ts3init_replay_rotate(struct ts3init_replay_filter *filter, unsigned long generation)
+{
+    unsigned long old;
+
+    if (!spin_trylock(&filter->lock))
+        return;
+
+    old = filter->generation;
+    if ((long)(generation - old) > 0)
+    {
+        bitmap_zero(filter->bits[generation & 1], 1U << filter->bits_log2);
+        if (generation - old > 1)
+            bitmap_zero(filter->bits[(generation - 1) & 1], 1U << filter->bits_log2);
+        /* the cleared filters are visible before the generation */
+        smp_store_release(&filter->generation, generation);
+    }
+    spin_unlock(&filter->lock);
+}
+
+/*
+ * The bits of a cookie, by double hashing. The cookie is a siphash with a
+ * secret key, so its halves are already independent hashes.
+ */
+static inline unsigned int ts3init_replay_bit(const struct ts3init_replay_filter *filter,
+                                              u64 cookie, unsigned int i)
+{
+    u32 h1 = (u32)cookie;
+    u32 h2 = (u32)(cookie >> 32) | 1;
+
+    return (h1 + i * h2) & ((1U << filter->bits_log2) - 1);
+}
+
+static inline bool ts3init_replay_test(const struct ts3init_replay_filter *filter,
+                                       const unsigned long *bits, u64 cookie)
+{
+    unsigned int i;
+
+    for (i = 0; i < TS3INIT_REPLAY_HASHES; ++i)
+    {
+        if (!test_bit(ts3init_replay_bit(filter, cookie, i), bits))
+            return false;
+    }
+    return true;
+}
+
+bool ts3init_replay_check(struct ts3init_replay_filter *filter, time_t current_unix_time,
+                          u64 cookie)
+{
+    unsigned long generation = ts3init_replay_generation(current_unix_time);
+    unsigned long *current_bits;
+    unsigned int i;
+
+    if (unlikely(generation != READ_ONCE(filter->generation)))
+        ts3init_replay_rotate(filter, generation);
+    generation = smp_load_acquire(&filter->generation);
+
+    current_bits = filter->bits[generation & 1];
+    if (ts3init_replay_test(filter, current_bits, cookie) ||
+        ts3init_replay_test(filter, filter->bits[(generation - 1) & 1], cookie))
+        return true;
+
+    /* only bits that are not set yet are written, so replays do not dirty cache lines */
+    for (i = 0; i < TS3INIT_REPLAY_HASHES; ++i)
+    {
+        unsigned int bit = ts3init_replay_bit(filter, cookie, i);
+
+        if (!test_bit(bit, current_bits))
+            set_bit(bit, current_bits);
+    }
+    return false;
+}
@@ -0,0 +1,42 @@
+#ifndef _TS3INIT_REPLAY_H
+#define _TS3INIT_REPLAY_H
+
+/*
+ * The cookies accepted by a get_puzzle rule with --reject-replay, kept in
+ * two Bloom filters of 2^replay_filter_bits bits. The filters take turns
+ * every generation of TS3INIT_REPLAY_PERIOD seconds: the current one is
+ * cleared and takes the new cookies, the previous one is only looked at.
+ * A cookie is thus remembered for at least one generation, longer than it
+ * is accepted, even with --max-skew. Bits are set atomically, without
+ * locks; only the rotation is serialized.
+ */
+enum
+{
+    /* 4 cookie seed windows, a cookie is accepted for at most 8 + 2 * 4 seconds */
+    TS3INIT_REPLAY_PERIOD = 16,
+    TS3INIT_REPLAY_HASHES = 4,
+    /* 512 KiB per filter */
+    TS3INIT_REPLAY_MAX_BITS_LOG2 = 22
+};
+
+struct ts3init_replay_filter
+{
+    spinlock_t lock;
+    unsigned long generation;
+    unsigned int bits_log2;
+    /* the filter of generation g is bits[g & 1] */
+    unsigned long *bits[2];
+};
+
+struct ts3init_replay_filter *ts3init_replay_filter_alloc(void);
+void ts3init_replay_filter_free(struct ts3init_replay_filter *filter);
+
+/*
+ * Returns true if cookie, a valid cookie at current_unix_time, was seen
+ * before. Otherwise remembers it and returns false. False positives are
+ * possible, at a rate set by replay_filter_bits.
+ */
+bool ts3init_replay_check(struct ts3init_replay_filter *filter, time_t current_unix_time,
+                          u64 cookie);
+
+#endif /* _TS3INIT_REPLAY_H */
@@ -0,0 +1,523 @@
+/*
+ *    "ts3init" extension for Xtables
+ *
+ *    Description: A module to aid in ts3 spoof protection
+ *                 This is the "reply allocation and transmission" related code
+ *
+ *    Authors:
+ *    Niels Werensteijn <niels werensteijn [at] teamspeak com>, 2016-10-03
+ *
+ *    This program is free software; you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License; either version 2
+ *    or 3 of the License, as published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/version.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/skbuff.h>
+#include <linux/netdevice.h>
+#include <linux/interrupt.h>
+#include <linux/percpu.h>
+#include <linux/topology.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/udp.h>
+#include <linux/netfilter/x_tables.h>
+#include <net/ip.h>
+#include <net/ipv6.h>
+#include <net/dst.h>
+#include <net/neighbour.h>
+#include <net/checksum.h>
+#include <net/ip6_checksum.h>
+#include <net/net_namespace.h>
+#include <net/netns/generic.h>
+#include <linux/hashtable.h>
+#include "compat_xtables.h"
+#include "ts3init_header.h"
+#include "ts3init_reply.h"
+#include "ts3init_netlink.h"
+#include "ts3init_profile.h"
+#include "ts3init_net.h"
+#include "ts3init_stats.h"
+
+static unsigned int xmit_batch = 16;
+module_param(xmit_batch, uint, 0644);
+MODULE_PARM_DESC(xmit_batch, "Number of generated replies queued per cpu before they are sent (default 16)");
+
+static unsigned int reply_pool_size = 32;
+module_param(reply_pool_size, uint, 0644);
+MODULE_PARM_DESC(reply_pool_size, "Number of preallocated replies per cpu, type and family, at most 1024 (default 32)");
+
+enum
+{
+    TS3INIT_REPLY_TEMPLATE_MAX = TS3INIT_REPLY_TYPE_MAX * 2,
+    TS3INIT_REPLY_POOL_MAX = 1024
+};
+
+/*
+ * Returns reply_pool_size, bounded. The parameter can be written through
+ * sysfs, so it is bounded where it is read.
+ */
+static inline unsigned int ts3init_reply_pool_size(void)
+{
+    return min_t(unsigned int, READ_ONCE(reply_pool_size), TS3INIT_REPLY_POOL_MAX);
+}
+
+/* The payload replied by TS3INIT_RESET. */
+static const char ts3init_reset_packet[TS3INIT_RESET_PACKET_SIZE] = {'T', 'S', '3', 'I', 'N', 'I', 'T', '1', 0, 0x65, 0x88, COMMAND_RESET, 0 };
+
+/* The header replied by TS3INIT_SET_COOKIE. */
+static const char ts3init_set_cookie_packet_header[TS3INIT_HEADER_SERVER_LENGTH] = {'T', 'S', '3', 'I', 'N', 'I', 'T', '1', 0, 0x65, 0x88, COMMAND_SET_COOKIE };
+
+/* The header replied by TS3INIT_SET_PUZZLE. */
+static const char ts3init_set_puzzle_packet_header[TS3INIT_HEADER_SERVER_LENGTH] = {'T', 'S', '3', 'I', 'N', 'I', 'T', '1', 0, 0x65, 0x88, COMMAND_SET_PUZZLE };
+
+/*
+ * The constant bytes of a reply, from the ip header up to the end
+ * of the ts3init payload.
+ */
+struct ts3init_reply_template
+{
+    __be16       protocol;
+    unsigned int network_header_len;
+    unsigned int len;
+    u8           data[sizeof(struct ipv6hdr) + sizeof(struct udphdr) + TS3INIT_REPLY_PACKET_MAX];
+};
+
+/* Indexed by reply type * 2 + (family == ipv6) */
+static struct ts3init_reply_template ts3init_reply_templates[TS3INIT_REPLY_TEMPLATE_MAX] __read_mostly;
+
+/*
+ * Replies generated on a cpu waiting to be sent, either through the
+ * output hooks or directly to the device, and preallocated
+ * replies waiting to be used.
+ */
+struct ts3init_reply_queue
+{
+    struct sk_buff_head   skbs;
+    struct sk_buff_head   direct_skbs;
+    struct sk_buff_head   pool[TS3INIT_REPLY_TEMPLATE_MAX];
+    struct tasklet_struct flush_tasklet;
+};
+
+static DEFINE_PER_CPU(struct ts3init_reply_queue, ts3init_reply_queue);
+
+static void __init ts3init_reply_init_template(struct ts3init_reply_template *template,
+                                              bool ipv6, const void *packet,
+                                              size_t packet_size)
+{
+    struct udphdr *udp;
+    size_t udp_len = sizeof(*udp) + packet_size;
+
+    memset(template, 0, sizeof(*template));
+    if (ipv6)
+    {
+        struct ipv6hdr *ip = (struct ipv6hdr *)template->data;
+
+        template->protocol = htons(ETH_P_IPV6);
+        template->network_header_len = sizeof(*ip);
+        ip->version     = 6;
+        ip->nexthdr     = IPPROTO_UDP;
+        ip->payload_len = htons(udp_len);
+    }
+    else
+    {
+        struct iphdr *ip = (struct iphdr *)template->data;
+
+        template->protocol = htons(ETH_P_IP);
+        template->network_header_len = sizeof(*ip);
+        ip->version  = 4;
+        ip->ihl      = sizeof(*ip) / 4;
+        ip->tot_len  = htons(sizeof(*ip) + udp_len);
+        ip->frag_off = htons(IP_DF);
+        ip->protocol = IPPROTO_UDP;
+    }
+
+    udp = (struct udphdr *)(template->data + template->network_header_len);
+    udp->len = htons(udp_len);
+    memcpy(udp + 1, packet, packet_size);
+
+    template->len = template->network_header_len + udp_len;
+}
+
+/*
+ * Allocates a reply on the numa node of the cpu and copies the template
+ * into it.
+ */
+static struct sk_buff *ts3init_reply_build(const struct ts3init_reply_template *template)
+{
+    struct sk_buff *skb;
+
+    skb = __alloc_skb(LL_MAX_HEADER + template->len, GFP_ATOMIC, 0, numa_node_id());
+    if (skb == NULL)
+        return NULL;
+
+    skb_reserve(skb, LL_MAX_HEADER);
+    skb->protocol = template->protocol;
+    skb_reset_network_header(skb);
+    skb_set_transport_header(skb, template->network_header_len);
+    memcpy(skb_put(skb, template->len), template->data, template->len);
+    return skb;
+}
+
+/*
+ * Tops up the pools of preallocated replies of this cpu, or trims them
+ * after reply_pool_size was lowered. Sent replies are consumed by the
+ * stack, so the pools do not save allocations; they move them out of
+ * the packet path, into this tasklet.
+ */
+static void ts3init_reply_refill(struct ts3init_reply_queue *queue)
+{
+    unsigned int pool_size = ts3init_reply_pool_size();
+    int i;
+
+    for (i = 0; i < TS3INIT_REPLY_TEMPLATE_MAX; ++i)
+    {
+        while (skb_queue_len(&queue->pool[i]) > pool_size)
+            consume_skb(__skb_dequeue(&queue->pool[i]));
+
+        while (skb_queue_len(&queue->pool[i]) < pool_size)
+        {
+            struct sk_buff *skb = ts3init_reply_build(&ts3init_reply_templates[i]);
+            if (skb == NULL)
+                return;
+            __skb_queue_tail(&queue->pool[i], skb);
+        }
+    }
+}
+
+static struct sk_buff *ts3init_reply_alloc(struct net *net, unsigned int template_index)
+{
+    struct ts3init_reply_queue *queue = this_cpu_ptr(&ts3init_reply_queue);
+    struct sk_buff *skb;
+
+    skb = __skb_dequeue(&queue->pool[template_index]);
+
+    /* let the tasklet refill the pool once it is half empty. */
+    if (skb_queue_len(&queue->pool[template_index]) < ts3init_reply_pool_size() / 2)
+        tasklet_schedule(&queue->flush_tasklet);
+
+    if (skb == NULL)
+    {
+        skb = ts3init_reply_build(&ts3init_reply_templates[template_index]);
+        if (skb == NULL)
+            ts3init_stat_inc(net, TS3INIT_STAT_REPLY_ALLOC_FAILED);
+    }
+    return skb;
+}
+
+/*
+ * Returns a reply from the pool, timed as the reply_alloc stage of the
+ * profile.
+ */
+static inline struct sk_buff *ts3init_reply_alloc_profiled(struct net *net,
+                                                           unsigned int template_index)
+{
+    u64 profile = ts3init_profile_start();
+    struct sk_buff *skb = ts3init_reply_alloc(net, template_index);
+
+    ts3init_profile_end(TS3INIT_PROFILE_REPLY_ALLOC, profile);
+    return skb;
+}
+
+struct sk_buff *ts3init_reply_alloc_ipv4(struct net *net, enum ts3init_reply_type type)
+{
+    return ts3init_reply_alloc_profiled(net, type * 2);
+}
+
+struct sk_buff *ts3init_reply_alloc_ipv6(struct net *net, enum ts3init_reply_type type)
+{
+    return ts3init_reply_alloc_profiled(net, type * 2 + 1);
+}
+
+unsigned int ts3init_reply_copy_packet(enum ts3init_reply_type type, u8 *dst)
+{
+    const struct ts3init_reply_template *template = &ts3init_reply_templates[type * 2];
+    unsigned int header_len = template->network_header_len + sizeof(struct udphdr);
+
+    memcpy(dst, template->data + header_len, template->len - header_len);
+    return template->len - header_len;
+}
+
+int ts3init_reply_resize(struct sk_buff *skb, unsigned int len)
+{
+    if (skb->len > len && pskb_trim(skb, len))
+        return -ENOMEM;
+
+    if (skb_ensure_writable(skb, skb->len) != 0)
+        return -ENOMEM;
+
+    if (skb->len < len)
+    {
+        unsigned int delta = len - skb->len;
+        int tailroom = skb_tailroom(skb);
+
+        if (tailroom < delta &&
+            pskb_expand_head(skb, 0, delta - tailroom, GFP_ATOMIC))
+            return -ENOMEM;
+        memset(__skb_put(skb, delta), 0, delta);
+    }
+    return 0;
+}
+
+static inline void ts3init_reply_csum_partial(struct sk_buff *skb)
+{
+    skb->ip_summed = CHECKSUM_PARTIAL;
+    skb->csum_start = skb_transport_header(skb) - skb->head;
+    skb->csum_offset = offsetof(struct udphdr, check);
+}
+
+void ts3init_reply_csum_ipv4(struct sk_buff *skb)
+{
+    const struct iphdr *ip = ip_hdr(skb);
+    struct udphdr *udp = udp_hdr(skb);
+    unsigned int len = ntohs(udp->len);
+
+    if (skb_dst(skb)->dev->features & NETIF_F_V4_CSUM)
+    {
+        ts3init_reply_csum_partial(skb);
+        udp->check = ~csum_tcpudp_magic(ip->saddr, ip->daddr, len, IPPROTO_UDP, 0);
+    }
+    else
+    {
+        skb->ip_summed = CHECKSUM_NONE;
+        udp->check = 0;
+        udp->check = csum_tcpudp_magic(ip->saddr, ip->daddr, len, IPPROTO_UDP,
+                                       csum_partial(udp, len, 0));
+        if (udp->check == 0)
+            udp->check = CSUM_MANGLED_0;
+    }
+}
+
+void ts3init_reply_csum_ipv6(struct sk_buff *skb)
+{
+    const struct ipv6hdr *ip = ipv6_hdr(skb);
+    struct udphdr *udp = udp_hdr(skb);
+    unsigned int len = ntohs(udp->len);
+
+    if (skb_dst(skb)->dev->features & NETIF_F_V6_CSUM)
+    {
+        ts3init_reply_csum_partial(skb);
+        udp->check = ~csum_ipv6_magic(&ip->saddr, &ip->daddr, len, IPPROTO_UDP, 0);
+    }
+    else
+    {
+        skb->ip_summed = CHECKSUM_NONE;
+        udp->check = 0;
+        udp->check = csum_ipv6_magic(&ip->saddr, &ip->daddr, len, IPPROTO_UDP,
+                                     csum_partial(udp, len, 0));
+        if (udp->check == 0)
+            udp->check = CSUM_MANGLED_0;
+    }
+}
+
+bool ts3init_reply_prepare_direct_xmit(struct sk_buff *skb, int ifindex)
+{
+    struct dst_entry *dst = skb_dst(skb);
+    struct net_device *dev = dst->dev;
+    struct neighbour *neigh;
+    u8 haddr[MAX_ADDR_LEN];
+    bool resolved = false;
+
+    if (dev->ifindex != ifindex || dev->header_ops == NULL)
+        return false;
+
+    if (skb_cow_head(skb, LL_RESERVED_SPACE(dev)))
+        return false;
+
+    neigh = dst_neigh_lookup_skb(dst, skb);
+    if (neigh == NULL)
+        return false;
+    if (neigh->nud_state & NUD_VALID)
+    {
+        neigh_ha_snapshot(haddr, neigh, dev);
+        resolved = true;
+    }
+    neigh_release(neigh);
+
+    /* the normal output path will resolve the neighbour */
+    if (!resolved)
+        return false;
+
+    skb->dev = dev;
+    if (dev_hard_header(skb, dev, ntohs(skb->protocol), haddr, NULL, skb->len) < 0)
+    {
+        __skb_pull(skb, skb_network_offset(skb));
+        return false;
+    }
+    skb_reset_mac_header(skb);
+    return true;
+}
+
+/*
+ * Hands replies prepared with ts3init_reply_prepare_direct_xmit() to their
+ * devices. A run of replies to the same device is passed to the driver on
+ * the transmit queue of this cpu, back to back with xmit_more, so the
+ * driver can ring its doorbell once per run. Like PACKET_QDISC_BYPASS this
+ * skips the qdisc and the packet taps. Once the queue is stopped the rest
+ * of the run goes through dev_queue_xmit, which keeps it in the qdisc.
+ */
+static void ts3init_reply_direct_xmit(struct sk_buff_head *list)
+{
+    struct sk_buff *skb;
+
+    while ((skb = __skb_dequeue(list)) != NULL)
+    {
+        struct net_device *dev = skb->dev;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 18, 0)
+        u16 queue_index = smp_processor_id() % dev->real_num_tx_queues;
+        struct netdev_queue *txq = netdev_get_tx_queue(dev, queue_index);
+
+        __netif_tx_lock(txq, smp_processor_id());
+        while (skb != NULL && netif_running(dev) && !netif_xmit_frozen_or_drv_stopped(txq))
+        {
+            struct sk_buff *next = skb_peek(list);
+            bool more = next != NULL && next->dev == dev;
+
+            skb_set_queue_mapping(skb, queue_index);
+            if (!dev_xmit_complete(netdev_start_xmit(skb, dev, txq, more)))
+                break;
+            skb = more ? __skb_dequeue(list) : NULL;
+        }
+        __netif_tx_unlock(txq);
+#endif
+
+        while (skb != NULL)
+        {
+            struct sk_buff *next = skb_peek(list);
+
+            dev_queue_xmit(skb);
+            skb = (next != NULL && next->dev == dev) ? __skb_dequeue(list) : NULL;
+        }
+    }
+}
+
+/*
+ * Sends all queued replies of this cpu.
+ * The queues are emptied first, so replies generated while sending
+ * are queued again instead of being sent recursively. Replies through
+ * the output path are passed to ip_local_out one by one, as the output
+ * hooks see every packet; they are sent in the namespace of their route.
+ */
+static void ts3init_reply_flush(struct ts3init_reply_queue *queue)
+{
+    struct sk_buff_head list;
+    struct sk_buff *skb;
+    u64 profile = ts3init_profile_start();
+
+    __skb_queue_head_init(&list);
+    skb_queue_splice_init(&queue->direct_skbs, &list);
+    ts3init_reply_direct_xmit(&list);
+
+    skb_queue_splice_init(&queue->skbs, &list);
+
+    while ((skb = __skb_dequeue(&list)) != NULL)
+    {
+        struct net *net = dev_net(skb_dst(skb)->dev);
+
+        if (skb->protocol == htons(ETH_P_IPV6))
+            ip6_local_out(net, skb->sk, skb);
+        else
+            ip_local_out(net, skb->sk, skb);
+    }
+    ts3init_profile_end(TS3INIT_PROFILE_XMIT, profile);
+}
+
+static void ts3init_reply_flush_tasklet(unsigned long data)
+{
+    struct ts3init_reply_queue *queue = (struct ts3init_reply_queue *)data;
+
+    ts3init_reply_flush(queue);
+    ts3init_reply_refill(queue);
+}
+
+void ts3init_reply_queue_xmit(struct net *net, struct sk_buff *skb, bool direct)
+{
+    struct ts3init_reply_queue *queue = this_cpu_ptr(&ts3init_reply_queue);
+    unsigned int queued;
+
+    ts3init_stat_inc(net, direct ? TS3INIT_STAT_REPLY_DIRECT_XMIT : TS3INIT_STAT_REPLY_XMIT);
+    __skb_queue_tail(direct ? &queue->direct_skbs : &queue->skbs, skb);
+
+    queued = skb_queue_len(&queue->skbs) + skb_queue_len(&queue->direct_skbs);
+    if (queued >= READ_ONCE(xmit_batch))
+        ts3init_reply_flush(queue);
+    else if (queued == 1)
+        tasklet_schedule(&queue->flush_tasklet);
+}
+
+unsigned int ts3init_reply_get_xmit_batch(void)
+{
+    return READ_ONCE(xmit_batch);
+}
+
+void ts3init_reply_set_xmit_batch(unsigned int value)
+{
+    WRITE_ONCE(xmit_batch, value);
+}
+
+unsigned int ts3init_reply_get_pool_size(void)
+{
+    return ts3init_reply_pool_size();
+}
+
+void ts3init_reply_set_pool_size(unsigned int value)
+{
+    WRITE_ONCE(reply_pool_size, min_t(unsigned int, value, TS3INIT_REPLY_POOL_MAX));
+}
+
+int __init ts3init_reply_init(void)
+{
+    u8 set_cookie_packet[TS3INIT_SET_COOKIE_PACKET_SIZE] = { 0 };
+    u8 set_puzzle_packet[TS3INIT_SET_PUZZLE_PACKET_SIZE] = { 0 };
+    int cpu, i;
+
+    memcpy(set_cookie_packet, ts3init_set_cookie_packet_header,
+           sizeof(ts3init_set_cookie_packet_header));
+    memcpy(set_puzzle_packet, ts3init_set_puzzle_packet_header,
+           sizeof(ts3init_set_puzzle_packet_header));
+
+    ts3init_reply_init_template(&ts3init_reply_templates[TS3INIT_REPLY_RESET * 2], false,
+                                ts3init_reset_packet, sizeof(ts3init_reset_packet));
+    ts3init_reply_init_template(&ts3init_reply_templates[TS3INIT_REPLY_RESET * 2 + 1], true,
+                                ts3init_reset_packet, sizeof(ts3init_reset_packet));
+    ts3init_reply_init_template(&ts3init_reply_templates[TS3INIT_REPLY_SET_COOKIE * 2], false,
+                                set_cookie_packet, sizeof(set_cookie_packet));
+    ts3init_reply_init_template(&ts3init_reply_templates[TS3INIT_REPLY_SET_COOKIE * 2 + 1], true,
+                                set_cookie_packet, sizeof(set_cookie_packet));
+    ts3init_reply_init_template(&ts3init_reply_templates[TS3INIT_REPLY_SET_PUZZLE * 2], false,
+                                set_puzzle_packet, sizeof(set_puzzle_packet));
+    ts3init_reply_init_template(&ts3init_reply_templates[TS3INIT_REPLY_SET_PUZZLE * 2 + 1], true,
+                                set_puzzle_packet, sizeof(set_puzzle_packet));
+
+    for_each_possible_cpu(cpu)
+    {
+        struct ts3init_reply_queue *queue = per_cpu_ptr(&ts3init_reply_queue, cpu);
+
+        __skb_queue_head_init(&queue->skbs);
+        __skb_queue_head_init(&queue->direct_skbs);
+        for (i = 0; i < TS3INIT_REPLY_TEMPLATE_MAX; ++i)
+            __skb_queue_head_init(&queue->pool[i]);
+        tasklet_init(&queue->flush_tasklet, ts3init_reply_flush_tasklet,
+                     (unsigned long)queue);
+    }
+    return 0;
+}
+
+void ts3init_reply_exit(void)
+{
+    int cpu, i;
+
+    for_each_possible_cpu(cpu)
+    {
+        struct ts3init_reply_queue *queue = per_cpu_ptr(&ts3init_reply_queue, cpu);
+
+        tasklet_kill(&queue->flush_tasklet);
+        __skb_queue_purge(&queue->skbs);
+        __skb_queue_purge(&queue->direct_skbs);
+        for (i = 0; i < TS3INIT_REPLY_TEMPLATE_MAX; ++i)
+            __skb_queue_purge(&queue->pool[i]);
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef _TS3INIT_REPLY_H
+#define _TS3INIT_REPLY_H
+
+/*
+ * The replies the module generates.
+ */
+enum ts3init_reply_type
+{
+    TS3INIT_REPLY_RESET,
+    TS3INIT_REPLY_SET_COOKIE,
+    TS3INIT_REPLY_SET_PUZZLE,
+    TS3INIT_REPLY_TYPE_MAX
+};
+
+/*
+ * Sizes of the ts3init packets (header and payload) of the replies.
+ */
+enum
+{
+    TS3INIT_RESET_PACKET_SIZE = TS3INIT_HEADER_SERVER_LENGTH + 1,
+    TS3INIT_SET_COOKIE_PACKET_SIZE = TS3INIT_HEADER_SERVER_LENGTH + 20,
+    TS3INIT_SET_PUZZLE_PACKET_SIZE = TS3INIT_HEADER_SERVER_LENGTH + TS3INIT_PUZZLE_LENGTH,
+    TS3INIT_REPLY_PACKET_MAX = TS3INIT_SET_PUZZLE_PACKET_SIZE
+};
+
+/*
+ * Returns a new reply skb of the given type, or NULL.
+ * The ip, udp and ts3init headers are laid out from a template, and
+ * the network and transport header offsets are set. Addresses, ports,
+ * hop limit, checksums and the non-constant part of the payload are
+ * left to the caller. A failure is counted in the namespace net.
+ */
+struct sk_buff *ts3init_reply_alloc_ipv4(struct net *net, enum ts3init_reply_type type);
+struct sk_buff *ts3init_reply_alloc_ipv6(struct net *net, enum ts3init_reply_type type);
+
+/*
+ * Returns the ts3init packet (header and payload) of a reply skb.
+ */
+static inline u8 *ts3init_reply_payload(struct sk_buff *skb)
+{
+    return skb_transport_header(skb) + sizeof(struct udphdr);
+}
+
+/*
+ * Copies the ts3init packet of a reply type, as laid out in its template,
+ * to dst. Returns the size of the packet.
+ */
+unsigned int ts3init_reply_copy_packet(enum ts3init_reply_type type, u8 *dst);
+
+/*
+ * Resizes skb, which starts at its network header, to len bytes and
+ * makes it linear and writable. Used to turn a received packet into
+ * a reply. Returns 0 on success.
+ */
+int ts3init_reply_resize(struct sk_buff *skb, unsigned int len);
+
+/*
+ * Sets the udp checksum of a reply that has been routed. If the egress
+ * device can offload the checksum only the pseudo header is summed, and
+ * the skb is marked CHECKSUM_PARTIAL.
+ */
+void ts3init_reply_csum_ipv4(struct sk_buff *skb);
+void ts3init_reply_csum_ipv6(struct sk_buff *skb);
+
+/*
+ * Adds the link layer header to a routed reply, so it can be handed to
+ * the device directly. Only done when the reply is routed out of the device
+ * with index ifindex and the neighbour of the route is resolved.
+ * Returns false if the reply has to take the normal output path.
+ */
+bool ts3init_reply_prepare_direct_xmit(struct sk_buff *skb, int ifindex);
+
+/*
+ * Queues a generated reply for transmission on the local cpu, and counts
+ * it in the network namespace net of the hook that generated it.
+ * The skb must have its dst set. If direct is true the skb was prepared
+ * with ts3init_reply_prepare_direct_xmit() and is handed to the device,
+ * otherwise it goes through the output hooks. The queue is flushed when
+ * it reaches xmit_batch packets, or at the end of the current softirq
+ * cycle.
+ */
+void ts3init_reply_queue_xmit(struct net *net, struct sk_buff *skb, bool direct);
+
+/*
+ * Gets and sets the xmit_batch and reply_pool_size module parameters.
+ */
+unsigned int ts3init_reply_get_xmit_batch(void);
+void ts3init_reply_set_xmit_batch(unsigned int value);
+unsigned int ts3init_reply_get_pool_size(void);
+void ts3init_reply_set_pool_size(unsigned int value);
+
+#endif /* _TS3INIT_REPLY_H */
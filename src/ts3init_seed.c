@@ -0,0 +1,208 @@
+/*
+ *    "ts3init" extension for Xtables
+ *
+ *    Description: A module to aid in ts3 spoof protection
+ *                 This is the "runtime configured seeds" related code
+ *
+ *    Authors:
+ *    Niels Werensteijn <niels werensteijn [at] teamspeak com>, 2016-10-03
+ *
+ *    This program is free software; you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License; either version 2
+ *    or 3 of the License, as published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/version.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/hashtable.h>
+#include <linux/rcupdate.h>
+#include <linux/percpu.h>
+#include <net/net_namespace.h>
+#include <net/netns/generic.h>
+#include "ts3init_random_seed.h"
+#include "ts3init_cookie.h"
+#include "ts3init_seed.h"
+#include "ts3init_net.h"
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 9, 0)
+#   define kfree_sensitive(x) kzfree(x)
+#endif
+
+/*
+ * The seeds of a namespace are in ts3init_net.seeds. They are changed
+ * under ts3init_seed_mutex, and read under rcu.
+ */
+static DEFINE_MUTEX(ts3init_seed_mutex);
+
+static struct ts3init_seed_key *ts3init_seed_key_alloc(const u8 *random_seed)
+{
+    struct ts3init_seed_key *key = kmalloc(sizeof(*key), GFP_KERNEL);
+
+    if (key == NULL)
+        return NULL;
+
+    key->cache = alloc_percpu(struct xt_ts3init_cookie_cache);
+    if (key->cache == NULL)
+    {
+        kfree(key);
+        return NULL;
+    }
+    memcpy(key->random_seed, random_seed, RANDOM_SEED_LEN);
+    return key;
+}
+
+static void ts3init_seed_key_free(struct ts3init_seed_key *key)
+{
+    int cpu;
+
+    if (key == NULL)
+        return;
+
+    /* the caches hold values derived from the seed */
+    for_each_possible_cpu(cpu)
+        memzero_explicit(per_cpu_ptr(key->cache, cpu), sizeof(struct xt_ts3init_cookie_cache));
+    free_percpu(key->cache);
+    kfree_sensitive(key);
+}
+
+static void ts3init_seed_key_free_rcu(struct rcu_head *head)
+{
+    ts3init_seed_key_free(container_of(head, struct ts3init_seed_key, rcu));
+}
+
+static struct ts3init_seed *ts3init_seed_find(struct net *net, u32 id)
+{
+    struct ts3init_seed *seed;
+
+    hash_for_each_possible(ts3init_pernet(net)->seeds, seed, node, id)
+    {
+        if (seed->id == id)
+            return seed;
+    }
+    return NULL;
+}
+
+static void ts3init_seed_free(struct ts3init_seed *seed)
+{
+    call_rcu(&rcu_dereference_protected(seed->key, true)->rcu, ts3init_seed_key_free_rcu);
+    kfree_rcu(seed, rcu);
+}
+
+int ts3init_seed_add(struct net *net, u32 id, const u8 *random_seed)
+{
+    struct ts3init_seed *seed;
+    struct ts3init_seed_key *key;
+    int error = 0;
+
+    seed = kzalloc(sizeof(*seed), GFP_KERNEL);
+    key = ts3init_seed_key_alloc(random_seed);
+    if (seed == NULL || key == NULL)
+    {
+        kfree(seed);
+        ts3init_seed_key_free(key);
+        return -ENOMEM;
+    }
+    seed->id = id;
+    RCU_INIT_POINTER(seed->key, key);
+
+    mutex_lock(&ts3init_seed_mutex);
+    if (ts3init_seed_find(net, id) != NULL)
+        error = -EEXIST;
+    else
+        hash_add_rcu(ts3init_pernet(net)->seeds, &seed->node, id);
+    mutex_unlock(&ts3init_seed_mutex);
+
+    if (error)
+    {
+        kfree(seed);
+        ts3init_seed_key_free(key);
+    }
+    return error;
+}
+
+int ts3init_seed_replace(struct net *net, u32 id, const u8 *random_seed)
+{
+    struct ts3init_seed *seed;
+    struct ts3init_seed_key *key, *old_key;
+
+    key = ts3init_seed_key_alloc(random_seed);
+    if (key == NULL)
+        return -ENOMEM;
+
+    mutex_lock(&ts3init_seed_mutex);
+    seed = ts3init_seed_find(net, id);
+    if (seed == NULL)
+    {
+        mutex_unlock(&ts3init_seed_mutex);
+        ts3init_seed_key_free(key);
+        return -ENOENT;
+    }
+    old_key = rcu_dereference_protected(seed->key, lockdep_is_held(&ts3init_seed_mutex));
+    rcu_assign_pointer(seed->key, key);
+    mutex_unlock(&ts3init_seed_mutex);
+
+    call_rcu(&old_key->rcu, ts3init_seed_key_free_rcu);
+    return 0;
+}
+
+int ts3init_seed_remove(struct net *net, u32 id)
+{
+    struct ts3init_seed *seed;
+    int error = 0;
+
+    mutex_lock(&ts3init_seed_mutex);
+    seed = ts3init_seed_find(net, id);
+    if (seed == NULL)
+        error = -ENOENT;
+    else if (seed->users != 0)
+        error = -EBUSY;
+    else
+        hash_del_rcu(&seed->node);
+    mutex_unlock(&ts3init_seed_mutex);
+
+    if (error == 0)
+        ts3init_seed_free(seed);
+    return error;
+}
+
+struct ts3init_seed *ts3init_seed_get(struct net *net, u32 id)
+{
+    struct ts3init_seed *seed;
+
+    mutex_lock(&ts3init_seed_mutex);
+    seed = ts3init_seed_find(net, id);
+    if (seed != NULL)
+        ++seed->users;
+    mutex_unlock(&ts3init_seed_mutex);
+    return seed;
+}
+
+void ts3init_seed_put(struct ts3init_seed *seed)
+{
+    mutex_lock(&ts3init_seed_mutex);
+    /* the namespace of a removed seed went away before its last user */
+    if (--seed->users == 0 && hlist_unhashed(&seed->node))
+        ts3init_seed_free(seed);
+    mutex_unlock(&ts3init_seed_mutex);
+}
+
+void ts3init_seed_net_exit(struct net *net)
+{
+    struct ts3init_seed *seed;
+    struct hlist_node *tmp;
+    int bkt;
+
+    mutex_lock(&ts3init_seed_mutex);
+    hash_for_each_safe(ts3init_pernet(net)->seeds, bkt, tmp, seed, node)
+    {
+        hash_del_rcu(&seed->node);
+        /* seeds in use are freed by ts3init_seed_put() */
+        if (seed->users == 0)
+            ts3init_seed_free(seed);
+    }
+    mutex_unlock(&ts3init_seed_mutex);
+}
@@ -0,0 +1,59 @@
+#ifndef _TS3INIT_SEED_H
+#define _TS3INIT_SEED_H
+
+struct xt_ts3init_cookie_cache;
+
+/*
+ * Random seeds configured at runtime, identified by a number that is
+ * unique within a network namespace.
+ * The value of a seed can be replaced while it is in use; readers
+ * dereference the current key under rcu_read_lock(). Every key has
+ * its own per cpu cache of cookie seeds.
+ */
+struct ts3init_seed_key
+{
+    struct rcu_head                          rcu;
+    struct xt_ts3init_cookie_cache __percpu *cache;
+    u8                                       random_seed[RANDOM_SEED_LEN];
+};
+
+struct ts3init_seed
+{
+    struct hlist_node               node;
+    struct rcu_head                 rcu;
+    u32                             id;
+    /* number of rules that use the seed */
+    unsigned int                    users;
+    struct ts3init_seed_key __rcu  *key;
+};
+
+/*
+ * Adds a new seed. Returns -EEXIST if the id is in use.
+ */
+int ts3init_seed_add(struct net *net, u32 id, const u8 *random_seed);
+
+/*
+ * Replaces the value of an existing seed. Returns -ENOENT if there
+ * is no seed with this id.
+ */
+int ts3init_seed_replace(struct net *net, u32 id, const u8 *random_seed);
+
+/*
+ * Removes a seed. Returns -ENOENT if there is no seed with this id, or
+ * -EBUSY if it is still used by a rule.
+ */
+int ts3init_seed_remove(struct net *net, u32 id);
+
+/*
+ * Returns the seed with this id for use by a rule, or NULL.
+ * Must be paired with ts3init_seed_put().
+ */
+struct ts3init_seed *ts3init_seed_get(struct net *net, u32 id);
+void ts3init_seed_put(struct ts3init_seed *seed);
+
+/*
+ * Removes all seeds of a namespace that goes away.
+ */
+void ts3init_seed_net_exit(struct net *net);
+
+#endif /* _TS3INIT_SEED_H */
@@ -0,0 +1,629 @@
+/*
+ *    "ts3init" extension for Xtables
+ *
+ *    Description: A throughput self test for xt_ts3init.
+ *                 Builds TS3INIT packets in the kernel and feeds them to
+ *                 the registered matches and targets of xt_ts3init on
+ *                 1, 2, 4, ... cpus, without any syscall or NIC in the way.
+ *                 The results are printed to the kernel log. Load it with
+ *                 insmod in a network namespace, see test/selftest.sh.
+ *
+ *    This program is free software; you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License; either version 2
+ *    or 3 of the License, as published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/version.h>
+#include <linux/module.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+#include <linux/rcupdate.h>
+#include <linux/skbuff.h>
+#include <linux/ip.h>
+#include <linux/udp.h>
+#include <linux/nsproxy.h>
+#include <linux/netfilter/x_tables.h>
+#include <linux/netfilter_ipv4/ip_tables.h>
+#include <net/ip.h>
+#include <net/route.h>
+#include <net/net_namespace.h>
+#include "compat_xtables.h"
+#include "ts3init_random_seed.h"
+#include "ts3init_cookie.h"
+#include "ts3init_header.h"
+#include "ts3init_match.h"
+#include "ts3init_target.h"
+
+MODULE_AUTHOR("Niels Werensteijn <niels.werensteijn@teamspeak.com>");
+MODULE_DESCRIPTION("Throughput self test for xt_ts3init");
+MODULE_LICENSE("GPL");
+
+static unsigned int duration_ms = 1000;
+module_param(duration_ms, uint, 0444);
+MODULE_PARM_DESC(duration_ms, "Duration of each run in milliseconds (default 1000)");
+
+static unsigned int max_cpus;
+module_param(max_cpus, uint, 0444);
+MODULE_PARM_DESC(max_cpus, "Highest number of cpus to run on (default 0: all online cpus)");
+
+/* defined in ts3init_cookie.c */
+int ts3init_cookie_init(void) __init;
+void ts3init_cookie_exit(void);
+
+enum
+{
+    /* distinct packets per cpu, from as many clients */
+    SELFTEST_PACKETS = 256,
+    /* packets per bottom half section */
+    SELFTEST_BATCH = 64,
+    SELFTEST_DPORT = 9987,
+    SELFTEST_CLIENT_VERSION = 1459504131,
+    /* get puzzle packets carry the cookie and its packet index */
+    SELFTEST_GET_PUZZLE_LENGTH = TS3INIT_HEADER_CLIENT_LENGTH + 20,
+    SELFTEST_GET_COOKIE_LENGTH = TS3INIT_HEADER_CLIENT_LENGTH + 16
+};
+
+/* 198.18.0.0/15, the benchmark range of RFC 2544 */
+#define SELFTEST_SADDR 0xc6120000
+#define SELFTEST_DADDR 0x0ac70002
+
+/*
+ * A workload: packets of one command, a match and optionally a target
+ * that is called for the packets the match accepts.
+ */
+struct ts3init_selftest_workload
+{
+    const char *name;
+    u8 command;
+    const char *match_name;
+    const char *target_name;
+};
+
+static const struct ts3init_selftest_workload ts3init_selftest_workloads[] =
+{
+    /* get cookie match alone, and with the reply */
+    { "get_cookie",  COMMAND_GET_COOKIE, "ts3init_get_cookie", NULL },
+    { "set_cookie",  COMMAND_GET_COOKIE, "ts3init_get_cookie", "TS3INIT_SET_COOKIE" },
+    /* get puzzle with valid cookies */
+    { "get_puzzle",  COMMAND_GET_PUZZLE, "ts3init_get_puzzle", NULL },
+};
+
+/*
+ * The rule a run uses. The matchinfo and targinfo are those of revision 0,
+ * with the random seed in the rule.
+ */
+struct ts3init_selftest_rule
+{
+    struct net *net;
+    /* the route to the clients, set on the packets as a received one */
+    struct dst_entry *dst;
+    const struct ts3init_selftest_workload *workload;
+    struct xt_match *match;
+    struct xt_target *target;
+    union
+    {
+        struct xt_ts3init_get_cookie_mtinfo get_cookie;
+        struct xt_ts3init_get_puzzle_mtinfo get_puzzle;
+    } matchinfo;
+    struct xt_ts3init_set_cookie_tginfo targinfo;
+    u8 random_seed[RANDOM_SEED_LEN];
+};
+
+struct ts3init_selftest_worker
+{
+    const struct ts3init_selftest_rule *rule;
+    int cpu;
+    struct completion *start;
+    struct completion done;
+    /* cookie seeds of the get puzzle packets */
+    struct xt_ts3init_cookie_cache *cookie_cache;
+    time_t cookie_time;
+    struct sk_buff *skbs[SELFTEST_PACKETS];
+    u64 packets;
+    u64 matched;
+    u64 ns;
+};
+
+/*
+ * Builds the packet of client n of a worker, from 198.18.x.y to
+ * 10.199.0.2:9987.
+ */
+static struct sk_buff *
+ts3init_selftest_alloc_skb(const struct ts3init_selftest_rule *rule, int cpu, unsigned int n)
+{
+    const unsigned int data_len = rule->workload->command == COMMAND_GET_PUZZLE ?
+        SELFTEST_GET_PUZZLE_LENGTH : SELFTEST_GET_COOKIE_LENGTH;
+    const __u32 version = SELFTEST_CLIENT_VERSION - CLIENT_VERSION_OFFSET;
+    struct sk_buff *skb;
+    struct iphdr *ip;
+    struct udphdr *udp;
+    u8 *data;
+
+    skb = __alloc_skb(LL_MAX_HEADER + sizeof(*ip) + sizeof(*udp) + data_len,
+                      GFP_KERNEL, 0, cpu_to_node(cpu));
+    if (skb == NULL)
+        return NULL;
+    skb_reserve(skb, LL_MAX_HEADER);
+
+    skb_reset_network_header(skb);
+    ip = (struct iphdr *)skb_put(skb, sizeof(*ip));
+    memset(ip, 0, sizeof(*ip));
+    ip->version  = 4;
+    ip->ihl      = sizeof(*ip) / 4;
+    ip->ttl      = 64;
+    ip->protocol = IPPROTO_UDP;
+    ip->tot_len  = htons(sizeof(*ip) + sizeof(*udp) + data_len);
+    ip->saddr    = htonl(SELFTEST_SADDR | (cpu << 8 | n) % (1 << 17));
+    ip->daddr    = htonl(SELFTEST_DADDR);
+    ip_send_check(ip);
+
+    skb_set_transport_header(skb, sizeof(*ip));
+    udp = (struct udphdr *)skb_put(skb, sizeof(*udp));
+    udp->source = htons(1024 + n);
+    udp->dest   = htons(SELFTEST_DPORT);
+    udp->len    = htons(sizeof(*udp) + data_len);
+    udp->check  = 0;
+
+    data = skb_put(skb, data_len);
+    memset(data, 0, data_len);
+    memcpy(data, "TS3INIT1", 8);
+    data[9]  = 101;
+    data[12] = 0x88;
+    data[13] = version >> 24;
+    data[14] = version >> 16;
+    data[15] = version >> 8;
+    data[16] = version;
+    data[17] = rule->workload->command;
+    /* the random sequence of a get cookie packet */
+    data[TS3INIT_HEADER_CLIENT_LENGTH + 4] = n;
+
+    skb->protocol = htons(ETH_P_IP);
+    skb->dev = rule->net->loopback_dev;
+    skb_dst_set(skb, dst_clone(rule->dst));
+    return skb;
+}
+
+/*
+ * Writes valid cookies into the get puzzle packets of a worker, once per
+ * second, so they stay valid however long the run is.
+ */
+static void ts3init_selftest_update_cookies(struct ts3init_selftest_worker *worker)
+{
+    time_t now = ktime_get_real_seconds();
+    __u8 packet_index = now % 8;
+    __u64 *cookie_seed, cookie;
+    u8 *payload;
+    int i, j;
+
+    if (worker->rule->workload->command != COMMAND_GET_PUZZLE ||
+        worker->cookie_time == now)
+        return;
+    worker->cookie_time = now;
+
+    cookie_seed = ts3init_get_cookie_seed(now, packet_index, worker->cookie_cache,
+                                          worker->rule->random_seed);
+    if (cookie_seed == NULL)
+        return;
+
+    for (i = 0; i < SELFTEST_PACKETS; i++)
+    {
+        struct sk_buff *skb = worker->skbs[i];
+
+        ts3init_calculate_cookie_ipv4(ip_hdr(skb), udp_hdr(skb),
+                                      cookie_seed[0], cookie_seed[1], &cookie);
+        payload = skb_transport_header(skb) + sizeof(struct udphdr) +
+            TS3INIT_HEADER_CLIENT_LENGTH;
+        for (j = 0; j < 8; j++)
+            payload[j] = (u8)(cookie >> (j * 8));
+        payload[8] = packet_index;
+    }
+}
+
+static void ts3init_selftest_init_par(const struct ts3init_selftest_rule *rule,
+                                      struct xt_action_param *par,
+                                      struct nf_hook_state *state)
+{
+    memset(par, 0, sizeof(*par));
+    par->thoff = sizeof(struct iphdr);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 10, 0)
+    memset(state, 0, sizeof(*state));
+    state->hook = NF_INET_LOCAL_IN;
+    state->pf   = NFPROTO_IPV4;
+    state->in   = rule->net->loopback_dev;
+    state->net  = rule->net;
+    par->state  = state;
+#else
+    par->net     = rule->net;
+    par->in      = rule->net->loopback_dev;
+    par->hooknum = NF_INET_LOCAL_IN;
+    par->family  = NFPROTO_IPV4;
+#endif
+}
+
+/*
+ * Runs the rule on the packets of the worker for duration_ms, in batches
+ * with bottom halves disabled and under rcu_read_lock(), as in the
+ * netfilter hooks.
+ */
+static int ts3init_selftest_worker_fn(void *data)
+{
+    struct ts3init_selftest_worker *worker = data;
+    const struct ts3init_selftest_rule *rule = worker->rule;
+    struct xt_action_param mtpar, tgpar;
+    struct nf_hook_state state;
+    u64 start, end, now;
+    unsigned int i, n = 0;
+
+    ts3init_selftest_init_par(rule, &mtpar, &state);
+    mtpar.match = rule->match;
+    mtpar.matchinfo = &rule->matchinfo;
+    tgpar = mtpar;
+    tgpar.target = rule->target;
+    tgpar.targinfo = &rule->targinfo;
+
+    wait_for_completion(worker->start);
+
+    start = ktime_get_ns();
+    end = start + (u64)duration_ms * NSEC_PER_MSEC;
+    do
+    {
+        ts3init_selftest_update_cookies(worker);
+
+        local_bh_disable();
+        rcu_read_lock();
+        for (i = 0; i < SELFTEST_BATCH; i++)
+        {
+            struct sk_buff *skb = worker->skbs[n];
+
+            n = (n + 1) % SELFTEST_PACKETS;
+            if (!rule->match->match(skb, &mtpar))
+                continue;
+            worker->matched++;
+            if (rule->target != NULL)
+                rule->target->target(skb, &tgpar);
+        }
+        rcu_read_unlock();
+        local_bh_enable();
+        worker->packets += SELFTEST_BATCH;
+
+        cond_resched();
+        now = ktime_get_ns();
+    } while (now < end);
+
+    worker->ns = now - start;
+    complete(&worker->done);
+    return 0;
+}
+
+static void ts3init_selftest_free_workers(struct ts3init_selftest_worker *workers,
+                                          unsigned int count)
+{
+    unsigned int i, j;
+
+    for (i = 0; i < count; i++)
+    {
+        for (j = 0; j < SELFTEST_PACKETS; j++)
+            kfree_skb(workers[i].skbs[j]);
+        kfree(workers[i].cookie_cache);
+    }
+    kfree(workers);
+}
+
+/*
+ * Returns the rate of packets in ns in kpps, which the results print as
+ * Mpps with 3 decimals.
+ */
+static inline u64 ts3init_selftest_kpps(u64 packets, u64 ns)
+{
+    return ns ? div64_u64(packets * NSEC_PER_MSEC, ns) : 0;
+}
+
+static inline u64 ts3init_selftest_mpps(u64 kpps, u32 *decimals)
+{
+    return div_u64_rem(kpps, 1000, decimals);
+}
+
+/*
+ * Returns the packets the device of the route to the clients has sent.
+ */
+static u64 ts3init_selftest_tx_packets(const struct ts3init_selftest_rule *rule)
+{
+    struct rtnl_link_stats64 stats;
+
+    return dev_get_stats(rule->dst->dev, &stats)->tx_packets;
+}
+
+/*
+ * Runs rule on the first cpu_count online cpus at once. Returns the
+ * packets per second of all of them in kpps, or 0 on error. A rule with
+ * a target fails if no reply reached the device.
+ */
+static u64 ts3init_selftest_run(const struct ts3init_selftest_rule *rule,
+                                unsigned int cpu_count, u64 single_kpps)
+{
+    struct ts3init_selftest_worker *workers;
+    struct completion start;
+    u64 total_kpps = 0, cpu_kpps, matched = 0, packets = 0, sent;
+    unsigned int i, j, started = 0;
+    u32 decimals, cpu_decimals;
+    int cpu;
+
+    workers = kcalloc(cpu_count, sizeof(*workers), GFP_KERNEL);
+    if (workers == NULL)
+        return 0;
+    init_completion(&start);
+
+    i = 0;
+    for_each_online_cpu(cpu)
+    {
+        struct ts3init_selftest_worker *worker = &workers[i];
+
+        if (i == cpu_count)
+            break;
+        worker->rule = rule;
+        worker->cpu = cpu;
+        worker->start = &start;
+        init_completion(&worker->done);
+        worker->cookie_cache = kzalloc_node(sizeof(*worker->cookie_cache),
+                                            GFP_KERNEL, cpu_to_node(cpu));
+        if (worker->cookie_cache == NULL)
+            goto out_free;
+        for (j = 0; j < SELFTEST_PACKETS; j++)
+        {
+            worker->skbs[j] = ts3init_selftest_alloc_skb(rule, cpu, j);
+            if (worker->skbs[j] == NULL)
+                goto out_free;
+        }
+        i++;
+    }
+
+    for (i = 0; i < cpu_count; i++)
+    {
+        struct task_struct *task;
+
+        task = kthread_create_on_node(ts3init_selftest_worker_fn, &workers[i],
+                                      cpu_to_node(workers[i].cpu),
+                                      "ts3init_selftest/%d", workers[i].cpu);
+        if (IS_ERR(task))
+            break;
+        kthread_bind(task, workers[i].cpu);
+        wake_up_process(task);
+        started++;
+    }
+
+    sent = ts3init_selftest_tx_packets(rule);
+    complete_all(&start);
+    for (i = 0; i < started; i++)
+        wait_for_completion(&workers[i].done);
+    if (started != cpu_count)
+    {
+        printk(KERN_ERR KBUILD_MODNAME ": could not start %u threads\n", cpu_count);
+        goto out_free;
+    }
+    /* the workers flushed their reply queues when they enabled bottom halves */
+    sent = ts3init_selftest_tx_packets(rule) - sent;
+    if (rule->target != NULL && sent == 0)
+    {
+        printk(KERN_ERR KBUILD_MODNAME ": %s sent no replies\n", rule->workload->target_name);
+        goto out_free;
+    }
+
+    for (i = 0; i < cpu_count; i++)
+    {
+        u64 kpps = ts3init_selftest_kpps(workers[i].packets, workers[i].ns);
+        u64 mpps = ts3init_selftest_mpps(kpps, &decimals);
+
+        printk(KERN_INFO KBUILD_MODNAME ": %s cpus=%u cpu%d %llu.%03u Mpps\n",
+               rule->workload->name, cpu_count, workers[i].cpu, mpps, decimals);
+        total_kpps += kpps;
+        matched += workers[i].matched;
+        packets += workers[i].packets;
+    }
+    if (single_kpps == 0)
+        single_kpps = total_kpps;
+    cpu_kpps = div_u64(total_kpps, cpu_count);
+    printk(KERN_INFO KBUILD_MODNAME ": %s cpus=%u total %llu.%03u Mpps, %llu.%03u Mpps/cpu, "
+           "scaling %llu%%, matched %llu of %llu, sent %llu\n",
+           rule->workload->name, cpu_count,
+           ts3init_selftest_mpps(total_kpps, &decimals), decimals,
+           ts3init_selftest_mpps(cpu_kpps, &cpu_decimals), cpu_decimals,
+           single_kpps ? div64_u64(cpu_kpps * 100, single_kpps) : 0,
+           matched, packets, sent);
+
+    ts3init_selftest_free_workers(workers, cpu_count);
+    return total_kpps;
+
+out_free:
+    ts3init_selftest_free_workers(workers, cpu_count);
+    return 0;
+}
+
+/*
+ * Finds the match and target of a workload and checks the rule, like
+ * iptables does when the rule is added to the INPUT chain.
+ */
+static int ts3init_selftest_get_rule(struct ts3init_selftest_rule *rule)
+{
+    static struct ipt_entry entry;
+    struct xt_mtchk_param mtpar = {};
+    struct xt_tgchk_param tgpar = {};
+    int error;
+
+    rule->match = xt_request_find_match(NFPROTO_IPV4, rule->workload->match_name, 0);
+    if (IS_ERR(rule->match))
+    {
+        printk(KERN_ERR KBUILD_MODNAME ": could not find %s, is xt_ts3init loaded?\n",
+               rule->workload->match_name);
+        return PTR_ERR(rule->match);
+    }
+
+    memset(&rule->matchinfo, 0, sizeof(rule->matchinfo));
+    if (rule->workload->command == COMMAND_GET_PUZZLE)
+    {
+        rule->matchinfo.get_puzzle.common_options = CHK_COMMON_CLIENT_VERSION;
+        rule->matchinfo.get_puzzle.specific_options = CHK_GET_PUZZLE_CHECK_COOKIE |
+            CHK_GET_PUZZLE_RANDOM_SEED_FROM_ARGUMENT;
+        rule->matchinfo.get_puzzle.min_client_version =
+            SELFTEST_CLIENT_VERSION - CLIENT_VERSION_OFFSET;
+        memcpy(rule->matchinfo.get_puzzle.random_seed, rule->random_seed, RANDOM_SEED_LEN);
+    }
+    else
+    {
+        rule->matchinfo.get_cookie.common_options = CHK_COMMON_CLIENT_VERSION;
+        rule->matchinfo.get_cookie.min_client_version =
+            SELFTEST_CLIENT_VERSION - CLIENT_VERSION_OFFSET;
+    }
+
+    mtpar.net       = rule->net;
+    mtpar.table     = "filter";
+    mtpar.entryinfo = &entry;
+    mtpar.match     = rule->match;
+    mtpar.matchinfo = &rule->matchinfo;
+    mtpar.hook_mask = 1 << NF_INET_LOCAL_IN;
+    mtpar.family    = NFPROTO_IPV4;
+    error = xt_check_match(&mtpar, XT_ALIGN(rule->match->matchsize), IPPROTO_UDP, false);
+    if (error)
+        goto out_match;
+
+    rule->target = NULL;
+    if (rule->workload->target_name == NULL)
+        return 0;
+
+    rule->target = xt_request_find_target(NFPROTO_IPV4, rule->workload->target_name, 0);
+    if (IS_ERR(rule->target))
+    {
+        printk(KERN_ERR KBUILD_MODNAME ": could not find %s\n", rule->workload->target_name);
+        error = PTR_ERR(rule->target);
+        goto out_match;
+    }
+
+    memset(&rule->targinfo, 0, sizeof(rule->targinfo));
+    rule->targinfo.specific_options = TARGET_SET_COOKIE_RANDOM_SEED_FROM_ARGUMENT;
+    memcpy(rule->targinfo.random_seed, rule->random_seed, RANDOM_SEED_LEN);
+
+    tgpar.net       = rule->net;
+    tgpar.table     = "filter";
+    tgpar.entryinfo = &entry;
+    tgpar.target    = rule->target;
+    tgpar.targinfo  = &rule->targinfo;
+    tgpar.hook_mask = 1 << NF_INET_LOCAL_IN;
+    tgpar.family    = NFPROTO_IPV4;
+    error = xt_check_target(&tgpar, XT_ALIGN(rule->target->targetsize), IPPROTO_UDP, false);
+    if (error)
+    {
+        module_put(rule->target->me);
+        goto out_match;
+    }
+    return 0;
+
+out_match:
+    module_put(rule->match->me);
+    return error;
+}
+
+/*
+ * The rules of the self test have nothing to clean up in xt_ts3init, as
+ * they are revision 0 without seed or port table references.
+ */
+static void ts3init_selftest_put_rule(struct ts3init_selftest_rule *rule)
+{
+    if (rule->target != NULL)
+        module_put(rule->target->me);
+    module_put(rule->match->me);
+}
+
+/*
+ * The replies of TS3INIT_SET_COOKIE need a route to the clients. Looking
+ * it up here makes a missing route an error, instead of a test that
+ * only measures failing route lookups.
+ */
+static int ts3init_selftest_get_route(struct ts3init_selftest_rule *rule)
+{
+    struct flowi4 fl4 = { .daddr = htonl(SELFTEST_SADDR) };
+    struct rtable *rt;
+
+    rt = ip_route_output_key(rule->net, &fl4);
+    if (IS_ERR(rt))
+    {
+        printk(KERN_ERR KBUILD_MODNAME ": no route to 198.18.0.0/15, add one to a "
+               "dummy device, see test/selftest.sh\n");
+        return PTR_ERR(rt);
+    }
+    rule->dst = &rt->dst;
+    return 0;
+}
+
+static int __init ts3init_selftest_init(void)
+{
+    struct ts3init_selftest_rule rule;
+    unsigned int cpu_count, i, n;
+    u64 single_kpps;
+    int error;
+
+    rule.net = current->nsproxy->net_ns;
+    if (net_eq(rule.net, &init_net))
+    {
+        printk(KERN_ERR KBUILD_MODNAME ": the replies go to 198.18.0.0/15, load the "
+               "self test in a network namespace, see test/selftest.sh\n");
+        return -EINVAL;
+    }
+
+    error = ts3init_selftest_get_route(&rule);
+    if (error)
+        return error;
+
+    error = ts3init_cookie_init();
+    if (error)
+        goto out_route;
+
+    for (i = 0; i < RANDOM_SEED_LEN; i++)
+        rule.random_seed[i] = i;
+    cpu_count = num_online_cpus();
+    if (max_cpus && max_cpus < cpu_count)
+        cpu_count = max_cpus;
+
+    for (i = 0; i < ARRAY_SIZE(ts3init_selftest_workloads); i++)
+    {
+        rule.workload = &ts3init_selftest_workloads[i];
+        error = ts3init_selftest_get_rule(&rule);
+        if (error)
+            break;
+
+        /* 1, 2, 4, ... cpus and all of them */
+        single_kpps = 0;
+        for (n = 1; ; n = min(n * 2, cpu_count))
+        {
+            u64 kpps = ts3init_selftest_run(&rule, n, single_kpps);
+
+            if (kpps == 0)
+            {
+                error = -ENOMEM;
+                break;
+            }
+            if (n == 1)
+                single_kpps = kpps;
+            if (n == cpu_count)
+                break;
+        }
+
+        ts3init_selftest_put_rule(&rule);
+        if (error)
+            break;
+    }
+
+    ts3init_cookie_exit();
+out_route:
+    dst_release(rule.dst);
+    return error;
+}
+
+static void __exit ts3init_selftest_exit(void)
+{
+}
+
+module_init(ts3init_selftest_init);
+module_exit(ts3init_selftest_exit);
@@ -0,0 +1,18 @@
+/*
+ *    "ts3init" extension for Xtables
+ *
+ *    Description: The cookie code of xt_ts3init, built into
+ *                 xt_ts3init_selftest so it can put valid cookies into its
+ *                 get puzzle packets. Kbuild does not link one object into
+ *                 two modules, so the sources are included here.
+ *
+ *    This program is free software; you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License; either version 2
+ *    or 3 of the License, as published by the Free Software Foundation.
+ */
+
+/* the profile histograms are part of xt_ts3init */
+#define TS3INIT_NO_PROFILE
+
+#include "ts3init_cookie.c"
+#include "siphash24.c"
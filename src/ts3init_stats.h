@@ -0,0 +1,75 @@
+#ifndef _TS3INIT_STATS_H
+#define _TS3INIT_STATS_H
+
+#include <linux/version.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)
+#   include <linux/sched/clock.h>
+#else
+#   include <linux/sched.h>
+#endif
+
+/*
+ * Per cpu counters of a network namespace, indexed by TS3INIT_STAT_*
+ * from ts3init_netlink.h.
+ */
+struct ts3init_stats
+{
+    unsigned long counters[__TS3INIT_STAT_MAX];
+};
+
+static inline void ts3init_stat_inc(const struct net *net, int stat)
+{
+    this_cpu_inc(ts3init_pernet(net)->stats->counters[stat]);
+}
+
+/*
+ * The outcome of the checks of a match, or of a target up to sending its
+ * reply. Rules with --shadow count it in the TS3INIT_STAT_SHADOW_*
+ * counter of the same name.
+ */
+enum ts3init_result
+{
+    TS3INIT_RESULT_MATCH          = TS3INIT_STAT_SHADOW_MATCHED,
+    TS3INIT_RESULT_HEADER         = TS3INIT_STAT_SHADOW_HEADER,
+    TS3INIT_RESULT_CLIENT_VERSION = TS3INIT_STAT_SHADOW_CLIENT_VERSION,
+    TS3INIT_RESULT_PORT           = TS3INIT_STAT_SHADOW_PORT,
+    TS3INIT_RESULT_TIME           = TS3INIT_STAT_SHADOW_TIME,
+    TS3INIT_RESULT_COOKIE         = TS3INIT_STAT_SHADOW_COOKIE,
+    TS3INIT_RESULT_PUZZLE         = TS3INIT_STAT_SHADOW_PUZZLE,
+    TS3INIT_RESULT_REPLAY         = TS3INIT_STAT_SHADOW_REPLAY,
+};
+
+/* Returns the start time of the checks of a --shadow rule. */
+static inline u64 ts3init_shadow_start(bool shadow)
+{
+    return shadow ? local_clock() : 0;
+}
+
+/*
+ * Counts the result of the checks of a --shadow rule, and the time they
+ * took since start.
+ */
+static inline void ts3init_shadow_count(const struct net *net, enum ts3init_result result,
+                                        u64 start)
+{
+    struct ts3init_stats __percpu *stats = ts3init_pernet(net)->stats;
+
+    this_cpu_inc(stats->counters[TS3INIT_STAT_SHADOW_EVALUATED]);
+    this_cpu_inc(stats->counters[result]);
+    this_cpu_add(stats->counters[TS3INIT_STAT_SHADOW_NS], local_clock() - start);
+}
+
+/*
+ * Returns the verdict of a match with result. A --shadow match counts
+ * the result and always matches, as if it was not part of the rule.
+ */
+static inline bool ts3init_shadow_match(const struct net *net, bool shadow,
+                                        enum ts3init_result result, u64 start)
+{
+    if (likely(!shadow))
+        return result == TS3INIT_RESULT_MATCH;
+    ts3init_shadow_count(net, result, start);
+    return true;
+}
+
+#endif /* _TS3INIT_STATS_H */
@@ -26,28 +26,178 @@
 #include <net/ip.h>
 #include <net/ip6_checksum.h>
 #include <net/ip6_route.h>
+#include <linux/netfilter_ipv6.h>
 #include <net/route.h>
+#include <net/xfrm.h>
+#include <net/netfilter/nf_conntrack.h>
+#include <net/net_namespace.h>
+#include <net/netns/generic.h>
+#include <linux/hashtable.h>
 #include "compat_xtables.h"
 #include "ts3init_random_seed.h"
 #include "ts3init_cookie.h"
 #include "ts3init_target.h"
 #include "ts3init_header.h"
 #include "ts3init_cache.h"
+#include "ts3init_reply.h"
+#include "ts3init_puzzle.h"
+#include "ts3init_seed.h"
+#include "ts3init_port_table.h"
+#include "ts3init_netlink.h"
+#include "ts3init_net.h"
+#include "ts3init_stats.h"
+#include "ts3init_adaptive.h"
+#include "ts3init_trusted.h"
+#include "ts3init_profile.h"
+#include "ts3init_variant.h"
 
 
 /*
- * Send a reply back to the client
+ * Returns the index of the device the packet came in on, or 0.
+ */
+static inline int
+ts3init_in_ifindex(const struct xt_action_param *par)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 10, 0)
+    const struct net_device *in = xt_in(par);
+#else
+    const struct net_device *in = par->in;
+#endif
+    return in != NULL ? in->ifindex : 0;
+}
+
+/*
+ * Routes an ipv6 reply to oldskb.
+ * skb may be oldskb itself, when the reply is made in place. oldskb has
+ * no dst yet when it is replied to before the routing decision, in
+ * PREROUTING.
+ */
+static __always_inline int
+__ts3init_route_ipv6_reply(struct net *net, struct sk_buff *skb, struct sk_buff *oldskb)
+{
+    const struct ipv6hdr *ip = ipv6_hdr(skb);
+    const struct udphdr *udp = udp_hdr(skb);
+    struct dst_entry *dst;
+    struct flowi6 fl;
+    int error;
+
+    if (skb == oldskb && skb_dst(skb) != NULL)
+    {
+        error = ip6_route_me_harder(net, skb);
+        if (error)
+            return error;
+    }
+    else
+    {
+        memset(&fl, 0, sizeof(fl));
+        fl.flowi6_proto = ip->nexthdr;
+        memcpy(&fl.saddr, &ip->saddr, sizeof(fl.saddr));
+        memcpy(&fl.daddr, &ip->daddr, sizeof(fl.daddr));
+        fl.fl6_sport = udp->source;
+        fl.fl6_dport = udp->dest;
+        security_skb_classify_flow((struct sk_buff *)oldskb, flowi6_to_flowi(&fl));
+        dst = ip6_route_output(net, NULL, &fl);
+        if (dst == NULL || dst->error != 0) {
+            error = dst ? dst->error : -ENETUNREACH;
+            dst_release(dst);
+            return error;
+        }
+        skb_dst_set(skb, dst);
+    }
+    return 0;
+}
+
+/*
+ * Routes an ipv4 reply to oldskb.
+ * skb may be oldskb itself, when the reply is made in place. oldskb has
+ * no dst yet when it is replied to before the routing decision, in
+ * PREROUTING.
+ */
+static __always_inline int
+__ts3init_route_ipv4_reply(struct net *net, struct sk_buff *skb, struct sk_buff *oldskb)
+{
+    const struct iphdr *ip;
+    const struct udphdr *udp;
+    struct rtable *rt;
+    struct flowi4 fl;
+
+    if (skb_dst(oldskb) == NULL)
+    {
+        ip = ip_hdr(skb);
+        udp = udp_hdr(skb);
+        memset(&fl, 0, sizeof(fl));
+        fl.flowi4_proto = ip->protocol;
+        /* as ip_route_me_harder, the source need not be local */
+        fl.flowi4_flags = FLOWI_FLAG_ANYSRC;
+        fl.saddr = ip->saddr;
+        fl.daddr = ip->daddr;
+        fl.fl4_sport = udp->source;
+        fl.fl4_dport = udp->dest;
+        security_skb_classify_flow(oldskb, flowi4_to_flowi(&fl));
+        rt = ip_route_output_key(net, &fl);
+        if (IS_ERR(rt))
+            return PTR_ERR(rt);
+        skb_dst_set(skb, &rt->dst);
+        return 0;
+    }
+
+    /* ip_route_me_harder expects the skb's dst to be set */
+    if (skb_dst(skb) == NULL)
+        skb_dst_set(skb, dst_clone(skb_dst(oldskb)));
+
+    return ip_route_me_harder(net, skb, RTN_UNSPEC);
+}
+
+/*
+ * Routes an ipv6 reply, timed as the route stage of the profile.
+ */
+static int
+ts3init_route_ipv6_reply(struct net *net, struct sk_buff *skb, struct sk_buff *oldskb)
+{
+    u64 profile = ts3init_profile_start();
+    int error = __ts3init_route_ipv6_reply(net, skb, oldskb);
+
+    ts3init_profile_end(TS3INIT_PROFILE_ROUTE, profile);
+    return error;
+}
+
+/*
+ * Routes an ipv4 reply, timed as the route stage of the profile.
+ */
+static int
+ts3init_route_ipv4_reply(struct net *net, struct sk_buff *skb, struct sk_buff *oldskb)
+{
+    u64 profile = ts3init_profile_start();
+    int error = __ts3init_route_ipv4_reply(net, skb, oldskb);
+
+    ts3init_profile_end(TS3INIT_PROFILE_ROUTE, profile);
+    return error;
+}
+
+/*
+ * Queues a routed reply, directly for the ingress device if the target
+ * has --direct-xmit and the reply can be sent that way.
+ */
+static inline void
+ts3init_xmit_reply(struct sk_buff *skb, const struct xt_action_param *par, u8 common_options)
+{
+    bool direct = (common_options & TARGET_COMMON_DIRECT_XMIT) &&
+        ts3init_reply_prepare_direct_xmit(skb, ts3init_in_ifindex(par));
+
+    ts3init_reply_queue_xmit(par_net(par), skb, direct);
+}
+
+/*
+ * Send a reply back to the client.
+ * skb is a reply from ts3init_reply_alloc_ipv6(), it is always consumed.
  */
 static bool
-ts3init_send_ipv6_reply(struct sk_buff *oldskb, const struct xt_action_param *par, 
-                        const struct ipv6hdr *oldip, const struct udphdr *oldudp,
-                        const void* payload, const size_t payload_size)
+ts3init_send_ipv6_reply(struct sk_buff *skb, struct sk_buff *oldskb,
+                        const struct xt_action_param *par, u8 common_options,
+                        const struct ipv6hdr *oldip, const struct udphdr *oldudp)
 {
-    struct sk_buff *skb;
     struct ipv6hdr *ip;
     struct udphdr *udp;
-    struct flowi6 fl;
-    struct dst_entry *dst = NULL;
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 10, 0)
     struct net *net = dev_net((xt_in(par) != NULL) ? xt_in(par) : xt_out(par));
@@ -55,59 +205,29 @@ ts3init_send_ipv6_reply(struct sk_buff *oldskb, const struct xt_action_param *pa
     struct net *net = dev_net((par->in != NULL) ? par->in : par->out);
 #endif
 
-    skb = alloc_skb(LL_MAX_HEADER + sizeof(*ip) +
-             sizeof(*udp) + payload_size, GFP_ATOMIC);
-    if (skb == NULL)
-        return false;
-
-    skb_reserve(skb, LL_MAX_HEADER);
-    skb->protocol = oldskb->protocol;
-
-    skb_reset_network_header(skb);
-    ip = (void *)skb_put(skb, sizeof(*ip));
-    ip->version  = oldip->version;
+    ip = ipv6_hdr(skb);
     ip->priority = oldip->priority;
     memcpy(ip->flow_lbl, oldip->flow_lbl, sizeof(ip->flow_lbl));
-    ip->nexthdr  = par->target->proto;
     ip->saddr    = oldip->daddr;
     ip->daddr    = oldip->saddr;
 
-    skb_reset_transport_header(skb);
-    udp = (void *)skb_put(skb, sizeof(*udp));
+    udp = udp_hdr(skb);
     udp->source = oldudp->dest;
     udp->dest   = oldudp->source;
-    udp->len    = htons(sizeof(*udp) + payload_size);
-
-    memcpy(skb_put(skb, payload_size), payload, payload_size);
-
-    udp->check = 0;
-    udp->check = csum_ipv6_magic(&ip->saddr, &ip->daddr,
-                    ntohs(udp->len), IPPROTO_UDP,
-                    csum_partial(udp, ntohs(udp->len), 0));
-
-    memset(&fl, 0, sizeof(fl));
-    fl.flowi6_proto = ip->nexthdr;
-    memcpy(&fl.saddr, &ip->saddr, sizeof(fl.saddr));
-    memcpy(&fl.daddr, &ip->daddr, sizeof(fl.daddr));
-    fl.fl6_sport = udp->source;
-    fl.fl6_dport = udp->dest;
-    security_skb_classify_flow((struct sk_buff *)oldskb, flowi6_to_flowi(&fl));
-    dst = ip6_route_output(net, NULL, &fl);
-    if (dst == NULL || dst->error != 0) {
-        dst_release(dst);
+
+    if (ts3init_route_ipv6_reply(net, skb, oldskb) != 0)
         goto free_nskb;
-    }
 
-    skb_dst_set(skb, dst);
+    ip = ipv6_hdr(skb);
     ip->hop_limit = ip6_dst_hoplimit(skb_dst(skb));
-    skb->ip_summed = CHECKSUM_NONE;
+    ts3init_reply_csum_ipv6(skb);
 
     /* "Never happens" (?) */
     if (skb->len > dst_mtu(skb_dst(skb)))
         goto free_nskb;
 
     nf_ct_attach(skb, oldskb);
-    ip6_local_out(par_net(par), skb->sk, skb);
+    ts3init_xmit_reply(skb, par, common_options);
     return true;
 
  free_nskb:
@@ -116,65 +236,41 @@ ts3init_send_ipv6_reply(struct sk_buff *oldskb, const struct xt_action_param *pa
 }
 
 /*
- * Send a reply back to the client
+ * Send a reply back to the client.
+ * skb is a reply from ts3init_reply_alloc_ipv4(), it is always consumed.
  */
 static bool
-ts3init_send_ipv4_reply(struct sk_buff *oldskb, const struct xt_action_param *par, 
-                        const struct iphdr *oldip, const struct udphdr *oldudp,
-                        const void* payload, const size_t payload_size)
+ts3init_send_ipv4_reply(struct sk_buff *skb, struct sk_buff *oldskb,
+                        const struct xt_action_param *par, u8 common_options,
+                        const struct iphdr *oldip, const struct udphdr *oldudp)
 {
-    struct sk_buff *skb;
     struct iphdr *ip;
     struct udphdr *udp;
 
-    skb = alloc_skb(LL_MAX_HEADER + sizeof(*ip) +
-         sizeof(*udp) + payload_size, GFP_ATOMIC);
-    if (skb == NULL)
-        return false;
-
-    skb_reserve(skb, LL_MAX_HEADER);
-    skb->protocol = oldskb->protocol;
-
-    skb_reset_network_header(skb);
-    ip = (void *)skb_put(skb, sizeof(*ip));
-    ip->version  = oldip->version;
-    ip->ihl      = sizeof(*ip) / 4;
+    ip = ip_hdr(skb);
     ip->tos      = oldip->tos;
-    ip->id       = 0;
-    ip->frag_off = htons(IP_DF);
-    ip->protocol = oldip->protocol;
-    ip->check    = 0;
     ip->saddr    = oldip->daddr;
     ip->daddr    = oldip->saddr;
 
-    skb_reset_transport_header(skb);
-    udp = (void *)skb_put(skb, sizeof(*udp));
+    udp = udp_hdr(skb);
     udp->source = oldudp->dest;
     udp->dest   = oldudp->source;
-    udp->len    = htons(sizeof(*udp) + payload_size);
-
-    memcpy(skb_put(skb, payload_size), payload, payload_size);
 
-    udp->check = 0;
-    udp->check = csum_tcpudp_magic(ip->saddr, ip->daddr,
-                    ntohs(udp->len), IPPROTO_UDP,
-                    csum_partial(udp, ntohs(udp->len), 0));
-
-    /* ip_route_me_harder expects the skb's dst to be set */
-    skb_dst_set(skb, dst_clone(skb_dst(oldskb)));
-
-    if (ip_route_me_harder(par_net(par), skb, RTN_UNSPEC) != 0)
+    if (ts3init_route_ipv4_reply(par_net(par), skb, oldskb) != 0)
         goto free_nskb;
 
+    ip = ip_hdr(skb);
     ip->ttl = ip4_dst_hoplimit(skb_dst(skb));
-    skb->ip_summed = CHECKSUM_NONE;
+    /* --direct-xmit skips ip_local_out, which would set it */
+    ip_send_check(ip);
+    ts3init_reply_csum_ipv4(skb);
 
     /* "Never happens" (?) */
     if (skb->len > dst_mtu(skb_dst(skb)))
         goto free_nskb;
 
     nf_ct_attach(skb, oldskb);
-    ip_local_out(par_net(par), skb->sk, skb);
+    ts3init_xmit_reply(skb, par, common_options);
     return true;
 
  free_nskb:
@@ -182,47 +278,413 @@ ts3init_send_ipv4_reply(struct sk_buff *oldskb, const struct xt_action_param *pa
     return false;
 }
 
-/* The payload replied by TS3INIT_RESET. */
-static const char ts3init_reset_packet[] = {'T', 'S', '3', 'I', 'N', 'I', 'T', '1', 0, 0x65, 0x88, COMMAND_RESET, 0 };
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 4, 0)
+#    define nf_reset_ct nf_reset
+#endif
+
+/*
+ * Drops the netfilter state the input path left on a received skb that
+ * was turned into a reply. Its conntrack entry is attached again, in the
+ * other direction, as nf_ct_attach() does for a new reply. Untracked skbs
+ * stay untracked.
+ */
+static void
+ts3init_reset_in_place_nf(struct sk_buff *skb)
+{
+#if IS_ENABLED(CONFIG_NF_CONNTRACK)
+    enum ip_conntrack_info ctinfo;
+    struct nf_conn *ct = nf_ct_get(skb, &ctinfo);
+
+    if (ct != NULL)
+    {
+        nf_conntrack_get(&ct->ct_general);
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 12, 0)
+        if (!nf_ct_is_untracked(ct))
+#endif
+            ctinfo = CTINFO2DIR(ctinfo) == IP_CT_DIR_ORIGINAL ?
+                     IP_CT_RELATED_REPLY : IP_CT_RELATED;
+    }
+#endif
+
+    nf_reset_ct(skb);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 4, 0) && IS_ENABLED(CONFIG_BRIDGE_NETFILTER)
+    /* nf_reset() dropped it on older kernels */
+    skb_ext_del(skb, SKB_EXT_BRIDGE_NF);
+#endif
+
+#if IS_ENABLED(CONFIG_NF_CONNTRACK)
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 11, 0)
+    skb->nfct = ct != NULL ? &ct->ct_general : NULL;
+    skb->nfctinfo = ctinfo;
+#else
+    nf_ct_set(skb, ct, ctinfo);
+#endif
+#endif
+}
+
+/*
+ * Prepares a received skb that was turned into a reply for the output path.
+ * Everything the input path left on it is dropped, so it leaves like a
+ * locally generated packet.
+ */
+static void
+ts3init_prepare_in_place_reply(struct sk_buff *skb)
+{
+    skb_orphan(skb);
+    skb_clear_hash(skb);
+    skb->tstamp = ktime_set(0, 0);
+    skb->encapsulation = 0;
+    skb->mark = 0;
+    skb->pkt_type = PACKET_HOST;
+    memset(skb->cb, 0, sizeof(skb->cb));
+    secpath_reset(skb);
+    ts3init_reset_in_place_nf(skb);
+}
+
+/*
+ * Turns the received packet into a reply carrying the ts3init 'packet',
+ * and sends it back to the client.
+ * Returns NF_STOLEN if skb was consumed, NF_DROP otherwise.
+ */
+static unsigned int
+ts3init_send_ipv6_reply_in_place(struct sk_buff *skb, const struct xt_action_param *par,
+                                 u8 common_options, const void *packet,
+                                 unsigned int packet_size)
+{
+    struct ipv6hdr *ip;
+    struct udphdr *udp;
+    struct in6_addr addr;
+    __be16 port;
+    unsigned int udp_len = sizeof(*udp) + packet_size;
+
+    if (ts3init_reply_resize(skb, par->thoff + udp_len))
+        return NF_DROP;
+
+    skb_set_transport_header(skb, par->thoff);
+    ip = ipv6_hdr(skb);
+    addr         = ip->saddr;
+    ip->saddr    = ip->daddr;
+    ip->daddr    = addr;
+    ip->payload_len = htons(par->thoff - sizeof(*ip) + udp_len);
+
+    udp = udp_hdr(skb);
+    port        = udp->source;
+    udp->source = udp->dest;
+    udp->dest   = port;
+    udp->len    = htons(udp_len);
+    memcpy(udp + 1, packet, packet_size);
+
+    ts3init_prepare_in_place_reply(skb);
+    if (ts3init_route_ipv6_reply(par_net(par), skb, skb) != 0)
+        return NF_DROP;
+
+    ip = ipv6_hdr(skb);
+    ip->hop_limit = ip6_dst_hoplimit(skb_dst(skb));
+    ts3init_reply_csum_ipv6(skb);
+
+    if (skb->len > dst_mtu(skb_dst(skb)))
+        return NF_DROP;
+
+    ts3init_xmit_reply(skb, par, common_options);
+    return NF_STOLEN;
+}
+
+/*
+ * Turns the received packet into a reply carrying the ts3init 'packet',
+ * and sends it back to the client.
+ * Returns NF_STOLEN if skb was consumed, NF_DROP otherwise.
+ */
+static unsigned int
+ts3init_send_ipv4_reply_in_place(struct sk_buff *skb, const struct xt_action_param *par,
+                                 u8 common_options, const void *packet,
+                                 unsigned int packet_size)
+{
+    struct iphdr *ip;
+    struct udphdr *udp;
+    __be32 addr;
+    __be16 port;
+    unsigned int udp_len = sizeof(*udp) + packet_size;
+
+    if (ts3init_reply_resize(skb, par->thoff + udp_len))
+        return NF_DROP;
+
+    skb_set_transport_header(skb, par->thoff);
+    ip = ip_hdr(skb);
+    addr         = ip->saddr;
+    ip->saddr    = ip->daddr;
+    ip->daddr    = addr;
+    ip->tot_len  = htons(par->thoff + udp_len);
+    ip->id       = 0;
+    ip->frag_off = htons(IP_DF);
+
+    udp = udp_hdr(skb);
+    port        = udp->source;
+    udp->source = udp->dest;
+    udp->dest   = port;
+    udp->len    = htons(udp_len);
+    memcpy(udp + 1, packet, packet_size);
+
+    ts3init_prepare_in_place_reply(skb);
+    if (ts3init_route_ipv4_reply(par_net(par), skb, skb) != 0)
+        return NF_DROP;
+
+    ip = ip_hdr(skb);
+    ip->ttl = ip4_dst_hoplimit(skb_dst(skb));
+    /* --direct-xmit skips ip_local_out, which would set it */
+    ip_send_check(ip);
+    ts3init_reply_csum_ipv4(skb);
+
+    if (skb->len > dst_mtu(skb_dst(skb)))
+        return NF_DROP;
+
+    ts3init_xmit_reply(skb, par, common_options);
+    return NF_STOLEN;
+}
+
+/*
+ * Returns true if the received packet can be turned into a reply.
+ * Fragments and packets with ip options or extension headers can not.
+ */
+static inline bool
+ts3init_can_reply_in_place_ipv4(const struct sk_buff *skb, const struct xt_action_param *par)
+{
+    return par->thoff == sizeof(struct iphdr) &&
+        !(ip_hdr(skb)->frag_off & htons(IP_MF | IP_OFFSET));
+}
+
+static inline bool
+ts3init_can_reply_in_place_ipv6(const struct sk_buff *skb, const struct xt_action_param *par)
+{
+    return par->thoff == sizeof(struct ipv6hdr);
+}
+
+/*
+ * Counts the result of a --shadow target, and lets the packet continue
+ * as if the rule was not there.
+ */
+static inline unsigned int
+ts3init_shadow_tg(const struct xt_action_param *par, enum ts3init_result result, u64 start)
+{
+    ts3init_shadow_count(par_net(par), result, start);
+    return XT_CONTINUE;
+}
+
+/*
+ * The 'TS3INIT_RESET' target with --shadow.
+ */
+static unsigned int
+ts3init_reset_shadow(const struct sk_buff *skb, const struct xt_action_param *par)
+{
+    u64 start = ts3init_shadow_start(true);
+    struct udphdr *udp, udp_buf;
+
+    udp = skb_header_pointer(skb, par->thoff, sizeof(*udp), &udp_buf);
+    if (udp == NULL || ntohs(udp->len) <= sizeof(*udp))
+        return ts3init_shadow_tg(par, TS3INIT_RESULT_HEADER, start);
+    return ts3init_shadow_tg(par, TS3INIT_RESULT_MATCH, start);
+}
 
 /* 
  * The 'TS3INIT_RESET' target handler.
  * Always replies with COMMAND_RESET and drops the packet
  */
 static unsigned int
-ts3init_reset_ipv4_tg(struct sk_buff *skb, const struct xt_action_param *par)
+ts3init_reset_ipv4(struct sk_buff *skb, const struct xt_action_param *par, u8 common_options)
 {
     struct iphdr *ip;
     struct udphdr *udp, udp_buf;
+    struct sk_buff *reply;
     ip  = ip_hdr(skb);
     udp = skb_header_pointer(skb, par->thoff, sizeof(*udp), &udp_buf);
     if (udp == NULL || ntohs(udp->len) <= sizeof(*udp))
         return NF_DROP;
 
-    ts3init_send_ipv4_reply(skb, par, ip, udp, ts3init_reset_packet, sizeof(ts3init_reset_packet));
+    reply = ts3init_reply_alloc_ipv4(par_net(par), TS3INIT_REPLY_RESET);
+    if (reply)
+        ts3init_send_ipv4_reply(reply, skb, par, common_options, ip, udp);
     return NF_DROP;
 }
 
+static unsigned int
+ts3init_reset_ipv4_tg(struct sk_buff *skb, const struct xt_action_param *par)
+{
+    u64 profile = ts3init_profile_start();
+    unsigned int verdict = ts3init_reset_ipv4(skb, par, 0);
+
+    ts3init_profile_end(TS3INIT_PROFILE_RESET, profile);
+    return verdict;
+}
+
 /* 
  * The 'TS3INIT_RESET' target handler.
  * Always replies with COMMAND_RESET and drops the packet.
  */
 static unsigned int
-ts3init_reset_ipv6_tg(struct sk_buff *skb, const struct xt_action_param *par)
+ts3init_reset_ipv6(struct sk_buff *skb, const struct xt_action_param *par, u8 common_options)
 {
     struct ipv6hdr *ip;
     struct udphdr *udp, udp_buf;
+    struct sk_buff *reply;
     ip  = ipv6_hdr(skb);
     udp = skb_header_pointer(skb, par->thoff, sizeof(*udp), &udp_buf);
     if (udp == NULL || ntohs(udp->len) <= sizeof(*udp))
         return NF_DROP;
 
-    ts3init_send_ipv6_reply(skb, par, ip, udp, ts3init_reset_packet, sizeof(ts3init_reset_packet));
+    reply = ts3init_reply_alloc_ipv6(par_net(par), TS3INIT_REPLY_RESET);
+    if (reply)
+        ts3init_send_ipv6_reply(reply, skb, par, common_options, ip, udp);
     return NF_DROP;
 }
 
-/* The header replied by TS3INIT_SET_COOKIE. */
-static const char ts3init_set_cookie_packet_header[TS3INIT_HEADER_SERVER_LENGTH] = {'T', 'S', '3', 'I', 'N', 'I', 'T', '1', 0, 0x65, 0x88, COMMAND_SET_COOKIE };
+static unsigned int
+ts3init_reset_ipv6_tg(struct sk_buff *skb, const struct xt_action_param *par)
+{
+    u64 profile = ts3init_profile_start();
+    unsigned int verdict = ts3init_reset_ipv6(skb, par, 0);
+
+    ts3init_profile_end(TS3INIT_PROFILE_RESET, profile);
+    return verdict;
+}
+
+/*
+ * The 'TS3INIT_RESET' target handler, revision 1.
+ * Same as revision 0, but can turn the packet into the reply and
+ * send it directly.
+ */
+static unsigned int
+ts3init_reset_ipv4_tg_v1(struct sk_buff *skb, const struct xt_action_param *par)
+{
+    const struct xt_ts3init_reset_tginfo *info = par->targinfo;
+    u8 packet[TS3INIT_RESET_PACKET_SIZE];
+    unsigned int verdict;
+    u64 profile;
+
+    if (unlikely(info->common_options & TARGET_COMMON_SHADOW))
+        return ts3init_reset_shadow(skb, par);
+
+    profile = ts3init_profile_start();
+    if ((info->common_options & TARGET_COMMON_IN_PLACE) &&
+        ts3init_can_reply_in_place_ipv4(skb, par))
+    {
+        ts3init_reply_copy_packet(TS3INIT_REPLY_RESET, packet);
+        verdict = ts3init_send_ipv4_reply_in_place(skb, par, info->common_options,
+                                                   packet, sizeof(packet));
+    }
+    else
+        verdict = ts3init_reset_ipv4(skb, par, info->common_options);
+    ts3init_profile_end(TS3INIT_PROFILE_RESET, profile);
+    return verdict;
+}
+
+/*
+ * The 'TS3INIT_RESET' target handler, revision 1.
+ * Same as revision 0, but can turn the packet into the reply and
+ * send it directly.
+ */
+static unsigned int
+ts3init_reset_ipv6_tg_v1(struct sk_buff *skb, const struct xt_action_param *par)
+{
+    const struct xt_ts3init_reset_tginfo *info = par->targinfo;
+    u8 packet[TS3INIT_RESET_PACKET_SIZE];
+    unsigned int verdict;
+    u64 profile;
+
+    if (unlikely(info->common_options & TARGET_COMMON_SHADOW))
+        return ts3init_reset_shadow(skb, par);
+
+    profile = ts3init_profile_start();
+    if ((info->common_options & TARGET_COMMON_IN_PLACE) &&
+        ts3init_can_reply_in_place_ipv6(skb, par))
+    {
+        ts3init_reply_copy_packet(TS3INIT_REPLY_RESET, packet);
+        verdict = ts3init_send_ipv6_reply_in_place(skb, par, info->common_options,
+                                                   packet, sizeof(packet));
+    }
+    else
+        verdict = ts3init_reset_ipv6(skb, par, info->common_options);
+    ts3init_profile_end(TS3INIT_PROFILE_RESET, profile);
+    return verdict;
+}
+
+/*
+ * Validates the common options of a target.
+ */
+static int ts3init_common_tg_check(const struct xt_tgchk_param *par,
+                                   u8 common_options, const char *name)
+{
+    if (common_options & ~(TARGET_COMMON_VALID_MASK))
+    {
+        printk(KERN_INFO KBUILD_MODNAME ": invalid (common) options for %s\n", name);
+        return -EINVAL;
+    }
+
+    /* the reply is sent on the device the packet came in on */
+    if ((common_options & TARGET_COMMON_DIRECT_XMIT) &&
+        (par->hook_mask & ~((1 << NF_INET_PRE_ROUTING) | (1 << NF_INET_LOCAL_IN) |
+                            (1 << NF_INET_FORWARD))))
+    {
+        printk(KERN_INFO KBUILD_MODNAME ": --direct-xmit for %s is only valid in "
+               "PREROUTING, INPUT and FORWARD\n", name);
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+/*
+ * Validates targinfo recieved from userspace.
+ */
+static int ts3init_reset_tg_check(const struct xt_tgchk_param *par)
+{
+    struct xt_ts3init_reset_tginfo *info = par->targinfo;
+    int error;
+
+    error = ts3init_common_tg_check(par, info->common_options, "TS3INIT_RESET");
+    if (error)
+        return error;
+
+    if (info->specific_options & ~(TARGET_RESET_VALID_MASK))
+    {
+        printk(KERN_INFO KBUILD_MODNAME ": invalid (specific) options for TS3INIT_RESET\n");
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+/*
+ * Returns the current cookie seed of a TS3INIT_SET_COOKIE rule. With a
+ * port table, the seed is taken from the entry of the destination port.
+ */
+static inline bool
+ts3init_set_cookie_current_seed(const struct xt_action_param *par, const struct udphdr *udp,
+                                u64 (*cookie_seed)[2], u8 *packet_index)
+{
+    if (par->target->revision == 0)
+    {
+        const struct xt_ts3init_set_cookie_tginfo *info = par->targinfo;
+        return ts3init_get_current_cookie_seed(par_net(par), info->random_seed,
+                                               cookie_seed, packet_index);
+    }
+    else
+    {
+        const struct xt_ts3init_set_cookie_tginfo_v1 *info = par->targinfo;
+        const struct ts3init_seed *seed = info->seed;
+
+        if (info->specific_options & TARGET_SET_COOKIE_PORT_TABLE)
+        {
+            const struct ts3init_port_entry *entry;
+
+            entry = ts3init_port_table_lookup(info->port_table, be16_to_cpu(udp->dest));
+            if (entry == NULL)
+                return false;
+            seed = entry->seed;
+        }
+        if (seed == NULL)
+            return false;
+        return ts3init_seed_current_cookie_seed(seed, cookie_seed, packet_index);
+    }
+}
 
 /*
  * Returns the current cookie.
@@ -232,13 +694,18 @@ ts3init_generate_cookie_ipv4(const struct xt_action_param *par,
                              const struct iphdr *ip, const struct udphdr *udp,
                              u64 *cookie, u8 *packet_index)
 {
-    const struct xt_ts3init_set_cookie_tginfo *info = par->targinfo;
     __u64 cookie_seed[2];
+    u64 profile;
 
-    if (ts3init_get_current_cookie_seed(info->random_seed, &cookie_seed, packet_index) == false)
+    profile = ts3init_profile_start();
+    if (ts3init_set_cookie_current_seed(par, udp, &cookie_seed, packet_index) == false)
         return false;
+    ts3init_profile_end(TS3INIT_PROFILE_COOKIE_SEED, profile);
+
+    profile = ts3init_profile_start();
     if (ts3init_calculate_cookie_ipv4(ip, udp, cookie_seed[0], cookie_seed[1], cookie))
         return false;
+    ts3init_profile_end(TS3INIT_PROFILE_COOKIE, profile);
     return true;
 }
 
@@ -250,29 +717,34 @@ ts3init_generate_cookie_ipv6(const struct xt_action_param *par,
                              const struct ipv6hdr *ip, const struct udphdr *udp,
                              u64 *cookie, u8 *packet_index)
 {
-    const struct xt_ts3init_set_cookie_tginfo *info = par->targinfo;
     __u64 cookie_seed[2];
+    u64 profile;
 
-    if (ts3init_get_current_cookie_seed(info->random_seed, &cookie_seed, packet_index) == false)
+    profile = ts3init_profile_start();
+    if (ts3init_set_cookie_current_seed(par, udp, &cookie_seed, packet_index) == false)
         return false;
+    ts3init_profile_end(TS3INIT_PROFILE_COOKIE_SEED, profile);
+
+    profile = ts3init_profile_start();
     if (ts3init_calculate_cookie_ipv6(ip, udp, cookie_seed[0], cookie_seed[1], cookie))
         return false;
+    ts3init_profile_end(TS3INIT_PROFILE_COOKIE, profile);
     return true;
 }
 
 /*
- * Fills 'newpayload' with a TS3INIT_SET_COOKIE packet.
+ * Fills the variable part of the TS3INIT_SET_COOKIE packet 'newpayload'.
+ * The header and the reserved bytes are already set by the reply template,
+ * which leaves the random sequence zero for zero_random_sequence.
  */
 static bool
 ts3init_fill_set_cookie_payload(const struct sk_buff *skb,
                                 const struct xt_action_param *par, 
                                 const u64 cookie, const u8 packet_index,
-                                u8 *newpayload)
+                                const bool zero_random_sequence, u8 *newpayload)
 {
-    const struct xt_ts3init_set_cookie_tginfo *info = par->targinfo;
     u8 *payload, payload_buf[34];
 
-    memcpy(newpayload, ts3init_set_cookie_packet_header, sizeof(ts3init_set_cookie_packet_header));
     newpayload[12] = (u8)cookie;
     newpayload[13] = (u8)(cookie >> 8);
     newpayload[14] = (u8)(cookie >> 16);
@@ -282,13 +754,8 @@ ts3init_fill_set_cookie_payload(const struct sk_buff *skb,
     newpayload[18] = (u8)(cookie >> 48);
     newpayload[19] = (u8)(cookie >> 56);
     newpayload[20] = packet_index;
-    if (info->specific_options & TARGET_SET_COOKIE_ZERO_RANDOM_SEQUENCE)
+    if (!zero_random_sequence)
     {
-        memset(&newpayload[21], 0, 11);
-    }
-    else
-    {
-        memset(&newpayload[21], 0, 7);
         payload = skb_header_pointer(skb, par->thoff + sizeof(struct udphdr), 
                                       sizeof(payload_buf), payload_buf);
         if (payload == NULL)
@@ -304,64 +771,299 @@ ts3init_fill_set_cookie_payload(const struct sk_buff *skb,
     return true;
 }
 
-/* 
- * The 'TS3INIT_SET_COOKIE' target handler.
- * Always replies with TS3INIT_SET_COOKIE and drops the packet.
+/*
+ * The 'TS3INIT_SET_COOKIE' target with --shadow. Builds the reply on the
+ * stack.
  */
 static unsigned int
-ts3init_set_cookie_ipv4_tg(struct sk_buff *skb, const struct xt_action_param *par)
+ts3init_set_cookie_ipv4_shadow(const struct sk_buff *skb, const struct xt_action_param *par)
 {
-    struct iphdr *ip;
+    const struct xt_ts3init_set_cookie_tginfo *info = par->targinfo;
+    u64 start = ts3init_shadow_start(true);
     struct udphdr *udp, udp_buf;
+    u8 packet[TS3INIT_SET_COOKIE_PACKET_SIZE];
     u64 cookie;
     u8 packet_index;
-    u8 payload[sizeof(ts3init_set_cookie_packet_header) + 20];
 
-    ip  = ip_hdr(skb);
     udp = skb_header_pointer(skb, par->thoff, sizeof(*udp), &udp_buf);
     if (udp == NULL || ntohs(udp->len) <= sizeof(*udp))
-        return NF_DROP;
+        return ts3init_shadow_tg(par, TS3INIT_RESULT_HEADER, start);
 
-    if (ts3init_generate_cookie_ipv4(par, ip, udp, &cookie, &packet_index) &&
-        ts3init_fill_set_cookie_payload(skb, par, cookie, packet_index, payload))
-    {
-        ts3init_send_ipv4_reply(skb, par, ip, udp, payload, sizeof(payload));
-    }
-    return NF_DROP;
+    if (!ts3init_generate_cookie_ipv4(par, ip_hdr(skb), udp, &cookie, &packet_index))
+        return ts3init_shadow_tg(par, TS3INIT_RESULT_COOKIE, start);
+
+    ts3init_reply_copy_packet(TS3INIT_REPLY_SET_COOKIE, packet);
+    if (!ts3init_fill_set_cookie_payload(skb, par, cookie, packet_index,
+            (info->specific_options & TARGET_SET_COOKIE_ZERO_RANDOM_SEQUENCE), packet))
+        return ts3init_shadow_tg(par, TS3INIT_RESULT_HEADER, start);
+    return ts3init_shadow_tg(par, TS3INIT_RESULT_MATCH, start);
 }
 
-/* 
- * The 'TS3INIT_SET_COOKIE' target handler.
- * Always replies with TS3INIT_SET_COOKIE and drops the packet.
+/*
+ * The 'TS3INIT_SET_COOKIE' target with --shadow. Builds the reply on the
+ * stack.
  */
 static unsigned int
-ts3init_set_cookie_ipv6_tg(struct sk_buff *skb, const struct xt_action_param *par)
+ts3init_set_cookie_ipv6_shadow(const struct sk_buff *skb, const struct xt_action_param *par)
 {
-    struct ipv6hdr *ip;
+    const struct xt_ts3init_set_cookie_tginfo *info = par->targinfo;
+    u64 start = ts3init_shadow_start(true);
     struct udphdr *udp, udp_buf;
+    u8 packet[TS3INIT_SET_COOKIE_PACKET_SIZE];
     u64 cookie;
     u8 packet_index;
-    u8 payload[sizeof(ts3init_set_cookie_packet_header) + 20];
 
-    ip  = ipv6_hdr(skb);
+    udp = skb_header_pointer(skb, par->thoff, sizeof(*udp), &udp_buf);
+    if (udp == NULL || ntohs(udp->len) <= sizeof(*udp))
+        return ts3init_shadow_tg(par, TS3INIT_RESULT_HEADER, start);
+
+    if (!ts3init_generate_cookie_ipv6(par, ipv6_hdr(skb), udp, &cookie, &packet_index))
+        return ts3init_shadow_tg(par, TS3INIT_RESULT_COOKIE, start);
+
+    ts3init_reply_copy_packet(TS3INIT_REPLY_SET_COOKIE, packet);
+    if (!ts3init_fill_set_cookie_payload(skb, par, cookie, packet_index,
+            (info->specific_options & TARGET_SET_COOKIE_ZERO_RANDOM_SEQUENCE), packet))
+        return ts3init_shadow_tg(par, TS3INIT_RESULT_HEADER, start);
+    return ts3init_shadow_tg(par, TS3INIT_RESULT_MATCH, start);
+}
+
+/*
+ * Variants of the 'TS3INIT_SET_COOKIE' target handlers.
+ */
+enum
+{
+    SET_COOKIE_VARIANT_IN_PLACE             = 1 << 0,
+    SET_COOKIE_VARIANT_ZERO_RANDOM_SEQUENCE = 1 << 1,
+};
+
+static inline unsigned int
+ts3init_set_cookie_variant(const struct xt_ts3init_set_cookie_tginfo *info)
+{
+    return ((info->common_options & TARGET_COMMON_IN_PLACE) ? SET_COOKIE_VARIANT_IN_PLACE : 0) |
+           ((info->specific_options & TARGET_SET_COOKIE_ZERO_RANDOM_SEQUENCE) ?
+            SET_COOKIE_VARIANT_ZERO_RANDOM_SEQUENCE : 0);
+}
+
+/*
+ * Adds the zero random sequence to the variant of an --adaptive rule,
+ * which does not look at the payload while under attack.
+ */
+static inline unsigned int
+ts3init_set_cookie_adaptive_variant(const struct xt_action_param *par, unsigned int variant)
+{
+    const struct xt_ts3init_set_cookie_tginfo *info = par->targinfo;
+
+    if (unlikely(info->specific_options & TARGET_SET_COOKIE_ADAPTIVE) &&
+        ts3init_under_attack(par_net(par)))
+        variant |= SET_COOKIE_VARIANT_ZERO_RANDOM_SEQUENCE;
+    return variant;
+}
+
+/* 
+ * Replies with TS3INIT_SET_COOKIE and drops the packet.
+ * Revision 1 targinfo starts with the same fields as revision 0.
+ */
+static __always_inline unsigned int
+ts3init_set_cookie_ipv4(struct sk_buff *skb, const struct xt_action_param *par,
+                        const unsigned int variant)
+{
+    const struct xt_ts3init_set_cookie_tginfo *info = par->targinfo;
+    struct iphdr *ip;
+    struct udphdr *udp, udp_buf;
+    struct sk_buff *reply;
+    u64 cookie;
+    u8 packet_index;
+
+    ip  = ip_hdr(skb);
+    udp = skb_header_pointer(skb, par->thoff, sizeof(*udp), &udp_buf);
+    if (udp == NULL || ntohs(udp->len) <= sizeof(*udp))
+        return NF_DROP;
+
+    if (!ts3init_reply_budget_take(par_net(par), NFPROTO_IPV4, &ip->saddr))
+        return NF_DROP;
+
+    if (!ts3init_generate_cookie_ipv4(par, ip, udp, &cookie, &packet_index))
+        return NF_DROP;
+
+    if ((variant & SET_COOKIE_VARIANT_IN_PLACE) &&
+        ts3init_can_reply_in_place_ipv4(skb, par))
+    {
+        u8 packet[TS3INIT_SET_COOKIE_PACKET_SIZE];
+
+        ts3init_reply_copy_packet(TS3INIT_REPLY_SET_COOKIE, packet);
+        if (!ts3init_fill_set_cookie_payload(skb, par, cookie, packet_index,
+                (variant & SET_COOKIE_VARIANT_ZERO_RANDOM_SEQUENCE), packet))
+            return NF_DROP;
+        return ts3init_send_ipv4_reply_in_place(skb, par, info->common_options,
+                                                packet, sizeof(packet));
+    }
+
+    reply = ts3init_reply_alloc_ipv4(par_net(par), TS3INIT_REPLY_SET_COOKIE);
+    if (reply == NULL)
+        return NF_DROP;
+
+    if (ts3init_fill_set_cookie_payload(skb, par, cookie, packet_index,
+                                        (variant & SET_COOKIE_VARIANT_ZERO_RANDOM_SEQUENCE),
+                                        ts3init_reply_payload(reply)))
+        ts3init_send_ipv4_reply(reply, skb, par, info->common_options, ip, udp);
+    else
+        kfree_skb(reply);
+    return NF_DROP;
+}
+
+/* 
+ * Replies with TS3INIT_SET_COOKIE and drops the packet.
+ * Revision 1 targinfo starts with the same fields as revision 0.
+ */
+static __always_inline unsigned int
+ts3init_set_cookie_ipv6(struct sk_buff *skb, const struct xt_action_param *par,
+                        const unsigned int variant)
+{
+    const struct xt_ts3init_set_cookie_tginfo *info = par->targinfo;
+    struct ipv6hdr *ip;
+    struct udphdr *udp, udp_buf;
+    struct sk_buff *reply;
+    u64 cookie;
+    u8 packet_index;
+
+    ip  = ipv6_hdr(skb);
     udp = skb_header_pointer(skb, par->thoff, sizeof(*udp), &udp_buf);
     if (udp == NULL || ntohs(udp->len) <= sizeof(*udp))
         return NF_DROP;
 
-    if (ts3init_generate_cookie_ipv6(par, ip, udp, &cookie, &packet_index) &&
-        ts3init_fill_set_cookie_payload(skb, par, cookie, packet_index, payload))
+    if (!ts3init_reply_budget_take(par_net(par), NFPROTO_IPV6, &ip->saddr))
+        return NF_DROP;
+
+    if (!ts3init_generate_cookie_ipv6(par, ip, udp, &cookie, &packet_index))
+        return NF_DROP;
+
+    if ((variant & SET_COOKIE_VARIANT_IN_PLACE) &&
+        ts3init_can_reply_in_place_ipv6(skb, par))
     {
-        ts3init_send_ipv6_reply(skb, par, ip, udp, payload, sizeof(payload));
+        u8 packet[TS3INIT_SET_COOKIE_PACKET_SIZE];
+
+        ts3init_reply_copy_packet(TS3INIT_REPLY_SET_COOKIE, packet);
+        if (!ts3init_fill_set_cookie_payload(skb, par, cookie, packet_index,
+                (variant & SET_COOKIE_VARIANT_ZERO_RANDOM_SEQUENCE), packet))
+            return NF_DROP;
+        return ts3init_send_ipv6_reply_in_place(skb, par, info->common_options,
+                                                packet, sizeof(packet));
     }
+
+    reply = ts3init_reply_alloc_ipv6(par_net(par), TS3INIT_REPLY_SET_COOKIE);
+    if (reply == NULL)
+        return NF_DROP;
+
+    if (ts3init_fill_set_cookie_payload(skb, par, cookie, packet_index,
+                                        (variant & SET_COOKIE_VARIANT_ZERO_RANDOM_SEQUENCE),
+                                        ts3init_reply_payload(reply)))
+        ts3init_send_ipv6_reply(reply, skb, par, info->common_options, ip, udp);
+    else
+        kfree_skb(reply);
     return NF_DROP;
 }
 
+/* 
+ * Runs the 'TS3INIT_SET_COOKIE' target variant of the rule, timed as a
+ * whole. Always replies with TS3INIT_SET_COOKIE and drops the packet.
+ */
+static unsigned int
+ts3init_set_cookie_ipv4_tg_variant(struct sk_buff *skb, const struct xt_action_param *par,
+                                  unsigned int variant)
+{
+    const struct xt_ts3init_set_cookie_tginfo *info = par->targinfo;
+    unsigned int verdict = NF_DROP;
+    u64 profile;
+
+    if (unlikely(info->common_options & TARGET_COMMON_SHADOW))
+        return ts3init_set_cookie_ipv4_shadow(skb, par);
+
+    profile = ts3init_profile_start();
+#define SET_COOKIE_VARIANT(v) case v: verdict = ts3init_set_cookie_ipv4(skb, par, v); break
+    switch (ts3init_set_cookie_adaptive_variant(par, variant))
+    {
+        TS3INIT_VARIANTS_4(SET_COOKIE_VARIANT);
+    }
+#undef SET_COOKIE_VARIANT
+    ts3init_profile_end(TS3INIT_PROFILE_SET_COOKIE, profile);
+    return verdict;
+}
+
+/* 
+ * The 'TS3INIT_SET_COOKIE' target handler of revision 0.
+ */
+static unsigned int
+ts3init_set_cookie_ipv4_tg(struct sk_buff *skb, const struct xt_action_param *par)
+{
+    return ts3init_set_cookie_ipv4_tg_variant(skb, par, ts3init_set_cookie_variant(par->targinfo));
+}
+
+/* 
+ * The 'TS3INIT_SET_COOKIE' target handler of revision 1, with the variant
+ * checkentry chose.
+ */
+static unsigned int
+ts3init_set_cookie_ipv4_tg_v1(struct sk_buff *skb, const struct xt_action_param *par)
+{
+    const struct xt_ts3init_set_cookie_tginfo_v1 *info = par->targinfo;
+
+    return ts3init_set_cookie_ipv4_tg_variant(skb, par, info->variant);
+}
+
+/* 
+ * Runs the 'TS3INIT_SET_COOKIE' target variant of the rule, timed as a
+ * whole. Always replies with TS3INIT_SET_COOKIE and drops the packet.
+ */
+static unsigned int
+ts3init_set_cookie_ipv6_tg_variant(struct sk_buff *skb, const struct xt_action_param *par,
+                                  unsigned int variant)
+{
+    const struct xt_ts3init_set_cookie_tginfo *info = par->targinfo;
+    unsigned int verdict = NF_DROP;
+    u64 profile;
+
+    if (unlikely(info->common_options & TARGET_COMMON_SHADOW))
+        return ts3init_set_cookie_ipv6_shadow(skb, par);
+
+    profile = ts3init_profile_start();
+#define SET_COOKIE_VARIANT(v) case v: verdict = ts3init_set_cookie_ipv6(skb, par, v); break
+    switch (ts3init_set_cookie_adaptive_variant(par, variant))
+    {
+        TS3INIT_VARIANTS_4(SET_COOKIE_VARIANT);
+    }
+#undef SET_COOKIE_VARIANT
+    ts3init_profile_end(TS3INIT_PROFILE_SET_COOKIE, profile);
+    return verdict;
+}
+
+/* 
+ * The 'TS3INIT_SET_COOKIE' target handler of revision 0.
+ */
+static unsigned int
+ts3init_set_cookie_ipv6_tg(struct sk_buff *skb, const struct xt_action_param *par)
+{
+    return ts3init_set_cookie_ipv6_tg_variant(skb, par, ts3init_set_cookie_variant(par->targinfo));
+}
+
+/* 
+ * The 'TS3INIT_SET_COOKIE' target handler of revision 1, with the variant
+ * checkentry chose.
+ */
+static unsigned int
+ts3init_set_cookie_ipv6_tg_v1(struct sk_buff *skb, const struct xt_action_param *par)
+{
+    const struct xt_ts3init_set_cookie_tginfo_v1 *info = par->targinfo;
+
+    return ts3init_set_cookie_ipv6_tg_variant(skb, par, info->variant);
+}
+
 /*
  * Validates targinfo recieved from userspace.
  */
 static int ts3init_set_cookie_tg_check(const struct xt_tgchk_param *par)
 {
     struct xt_ts3init_set_cookie_tginfo *info = par->targinfo;
+    int error;
     
     if (! (par->family == NFPROTO_IPV4 || par->family == NFPROTO_IPV6))
     {
@@ -369,25 +1071,257 @@ static int ts3init_set_cookie_tg_check(const struct xt_tgchk_param *par)
         return -EINVAL;
     }
 
-    if (info->common_options & ~(TARGET_COMMON_VALID_MASK))
+    error = ts3init_common_tg_check(par, info->common_options, "TS3INIT_SET_COOKIE");
+    if (error)
+        return error;
+
+    if (info->specific_options & ~(TARGET_SET_COOKIE_VALID_MASK))
     {
-        printk(KERN_INFO KBUILD_MODNAME ": invalid (common) options for TS3INIT_SET_COOKIE\n");
+        printk(KERN_INFO KBUILD_MODNAME ": invalid (specific) options for TS3INIT_SET_COOKIE\n");
         return -EINVAL;
     }
+    
+    return 0;
+}
 
-    if (info->specific_options & ~(TARGET_SET_COOKIE_VALID_MASK))
+/*
+ * Validates targinfo recieved from userspace, and takes a reference
+ * to the seed or the port table.
+ */
+static int ts3init_set_cookie_tg_check_v1(const struct xt_tgchk_param *par)
+{
+    struct xt_ts3init_set_cookie_tginfo_v1 *info = par->targinfo;
+    int error;
+
+    if (! (par->family == NFPROTO_IPV4 || par->family == NFPROTO_IPV6))
+    {
+        printk(KERN_INFO KBUILD_MODNAME ": invalid protocol (only ipv4 and ipv6) for TS3INIT_SET_COOKIE\n");
+        return -EINVAL;
+    }
+
+    error = ts3init_common_tg_check(par, info->common_options, "TS3INIT_SET_COOKIE");
+    if (error)
+        return error;
+
+    if (info->specific_options & ~(TARGET_SET_COOKIE_V1_VALID_MASK))
     {
         printk(KERN_INFO KBUILD_MODNAME ": invalid (specific) options for TS3INIT_SET_COOKIE\n");
         return -EINVAL;
     }
-    
+
+    info->seed = NULL;
+    info->port_table = NULL;
+    if (info->specific_options & TARGET_SET_COOKIE_PORT_TABLE)
+    {
+        info->port_table = ts3init_port_table_get(par->net, info->port_table_id);
+        if (info->port_table == NULL)
+        {
+            printk(KERN_INFO KBUILD_MODNAME ": unknown port table %u for TS3INIT_SET_COOKIE\n", info->port_table_id);
+            return -ENOENT;
+        }
+    }
+    else
+    {
+        info->seed = ts3init_seed_get(par->net, info->seed_id);
+        if (info->seed == NULL)
+        {
+            printk(KERN_INFO KBUILD_MODNAME ": unknown seed %u for TS3INIT_SET_COOKIE\n", info->seed_id);
+            return -ENOENT;
+        }
+    }
+
+    info->variant = ts3init_set_cookie_variant((const struct xt_ts3init_set_cookie_tginfo *)info);
+    return 0;
+}
+
+static void ts3init_set_cookie_tg_destroy_v1(const struct xt_tgdtor_param *par)
+{
+    struct xt_ts3init_set_cookie_tginfo_v1 *info = par->targinfo;
+
+    if (info->seed != NULL)
+        ts3init_seed_put(info->seed);
+    if (info->port_table != NULL)
+        ts3init_port_table_put(info->port_table);
+}
+
+/*
+ * The 'TS3INIT_SET_PUZZLE' target with --shadow. Copies the puzzle to the
+ * stack.
+ */
+static unsigned int
+ts3init_set_puzzle_shadow(const struct sk_buff *skb, const struct xt_action_param *par)
+{
+    u64 start = ts3init_shadow_start(true);
+    struct udphdr *udp, udp_buf;
+    u8 packet[TS3INIT_SET_PUZZLE_PACKET_SIZE];
+
+    udp = skb_header_pointer(skb, par->thoff, sizeof(*udp), &udp_buf);
+    if (udp == NULL || ntohs(udp->len) <= sizeof(*udp))
+        return ts3init_shadow_tg(par, TS3INIT_RESULT_HEADER, start);
+
+    ts3init_reply_copy_packet(TS3INIT_REPLY_SET_PUZZLE, packet);
+    if (!ts3init_puzzle_get(par_net(par), packet + TS3INIT_HEADER_SERVER_LENGTH))
+        return ts3init_shadow_tg(par, TS3INIT_RESULT_PUZZLE, start);
+    return ts3init_shadow_tg(par, TS3INIT_RESULT_MATCH, start);
+}
+
+/*
+ * Replies with a puzzle from the pool and drops the packet. If the pool
+ * is empty the packet continues, so the server can send the puzzle.
+ */
+static inline unsigned int
+ts3init_set_puzzle_ipv4(struct sk_buff *skb, const struct xt_action_param *par,
+                        const struct xt_ts3init_set_puzzle_tginfo *info)
+{
+    struct iphdr *ip;
+    struct udphdr *udp, udp_buf;
+    struct sk_buff *reply;
+
+    ip  = ip_hdr(skb);
+    udp = skb_header_pointer(skb, par->thoff, sizeof(*udp), &udp_buf);
+    if (udp == NULL || ntohs(udp->len) <= sizeof(*udp))
+        return NF_DROP;
+
+    if ((info->common_options & TARGET_COMMON_IN_PLACE) &&
+        ts3init_can_reply_in_place_ipv4(skb, par))
+    {
+        u8 packet[TS3INIT_SET_PUZZLE_PACKET_SIZE];
+
+        ts3init_reply_copy_packet(TS3INIT_REPLY_SET_PUZZLE, packet);
+        if (!ts3init_puzzle_get(par_net(par), packet + TS3INIT_HEADER_SERVER_LENGTH))
+        {
+            ts3init_stat_inc(par_net(par), TS3INIT_STAT_PUZZLE_POOL_EMPTY);
+            return XT_CONTINUE;
+        }
+        return ts3init_send_ipv4_reply_in_place(skb, par, info->common_options,
+                                                packet, sizeof(packet));
+    }
+
+    reply = ts3init_reply_alloc_ipv4(par_net(par), TS3INIT_REPLY_SET_PUZZLE);
+    if (reply == NULL)
+        return NF_DROP;
+
+    if (!ts3init_puzzle_get(par_net(par), ts3init_reply_payload(reply) + TS3INIT_HEADER_SERVER_LENGTH))
+    {
+        ts3init_stat_inc(par_net(par), TS3INIT_STAT_PUZZLE_POOL_EMPTY);
+        kfree_skb(reply);
+        return XT_CONTINUE;
+    }
+
+    ts3init_send_ipv4_reply(reply, skb, par, info->common_options, ip, udp);
+    return NF_DROP;
+}
+
+/*
+ * The 'TS3INIT_SET_PUZZLE' target handler, timed as a whole.
+ */
+static unsigned int
+ts3init_set_puzzle_ipv4_tg(struct sk_buff *skb, const struct xt_action_param *par)
+{
+    const struct xt_ts3init_set_puzzle_tginfo *info = par->targinfo;
+    unsigned int verdict;
+    u64 profile;
+
+    if (unlikely(info->common_options & TARGET_COMMON_SHADOW))
+        return ts3init_set_puzzle_shadow(skb, par);
+
+    profile = ts3init_profile_start();
+    verdict = ts3init_set_puzzle_ipv4(skb, par, info);
+    ts3init_profile_end(TS3INIT_PROFILE_SET_PUZZLE, profile);
+    return verdict;
+}
+
+/*
+ * Replies with a puzzle from the pool and drops the packet. If the pool
+ * is empty the packet continues, so the server can send the puzzle.
+ */
+static inline unsigned int
+ts3init_set_puzzle_ipv6(struct sk_buff *skb, const struct xt_action_param *par,
+                        const struct xt_ts3init_set_puzzle_tginfo *info)
+{
+    struct ipv6hdr *ip;
+    struct udphdr *udp, udp_buf;
+    struct sk_buff *reply;
+
+    ip  = ipv6_hdr(skb);
+    udp = skb_header_pointer(skb, par->thoff, sizeof(*udp), &udp_buf);
+    if (udp == NULL || ntohs(udp->len) <= sizeof(*udp))
+        return NF_DROP;
+
+    if ((info->common_options & TARGET_COMMON_IN_PLACE) &&
+        ts3init_can_reply_in_place_ipv6(skb, par))
+    {
+        u8 packet[TS3INIT_SET_PUZZLE_PACKET_SIZE];
+
+        ts3init_reply_copy_packet(TS3INIT_REPLY_SET_PUZZLE, packet);
+        if (!ts3init_puzzle_get(par_net(par), packet + TS3INIT_HEADER_SERVER_LENGTH))
+        {
+            ts3init_stat_inc(par_net(par), TS3INIT_STAT_PUZZLE_POOL_EMPTY);
+            return XT_CONTINUE;
+        }
+        return ts3init_send_ipv6_reply_in_place(skb, par, info->common_options,
+                                                packet, sizeof(packet));
+    }
+
+    reply = ts3init_reply_alloc_ipv6(par_net(par), TS3INIT_REPLY_SET_PUZZLE);
+    if (reply == NULL)
+        return NF_DROP;
+
+    if (!ts3init_puzzle_get(par_net(par), ts3init_reply_payload(reply) + TS3INIT_HEADER_SERVER_LENGTH))
+    {
+        ts3init_stat_inc(par_net(par), TS3INIT_STAT_PUZZLE_POOL_EMPTY);
+        kfree_skb(reply);
+        return XT_CONTINUE;
+    }
+
+    ts3init_send_ipv6_reply(reply, skb, par, info->common_options, ip, udp);
+    return NF_DROP;
+}
+
+/*
+ * The 'TS3INIT_SET_PUZZLE' target handler, timed as a whole.
+ */
+static unsigned int
+ts3init_set_puzzle_ipv6_tg(struct sk_buff *skb, const struct xt_action_param *par)
+{
+    const struct xt_ts3init_set_puzzle_tginfo *info = par->targinfo;
+    unsigned int verdict;
+    u64 profile;
+
+    if (unlikely(info->common_options & TARGET_COMMON_SHADOW))
+        return ts3init_set_puzzle_shadow(skb, par);
+
+    profile = ts3init_profile_start();
+    verdict = ts3init_set_puzzle_ipv6(skb, par, info);
+    ts3init_profile_end(TS3INIT_PROFILE_SET_PUZZLE, profile);
+    return verdict;
+}
+
+/*
+ * Validates targinfo recieved from userspace.
+ */
+static int ts3init_set_puzzle_tg_check(const struct xt_tgchk_param *par)
+{
+    struct xt_ts3init_set_puzzle_tginfo *info = par->targinfo;
+    int error;
+
+    error = ts3init_common_tg_check(par, info->common_options, "TS3INIT_SET_PUZZLE");
+    if (error)
+        return error;
+
+    if (info->specific_options & ~(TARGET_SET_PUZZLE_VALID_MASK))
+    {
+        printk(KERN_INFO KBUILD_MODNAME ": invalid (specific) options for TS3INIT_SET_PUZZLE\n");
+        return -EINVAL;
+    }
+
     return 0;
 }
 
 static inline void
 ts3init_fill_get_cookie_payload(u8 *payload)
 {
-    time_t current_unix_time = ts3init_get_cached_unix_time();
+    time_t current_unix_time = ts3init_get_epoch();
     payload[TS3INIT_HEADER_CLIENT_LENGTH - 1] = COMMAND_GET_COOKIE;
     payload[TS3INIT_HEADER_CLIENT_LENGTH + 0] = current_unix_time >> 24;
     payload[TS3INIT_HEADER_CLIENT_LENGTH + 1] = current_unix_time >> 16;
@@ -397,18 +1331,109 @@ ts3init_fill_get_cookie_payload(u8 *payload)
     memset(&payload[TS3INIT_HEADER_CLIENT_LENGTH + 8], 0, 8);
 }
 
+enum
+{
+    /* The first udp byte that TS3INIT_GET_COOKIE changes is the command
+     * in the ts3init header. The checksum is updated starting at the
+     * 16 bit word that contains it. */
+    TS3INIT_GET_COOKIE_CSUM_OFFSET = sizeof(struct udphdr) + TS3INIT_HEADER_CLIENT_LENGTH - 2,
+    TS3INIT_GET_COOKIE_UDP_LEN = sizeof(struct udphdr) + TS3INIT_HEADER_CLIENT_LENGTH + 16
+};
+
+/*
+ * How the udp checksum of a packet rewritten by TS3INIT_GET_COOKIE
+ * is updated.
+ */
+enum ts3init_get_cookie_csum
+{
+    GET_COOKIE_CSUM_NONE,        /* ipv4 packet without checksum */
+    GET_COOKIE_CSUM_PARTIAL,     /* only the pseudo header is summed */
+    GET_COOKIE_CSUM_INCREMENTAL, /* only the rewritten bytes are summed */
+    GET_COOKIE_CSUM_FULL
+};
+
+/*
+ * Decides how the checksum of the packet is updated after the rewrite.
+ * For incremental updates, the sum of the bytes that will be rewritten
+ * is returned in old_csum.
+ */
+static enum ts3init_get_cookie_csum
+ts3init_get_cookie_prepare_csum(const struct sk_buff *skb, const struct xt_action_param *par,
+                                const struct udphdr *udp, __wsum *old_csum)
+{
+    unsigned int udp_len = ntohs(udp->len);
+
+    if (skb->ip_summed == CHECKSUM_PARTIAL)
+        return GET_COOKIE_CSUM_PARTIAL;
+
+    if (udp->check == 0 || udp_len < TS3INIT_GET_COOKIE_CSUM_OFFSET ||
+        par->thoff + udp_len != skb->len)
+        return GET_COOKIE_CSUM_FULL;
+
+    *old_csum = skb_checksum(skb, par->thoff + TS3INIT_GET_COOKIE_CSUM_OFFSET,
+                             udp_len - TS3INIT_GET_COOKIE_CSUM_OFFSET, 0);
+    return GET_COOKIE_CSUM_INCREMENTAL;
+}
+
+/*
+ * Replaces the sum of the rewritten bytes and the old udp length in
+ * the checksum of the rewritten packet.
+ */
+static void
+ts3init_get_cookie_update_csum(struct udphdr *udp, __be16 old_len, __wsum old_csum)
+{
+    __wsum new_csum = csum_partial((u8 *)udp + TS3INIT_GET_COOKIE_CSUM_OFFSET,
+                                   ntohs(udp->len) - TS3INIT_GET_COOKIE_CSUM_OFFSET, 0);
+
+    /* the length is in both the udp header and the pseudo header */
+    csum_replace2(&udp->check, old_len, udp->len);
+    csum_replace2(&udp->check, old_len, udp->len);
+    udp->check = csum_fold(csum_add(csum_sub(new_csum, old_csum),
+                                    ~csum_unfold(udp->check)));
+    if (udp->check == 0)
+        udp->check = CSUM_MANGLED_0;
+}
+
+/*
+ * Trims or pads the udp payload of skb to TS3INIT_GET_COOKIE_UDP_LEN,
+ * and makes it writable. Returns the udp header, or NULL. If the skb
+ * was freed, *stolen is set.
+ */
+static struct udphdr *
+ts3init_get_cookie_resize(struct sk_buff *skb, const struct xt_action_param *par,
+                          int delta, bool *stolen)
+{
+    *stolen = false;
+    if (delta < 0)
+    {
+        skb_trim(skb, skb->len + delta);
+    }
+    else
+    {
+        if (skb_put_padto(skb, skb->len + delta))
+        {
+            *stolen = true;
+            return NULL;
+        }
+    }
+    if (skb_ensure_writable(skb, skb->len) != 0)
+        return NULL;
+    return (struct udphdr *)(skb_network_header(skb) + par->thoff);
+}
+
 /*
- * The 'TS3INIT_GET_COOKIE' target handler.
  * Morphes the incomming packet into a TS3INIT_GET_COOKIE
  */
-static unsigned int
-ts3init_get_cookie_ipv4_tg(struct sk_buff *skb, const struct xt_action_param *par)
+static inline unsigned int
+ts3init_get_cookie_ipv4(struct sk_buff *skb, const struct xt_action_param *par)
 {
     struct iphdr *ip;
     struct udphdr *udp, udp_buf;
-    u8 *payload, payload_buf[TS3INIT_HEADER_CLIENT_LENGTH + 16];
+    enum ts3init_get_cookie_csum csum_mode;
+    __wsum old_csum = 0;
+    __be16 old_len;
+    bool stolen;
     int delta;
-    int new_udp_len;
 
     ip  = ip_hdr(skb);
     udp = skb_header_pointer(skb, par->thoff, sizeof(udp_buf), &udp_buf);
@@ -417,28 +1442,40 @@ ts3init_get_cookie_ipv4_tg(struct sk_buff *skb, const struct xt_action_param *pa
     if (ip->frag_off & htons(IP_OFFSET))
         return NF_DROP;
 
-    new_udp_len = sizeof(*udp) + sizeof(payload_buf);
-    delta = new_udp_len - ntohs(udp->len);
-    if (delta < 0)
-    {
-        skb_trim(skb, skb->len + delta);
-    }
-    else
+    old_len = udp->len;
+    delta = TS3INIT_GET_COOKIE_UDP_LEN - ntohs(old_len);
+    csum_mode = udp->check == 0 ? GET_COOKIE_CSUM_NONE :
+        ts3init_get_cookie_prepare_csum(skb, par, udp, &old_csum);
+
+    udp = ts3init_get_cookie_resize(skb, par, delta, &stolen);
+    if (udp == NULL)
+        return stolen ? NF_STOLEN : NF_DROP;
+
+    ip = ip_hdr(skb);
+    ts3init_fill_get_cookie_payload((u8 *)(udp + 1));
+    udp->len = htons(TS3INIT_GET_COOKIE_UDP_LEN);
+
+    switch (csum_mode)
     {
-        if (skb_put_padto(skb, skb->len + delta))
-            return NF_STOLEN;
+    case GET_COOKIE_CSUM_NONE:
+        break;
+    case GET_COOKIE_CSUM_PARTIAL:
+        udp->check = ~csum_tcpudp_magic(ip->saddr, ip->daddr,
+                                        TS3INIT_GET_COOKIE_UDP_LEN, IPPROTO_UDP, 0);
+        break;
+    case GET_COOKIE_CSUM_INCREMENTAL:
+        ts3init_get_cookie_update_csum(udp, old_len, old_csum);
+        break;
+    case GET_COOKIE_CSUM_FULL:
+        udp->check = 0;
+        udp->check = csum_tcpudp_magic(ip->saddr, ip->daddr,
+                                       TS3INIT_GET_COOKIE_UDP_LEN, IPPROTO_UDP,
+                                       csum_partial(udp, TS3INIT_GET_COOKIE_UDP_LEN, 0));
+        break;
     }
-    if (!skb_make_writable(skb, skb->len))
-        return NF_DROP;
+    if (skb->ip_summed == CHECKSUM_COMPLETE)
+        skb->ip_summed = CHECKSUM_NONE;
 
-    payload = skb_header_pointer(skb, par->thoff + sizeof(*udp), sizeof(payload_buf), payload_buf);
-    ts3init_fill_get_cookie_payload(payload);
-
-    udp->len = htons(new_udp_len);
-    udp->check = 0;
-    udp->check = csum_tcpudp_magic(ip->saddr, ip->daddr,
-                                   new_udp_len, IPPROTO_UDP, 
-                                   csum_partial(udp, new_udp_len, 0));
     ip->tot_len = htons( ntohs(ip->tot_len) + delta );
     ip_send_check(ip);
 
@@ -449,46 +1486,67 @@ ts3init_get_cookie_ipv4_tg(struct sk_buff *skb, const struct xt_action_param *pa
 }
 
 /*
- * The 'TS3INIT_GET_COOKIE' target handler.
- * Morphes the incomming packet into a TS3INIT_GET_COOKIE
+ * The 'TS3INIT_GET_COOKIE' target handler, timed as a whole.
  */
 static unsigned int
-ts3init_get_cookie_ipv6_tg(struct sk_buff *skb, const struct xt_action_param *par)
+ts3init_get_cookie_ipv4_tg(struct sk_buff *skb, const struct xt_action_param *par)
+{
+    u64 profile = ts3init_profile_start();
+    unsigned int verdict = ts3init_get_cookie_ipv4(skb, par);
+
+    ts3init_profile_end(TS3INIT_PROFILE_GET_COOKIE, profile);
+    return verdict;
+}
+
+/*
+ * Morphes the incomming packet into a TS3INIT_GET_COOKIE
+ */
+static inline unsigned int
+ts3init_get_cookie_ipv6(struct sk_buff *skb, const struct xt_action_param *par)
 {
     struct ipv6hdr *ip;
     struct udphdr *udp, udp_buf;
-    u8 *payload, payload_buf[TS3INIT_HEADER_CLIENT_LENGTH + 16];
+    enum ts3init_get_cookie_csum csum_mode;
+    __wsum old_csum = 0;
+    __be16 old_len;
+    bool stolen;
     int delta;
-    int new_udp_len;
 
-    ip  = ipv6_hdr(skb);
     udp = skb_header_pointer(skb, par->thoff, sizeof(udp_buf), &udp_buf);
     if (udp == NULL)
         return NF_DROP;
 
-    new_udp_len = sizeof(*udp) + sizeof(payload_buf);
-    delta = new_udp_len - ntohs(udp->len);
+    old_len = udp->len;
+    delta = TS3INIT_GET_COOKIE_UDP_LEN - ntohs(old_len);
+    csum_mode = ts3init_get_cookie_prepare_csum(skb, par, udp, &old_csum);
 
-    if (delta < 0)
-    {
-        skb_trim(skb, skb->len + delta);
-    }
-    else
+    udp = ts3init_get_cookie_resize(skb, par, delta, &stolen);
+    if (udp == NULL)
+        return stolen ? NF_STOLEN : NF_DROP;
+
+    ip = ipv6_hdr(skb);
+    ts3init_fill_get_cookie_payload((u8 *)(udp + 1));
+    udp->len = htons(TS3INIT_GET_COOKIE_UDP_LEN);
+
+    switch (csum_mode)
     {
-        if (skb_put_padto(skb, skb->len + delta))
-            return NF_STOLEN;
+    case GET_COOKIE_CSUM_PARTIAL:
+        udp->check = ~csum_ipv6_magic(&ip->saddr, &ip->daddr,
+                                      TS3INIT_GET_COOKIE_UDP_LEN, IPPROTO_UDP, 0);
+        break;
+    case GET_COOKIE_CSUM_INCREMENTAL:
+        ts3init_get_cookie_update_csum(udp, old_len, old_csum);
+        break;
+    default:
+        udp->check = 0;
+        udp->check = csum_ipv6_magic(&ip->saddr, &ip->daddr,
+                                     TS3INIT_GET_COOKIE_UDP_LEN, IPPROTO_UDP,
+                                     csum_partial(udp, TS3INIT_GET_COOKIE_UDP_LEN, 0));
+        break;
     }
-    if (!skb_make_writable(skb, skb->len))
-        return NF_DROP;
+    if (skb->ip_summed == CHECKSUM_COMPLETE)
+        skb->ip_summed = CHECKSUM_NONE;
 
-    payload = skb_header_pointer(skb, par->thoff + sizeof(*udp), sizeof(payload_buf), payload_buf);
-    ts3init_fill_get_cookie_payload(payload);
-
-    udp->len = htons(new_udp_len);
-    udp->check = 0;
-    udp->check = csum_ipv6_magic(&ip->saddr, &ip->daddr,
-                                 new_udp_len, IPPROTO_UDP, 
-                                 csum_partial(udp, new_udp_len, 0));
     ip->payload_len = htons( ntohs(ip->payload_len) + delta );
 
     if (skb->len > dst_mtu(skb_dst(skb)))
@@ -497,6 +1555,87 @@ ts3init_get_cookie_ipv6_tg(struct sk_buff *skb, const struct xt_action_param *pa
     return NF_ACCEPT;
 }
 
+/*
+ * The 'TS3INIT_GET_COOKIE' target handler, timed as a whole.
+ */
+static unsigned int
+ts3init_get_cookie_ipv6_tg(struct sk_buff *skb, const struct xt_action_param *par)
+{
+    u64 profile = ts3init_profile_start();
+    unsigned int verdict = ts3init_get_cookie_ipv6(skb, par);
+
+    ts3init_profile_end(TS3INIT_PROFILE_GET_COOKIE, profile);
+    return verdict;
+}
+
+/*
+ * The 'TS3INIT_GET_COOKIE' target handler, revision 1.
+ * Same as revision 0, but an --adaptive rule counts the packet towards
+ * the handshake rate, and replies with COMMAND_RESET under attack.
+ */
+static unsigned int
+ts3init_get_cookie_ipv4_tg_v1(struct sk_buff *skb, const struct xt_action_param *par)
+{
+    const struct xt_ts3init_get_cookie_tginfo *info = par->targinfo;
+
+    if (info->specific_options & TARGET_GET_COOKIE_ADAPTIVE)
+    {
+        ts3init_adaptive_count(par_net(par));
+        /* targinfo has the layout of the one of TS3INIT_RESET revision 1 */
+        if (ts3init_under_attack(par_net(par)))
+            return ts3init_reset_ipv4_tg_v1(skb, par);
+    }
+    return ts3init_get_cookie_ipv4_tg(skb, par);
+}
+
+/*
+ * The 'TS3INIT_GET_COOKIE' target handler, revision 1.
+ * Same as revision 0, but an --adaptive rule counts the packet towards
+ * the handshake rate, and replies with COMMAND_RESET under attack.
+ */
+static unsigned int
+ts3init_get_cookie_ipv6_tg_v1(struct sk_buff *skb, const struct xt_action_param *par)
+{
+    const struct xt_ts3init_get_cookie_tginfo *info = par->targinfo;
+
+    if (info->specific_options & TARGET_GET_COOKIE_ADAPTIVE)
+    {
+        ts3init_adaptive_count(par_net(par));
+        /* targinfo has the layout of the one of TS3INIT_RESET revision 1 */
+        if (ts3init_under_attack(par_net(par)))
+            return ts3init_reset_ipv6_tg_v1(skb, par);
+    }
+    return ts3init_get_cookie_ipv6_tg(skb, par);
+}
+
+/*
+ * Validates targinfo recieved from userspace.
+ */
+static int ts3init_get_cookie_tg_check_v1(const struct xt_tgchk_param *par)
+{
+    struct xt_ts3init_get_cookie_tginfo *info = par->targinfo;
+    int error;
+
+    error = ts3init_common_tg_check(par, info->common_options, "TS3INIT_GET_COOKIE");
+    if (error)
+        return error;
+
+    /* the packet is rewritten, there is no reply to build */
+    if (info->common_options & TARGET_COMMON_SHADOW)
+    {
+        printk(KERN_INFO KBUILD_MODNAME ": --shadow is not supported by TS3INIT_GET_COOKIE\n");
+        return -EINVAL;
+    }
+
+    if (info->specific_options & ~(TARGET_GET_COOKIE_VALID_MASK))
+    {
+        printk(KERN_INFO KBUILD_MODNAME ": invalid (specific) options for TS3INIT_GET_COOKIE\n");
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
 static struct xt_target ts3init_tg_reg[] __read_mostly = {
     {
         .name       = "TS3INIT_RESET",
@@ -514,6 +1653,26 @@ static struct xt_target ts3init_tg_reg[] __read_mostly = {
         .target     = ts3init_reset_ipv6_tg,
         .me         = THIS_MODULE,
     },
+    {
+        .name       = "TS3INIT_RESET",
+        .revision   = 1,
+        .family     = NFPROTO_IPV4,
+        .proto      = IPPROTO_UDP,
+        .targetsize = sizeof(struct xt_ts3init_reset_tginfo),
+        .target     = ts3init_reset_ipv4_tg_v1,
+        .checkentry = ts3init_reset_tg_check,
+        .me         = THIS_MODULE,
+    },
+    {
+        .name       = "TS3INIT_RESET",
+        .revision   = 1,
+        .family     = NFPROTO_IPV6,
+        .proto      = IPPROTO_UDP,
+        .targetsize = sizeof(struct xt_ts3init_reset_tginfo),
+        .target     = ts3init_reset_ipv6_tg_v1,
+        .checkentry = ts3init_reset_tg_check,
+        .me         = THIS_MODULE,
+    },
     {
         .name       = "TS3INIT_SET_COOKIE",
         .revision   = 0,
@@ -534,6 +1693,48 @@ static struct xt_target ts3init_tg_reg[] __read_mostly = {
         .checkentry = ts3init_set_cookie_tg_check,
         .me         = THIS_MODULE,
     },
+    {
+        .name       = "TS3INIT_SET_COOKIE",
+        .revision   = 1,
+        .family     = NFPROTO_IPV4,
+        .proto      = IPPROTO_UDP,
+        .targetsize = sizeof(struct xt_ts3init_set_cookie_tginfo_v1),
+        .target     = ts3init_set_cookie_ipv4_tg_v1,
+        .checkentry = ts3init_set_cookie_tg_check_v1,
+        .destroy    = ts3init_set_cookie_tg_destroy_v1,
+        .me         = THIS_MODULE,
+    },
+    {
+        .name       = "TS3INIT_SET_COOKIE",
+        .revision   = 1,
+        .family     = NFPROTO_IPV6,
+        .proto      = IPPROTO_UDP,
+        .targetsize = sizeof(struct xt_ts3init_set_cookie_tginfo_v1),
+        .target     = ts3init_set_cookie_ipv6_tg_v1,
+        .checkentry = ts3init_set_cookie_tg_check_v1,
+        .destroy    = ts3init_set_cookie_tg_destroy_v1,
+        .me         = THIS_MODULE,
+    },
+    {
+        .name       = "TS3INIT_SET_PUZZLE",
+        .revision   = 0,
+        .family     = NFPROTO_IPV4,
+        .proto      = IPPROTO_UDP,
+        .targetsize = sizeof(struct xt_ts3init_set_puzzle_tginfo),
+        .target     = ts3init_set_puzzle_ipv4_tg,
+        .checkentry = ts3init_set_puzzle_tg_check,
+        .me         = THIS_MODULE,
+    },
+    {
+        .name       = "TS3INIT_SET_PUZZLE",
+        .revision   = 0,
+        .family     = NFPROTO_IPV6,
+        .proto      = IPPROTO_UDP,
+        .targetsize = sizeof(struct xt_ts3init_set_puzzle_tginfo),
+        .target     = ts3init_set_puzzle_ipv6_tg,
+        .checkentry = ts3init_set_puzzle_tg_check,
+        .me         = THIS_MODULE,
+    },
     {
         .name       = "TS3INIT_GET_COOKIE",
         .revision   = 0,
@@ -550,6 +1751,26 @@ static struct xt_target ts3init_tg_reg[] __read_mostly = {
         .target     = ts3init_get_cookie_ipv6_tg,
         .me         = THIS_MODULE,
     },
+    {
+        .name       = "TS3INIT_GET_COOKIE",
+        .revision   = 1,
+        .family     = NFPROTO_IPV4,
+        .proto      = IPPROTO_UDP,
+        .targetsize = sizeof(struct xt_ts3init_get_cookie_tginfo),
+        .target     = ts3init_get_cookie_ipv4_tg_v1,
+        .checkentry = ts3init_get_cookie_tg_check_v1,
+        .me         = THIS_MODULE,
+    },
+    {
+        .name       = "TS3INIT_GET_COOKIE",
+        .revision   = 1,
+        .family     = NFPROTO_IPV6,
+        .proto      = IPPROTO_UDP,
+        .targetsize = sizeof(struct xt_ts3init_get_cookie_tginfo),
+        .target     = ts3init_get_cookie_ipv6_tg_v1,
+        .checkentry = ts3init_get_cookie_tg_check_v1,
+        .me         = THIS_MODULE,
+    },
 };
 
 int __init ts3init_target_init(void)
@@ -561,3 +1782,7 @@ void ts3init_target_exit(void)
 {
     xt_unregister_targets(ts3init_tg_reg, ARRAY_SIZE(ts3init_tg_reg));
 }
+
+#ifdef TS3INIT_KUNIT_TEST
+#include "ts3init_target_test.c"
+#endif
@@ -1,19 +1,44 @@
 #ifndef _TS3INIT_TARGET_H
 #define _TS3INIT_TARGET_H
 
-/* Common Enums for targets */
+/*
+ * Common Enums for targets.
+ * With TARGET_COMMON_SHADOW, the target builds its reply and counts the
+ * result, but sends nothing and lets the packet continue.
+ */
 enum
 {
-    TARGET_COMMON_VALID_MASK = (1 << 0) -1
+    TARGET_COMMON_IN_PLACE    = 1 << 0,
+    TARGET_COMMON_DIRECT_XMIT = 1 << 1,
+    TARGET_COMMON_SHADOW      = 1 << 2,
+    TARGET_COMMON_VALID_MASK  = (1 << 3) -1
 };
 
-/* Enums and structs for set_cookie */
+/* Enums and structs for reset */
+enum
+{
+    TARGET_RESET_VALID_MASK = (1 << 0) - 1
+};
+
+struct xt_ts3init_reset_tginfo
+{
+    __u8 common_options;
+    __u8 specific_options;
+    __u16 reserved1;
+};
+
+/*
+ * Enums and structs for set_cookie.
+ * With TARGET_SET_COOKIE_ADAPTIVE, the target acts as if
+ * TARGET_SET_COOKIE_ZERO_RANDOM_SEQUENCE was set while under attack.
+ */
 enum
 {
     TARGET_SET_COOKIE_ZERO_RANDOM_SEQUENCE        = 1 << 0,
     TARGET_SET_COOKIE_RANDOM_SEED_FROM_ARGUMENT   = 1 << 1,
     TARGET_SET_COOKIE_RANDOM_SEED_FROM_FILE       = 1 << 2,
-    TARGET_SET_COOKIE_VALID_MASK                 = (1 << 3) - 1
+    TARGET_SET_COOKIE_ADAPTIVE                    = 1 << 4,
+    TARGET_SET_COOKIE_VALID_MASK                 = ((1 << 3) - 1) | TARGET_SET_COOKIE_ADAPTIVE
 };
 
 
@@ -26,4 +51,66 @@ struct xt_ts3init_set_cookie_tginfo
     char random_seed_path[RANDOM_SEED_PATH_MAX];
 };
 
+/*
+ * Enums and structs for set_cookie revision 1.
+ * The seed is referenced by the id of a seed added through netlink, or
+ * taken from the entry of the destination port in a port table.
+ */
+enum
+{
+    TARGET_SET_COOKIE_PORT_TABLE    = 1 << 3,
+    TARGET_SET_COOKIE_V1_VALID_MASK = TARGET_SET_COOKIE_ZERO_RANDOM_SEQUENCE |
+                                      TARGET_SET_COOKIE_PORT_TABLE |
+                                      TARGET_SET_COOKIE_ADAPTIVE
+};
+
+struct ts3init_seed;
+struct ts3init_port_table;
+
+struct xt_ts3init_set_cookie_tginfo_v1
+{
+    __u8 common_options;
+    __u8 specific_options;
+    __u16 reserved1;
+    __u32 seed_id;
+    __u32 port_table_id;
+
+    /* Used internally by the kernel */
+    struct ts3init_seed *seed __attribute__((aligned(8)));
+    struct ts3init_port_table *port_table __attribute__((aligned(8)));
+    __u32 variant __attribute__((aligned(8)));
+};
+
+/* Enums and structs for set_puzzle */
+enum
+{
+    TARGET_SET_PUZZLE_VALID_MASK = (1 << 0) - 1
+};
+
+struct xt_ts3init_set_puzzle_tginfo
+{
+    __u8 common_options;
+    __u8 specific_options;
+    __u16 reserved1;
+};
+
+/*
+ * Enums and structs for get_cookie revision 1.
+ * With TARGET_GET_COOKIE_ADAPTIVE, the target replies with COMMAND_RESET
+ * while under attack, as TS3INIT_RESET revision 1 with the same common
+ * options would, instead of rewriting the packet.
+ */
+enum
+{
+    TARGET_GET_COOKIE_ADAPTIVE   = 1 << 0,
+    TARGET_GET_COOKIE_VALID_MASK = (1 << 1) - 1
+};
+
+struct xt_ts3init_get_cookie_tginfo
+{
+    __u8 common_options;
+    __u8 specific_options;
+    __u16 reserved1;
+};
+
 #endif /* _TS3INIT_TARGET_H */
@@ -0,0 +1,102 @@
+/*
+ *    "ts3init" extension for Xtables
+ *
+ *    Description: KUnit tests and microbenchmarks of the target payload
+ *                 builders. Included at the end of ts3init_target.c, built
+ *                 with 'make TS3INIT_KUNIT=1'.
+ *
+ *    This program is free software; you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License; either version 2
+ *    or 3 of the License, as published by the Free Software Foundation.
+ */
+
+#include "ts3init_match.h"
+#include "ts3init_test.h"
+
+enum
+{
+    TEST_GET_COOKIE_LENGTH = TS3INIT_HEADER_CLIENT_LENGTH + 16
+};
+
+#define TEST_COOKIE 0x0102030405060708ULL
+
+static struct sk_buff *test_get_cookie_skb(struct kunit *test, struct xt_action_param *par)
+{
+    __u8 packet[TEST_GET_COOKIE_LENGTH] = {};
+
+    ts3init_test_client_header(packet, COMMAND_GET_COOKIE, 1459504131);
+    /* the random sequence the reply echoes reversed */
+    packet[22] = 0x11;
+    packet[23] = 0x22;
+    packet[24] = 0x33;
+    packet[25] = 0x44;
+    return ts3init_test_skb_ipv4(test, par, packet, sizeof(packet));
+}
+
+static void ts3init_test_set_cookie_payload(struct kunit *test)
+{
+    static const __u8 cookie_le[8] = { 8, 7, 6, 5, 4, 3, 2, 1 };
+    static const __u8 random_sequence[4] = { 0x44, 0x33, 0x22, 0x11 };
+    struct xt_ts3init_set_cookie_tginfo info = {};
+    struct xt_action_param par = { .targinfo = &info };
+    struct sk_buff *skb;
+    __u8 packet[TS3INIT_SET_COOKIE_PACKET_SIZE];
+
+    skb = test_get_cookie_skb(test, &par);
+    KUNIT_ASSERT_EQ(test, ts3init_reply_copy_packet(TS3INIT_REPLY_SET_COOKIE, packet),
+        (unsigned int)TS3INIT_SET_COOKIE_PACKET_SIZE);
+    KUNIT_EXPECT_MEMEQ(test, packet, "TS3INIT1", 8);
+    KUNIT_EXPECT_EQ(test, packet[11], (__u8)COMMAND_SET_COOKIE);
+
+    KUNIT_EXPECT_TRUE(test, ts3init_fill_set_cookie_payload(skb, &par, TEST_COOKIE, 5, false, packet));
+    KUNIT_EXPECT_MEMEQ(test, packet + 12, cookie_le, sizeof(cookie_le));
+    KUNIT_EXPECT_EQ(test, packet[20], 5);
+    KUNIT_EXPECT_MEMEQ(test, packet + 28, random_sequence, sizeof(random_sequence));
+
+    /* --zero-random-sequence keeps the zeros of the template */
+    ts3init_reply_copy_packet(TS3INIT_REPLY_SET_COOKIE, packet);
+    KUNIT_EXPECT_TRUE(test, ts3init_fill_set_cookie_payload(skb, &par, TEST_COOKIE, 5, true, packet));
+    KUNIT_EXPECT_EQ(test, packet[28] | packet[29] | packet[30] | packet[31], 0);
+    kfree_skb(skb);
+}
+
+/*
+ * Times the building of a TS3INIT_SET_COOKIE reply payload. The result is
+ * printed, not checked; compare it between builds on the same machine.
+ */
+static void ts3init_test_bench_set_cookie(struct kunit *test)
+{
+    struct xt_ts3init_set_cookie_tginfo info = {};
+    struct xt_action_param par = { .targinfo = &info };
+    struct sk_buff *skb;
+    __u8 packet[TS3INIT_SET_COOKIE_PACKET_SIZE];
+    unsigned int i, filled = 0;
+    u64 start;
+
+    skb = test_get_cookie_skb(test, &par);
+
+    start = ktime_get_ns();
+    for (i = 0; i < TS3INIT_TEST_BENCH_LOOPS; i++)
+    {
+        ts3init_reply_copy_packet(TS3INIT_REPLY_SET_COOKIE, packet);
+        filled += ts3init_fill_set_cookie_payload(skb, &par, TEST_COOKIE + i, i % 8, false, packet);
+    }
+    ts3init_test_bench_report(test, "set_cookie payload", start, TS3INIT_TEST_BENCH_LOOPS);
+    KUNIT_EXPECT_EQ(test, filled, (unsigned int)TS3INIT_TEST_BENCH_LOOPS);
+    kfree_skb(skb);
+}
+
+static struct kunit_case ts3init_target_test_cases[] =
+{
+    KUNIT_CASE(ts3init_test_set_cookie_payload),
+    KUNIT_CASE(ts3init_test_bench_set_cookie),
+    {}
+};
+
+static struct kunit_suite ts3init_target_test_suite =
+{
+    .name = "ts3init_target",
+    .test_cases = ts3init_target_test_cases,
+};
+
+kunit_test_suite(ts3init_target_test_suite);
@@ -0,0 +1,103 @@
+#ifndef _TS3INIT_TEST_H
+#define _TS3INIT_TEST_H
+
+/*
+ * Helpers of the KUnit tests, built with 'make TS3INIT_KUNIT=1'.
+ * The tests are included at the end of the file whose static functions
+ * they test.
+ */
+
+#include <kunit/test.h>
+#include <linux/version.h>
+#include <linux/ktime.h>
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 1, 0)
+#error "the ts3init KUnit tests need Linux 6.1 or later"
+#endif
+
+enum
+{
+    TS3INIT_TEST_SPORT = 50000,
+    TS3INIT_TEST_DPORT = 9987,
+    /* 1500000000 % 8 == 0: packet index 0 is the current window */
+    TS3INIT_TEST_TIME  = 1500000000,
+    TS3INIT_TEST_BENCH_LOOPS = 100000
+};
+
+/* 192.0.2.1 and 198.51.100.2 */
+#define TS3INIT_TEST_SADDR4 0xc0000201
+#define TS3INIT_TEST_DADDR4 0xc6336402
+
+/* random_seed[i] = i, the seed of the test vectors in cookie.md */
+static inline void ts3init_test_random_seed(__u8 *random_seed)
+{
+    int i;
+    for (i = 0; i < RANDOM_SEED_LEN; i++)
+        random_seed[i] = i;
+}
+
+/*
+ * Writes a TS3INIT client header with command and client version to
+ * packet, which must hold TS3INIT_HEADER_CLIENT_LENGTH bytes.
+ */
+static inline void ts3init_test_client_header(__u8 *packet, __u8 command, __u32 version)
+{
+    __u32 packet_version = version - CLIENT_VERSION_OFFSET;
+
+    memcpy(packet, "TS3INIT1", 8);
+    packet[8]  = 0;
+    packet[9]  = 101;
+    packet[10] = 0;
+    packet[11] = 0;
+    packet[12] = 0x88;
+    packet[13] = packet_version >> 24;
+    packet[14] = packet_version >> 16;
+    packet[15] = packet_version >> 8;
+    packet[16] = packet_version;
+    packet[17] = command;
+}
+
+/*
+ * Returns an ipv4 udp skb from 192.0.2.1:50000 to 198.51.100.2:9987
+ * carrying data, and sets par up as the match or target would see it.
+ */
+static inline struct sk_buff *ts3init_test_skb_ipv4(struct kunit *test,
+    struct xt_action_param *par, const void *data, unsigned int data_len)
+{
+    struct sk_buff *skb;
+    struct iphdr *ip;
+    struct udphdr *udp;
+
+    skb = alloc_skb(sizeof(*ip) + sizeof(*udp) + data_len, GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, skb);
+
+    skb_reset_network_header(skb);
+    ip = skb_put_zero(skb, sizeof(*ip));
+    ip->version  = 4;
+    ip->ihl      = sizeof(*ip) / 4;
+    ip->ttl      = 64;
+    ip->protocol = IPPROTO_UDP;
+    ip->tot_len  = htons(sizeof(*ip) + sizeof(*udp) + data_len);
+    ip->saddr    = htonl(TS3INIT_TEST_SADDR4);
+    ip->daddr    = htonl(TS3INIT_TEST_DADDR4);
+
+    skb_set_transport_header(skb, sizeof(*ip));
+    udp = skb_put_zero(skb, sizeof(*udp));
+    udp->source = htons(TS3INIT_TEST_SPORT);
+    udp->dest   = htons(TS3INIT_TEST_DPORT);
+    udp->len    = htons(sizeof(*udp) + data_len);
+    skb_put_data(skb, data, data_len);
+
+    par->thoff = sizeof(*ip);
+    return skb;
+}
+
+/* Prints the time per call of a loop started at start_ns. */
+static inline void ts3init_test_bench_report(struct kunit *test, const char *name,
+    u64 start_ns, unsigned int loops)
+{
+    u64 ns = ktime_get_ns() - start_ns;
+    kunit_info(test, "bench %s: %llu ns/call\n", name, div_u64(ns, loops));
+}
+
+#endif /* _TS3INIT_TEST_H */
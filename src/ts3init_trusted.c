@@ -0,0 +1,363 @@
+/*
+ *    "ts3init" extension for Xtables
+ *
+ *    Description: A module to aid in ts3 spoof protection
+ *                 This is the "trusted prefixes and reply budget" related code
+ *
+ *    Authors:
+ *    Niels Werensteijn <niels werensteijn [at] teamspeak com>, 2016-10-03
+ *
+ *    This program is free software; you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License; either version 2
+ *    or 3 of the License, as published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/version.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/jiffies.h>
+#include <linux/hashtable.h>
+#include <linux/rcupdate.h>
+#include <linux/sort.h>
+#include <linux/netfilter.h>
+#include <asm/unaligned.h>
+#include <net/net_namespace.h>
+#include <net/netns/generic.h>
+#include "ts3init_netlink.h"
+#include "ts3init_net.h"
+#include "ts3init_stats.h"
+#include "ts3init_trusted.h"
+
+unsigned int ts3init_reply_budget;
+module_param_named(reply_budget, ts3init_reply_budget, uint, 0644);
+MODULE_PARM_DESC(reply_budget, "TS3INIT_SET_COOKIE replies per second and cpu to any source, 0 is unlimited (default 0)");
+
+static unsigned int trusted_reply_budget = 10000;
+module_param(trusted_reply_budget, uint, 0644);
+MODULE_PARM_DESC(trusted_reply_budget, "TS3INIT_SET_COOKIE replies per second and cpu to trusted sources beyond reply_budget (default 10000)");
+
+/*
+ * The sets of a namespace are in ts3init_net.trusted. They are replaced
+ * under ts3init_trusted_mutex, and read under rcu.
+ */
+static DEFINE_MUTEX(ts3init_trusted_mutex);
+
+static inline struct ts3init_trusted_set __rcu **
+ts3init_trusted_slot(const struct net *net, u8 family)
+{
+    return &ts3init_pernet(net)->trusted[family == NFPROTO_IPV6];
+}
+
+static void ts3init_trusted_addr_from(u8 family, const void *addr, struct ts3init_trusted_addr *out)
+{
+    if (family == NFPROTO_IPV4)
+    {
+        out->hi = (u64)get_unaligned_be32(addr) << 32;
+        out->lo = 0;
+    }
+    else
+    {
+        out->hi = get_unaligned_be64(addr);
+        out->lo = get_unaligned_be64((const u8 *)addr + 8);
+    }
+}
+
+static inline int ts3init_trusted_addr_cmp(const struct ts3init_trusted_addr *a,
+                                           const struct ts3init_trusted_addr *b)
+{
+    if (a->hi != b->hi)
+        return a->hi < b->hi ? -1 : 1;
+    if (a->lo != b->lo)
+        return a->lo < b->lo ? -1 : 1;
+    return 0;
+}
+
+static int ts3init_trusted_prefix_cmp(const struct ts3init_trusted_prefix *a,
+                                      const struct ts3init_trusted_prefix *b)
+{
+    int cmp = ts3init_trusted_addr_cmp(&a->addr, &b->addr);
+
+    return cmp ? cmp : (int)a->len - (int)b->len;
+}
+
+/*
+ * Returns the first and the last address of the prefix of len bits
+ * of addr.
+ */
+static void ts3init_trusted_prefix_range(const struct ts3init_trusted_addr *addr, u8 len,
+                                         struct ts3init_trusted_range *range)
+{
+    u64 mask_hi = len == 0 ? 0 : len >= 64 ? ~0ULL : ~0ULL << (64 - len);
+    u64 mask_lo = len <= 64 ? 0 : len >= 128 ? ~0ULL : ~0ULL << (128 - len);
+
+    range->first.hi = addr->hi & mask_hi;
+    range->first.lo = addr->lo & mask_lo;
+    range->last.hi = range->first.hi | ~mask_hi;
+    range->last.lo = range->first.lo | ~mask_lo;
+}
+
+static void *ts3init_trusted_alloc(size_t size)
+{
+    if (size <= PAGE_SIZE)
+        return kmalloc(size, GFP_KERNEL);
+    return vmalloc(size);
+}
+
+static struct ts3init_trusted_set *ts3init_trusted_set_alloc(unsigned int prefix_count)
+{
+    struct ts3init_trusted_set *set;
+
+    set = ts3init_trusted_alloc(sizeof(*set) + prefix_count *
+                                (sizeof(set->prefixes[0]) + sizeof(set->ranges[0])));
+    if (set == NULL)
+        return NULL;
+    set->prefix_count = prefix_count;
+    set->ranges = (struct ts3init_trusted_range *)&set->prefixes[prefix_count];
+    return set;
+}
+
+struct ts3init_trusted_prefix *ts3init_trusted_prefixes_alloc(unsigned int count)
+{
+    return ts3init_trusted_alloc(count * sizeof(struct ts3init_trusted_prefix));
+}
+
+int ts3init_trusted_prefix_init(u8 family, const void *addr, u8 len,
+                                struct ts3init_trusted_prefix *prefix)
+{
+    struct ts3init_trusted_range range;
+
+    if (len > (family == NFPROTO_IPV4 ? 32 : 128))
+        return -EINVAL;
+
+    /* host bits are ignored, 10.0.0.1/8 is 10.0.0.0/8 */
+    ts3init_trusted_addr_from(family, addr, &prefix->addr);
+    ts3init_trusted_prefix_range(&prefix->addr, len, &range);
+    prefix->addr = range.first;
+    prefix->len = len;
+    return 0;
+}
+
+static void ts3init_trusted_set_free_rcu(struct rcu_head *head)
+{
+    kvfree(container_of(head, struct ts3init_trusted_set, rcu));
+}
+
+/*
+ * Merges the ranges of the sorted prefixes of set.
+ */
+static void ts3init_trusted_set_build(struct ts3init_trusted_set *set)
+{
+    struct ts3init_trusted_range range, *last = NULL;
+    unsigned int i;
+
+    set->range_count = 0;
+    for (i = 0; i < set->prefix_count; ++i)
+    {
+        ts3init_trusted_prefix_range(&set->prefixes[i].addr, set->prefixes[i].len, &range);
+        if (last != NULL && ts3init_trusted_addr_cmp(&range.first, &last->last) <= 0)
+        {
+            if (ts3init_trusted_addr_cmp(&range.last, &last->last) > 0)
+                last->last = range.last;
+            continue;
+        }
+        last = &set->ranges[set->range_count++];
+        *last = range;
+    }
+}
+
+static int ts3init_trusted_prefix_sort_cmp(const void *a, const void *b)
+{
+    return ts3init_trusted_prefix_cmp(a, b);
+}
+
+/*
+ * Replaces the set of family with a copy that has the prefixes added or
+ * removed, all or none of them. The old set and the sorted prefixes are
+ * merged in one pass, so a message of many prefixes costs one copy of the
+ * set and one grace period.
+ */
+static int ts3init_trusted_change(struct net *net, u8 family,
+                                  struct ts3init_trusted_prefix *prefixes,
+                                  unsigned int count, bool add)
+{
+    struct ts3init_trusted_set __rcu **slot = ts3init_trusted_slot(net, family);
+    struct ts3init_trusted_set *old_set, *set = NULL;
+    unsigned int old_count, new_count, i, j, k;
+    int error = 0;
+
+    if (count == 0)
+        return 0;
+
+    sort(prefixes, count, sizeof(*prefixes), ts3init_trusted_prefix_sort_cmp, NULL);
+    for (i = 1; i < count; ++i)
+    {
+        if (ts3init_trusted_prefix_cmp(&prefixes[i - 1], &prefixes[i]) == 0)
+            return add ? -EEXIST : -ENOENT;
+    }
+
+    mutex_lock(&ts3init_trusted_mutex);
+    old_set = rcu_dereference_protected(*slot, lockdep_is_held(&ts3init_trusted_mutex));
+    old_count = old_set != NULL ? old_set->prefix_count : 0;
+    if (add && count > TS3INIT_TRUSTED_MAX_PREFIXES - old_count)
+        error = -ENOSPC;
+    else if (!add && count > old_count)
+        error = -ENOENT;
+    if (error)
+        goto out;
+
+    new_count = add ? old_count + count : old_count - count;
+    if (new_count > 0)
+    {
+        set = ts3init_trusted_set_alloc(new_count);
+        if (set == NULL)
+        {
+            error = -ENOMEM;
+            goto out;
+        }
+    }
+
+    for (i = 0, j = 0, k = 0; i < old_count || j < count; )
+    {
+        int cmp = i == old_count ? 1 :
+                  j == count ? -1 :
+                  ts3init_trusted_prefix_cmp(&old_set->prefixes[i], &prefixes[j]);
+
+        if (cmp < 0 && k < new_count)
+            set->prefixes[k++] = old_set->prefixes[i++];
+        else if (cmp > 0 && add)
+            set->prefixes[k++] = prefixes[j++];
+        else if (cmp == 0 && !add)
+        {
+            ++i;
+            ++j;
+        }
+        else
+        {
+            /* an added prefix is already there, or a removed one is not */
+            error = add ? -EEXIST : -ENOENT;
+            kvfree(set);
+            goto out;
+        }
+    }
+    if (set != NULL)
+        ts3init_trusted_set_build(set);
+
+    rcu_assign_pointer(*slot, set);
+    if (old_set != NULL)
+        call_rcu(&old_set->rcu, ts3init_trusted_set_free_rcu);
+out:
+    mutex_unlock(&ts3init_trusted_mutex);
+    return error;
+}
+
+int ts3init_trusted_add(struct net *net, u8 family,
+                        struct ts3init_trusted_prefix *prefixes, unsigned int count)
+{
+    return ts3init_trusted_change(net, family, prefixes, count, true);
+}
+
+int ts3init_trusted_remove(struct net *net, u8 family,
+                           struct ts3init_trusted_prefix *prefixes, unsigned int count)
+{
+    return ts3init_trusted_change(net, family, prefixes, count, false);
+}
+
+void ts3init_trusted_flush(struct net *net)
+{
+    struct ts3init_trusted_set *old_set;
+    int i;
+
+    mutex_lock(&ts3init_trusted_mutex);
+    for (i = 0; i < ARRAY_SIZE(ts3init_pernet(net)->trusted); ++i)
+    {
+        old_set = rcu_dereference_protected(ts3init_pernet(net)->trusted[i],
+                                            lockdep_is_held(&ts3init_trusted_mutex));
+        RCU_INIT_POINTER(ts3init_pernet(net)->trusted[i], NULL);
+        if (old_set != NULL)
+            call_rcu(&old_set->rcu, ts3init_trusted_set_free_rcu);
+    }
+    mutex_unlock(&ts3init_trusted_mutex);
+}
+
+bool ts3init_trusted_lookup(const struct net *net, u8 family, const void *addr)
+{
+    const struct ts3init_trusted_set *set = rcu_dereference(*ts3init_trusted_slot(net, family));
+    struct ts3init_trusted_addr key;
+    unsigned int low = 0, high;
+
+    if (set == NULL)
+        return false;
+
+    ts3init_trusted_addr_from(family, addr, &key);
+    /* finds the first range that starts after key */
+    high = set->range_count;
+    while (low < high)
+    {
+        unsigned int mid = low + (high - low) / 2;
+
+        if (ts3init_trusted_addr_cmp(&set->ranges[mid].first, &key) <= 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low > 0 && ts3init_trusted_addr_cmp(&key, &set->ranges[low - 1].last) <= 0;
+}
+
+/*
+ * The budget is counted in windows of a tenth of a second, so a burst
+ * can not use up the budget of a whole second.
+ */
+bool ts3init_reply_budget_admit(const struct net *net, u8 family, const void *saddr)
+{
+    struct ts3init_budget *budget = this_cpu_ptr(ts3init_pernet(net)->budget);
+    unsigned long now = jiffies;
+    unsigned int limit = DIV_ROUND_UP(READ_ONCE(ts3init_reply_budget),
+                                      TS3INIT_REPLY_BUDGET_WINDOWS_PER_SEC);
+
+    if (time_after_eq(now, budget->window_start + TS3INIT_REPLY_BUDGET_WINDOW))
+    {
+        budget->window_start = now;
+        budget->replies = 0;
+    }
+
+    if (budget->replies < limit)
+    {
+        ++budget->replies;
+        return true;
+    }
+
+    limit += DIV_ROUND_UP(READ_ONCE(trusted_reply_budget), TS3INIT_REPLY_BUDGET_WINDOWS_PER_SEC);
+    if (budget->replies < limit && ts3init_trusted_lookup(net, family, saddr))
+    {
+        ++budget->replies;
+        ts3init_stat_inc(net, TS3INIT_STAT_BUDGET_TRUSTED);
+        return true;
+    }
+
+    ts3init_stat_inc(net, TS3INIT_STAT_BUDGET_SHED);
+    return false;
+}
+
+/*
+ * Sets up the trusted prefixes and the reply budget of a new network
+ * namespace.
+ */
+void ts3init_trusted_net_init(struct ts3init_net *tn)
+{
+    int cpu;
+
+    RCU_INIT_POINTER(tn->trusted[0], NULL);
+    RCU_INIT_POINTER(tn->trusted[1], NULL);
+    for_each_possible_cpu(cpu)
+        per_cpu_ptr(tn->budget, cpu)->window_start = jiffies;
+}
+
+void ts3init_trusted_net_exit(struct net *net)
+{
+    ts3init_trusted_flush(net);
+}
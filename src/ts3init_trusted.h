@@ -0,0 +1,111 @@
+#ifndef _TS3INIT_TRUSTED_H
+#define _TS3INIT_TRUSTED_H
+
+/*
+ * Trusted prefixes, such as ranges of returning clients, keep getting
+ * TS3INIT_SET_COOKIE replies when the reply budget of a cpu is used up.
+ * Addresses are kept as 128 bit numbers in two host order halves; ipv4
+ * addresses are in the top 32 bits.
+ */
+struct ts3init_trusted_addr
+{
+    u64 hi;
+    u64 lo;
+};
+
+struct ts3init_trusted_prefix
+{
+    struct ts3init_trusted_addr addr;
+    u8 len;
+};
+
+struct ts3init_trusted_range
+{
+    struct ts3init_trusted_addr first;
+    struct ts3init_trusted_addr last;
+};
+
+/*
+ * The trusted prefixes of one address family. The prefixes are kept as
+ * they were added, sorted; the ranges they cover are merged and sorted,
+ * so a lookup is a binary search. Replaced as a whole under rcu.
+ */
+struct ts3init_trusted_set
+{
+    struct rcu_head rcu;
+    unsigned int prefix_count;
+    unsigned int range_count;
+    struct ts3init_trusted_range *ranges;
+    struct ts3init_trusted_prefix prefixes[];
+};
+
+/* The reply budget of a cpu in the current window. */
+struct ts3init_budget
+{
+    unsigned long window_start;
+    unsigned int replies;
+};
+
+enum
+{
+    TS3INIT_TRUSTED_MAX_PREFIXES = 1 << 16,
+    TS3INIT_REPLY_BUDGET_WINDOWS_PER_SEC = 10,
+    TS3INIT_REPLY_BUDGET_WINDOW = HZ / TS3INIT_REPLY_BUDGET_WINDOWS_PER_SEC
+};
+
+/* The reply_budget module parameter */
+extern unsigned int ts3init_reply_budget;
+
+/*
+ * Sets prefix to the prefix of len bits of addr, a network order address
+ * of family, NFPROTO_IPV4 or NFPROTO_IPV6. Returns -EINVAL if len is
+ * longer than the address.
+ */
+int ts3init_trusted_prefix_init(u8 family, const void *addr, u8 len,
+                                struct ts3init_trusted_prefix *prefix);
+
+/* Allocates count prefixes, freed with kvfree. */
+struct ts3init_trusted_prefix *ts3init_trusted_prefixes_alloc(unsigned int count);
+
+/*
+ * Adds count prefixes of family, all or none of them, and sorts
+ * prefixes. Returns -EEXIST if one was already added or is given twice,
+ * -ENOSPC if the family would have more than TS3INIT_TRUSTED_MAX_PREFIXES.
+ */
+int ts3init_trusted_add(struct net *net, u8 family,
+                        struct ts3init_trusted_prefix *prefixes, unsigned int count);
+
+/*
+ * Removes count prefixes of family, all or none of them, and sorts
+ * prefixes. Returns -ENOENT if one of them was not added.
+ */
+int ts3init_trusted_remove(struct net *net, u8 family,
+                           struct ts3init_trusted_prefix *prefixes, unsigned int count);
+
+/* Removes all prefixes of a namespace. */
+void ts3init_trusted_flush(struct net *net);
+
+/*
+ * Returns whether addr, a network order address of family, is in a
+ * trusted prefix. Must be called under rcu_read_lock().
+ */
+bool ts3init_trusted_lookup(const struct net *net, u8 family, const void *addr);
+
+bool ts3init_reply_budget_admit(const struct net *net, u8 family, const void *saddr);
+
+/*
+ * Takes a reply from the budget of the current cpu for a packet from
+ * saddr. Once the budget of the window is used up, only trusted sources
+ * are replied to, up to trusted_reply_budget more.
+ */
+static inline bool ts3init_reply_budget_take(const struct net *net, u8 family, const void *saddr)
+{
+    if (likely(READ_ONCE(ts3init_reply_budget) == 0))
+        return true;
+    return ts3init_reply_budget_admit(net, family, saddr);
+}
+
+void ts3init_trusted_net_init(struct ts3init_net *tn);
+void ts3init_trusted_net_exit(struct net *net);
+
+#endif /* _TS3INIT_TRUSTED_H */
@@ -0,0 +1,22 @@
+#ifndef _TS3INIT_VARIANT_H
+#define _TS3INIT_VARIANT_H
+
+/*
+ * Specialised variants of the match and target handlers.
+ *
+ * A handler with options has an __always_inline body that takes the
+ * options it tests on the hot path as a constant 'variant' bit mask, and
+ * a switch that runs the body compiled for the variant of the rule.
+ * checkentry of revision 1 computes the variant once and stores it in the
+ * kernel-only part of the info. Revision 0 infos have no such part, so
+ * their handlers compute it from the options on each packet.
+ *
+ * TS3INIT_VARIANTS_n(call) expands call(0) ... call(n - 1), to write the
+ * cases of such a switch.
+ */
+#define TS3INIT_VARIANTS_4(call)  call(0); call(1); call(2); call(3)
+#define TS3INIT_VARIANTS_8(call)  TS3INIT_VARIANTS_4(call); call(4); call(5); call(6); call(7)
+#define TS3INIT_VARIANTS_16(call) TS3INIT_VARIANTS_8(call); call(8); call(9); call(10); \
+                                  call(11); call(12); call(13); call(14); call(15)
+
+#endif /* _TS3INIT_VARIANT_H */
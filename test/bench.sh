@@ -0,0 +1,186 @@
+#!/bin/bash
+
+#Performance regression suite, run by 'make bench'.
+#Installs the rulesets of examples/simple and examples/complex in a network
+#namespace, floods them with ts3init_flood from another one and measures:
+#* replies_per_sec: TS3INIT_SET_COOKIE replies to valid get cookie packets
+#* verified_per_sec: get puzzle packets with a valid cookie
+#* cycles_per_packet: cpu cycles of the whole machine (perf) per packet
+#  received by the ruleset namespace, minus that of the same flood without
+#  any rules, so only the cost of the rules remains
+#The results are compared with the baseline file, if there is one, and the
+#suite fails if any result is more than BENCH_THRESHOLD percent worse.
+#Baselines depend on the machine, so create one per machine with
+#'make bench-baseline' (bench.sh --update-baseline) before changing code.
+#
+#Environment:
+#  BENCH_DURATION   seconds per run (default 5)
+#  BENCH_THRESHOLD  allowed regression in percent (default 10)
+#  BENCH_BASELINE   baseline file (default test/bench.baseline)
+
+DIR=$(cd "$(dirname "$0")" && pwd)
+REPO=$(cd "${DIR}/.." && pwd)
+DURATION=${BENCH_DURATION:-5}
+THRESHOLD=${BENCH_THRESHOLD:-10}
+BASELINE=${BENCH_BASELINE:-${DIR}/bench.baseline}
+WORK=$(mktemp -d)
+RESULTS=${WORK}/results
+
+. "${DIR}/netns.sh"
+trap 'netns_delete; rm -rf "${WORK}"' EXIT
+
+if [ ! -x "${DIR}/ts3init_flood" ]
+then
+  make -C "${DIR}" ts3init_flood || exit -1
+fi
+#the examples push their seed with ts3initd
+if [ ! -x "${REPO}/tools/ts3initd/ts3initd" ]
+then
+  make -C "${REPO}/tools/ts3initd" || exit -1
+fi
+export TS3INITD=${REPO}/tools/ts3initd/ts3initd
+modprobe xt_ts3init || { echo "could not load xt_ts3init"; exit -1; }
+xxd -l 60 -c 60 -p /dev/urandom > "${WORK}/random.data" || { echo "could not use xxd to create random data"; exit -1; }
+PERF=$(command -v perf)
+if [ -z "${PERF}" ]
+then
+  echo "perf not found, cycles_per_packet is not measured"
+fi
+
+#prints the packet counter of the ts3init_get_puzzle rule
+puzzle_counter()
+{
+  ip netns exec ${DUT} iptables -v -S TS3_UDP_TRAFFIC 2>/dev/null |
+    awk '/ts3init_get_puzzle/ { for (i = 1; i < NF; ++i) if ($i == "-c") print $(i + 1) }'
+}
+
+#prints the number of ts3init rules in the ruleset namespace, or in the
+#create-fw.sh of an example
+ts3init_rules()
+{
+  grep -c -e '-m ts3init' -e '-j TS3INIT'
+}
+
+#run <ruleset> <workload> <ts3init_flood options...>
+#ruleset is none or the name of a directory in examples
+run()
+{
+  local ruleset=$1 workload=$2
+  local rx tx puzzles cycles
+  shift 2
+
+  netns_create || exit -1
+  if [ "${ruleset}" != "none" ]
+  then
+    #the examples create random.data in the current directory, if needed
+    (cd "${WORK}" && ip netns exec ${DUT} "${REPO}/examples/${ruleset}/create-fw.sh" 4 > /dev/null) ||
+      { echo "could not install examples/${ruleset}"; exit -1; }
+    #the examples go on after a rule failed, so check that all were added
+    if [ $(ip netns exec ${DUT} iptables-save | ts3init_rules) -ne \
+         $(ts3init_rules < "${REPO}/examples/${ruleset}/create-fw.sh") ]
+    then
+      echo "examples/${ruleset} was only partly installed"
+      exit -1
+    fi
+  fi
+
+  rx=$(dut_counter rx_packets)
+  tx=$(dut_counter tx_packets)
+  puzzles=$(puzzle_counter)
+  puzzles=${puzzles:-0}
+  if [ -n "${PERF}" ]
+  then
+    ${PERF} stat -a -x, -e cycles -o "${WORK}/perf" -- sleep ${DURATION} &
+  fi
+  ip netns exec ${GEN} "${DIR}/ts3init_flood" -d ${DURATION} -s ${SPOOF_NET} \
+    -S "${WORK}/random.data" "$@" ${DUT_ADDR} > /dev/null
+  wait
+  rx=$(( $(dut_counter rx_packets) - rx ))
+  tx=$(( $(dut_counter tx_packets) - tx ))
+
+  if [ "${ruleset}" == "none" ]
+  then
+    :
+  elif [ "${workload}" == "handshake" ]
+  then
+    echo "${ruleset}.${workload}.replies_per_sec $(( tx / DURATION ))" >> "${RESULTS}"
+  elif [ "${workload}" == "puzzle" ]
+  then
+    echo "${ruleset}.${workload}.verified_per_sec $(( ($(puzzle_counter) - puzzles) / DURATION ))" >> "${RESULTS}"
+  fi
+  if [ -n "${PERF}" ] && [ ${rx} -gt 0 ]
+  then
+    cycles=$(awk -F, '/cycles/ { print $1 }' "${WORK}/perf")
+    echo "${ruleset}.${workload}.cycles_total_per_packet $(( cycles / rx ))" >> "${RESULTS}"
+  fi
+  netns_delete
+}
+
+for workload in handshake puzzle junk
+do
+  case ${workload} in
+    handshake) KINDS="-k get_cookie";;
+    puzzle)    KINDS="-k get_puzzle";;
+    junk)      KINDS="-k bad_cookie -k bad_version -k bad_tag";;
+  esac
+  for ruleset in none simple complex
+  do
+    run ${ruleset} ${workload} ${KINDS}
+  done
+done
+
+#the cycles of the rules alone: the cycles of a ruleset minus those of none
+awk '
+  $1 ~ /cycles_total_per_packet$/ {
+    split($1, name, ".")
+    total[name[1] "." name[2]] = $2
+    next
+  }
+  { print }
+  END {
+    for (key in total)
+    {
+      split(key, name, ".")
+      if (name[1] != "none" && (("none." name[2]) in total))
+        print key ".cycles_per_packet " total[key] - total["none." name[2]]
+    }
+  }' "${RESULTS}" | grep -v "^none\." | sort > "${WORK}/final"
+
+if [ "$1" == "--update-baseline" ]
+then
+  cp "${WORK}/final" "${BASELINE}"
+  echo "baseline written to ${BASELINE}:"
+  cat "${BASELINE}"
+  exit 0
+fi
+
+if [ ! -f "${BASELINE}" ]
+then
+  cat "${WORK}/final"
+  echo "no baseline ${BASELINE}, create one with 'make bench-baseline'"
+  exit 0
+fi
+
+#rates must not drop, cycles must not rise, by more than THRESHOLD percent
+awk -v threshold=${THRESHOLD} '
+  FNR == NR { baseline[$1] = $2; next }
+  {
+    result = "ok"
+    if ($1 in baseline)
+    {
+      base = baseline[$1]
+      if ($1 ~ /cycles_per_packet$/)
+        bad = $2 > base + (base < 0 ? -base : base) * threshold / 100
+      else
+        bad = $2 < base * (100 - threshold) / 100
+      if (bad)
+      {
+        result = "REGRESSION"
+        failed = 1
+      }
+      printf "%-40s %12d %12d  %s\n", $1, base, $2, result
+    }
+    else
+      printf "%-40s %12s %12d  %s\n", $1, "-", $2, "new"
+  }
+  END { exit failed }' "${BASELINE}" "${WORK}/final"
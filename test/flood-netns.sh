@@ -0,0 +1,51 @@
+#!/bin/bash
+
+#Floods a ts3init ruleset in a network namespace with ts3init_flood, over a
+#veth pair, and shows how many packets were dropped and answered.
+#The rules of examples/simple are used, without ipset.
+#Usage: flood-netns.sh [seconds] [pps] [ts3init_flood options...]
+#e.g.   flood-netns.sh 10 0 -k get_cookie:8 -k bad_cookie:1 -k get_puzzle:1
+
+DURATION=${1:-10}
+RATE=${2:-0}
+shift 2
+
+PORT=9987
+DIR=$(cd "$(dirname "$0")" && pwd)
+SEED_FILE=$(mktemp)
+
+. "${DIR}/netns.sh"
+trap 'netns_delete; rm -f "${SEED_FILE}"' EXIT
+
+if [ ! -x "${DIR}/ts3init_flood" ]
+then
+  make -C "${DIR}" ts3init_flood || exit -1
+fi
+if [ ! -x "${DIR}/../tools/ts3initd/ts3initd" ]
+then
+  make -C "${DIR}/../tools/ts3initd" || exit -1
+fi
+modprobe xt_ts3init || { echo "could not load xt_ts3init"; exit -1; }
+xxd -l 60 -c 60 -p /dev/urandom > "${SEED_FILE}" || { echo "could not use xxd to create random data"; exit -1; }
+
+netns_create || exit -1
+ip netns exec ${DUT} "${DIR}/../tools/ts3initd/ts3initd" --once --seed 1:${SEED_FILE} || exit -1
+
+IPT="ip netns exec ${DUT} iptables"
+${IPT} -t raw -A PREROUTING -p udp --dport ${PORT} -j CT --notrack
+${IPT} -t raw -A OUTPUT -p udp --sport ${PORT} -j CT --notrack
+${IPT} -N TS3_UDP_TRAFFIC
+${IPT} -A INPUT -p udp --dport ${PORT} ! -f -j TS3_UDP_TRAFFIC
+${IPT} -A TS3_UDP_TRAFFIC -p udp -m ts3init_get_cookie --min-client 1459504131 -j TS3INIT_SET_COOKIE --seed-id 1
+${IPT} -A TS3_UDP_TRAFFIC -p udp -m ts3init_get_puzzle --check-cookie --seed-id 1 -j TS3INIT_GET_COOKIE
+${IPT} -A TS3_UDP_TRAFFIC -j DROP
+
+ip netns exec ${GEN} "${DIR}/ts3init_flood" -p ${PORT} -d ${DURATION} -r ${RATE} \
+  -s ${SPOOF_NET} -S "${SEED_FILE}" "$@" ${DUT_ADDR}
+
+echo
+echo "rule counters:"
+${IPT} -L TS3_UDP_TRAFFIC -n -v -x
+echo
+echo "packets received and replies sent by the ruleset namespace:"
+ip -n ${DUT} -s link show veth_dut
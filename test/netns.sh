@@ -0,0 +1,38 @@
+#Functions shared by the load tests: a generator namespace and a namespace
+#with the rules under test (DUT), joined by a veth pair. Replies to the
+#spoofed sources are routed back to the generator side, which drops them.
+#Source this file; it expects to run as root.
+
+GEN=ts3flood_gen
+DUT=ts3flood_dut
+GEN_ADDR=10.199.0.1
+DUT_ADDR=10.199.0.2
+SPOOF_NET=198.18.0.0/15
+
+netns_delete()
+{
+  ip netns del ${GEN} 2>/dev/null
+  ip netns del ${DUT} 2>/dev/null
+}
+
+netns_create()
+{
+  netns_delete
+  ip netns add ${GEN} || return 1
+  ip netns add ${DUT} || return 1
+  ip link add veth_gen netns ${GEN} type veth peer name veth_dut netns ${DUT} || return 1
+  ip -n ${GEN} addr add ${GEN_ADDR}/24 dev veth_gen
+  ip -n ${DUT} addr add ${DUT_ADDR}/24 dev veth_dut
+  ip -n ${GEN} link set veth_gen up
+  ip -n ${DUT} link set veth_dut up
+  ip -n ${GEN} link set lo up
+  ip -n ${DUT} link set lo up
+  ip -n ${DUT} route add ${SPOOF_NET} via ${GEN_ADDR}
+  ip netns exec ${DUT} sysctl -qw net.ipv4.conf.all.rp_filter=0 net.ipv4.conf.veth_dut.rp_filter=0
+}
+
+#prints a counter of the DUT side of the veth pair, e.g. rx_packets
+dut_counter()
+{
+  ip netns exec ${DUT} cat /sys/class/net/veth_dut/statistics/$1
+}
@@ -0,0 +1,41 @@
+#!/bin/bash
+
+#Runs xt_ts3init_selftest, which builds TS3INIT packets in the kernel and
+#feeds them to the matches and targets of xt_ts3init on 1, 2, 4, ... cpus,
+#and prints the packets per second of every cpu and how they scale.
+#The self test runs in a network namespace in which the replies to the
+#clients (198.18.0.0/15) go to a dummy device.
+#Usage: selftest.sh [duration_ms] [max_cpus]
+
+DURATION_MS=${1:-1000}
+MAX_CPUS=${2:-0}
+
+NS=ts3init_selftest
+DIR=$(cd "$(dirname "$0")" && pwd)
+SRC=$(cd "${DIR}/../src" && pwd)
+MODULE=${SRC}/xt_ts3init_selftest.ko
+
+. "${DIR}/netns.sh"
+trap 'ip netns del ${NS} 2>/dev/null' EXIT
+
+if [ ! -f "${MODULE}" ]
+then
+  make -C "${SRC}" TS3INIT_SELFTEST=1 || exit -1
+fi
+modprobe xt_ts3init || insmod "${SRC}/xt_ts3init.ko" || { echo "could not load xt_ts3init"; exit -1; }
+
+ip netns del ${NS} 2>/dev/null
+ip netns add ${NS} || exit -1
+ip -n ${NS} link set lo up
+ip -n ${NS} link add ts3init_st type dummy || exit -1
+ip -n ${NS} link set ts3init_st up
+ip -n ${NS} addr add ${DUT_ADDR}/24 dev ts3init_st
+ip -n ${NS} route add ${SPOOF_NET} dev ts3init_st
+
+LINES=$(dmesg | wc -l)
+rmmod xt_ts3init_selftest 2>/dev/null
+ip netns exec ${NS} insmod "${MODULE}" duration_ms=${DURATION_MS} max_cpus=${MAX_CPUS}
+RESULT=$?
+rmmod xt_ts3init_selftest 2>/dev/null
+dmesg | tail -n +$(( LINES + 1 )) | grep xt_ts3init_selftest
+exit ${RESULT}
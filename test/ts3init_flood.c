@@ -0,0 +1,548 @@
+/*
+ *    Generates a flood of TS3INIT client packets with spoofed source
+ *    addresses, to measure how many packets the ts3init module can drop
+ *    or answer. Meant to be run against another network namespace, see
+ *    flood-netns.sh.
+ *
+ *    This program is free software; you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License; either version 2
+ *    or 3 of the License, as published by the Free Software Foundation.
+ */
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <linux/types.h>
+#include "../src/siphash24.h"
+#include "../src/ts3init_header.h"
+
+enum
+{
+    RANDOM_SEED_LEN = 60,
+    CLIENT_VERSION_OFFSET = 1356998400,
+    DEFAULT_CLIENT_VERSION = 1459504131,
+    MAX_BATCH = 256,
+    MAX_PACKET_SIZE = 64,
+    GET_COOKIE_PAYLOAD_SIZE = 16,
+    GET_PUZZLE_PAYLOAD_SIZE = 20
+};
+
+/*
+ * The kinds of packets that can be generated.
+ */
+enum
+{
+    FLOOD_GET_COOKIE,       /* valid COMMAND_GET_COOKIE */
+    FLOOD_GET_PUZZLE,       /* COMMAND_GET_PUZZLE with a valid cookie, needs the seed */
+    FLOOD_BAD_COOKIE,       /* COMMAND_GET_PUZZLE with a random cookie */
+    FLOOD_BAD_VERSION,      /* COMMAND_GET_COOKIE from a client that is too old */
+    FLOOD_BAD_TAG,          /* COMMAND_GET_COOKIE with a wrong magic number */
+    FLOOD_MAX
+};
+
+static const char *flood_names[FLOOD_MAX] =
+{
+    [FLOOD_GET_COOKIE]  = "get_cookie",
+    [FLOOD_GET_PUZZLE]  = "get_puzzle",
+    [FLOOD_BAD_COOKIE]  = "bad_cookie",
+    [FLOOD_BAD_VERSION] = "bad_version",
+    [FLOOD_BAD_TAG]     = "bad_tag",
+};
+
+static unsigned int weights[FLOOD_MAX];
+static unsigned int total_weight;
+static __u8 random_seed[RANDOM_SEED_LEN];
+static bool have_seed;
+static __u32 source_net, source_mask;
+static struct sockaddr_in target;
+static __u32 client_version = DEFAULT_CLIENT_VERSION;
+static volatile sig_atomic_t stop;
+
+/*
+ * SHA-512 as in FIPS 180-4, only used to derive the cookie seeds the
+ * module derives from the random seed.
+ */
+static const uint64_t sha512_k[80] =
+{
+    0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+    0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+    0xd807aa98a3030242ULL, 0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+    0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+    0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+    0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+    0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+    0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL, 0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+    0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+    0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+    0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+    0xd192e819d6ef5218ULL, 0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+    0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+    0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+    0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+    0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+    0xca273eceea26619cULL, 0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+    0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+    0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+    0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL,
+};
+
+static inline uint64_t ror64(uint64_t x, int n)
+{
+    return (x >> n) | (x << (64 - n));
+}
+
+static void sha512_block(uint64_t state[8], const uint8_t *block)
+{
+    uint64_t w[80], a, b, c, d, e, f, g, h;
+    int i, j;
+
+    for (i = 0; i < 16; ++i)
+    {
+        w[i] = 0;
+        for (j = 0; j < 8; ++j)
+            w[i] = (w[i] << 8) | block[i * 8 + j];
+    }
+    for (i = 16; i < 80; ++i)
+    {
+        uint64_t s0 = ror64(w[i - 15], 1) ^ ror64(w[i - 15], 8) ^ (w[i - 15] >> 7);
+        uint64_t s1 = ror64(w[i - 2], 19) ^ ror64(w[i - 2], 61) ^ (w[i - 2] >> 6);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    a = state[0]; b = state[1]; c = state[2]; d = state[3];
+    e = state[4]; f = state[5]; g = state[6]; h = state[7];
+    for (i = 0; i < 80; ++i)
+    {
+        uint64_t t1 = h + (ror64(e, 14) ^ ror64(e, 18) ^ ror64(e, 41)) +
+                      ((e & f) ^ (~e & g)) + sha512_k[i] + w[i];
+        uint64_t t2 = (ror64(a, 28) ^ ror64(a, 34) ^ ror64(a, 39)) +
+                      ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+/*
+ * Hashes a message of less than 112 bytes, which is all that is needed here.
+ */
+static void sha512_short(const uint8_t *data, size_t len, uint8_t out[64])
+{
+    uint64_t state[8] =
+    {
+        0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+        0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL,
+    };
+    uint8_t block[128] = { 0 };
+    int i;
+
+    memcpy(block, data, len);
+    block[len] = 0x80;
+    for (i = 0; i < 8; ++i)
+        block[127 - i] = (uint8_t)(((uint64_t)len * 8) >> (i * 8));
+    sha512_block(state, block);
+
+    for (i = 0; i < 64; ++i)
+        out[i] = (uint8_t)(state[i / 8] >> (56 - (i % 8) * 8));
+}
+
+/*
+ * Returns the siphash key the module uses for packet_index at time now,
+ * see cookie.md.
+ */
+static void cookie_key(time_t now, uint8_t packet_index, uint64_t key[2])
+{
+    static time_t cached_window = -1;
+    static uint8_t cookie_seed[64];
+    time_t window = now & ~((time_t)3);
+    int i;
+
+    if (window != cached_window)
+    {
+        uint8_t text[RANDOM_SEED_LEN + 4];
+
+        memcpy(text, random_seed, RANDOM_SEED_LEN);
+        for (i = 0; i < 4; ++i)
+            text[RANDOM_SEED_LEN + i] = (uint8_t)((uint32_t)window >> (i * 8));
+        sha512_short(text, sizeof(text), cookie_seed);
+        cached_window = window;
+    }
+
+    for (i = 0; i < 2; ++i)
+        memcpy(&key[i], cookie_seed + (packet_index % 4) * 16 + i * 8, 8);
+}
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static inline uint64_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static int pick_kind(void)
+{
+    unsigned int r = rng() % total_weight;
+    int kind;
+
+    for (kind = 0; kind < FLOOD_MAX; ++kind)
+    {
+        if (r < weights[kind])
+            return kind;
+        r -= weights[kind];
+    }
+    return FLOOD_GET_COOKIE;
+}
+
+/*
+ * Builds one packet of the given kind into buf and returns its length.
+ */
+static size_t build_packet(int kind, time_t now, uint8_t *buf)
+{
+    struct iphdr *ip = (struct iphdr *)buf;
+    struct udphdr *udp = (struct udphdr *)(ip + 1);
+    struct ts3_init_client_header *header = (struct ts3_init_client_header *)(udp + 1);
+    uint8_t *payload = (uint8_t *)header + TS3INIT_HEADER_CLIENT_LENGTH;
+    size_t payload_size;
+    __u32 version = client_version - CLIENT_VERSION_OFFSET;
+    uint64_t r = rng();
+
+    memset(buf, 0, MAX_PACKET_SIZE);
+
+    /* the kernel fills in the total length, id and checksum */
+    ip->version = 4;
+    ip->ihl = 5;
+    ip->ttl = 64;
+    ip->protocol = IPPROTO_UDP;
+    ip->saddr = htonl(source_net | ((__u32)r & ~source_mask));
+    ip->daddr = target.sin_addr.s_addr;
+    udp->source = htons(1024 + (uint16_t)(r >> 32) % (65536 - 1024));
+    udp->dest = target.sin_port;
+
+    memcpy(header->tag.tag8, kind == FLOOD_BAD_TAG ? "TS3INIT2" : "TS3INIT1", 8);
+    header->packet_id = htons(101);
+    header->flags = 0x88;
+    if (kind == FLOOD_BAD_VERSION)
+        version = 0;
+    header->client_version[0] = version >> 24;
+    header->client_version[1] = version >> 16;
+    header->client_version[2] = version >> 8;
+    header->client_version[3] = version;
+
+    if (kind == FLOOD_GET_PUZZLE || kind == FLOOD_BAD_COOKIE)
+    {
+        uint64_t cookie = rng();
+        uint8_t packet_index = now % 8;
+
+        header->command = COMMAND_GET_PUZZLE;
+        if (kind == FLOOD_GET_PUZZLE)
+        {
+            struct ts3init_siphash_state state;
+            uint64_t key[2];
+
+            cookie_key(now, packet_index, key);
+            ts3init_siphash_setup(&state, key[0], key[1]);
+            ts3init_siphash_update(&state, (uint8_t *)&ip->saddr, 8);
+            ts3init_siphash_update(&state, (uint8_t *)&udp->source, 4);
+            cookie = ts3init_siphash_finalize(&state);
+        }
+        memcpy(payload, &cookie, 8);
+        payload[8] = packet_index;
+        memcpy(payload + 16, &r, 4);
+        payload_size = GET_PUZZLE_PAYLOAD_SIZE;
+    }
+    else
+    {
+        header->command = COMMAND_GET_COOKIE;
+        payload[0] = (uint32_t)now >> 24;
+        payload[1] = (uint32_t)now >> 16;
+        payload[2] = (uint32_t)now >> 8;
+        payload[3] = (uint32_t)now;
+        memcpy(payload + 4, &r, 4);
+        payload_size = GET_COOKIE_PAYLOAD_SIZE;
+    }
+
+    udp->len = htons(sizeof(*udp) + TS3INIT_HEADER_CLIENT_LENGTH + payload_size);
+    return sizeof(*ip) + ntohs(udp->len);
+}
+
+static bool read_seed(const char *path)
+{
+    char text[RANDOM_SEED_LEN * 2];
+    int fd, i;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || read(fd, text, sizeof(text)) != sizeof(text))
+    {
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    close(fd);
+    for (i = 0; i < RANDOM_SEED_LEN; ++i)
+    {
+        unsigned int v;
+        char byte[3] = { text[2 * i], text[2 * i + 1], 0 };
+
+        if (sscanf(byte, "%2x", &v) != 1)
+            return false;
+        random_seed[i] = v;
+    }
+    return true;
+}
+
+static bool parse_weight(const char *arg)
+{
+    const char *colon = strchr(arg, ':');
+    size_t len = colon ? (size_t)(colon - arg) : strlen(arg);
+    int kind;
+
+    for (kind = 0; kind < FLOOD_MAX; ++kind)
+    {
+        if (strlen(flood_names[kind]) == len && strncmp(flood_names[kind], arg, len) == 0)
+        {
+            weights[kind] = colon ? strtoul(colon + 1, NULL, 0) : 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_source(const char *arg)
+{
+    char addr[INET_ADDRSTRLEN];
+    const char *slash = strchr(arg, '/');
+    struct in_addr in;
+    unsigned long len = 32;
+
+    if (slash)
+    {
+        len = strtoul(slash + 1, NULL, 10);
+        if (len > 32 || (size_t)(slash - arg) >= sizeof(addr))
+            return false;
+        memcpy(addr, arg, slash - arg);
+        addr[slash - arg] = '\0';
+    }
+    else
+        snprintf(addr, sizeof(addr), "%s", arg);
+    if (inet_pton(AF_INET, addr, &in) != 1)
+        return false;
+    source_mask = len ? ~0U << (32 - len) : 0;
+    source_net = ntohl(in.s_addr) & source_mask;
+    return true;
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void handle_signal(int signal)
+{
+    stop = 1;
+}
+
+static void usage(const char *name)
+{
+    int kind;
+
+    fprintf(stderr,
+        "Usage: %s [options] host\n"
+        "  -p, --port n            target udp port (default 9987)\n"
+        "  -r, --rate pps          packets per second, 0 for as fast as possible (default 0)\n"
+        "  -d, --duration s        seconds to run (default 10)\n"
+        "  -b, --batch n           packets per sendmmsg call (default 32, at most %d)\n"
+        "  -s, --source net/len    spoofed source addresses (default 198.18.0.0/15)\n"
+        "  -k, --kind kind[:w]     packet kind with weight w, may be repeated (default get_cookie)\n"
+        "  -S, --seed-file file    random seed of the rules, needed for get_puzzle\n"
+        "  -v, --version n         client version (default %d)\n"
+        "kinds:",
+        name, MAX_BATCH, DEFAULT_CLIENT_VERSION);
+    for (kind = 0; kind < FLOOD_MAX; ++kind)
+        fprintf(stderr, " %s", flood_names[kind]);
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {.name = "port",      .has_arg = true, .val = 'p'},
+        {.name = "rate",      .has_arg = true, .val = 'r'},
+        {.name = "duration",  .has_arg = true, .val = 'd'},
+        {.name = "batch",     .has_arg = true, .val = 'b'},
+        {.name = "source",    .has_arg = true, .val = 's'},
+        {.name = "kind",      .has_arg = true, .val = 'k'},
+        {.name = "seed-file", .has_arg = true, .val = 'S'},
+        {.name = "version",   .has_arg = true, .val = 'v'},
+        {NULL},
+    };
+    static uint8_t packets[MAX_BATCH][MAX_PACKET_SIZE];
+    struct mmsghdr msgs[MAX_BATCH];
+    struct iovec iovs[MAX_BATCH];
+    unsigned long rate = 0, duration = 10, batch = 32, port = 9987;
+    unsigned long long sent = 0, errors = 0, kinds[FLOOD_MAX] = { 0 };
+    unsigned long long last_sent = 0;
+    double start, last_report;
+    int sock, c, i, one = 1;
+
+    parse_source("198.18.0.0/15");
+    while ((c = getopt_long(argc, argv, "p:r:d:b:s:k:S:v:", options, NULL)) != -1)
+    {
+        switch (c)
+        {
+        case 'p': port = strtoul(optarg, NULL, 0); break;
+        case 'r': rate = strtoul(optarg, NULL, 0); break;
+        case 'd': duration = strtoul(optarg, NULL, 0); break;
+        case 'b': batch = strtoul(optarg, NULL, 0); break;
+        case 'v': client_version = strtoul(optarg, NULL, 0); break;
+        case 's':
+            if (!parse_source(optarg))
+            {
+                fprintf(stderr, "invalid source network %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'k':
+            if (!parse_weight(optarg))
+            {
+                fprintf(stderr, "invalid kind %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'S':
+            if (!read_seed(optarg))
+            {
+                fprintf(stderr, "%s must start with %d hex characters\n", optarg, RANDOM_SEED_LEN * 2);
+                return EXIT_FAILURE;
+            }
+            have_seed = true;
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind + 1 != argc || port == 0 || port > 65535 || batch == 0 || batch > MAX_BATCH)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    target.sin_family = AF_INET;
+    target.sin_port = htons(port);
+    if (inet_pton(AF_INET, argv[optind], &target.sin_addr) != 1)
+    {
+        fprintf(stderr, "invalid ipv4 address %s\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    for (i = 0; i < FLOOD_MAX; ++i)
+        total_weight += weights[i];
+    if (total_weight == 0)
+        weights[FLOOD_GET_COOKIE] = total_weight = 1;
+    if (weights[FLOOD_GET_PUZZLE] && !have_seed)
+    {
+        fprintf(stderr, "get_puzzle needs --seed-file\n");
+        return EXIT_FAILURE;
+    }
+    rng_state ^= (uint64_t)time(NULL) << 20 ^ getpid();
+
+    sock = socket(AF_INET, SOCK_RAW, IPPROTO_RAW);
+    if (sock < 0 || setsockopt(sock, IPPROTO_IP, IP_HDRINCL, &one, sizeof(one)) < 0)
+    {
+        perror("raw socket");
+        return EXIT_FAILURE;
+    }
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < MAX_BATCH; ++i)
+    {
+        iovs[i].iov_base = packets[i];
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &target;
+        msgs[i].msg_hdr.msg_namelen = sizeof(target);
+    }
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    start = last_report = now_seconds();
+    while (!stop)
+    {
+        double now = now_seconds();
+        time_t unix_now = time(NULL);
+        unsigned long n = batch;
+        int result;
+
+        if (now - start >= duration)
+            break;
+        if (rate)
+        {
+            double due = (sent + errors + batch) / (double)rate;
+            if (now - start < due)
+            {
+                struct timespec wait = { 0, (long)((due - (now - start)) * 1e9) };
+                if (wait.tv_nsec > 1000000)
+                    wait.tv_nsec = 1000000;
+                nanosleep(&wait, NULL);
+                continue;
+            }
+        }
+
+        for (i = 0; i < (int)n; ++i)
+        {
+            int kind = pick_kind();
+            iovs[i].iov_len = build_packet(kind, unix_now, packets[i]);
+            ++kinds[kind];
+        }
+
+        result = sendmmsg(sock, msgs, n, 0);
+        if (result < 0)
+        {
+            if (errno != ENOBUFS && errno != EAGAIN && errno != EINTR)
+            {
+                perror("sendmmsg");
+                break;
+            }
+            result = 0;
+        }
+        sent += result;
+        errors += n - result;
+
+        if (now - last_report >= 1)
+        {
+            fprintf(stderr, "%.0f pps\n", (sent - last_sent) / (now - last_report));
+            last_sent = sent;
+            last_report = now;
+        }
+    }
+
+    printf("sent %llu packets in %.2f s (%.0f pps), %llu not sent\n",
+           sent, now_seconds() - start, sent / (now_seconds() - start), errors);
+    for (i = 0; i < FLOOD_MAX; ++i)
+    {
+        if (weights[i])
+            printf("  %s: %llu\n", flood_names[i], kinds[i]);
+    }
+    close(sock);
+    return EXIT_SUCCESS;
+}
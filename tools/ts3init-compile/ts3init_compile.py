@@ -0,0 +1,210 @@
+#!/usr/bin/env python3
+"""
+Compiles a declarative description of one or more TeamSpeak 3 servers into
+an ipset and iptables ruleset that uses the ts3init extensions.
+
+The layout is the one of examples/complex and examples/complex-forward, but
+built so that each packet does as little work as possible:
+* all ports share one jump from INPUT/FORWARD (multiport), so the base chain
+  grows by one rule, not one per port, and every match on protocol, port and
+  fragments is done once.
+* known clients are accepted by the first rules, with one set lookup each,
+  before any ts3init match parses the packet.
+* the rate limit of new clients only counts clients whose cookie was
+  checked, so spoofed packets can not use up the limit of another address.
+* every rule uses the same seed, by id; push it first, e.g. with
+  'ts3initd --once --seed 1:file'.
+
+The output is meant for 'ipset restore' and 'iptables-restore --noflush'
+(or ip6tables-restore), e.g.:
+  ts3init_compile.py ts3.json --ipset | ipset restore
+  ts3init_compile.py ts3.json --family 4 | iptables-restore --noflush
+"""
+from argparse import ArgumentParser
+from json import load
+from sys import version_info, exit, stderr
+
+if version_info < (3,0):
+    print('python3 required.')
+    exit(1)
+
+# iptables multiport takes at most 15 ports
+MULTIPORT_MAX = 15
+
+DEFAULTS = {
+    'families': [4, 6],
+    'mode': 'local',
+    'filetransfer_ports': [],
+    'filetransfer_connlimit': 20,
+    'min_client': 1459504131,
+    'check_time': None,
+    'max_skew': None,
+    'authorizing_timeout': 8,
+    'authorized_timeout': 30,
+    'set_maxelem': 65536,
+    'new_client_rate': None,
+    'new_client_burst': 10,
+}
+
+class ConfigError(Exception):
+    pass
+
+def check_config(config):
+    unknown = set(config) - set(DEFAULTS) - {'ports', 'seed', 'client_interface', 'server_interface'}
+    if unknown:
+        raise ConfigError('unknown keys: ' + ', '.join(sorted(unknown)))
+    result = dict(DEFAULTS)
+    result.update(config)
+
+    for key in ('ports', 'seed'):
+        if key not in result:
+            raise ConfigError(key + ' is required')
+    for key in ('ports', 'filetransfer_ports'):
+        ports = result[key]
+        if not isinstance(ports, list) or any(not isinstance(p, int) or not 0 < p < 65536 for p in ports):
+            raise ConfigError(key + ' must be a list of ports')
+        result[key] = sorted(set(ports))
+    if not result['ports']:
+        raise ConfigError('ports must not be empty')
+    if not set(result['families']) <= {4, 6} or not result['families']:
+        raise ConfigError('families must be a list of 4 and/or 6')
+
+    seed = result['seed']
+    if not isinstance(seed, dict) or list(seed) != ['id'] or not isinstance(seed['id'], int) or \
+            not 0 <= seed['id'] < 2 ** 32:
+        # revision 1 rules only take seed ids, seed files are pushed by ts3initd
+        raise ConfigError('seed must be {"id": n}, push seed files with ts3initd --seed n:file')
+
+    if result['mode'] == 'forward':
+        for key in ('client_interface', 'server_interface'):
+            if key not in result:
+                raise ConfigError(key + ' is required in forward mode')
+    elif result['mode'] != 'local':
+        raise ConfigError('mode must be local or forward')
+    return result
+
+def port_groups(ports):
+    for i in range(0, len(ports), MULTIPORT_MAX):
+        yield ','.join(str(p) for p in ports[i:i + MULTIPORT_MAX])
+
+def seed_options(config):
+    return '--seed-id %d' % config['seed']['id']
+
+def set_names(family):
+    return {
+        'authorizing': 'ts3_authorizing%d' % family,
+        'authorized': 'ts3_authorized%d' % family,
+        'authorized_ft': 'ts3_authorized_ft%d' % family,
+    }
+
+def compile_ipset(config):
+    lines = []
+    for family in config['families']:
+        sets = set_names(family)
+        options = 'family %s maxelem %d' % ('inet' if family == 4 else 'inet6', config['set_maxelem'])
+        lines.append('create %s hash:ip,port %s timeout %d -exist' %
+                     (sets['authorizing'], options, config['authorizing_timeout']))
+        lines.append('create %s hash:ip,port %s timeout %d -exist' %
+                     (sets['authorized'], options, config['authorized_timeout']))
+        if config['filetransfer_ports']:
+            lines.append('create %s hash:ip %s timeout %d -exist' %
+                         (sets['authorized_ft'], options, config['authorized_timeout']))
+    return lines
+
+def compile_iptables(config, family):
+    sets = set_names(family)
+    seed = seed_options(config)
+    forward = config['mode'] == 'forward'
+    fragment = ' ! -f' if family == 4 else ''
+    client_in = ' -i ' + config['client_interface'] if forward else ''
+    server_in = ' -i ' + config['server_interface'] if forward else ''
+    in_chain = 'FORWARD' if forward else 'INPUT'
+    out_chain = 'FORWARD' if forward else 'OUTPUT'
+    out_raw = 'PREROUTING' if forward else 'OUTPUT'
+
+    raw = ['*raw']
+    for ports in port_groups(config['ports']):
+        raw.append('-A PREROUTING%s -p udp -m multiport --dports %s -j CT --notrack' % (client_in, ports))
+        raw.append('-A %s%s -p udp -m multiport --sports %s -j CT --notrack' % (out_raw, server_in, ports))
+    raw.append('COMMIT')
+
+    chains = ['TS3_IN', 'TS3_NEW', 'TS3_OUT', 'TS3_OUT_AUTHORIZED']
+    if config['filetransfer_ports']:
+        chains.append('TS3_FT')
+    rules = []
+
+    for ports in port_groups(config['ports']):
+        rules.append('-A %s%s -p udp -m multiport --dports %s%s -j TS3_IN' % (in_chain, client_in, ports, fragment))
+    for ports in port_groups(config['filetransfer_ports']):
+        rules.append('-A %s%s -p tcp -m multiport --dports %s -j TS3_FT' % (in_chain, client_in, ports))
+    for ports in port_groups(config['ports']):
+        rules.append('-A %s%s -p udp -m multiport --sports %s%s -j TS3_OUT' % (out_chain, server_in, ports, fragment))
+
+    # client -> server: known clients first, then the matches that parse and
+    # hash the packet
+    rules.append('-A TS3_IN -m set --match-set %s src,src -j ACCEPT' % sets['authorized'])
+    rules.append('-A TS3_IN -m set --match-set %s src,src -j ACCEPT' % sets['authorizing'])
+    get_cookie = '-m ts3init_get_cookie --min-client %d' % config['min_client']
+    if config['check_time'] is not None:
+        get_cookie += ' --check-time %d' % config['check_time']
+    rules.append('-A TS3_IN %s -j TS3INIT_SET_COOKIE %s' % (get_cookie, seed))
+    get_puzzle = '-m ts3init_get_puzzle --check-cookie ' + seed
+    if config['max_skew'] is not None:
+        get_puzzle += ' --max-skew %d' % config['max_skew']
+    rules.append('-A TS3_IN %s -j TS3_NEW' % get_puzzle)
+    rules.append('-A TS3_IN -j DROP')
+
+    # after the cookie check, so spoofed packets do not count against the
+    # address they claim
+    if config['new_client_rate']:
+        rules.append('-A TS3_NEW -m hashlimit --hashlimit-above %s --hashlimit-burst %d '
+                     '--hashlimit-mode srcip --hashlimit-name ts3_new%d -j DROP' %
+                     (config['new_client_rate'], config['new_client_burst'], family))
+    rules.append('-A TS3_NEW -j SET --add-set %s src,src' % sets['authorizing'])
+    rules.append('-A TS3_NEW -j TS3INIT_GET_COOKIE')
+
+    if config['filetransfer_ports']:
+        rules.append('-A TS3_FT -m set ! --match-set %s src -j DROP' % sets['authorized_ft'])
+        rules.append('-A TS3_FT -p tcp --syn -m connlimit --connlimit-above %d -j REJECT --reject-with tcp-reset' %
+                     config['filetransfer_connlimit'])
+        rules.append('-A TS3_FT -j ACCEPT')
+
+    # server -> client: every set is looked up at most once per packet
+    rules.append('-A TS3_OUT -m set --match-set %s dst,dst -j TS3_OUT_AUTHORIZED' % sets['authorized'])
+    # replies of TS3INIT_SET_COOKIE and others to unknown clients
+    rules.append('-A TS3_OUT -m set ! --match-set %s dst,dst -j ACCEPT' % sets['authorizing'])
+    rules.append('-A TS3_OUT -p udp -m ts3init --server -j ACCEPT')
+    # the server accepted the puzzle; the connection may still be refused
+    # later, e.g. because of a wrong password
+    rules.append('-A TS3_OUT -j SET --del-set %s dst,dst' % sets['authorizing'])
+    rules.append('-A TS3_OUT -j TS3_OUT_AUTHORIZED')
+
+    rules.append('-A TS3_OUT_AUTHORIZED -j SET --add-set %s dst,dst --exist' % sets['authorized'])
+    if config['filetransfer_ports']:
+        rules.append('-A TS3_OUT_AUTHORIZED -j SET --add-set %s dst --exist' % sets['authorized_ft'])
+    rules.append('-A TS3_OUT_AUTHORIZED -j ACCEPT')
+
+    return raw + ['*filter'] + [':%s - [0:0]' % c for c in chains] + rules + ['COMMIT']
+
+def main():
+    parser = ArgumentParser(description='Compiles a ts3init ruleset from a declarative config.')
+    parser.add_argument('config', help='json config file')
+    group = parser.add_mutually_exclusive_group(required=True)
+    group.add_argument('--family', type=int, choices=[4, 6], help='write the iptables-restore input for this family')
+    group.add_argument('--ipset', action='store_const', const=True, default=False, help='write the ipset restore input')
+    args = parser.parse_args()
+
+    try:
+        with open(args.config) as f:
+            config = check_config(load(f))
+        if args.family is not None and args.family not in config['families']:
+            raise ConfigError('family %d is not configured' % args.family)
+    except (OSError, ValueError, ConfigError) as e:
+        print('%s: %s' % (args.config, e), file=stderr)
+        exit(1)
+
+    lines = compile_ipset(config) if args.ipset else compile_iptables(config, args.family)
+    print('\n'.join(lines))
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,845 @@
+/*
+ *    "ts3init" extension for Xtables
+ *
+ *    Description: A daemon that keeps the runtime seeds of the module up to
+ *                 date, rotates them, and exports the module counters in
+ *                 the Prometheus text format.
+ *
+ *    This program is free software; you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License; either version 2
+ *    or 3 of the License, as published by the Free Software Foundation.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <syslog.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <linux/types.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include "../../src/ts3init_netlink.h"
+
+enum
+{
+    RANDOM_SEED_LEN = 60,
+    MAX_SEEDS = 64,
+    NL_BUFFER_SIZE = 32768,
+    /* seconds between retries of seeds that could not be pushed */
+    RETRY_INTERVAL = 5,
+    DEFAULT_METRICS_INTERVAL = 15
+};
+
+struct ts3initd_seed
+{
+    __u32 id;
+    char path[PATH_MAX];
+    /* the directory of path is watched, as seed files are replaced by rename */
+    const char *name;
+    int wd;
+    bool loaded;
+    bool pushed;
+    __u8 seed[RANDOM_SEED_LEN];
+};
+
+struct ts3initd_nl
+{
+    int fd;
+    __u32 seq;
+    __u16 family;
+};
+
+static struct ts3initd_seed seeds[MAX_SEEDS];
+static int seed_count;
+static unsigned int rotate_interval;
+static const char *metrics_path;
+static unsigned int metrics_interval = DEFAULT_METRICS_INTERVAL;
+static bool foreground;
+static bool once;
+
+static __u64 seed_pushes, seed_push_errors, seed_rotations;
+
+static volatile sig_atomic_t stop, repush;
+
+static void log_msg(int priority, const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    if (foreground)
+    {
+        vfprintf(stderr, format, args);
+        fputc('\n', stderr);
+    }
+    else
+        vsyslog(priority, format, args);
+    va_end(args);
+}
+
+static time_t monotonic_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+/*
+ * Generic netlink
+ */
+
+static int nl_open(struct ts3initd_nl *nl)
+{
+    struct sockaddr_nl addr = { .nl_family = AF_NETLINK };
+    struct timeval timeout = { .tv_sec = 2 };
+
+    nl->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC);
+    if (nl->fd < 0)
+        return -errno;
+    if (bind(nl->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        setsockopt(nl->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0)
+    {
+        int error = -errno;
+        close(nl->fd);
+        return error;
+    }
+    nl->seq = time(NULL);
+    nl->family = 0;
+    return 0;
+}
+
+static struct nlmsghdr *genl_msg_init(void *buf, __u16 type, __u16 flags, __u8 cmd, __u8 version)
+{
+    struct nlmsghdr *nlh = buf;
+    struct genlmsghdr *genl;
+
+    memset(nlh, 0, NLMSG_LENGTH(GENL_HDRLEN));
+    nlh->nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+    nlh->nlmsg_type = type;
+    nlh->nlmsg_flags = NLM_F_REQUEST | flags;
+    genl = NLMSG_DATA(nlh);
+    genl->cmd = cmd;
+    genl->version = version;
+    return nlh;
+}
+
+static void nl_put(struct nlmsghdr *nlh, __u16 type, const void *data, size_t len)
+{
+    struct nlattr *nla = (struct nlattr *)((char *)nlh + NLMSG_ALIGN(nlh->nlmsg_len));
+
+    nla->nla_type = type;
+    nla->nla_len = NLA_HDRLEN + len;
+    memcpy((char *)nla + NLA_HDRLEN, data, len);
+    nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + NLA_ALIGN(nla->nla_len);
+}
+
+static inline bool nla_ok(const struct nlattr *nla, int remaining)
+{
+    return remaining >= (int)NLA_HDRLEN && nla->nla_len >= NLA_HDRLEN &&
+           nla->nla_len <= remaining;
+}
+
+static inline const struct nlattr *nla_next(const struct nlattr *nla, int *remaining)
+{
+    *remaining -= NLA_ALIGN(nla->nla_len);
+    return (const struct nlattr *)((const char *)nla + NLA_ALIGN(nla->nla_len));
+}
+
+#define nla_for_each(nla, head, len, rem) \
+    for (nla = (head), rem = (len); nla_ok(nla, rem); nla = nla_next(nla, &rem))
+
+#define genl_attrs(nlh) \
+    ((const struct nlattr *)((const char *)NLMSG_DATA(nlh) + GENL_HDRLEN))
+#define genl_attrs_len(nlh) \
+    ((int)(nlh)->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN))
+
+/*
+ * Sends nlh and passes every reply to cb, if given.
+ * Returns 0 on success or a negative errno.
+ */
+static int nl_talk(struct ts3initd_nl *nl, struct nlmsghdr *nlh,
+                   int (*cb)(const struct nlmsghdr *, void *), void *arg)
+{
+    static char buf[NL_BUFFER_SIZE] __attribute__((aligned(NLMSG_ALIGNTO)));
+    struct sockaddr_nl kernel = { .nl_family = AF_NETLINK };
+    bool dump = nlh->nlmsg_flags & NLM_F_DUMP;
+
+    if (!dump)
+        nlh->nlmsg_flags |= NLM_F_ACK;
+    nlh->nlmsg_seq = ++nl->seq;
+    if (sendto(nl->fd, nlh, nlh->nlmsg_len, 0, (struct sockaddr *)&kernel, sizeof(kernel)) < 0)
+        return -errno;
+
+    for (;;)
+    {
+        const struct nlmsghdr *reply;
+        ssize_t len = recv(nl->fd, buf, sizeof(buf), 0);
+        int remaining;
+
+        if (len < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+
+        remaining = len;
+        for (reply = (struct nlmsghdr *)buf; NLMSG_OK(reply, remaining);
+             reply = NLMSG_NEXT(reply, remaining))
+        {
+            if (reply->nlmsg_seq != nl->seq)
+                continue;
+            if (reply->nlmsg_type == NLMSG_ERROR)
+            {
+                const struct nlmsgerr *err = NLMSG_DATA(reply);
+                return err->error;
+            }
+            if (reply->nlmsg_type == NLMSG_DONE)
+                return 0;
+            if (cb)
+            {
+                int error = cb(reply, arg);
+                if (error)
+                    return error;
+            }
+        }
+    }
+}
+
+static int nl_family_cb(const struct nlmsghdr *nlh, void *arg)
+{
+    const struct nlattr *nla;
+    int rem;
+
+    nla_for_each(nla, genl_attrs(nlh), genl_attrs_len(nlh), rem)
+    {
+        if ((nla->nla_type & NLA_TYPE_MASK) == CTRL_ATTR_FAMILY_ID)
+            memcpy(arg, (const char *)nla + NLA_HDRLEN, sizeof(__u16));
+    }
+    return 0;
+}
+
+/*
+ * Looks up the id of the ts3init family, once per module load.
+ */
+static int nl_resolve(struct ts3initd_nl *nl)
+{
+    char buf[256] __attribute__((aligned(NLMSG_ALIGNTO)));
+    struct nlmsghdr *nlh;
+    __u16 family = 0;
+    int error;
+
+    if (nl->family)
+        return 0;
+
+    nlh = genl_msg_init(buf, GENL_ID_CTRL, 0, CTRL_CMD_GETFAMILY, 1);
+    nl_put(nlh, CTRL_ATTR_FAMILY_NAME, TS3INIT_GENL_NAME, sizeof(TS3INIT_GENL_NAME));
+    error = nl_talk(nl, nlh, nl_family_cb, &family);
+    if (error == 0 && family == 0)
+        error = -ENOENT;
+    if (error == 0)
+        nl->family = family;
+    return error;
+}
+
+/*
+ * Seeds
+ */
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/*
+ * Reads a seed file as written by 'xxd -l 60 -c 60 -p /dev/urandom':
+ * 120 hex characters, optionally followed by whitespace.
+ */
+static int read_seed_file(const char *path, __u8 *seed)
+{
+    char text[RANDOM_SEED_LEN * 2 + 8];
+    ssize_t n;
+    int fd, i;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -errno;
+    n = read(fd, text, sizeof(text));
+    close(fd);
+    if (n < 0)
+        return -errno;
+    if (n < RANDOM_SEED_LEN * 2)
+        return -EINVAL;
+    for (i = RANDOM_SEED_LEN * 2; i < n; ++i)
+    {
+        if (text[i] != '\n' && text[i] != '\r' && text[i] != ' ' && text[i] != '\t')
+            return -EINVAL;
+    }
+    for (i = 0; i < RANDOM_SEED_LEN; ++i)
+    {
+        int high = hex_value(text[2 * i]), low = hex_value(text[2 * i + 1]);
+        if (high < 0 || low < 0)
+            return -EINVAL;
+        seed[i] = (high << 4) | low;
+    }
+    return 0;
+}
+
+/*
+ * Writes a seed file next to path and renames it into place, so readers
+ * never see a partial seed.
+ */
+static int write_seed_file(const char *path, const __u8 *seed)
+{
+    static const char digits[] = "0123456789abcdef";
+    char text[RANDOM_SEED_LEN * 2 + 1], tmp[PATH_MAX];
+    int fd, i, error = 0;
+
+    for (i = 0; i < RANDOM_SEED_LEN; ++i)
+    {
+        text[2 * i] = digits[seed[i] >> 4];
+        text[2 * i + 1] = digits[seed[i] & 0xf];
+    }
+    text[sizeof(text) - 1] = '\n';
+
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+        return -ENAMETOOLONG;
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0)
+        return -errno;
+    if (write(fd, text, sizeof(text)) != sizeof(text) || fsync(fd) < 0)
+        error = errno ? -errno : -EIO;
+    if (close(fd) < 0 && error == 0)
+        error = -errno;
+    if (error == 0 && rename(tmp, path) < 0)
+        error = -errno;
+    if (error)
+        unlink(tmp);
+    return error;
+}
+
+/*
+ * Replaces the seed in the module, or adds it if the module does not
+ * know it yet.
+ */
+static int push_seed(struct ts3initd_nl *nl, struct ts3initd_seed *s)
+{
+    char buf[256] __attribute__((aligned(NLMSG_ALIGNTO)));
+    struct nlmsghdr *nlh;
+    int error;
+
+    error = nl_resolve(nl);
+    if (error == 0)
+    {
+        nlh = genl_msg_init(buf, nl->family, 0, TS3INIT_CMD_SEED_REPLACE, TS3INIT_GENL_VERSION);
+        nl_put(nlh, TS3INIT_ATTR_SEED_ID, &s->id, sizeof(s->id));
+        nl_put(nlh, TS3INIT_ATTR_SEED, s->seed, RANDOM_SEED_LEN);
+        error = nl_talk(nl, nlh, NULL, NULL);
+        if (error == -ENOENT)
+        {
+            nlh = genl_msg_init(buf, nl->family, 0, TS3INIT_CMD_SEED_ADD, TS3INIT_GENL_VERSION);
+            nl_put(nlh, TS3INIT_ATTR_SEED_ID, &s->id, sizeof(s->id));
+            nl_put(nlh, TS3INIT_ATTR_SEED, s->seed, RANDOM_SEED_LEN);
+            error = nl_talk(nl, nlh, NULL, NULL);
+        }
+    }
+
+    s->pushed = error == 0;
+    if (error)
+    {
+        /* the module may have been reloaded with another family id */
+        nl->family = 0;
+        ++seed_push_errors;
+        log_msg(LOG_WARNING, "could not push seed %u: %s", s->id, strerror(-error));
+    }
+    else
+        ++seed_pushes;
+    return error;
+}
+
+/*
+ * (Re)reads the seed file of s and pushes it if it changed.
+ */
+static void load_seed(struct ts3initd_nl *nl, struct ts3initd_seed *s)
+{
+    __u8 seed[RANDOM_SEED_LEN];
+    int error;
+
+    error = read_seed_file(s->path, seed);
+    if (error)
+    {
+        log_msg(LOG_WARNING, "could not read seed %u from %s: %s", s->id, s->path, strerror(-error));
+        return;
+    }
+    if (s->loaded && s->pushed && memcmp(seed, s->seed, RANDOM_SEED_LEN) == 0)
+        return;
+
+    memcpy(s->seed, seed, RANDOM_SEED_LEN);
+    s->loaded = true;
+    if (push_seed(nl, s) == 0)
+        log_msg(LOG_INFO, "pushed seed %u from %s", s->id, s->path);
+}
+
+/*
+ * Writes a new random seed to the seed file of s. The inotify watch then
+ * pushes it, here and on every host that shares the file.
+ */
+static void rotate_seed(struct ts3initd_seed *s)
+{
+    __u8 seed[RANDOM_SEED_LEN];
+    int error = 0;
+
+    if (getrandom(seed, sizeof(seed), 0) != sizeof(seed))
+        error = -errno;
+    if (error == 0)
+        error = write_seed_file(s->path, seed);
+    if (error)
+    {
+        log_msg(LOG_ERR, "could not rotate seed %u: %s", s->id, strerror(-error));
+        return;
+    }
+    ++seed_rotations;
+}
+
+static int watch_seeds(int inotify_fd)
+{
+    int i;
+
+    for (i = 0; i < seed_count; ++i)
+    {
+        struct ts3initd_seed *s = &seeds[i];
+        char dir[PATH_MAX];
+        char *slash;
+
+        strcpy(dir, s->path);
+        slash = strrchr(dir, '/');
+        if (slash == NULL)
+        {
+            strcpy(dir, ".");
+            s->name = s->path;
+        }
+        else
+        {
+            *slash = '\0';
+            if (slash == dir)
+                strcpy(dir, "/");
+            s->name = s->path + (slash - dir) + 1;
+        }
+
+        s->wd = inotify_add_watch(inotify_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (s->wd < 0)
+        {
+            log_msg(LOG_ERR, "could not watch %s: %s", dir, strerror(errno));
+            return -errno;
+        }
+    }
+    return 0;
+}
+
+static void handle_inotify(struct ts3initd_nl *nl, int inotify_fd)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+
+    while ((len = read(inotify_fd, buf, sizeof(buf))) > 0)
+    {
+        const char *p;
+
+        for (p = buf; p < buf + len; p += sizeof(struct inotify_event) + ((const struct inotify_event *)p)->len)
+        {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            int i;
+
+            if (event->len == 0)
+                continue;
+            for (i = 0; i < seed_count; ++i)
+            {
+                if (seeds[i].wd == event->wd && strcmp(seeds[i].name, event->name) == 0)
+                    load_seed(nl, &seeds[i]);
+            }
+        }
+    }
+}
+
+/*
+ * Metrics
+ */
+
+static const struct
+{
+    const char *name;
+    const char *help;
+} stat_names[__TS3INIT_STAT_MAX] =
+{
+    [TS3INIT_STAT_REPLY_XMIT]         = { "reply_xmit_total", "Replies sent through the output path." },
+    [TS3INIT_STAT_REPLY_DIRECT_XMIT]  = { "reply_direct_xmit_total", "Replies sent with --direct-xmit." },
+    [TS3INIT_STAT_REPLY_ALLOC_FAILED] = { "reply_alloc_failed_total", "Replies that could not be allocated." },
+    [TS3INIT_STAT_TIME_INVALID]       = { "time_invalid_total", "Packets that failed --check-time." },
+    [TS3INIT_STAT_COOKIE_VALID]       = { "cookie_valid_total", "Packets that passed --check-cookie." },
+    [TS3INIT_STAT_COOKIE_INVALID]     = { "cookie_invalid_total", "Packets that failed --check-cookie." },
+    [TS3INIT_STAT_PUZZLE_POOL_EMPTY]  = { "puzzle_pool_empty_total", "Puzzles requested from an empty pool." },
+    [TS3INIT_STAT_PUZZLE_SOLVED]      = { "puzzle_solved_total", "Correct puzzle solutions." },
+    [TS3INIT_STAT_PUZZLE_INVALID]     = { "puzzle_invalid_total", "Wrong puzzle solutions." },
+    [TS3INIT_STAT_COOKIE_SKEW_AHEAD]  = { "cookie_skew_ahead_total", "Cookies only valid for a clock that is ahead." },
+    [TS3INIT_STAT_COOKIE_SKEW_BEHIND] = { "cookie_skew_behind_total", "Cookies only valid for a clock that is behind." },
+    [TS3INIT_STAT_SHADOW_EVALUATED]   = { "shadow_evaluated_total", "Packets checked by --shadow rules." },
+    [TS3INIT_STAT_SHADOW_MATCHED]     = { "shadow_matched_total", "Packets --shadow rules would have matched or replied to." },
+    [TS3INIT_STAT_SHADOW_HEADER]      = { "shadow_header_total", "Packets --shadow rules are not for." },
+    [TS3INIT_STAT_SHADOW_CLIENT_VERSION] = { "shadow_client_version_total", "Packets --shadow rules would have dropped for --min-client." },
+    [TS3INIT_STAT_SHADOW_PORT]        = { "shadow_port_total", "Packets --shadow rules would have dropped for --port-table." },
+    [TS3INIT_STAT_SHADOW_TIME]        = { "shadow_time_total", "Packets --shadow rules would have dropped for --check-time." },
+    [TS3INIT_STAT_SHADOW_COOKIE]      = { "shadow_cookie_total", "Packets --shadow rules would have dropped for --check-cookie." },
+    [TS3INIT_STAT_SHADOW_PUZZLE]      = { "shadow_puzzle_total", "Packets --shadow rules would have dropped for the puzzle." },
+    [TS3INIT_STAT_SHADOW_NS]          = { "shadow_nanoseconds_total", "Time spent in --shadow rules." },
+    [TS3INIT_STAT_ATTACK_ENTERED]     = { "attack_entered_total", "Switches of --adaptive rules to their attack profile." },
+    [TS3INIT_STAT_ATTACK_LEFT]        = { "attack_left_total", "Switches of --adaptive rules back to their normal profile." },
+    [TS3INIT_STAT_BUDGET_TRUSTED]     = { "budget_trusted_total", "TS3INIT_SET_COOKIE replies to trusted prefixes beyond reply_budget." },
+    [TS3INIT_STAT_BUDGET_SHED]        = { "budget_shed_total", "TS3INIT_SET_COOKIE replies dropped over reply_budget." },
+    [TS3INIT_STAT_COOKIE_REPLAYED]    = { "cookie_replayed_total", "Valid get_puzzle cookies --reject-replay saw before, retransmits included." },
+    [TS3INIT_STAT_SHADOW_REPLAY]      = { "shadow_replay_total", "Packets --shadow rules would have dropped for --reject-replay." },
+};
+
+static int stats_cb(const struct nlmsghdr *nlh, void *arg)
+{
+    __u64 *totals = arg;
+    const struct nlattr *nla, *stat;
+    int rem, stat_rem;
+
+    nla_for_each(nla, genl_attrs(nlh), genl_attrs_len(nlh), rem)
+    {
+        if ((nla->nla_type & NLA_TYPE_MASK) != TS3INIT_ATTR_STATS)
+            continue;
+        nla_for_each(stat, (const struct nlattr *)((const char *)nla + NLA_HDRLEN),
+                     nla->nla_len - NLA_HDRLEN, stat_rem)
+        {
+            __u16 type = stat->nla_type & NLA_TYPE_MASK;
+            __u64 value;
+
+            if (type <= TS3INIT_STAT_PAD || type >= __TS3INIT_STAT_MAX ||
+                stat->nla_len != NLA_HDRLEN + sizeof(value))
+                continue;
+            memcpy(&value, (const char *)stat + NLA_HDRLEN, sizeof(value));
+            totals[type] += value;
+        }
+    }
+    return 0;
+}
+
+static void write_counter(FILE *file, const char *name, const char *help, __u64 value)
+{
+    fprintf(file, "# HELP ts3init_%s %s\n# TYPE ts3init_%s counter\nts3init_%s %llu\n",
+            name, help, name, name, (unsigned long long)value);
+}
+
+/*
+ * Dumps the counters of the module, summed over all cpus, and writes them
+ * in the Prometheus text format, e.g. for the textfile collector of the
+ * node exporter.
+ */
+static void write_metrics(struct ts3initd_nl *nl)
+{
+    char buf[64] __attribute__((aligned(NLMSG_ALIGNTO)));
+    char tmp[PATH_MAX];
+    __u64 totals[__TS3INIT_STAT_MAX] = { 0 };
+    struct nlmsghdr *nlh;
+    FILE *file;
+    int error, i;
+
+    error = nl_resolve(nl);
+    if (error == 0)
+    {
+        nlh = genl_msg_init(buf, nl->family, NLM_F_DUMP, TS3INIT_CMD_STATS_GET, TS3INIT_GENL_VERSION);
+        error = nl_talk(nl, nlh, stats_cb, totals);
+    }
+    if (error)
+    {
+        nl->family = 0;
+        for (i = 0; i < seed_count; ++i)
+            seeds[i].pushed = false;
+    }
+
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", metrics_path) >= (int)sizeof(tmp))
+        return;
+    file = fopen(tmp, "we");
+    if (file == NULL)
+    {
+        log_msg(LOG_WARNING, "could not write %s: %s", tmp, strerror(errno));
+        return;
+    }
+
+    fprintf(file, "# HELP ts3init_up Whether the counters could be read from the module.\n"
+                  "# TYPE ts3init_up gauge\nts3init_up %d\n", error == 0);
+    if (error == 0)
+    {
+        for (i = TS3INIT_STAT_PAD + 1; i < __TS3INIT_STAT_MAX; ++i)
+        {
+            if (stat_names[i].name)
+                write_counter(file, stat_names[i].name, stat_names[i].help, totals[i]);
+        }
+    }
+    write_counter(file, "daemon_seed_pushes_total", "Seeds pushed to the module.", seed_pushes);
+    write_counter(file, "daemon_seed_push_errors_total", "Seeds that could not be pushed.", seed_push_errors);
+    write_counter(file, "daemon_seed_rotations_total", "Seeds rotated.", seed_rotations);
+
+    if (fclose(file) != 0 || rename(tmp, metrics_path) < 0)
+    {
+        log_msg(LOG_WARNING, "could not write %s: %s", metrics_path, strerror(errno));
+        unlink(tmp);
+    }
+}
+
+/*
+ * Main loop
+ */
+
+static void handle_signal(int signal)
+{
+    if (signal == SIGHUP)
+        repush = 1;
+    else
+        stop = 1;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -s, --seed id:file            Push the seed in file as seed id, and again\n"
+        "                                whenever the file changes. May be repeated.\n"
+        "  -r, --rotate seconds          Write a new random seed to every seed file\n"
+        "                                each interval. Run this on one host only\n"
+        "                                when the files are shared.\n"
+        "  -m, --metrics-file file       Write the module counters to file in the\n"
+        "                                Prometheus text format.\n"
+        "  -i, --metrics-interval n      Seconds between metrics updates (default %d).\n"
+        "  -f, --foreground              Log to stderr instead of syslog.\n"
+        "  -1, --once                    Push the seeds and exit, with an error if\n"
+        "                                one could not be pushed.\n"
+        "SIGHUP pushes all seeds again.\n",
+        name, DEFAULT_METRICS_INTERVAL);
+}
+
+static bool parse_seed_arg(const char *arg)
+{
+    struct ts3initd_seed *s;
+    unsigned long id;
+    char *end;
+    int i;
+
+    if (seed_count == MAX_SEEDS)
+        return false;
+    errno = 0;
+    id = strtoul(arg, &end, 0);
+    if (errno || end == arg || *end != ':' || id > UINT32_MAX || end[1] == '\0' ||
+        strlen(end + 1) >= PATH_MAX)
+        return false;
+    for (i = 0; i < seed_count; ++i)
+    {
+        if (seeds[i].id == id)
+            return false;
+    }
+
+    s = &seeds[seed_count++];
+    s->id = id;
+    strcpy(s->path, end + 1);
+    s->wd = -1;
+    return true;
+}
+
+static bool parse_interval(const char *arg, unsigned int *interval)
+{
+    unsigned long value;
+    char *end;
+
+    errno = 0;
+    value = strtoul(arg, &end, 0);
+    if (errno || end == arg || *end != '\0' || value == 0 || value > UINT32_MAX)
+        return false;
+    *interval = value;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {.name = "seed",             .has_arg = true,  .val = 's'},
+        {.name = "rotate",           .has_arg = true,  .val = 'r'},
+        {.name = "metrics-file",     .has_arg = true,  .val = 'm'},
+        {.name = "metrics-interval", .has_arg = true,  .val = 'i'},
+        {.name = "foreground",       .has_arg = false, .val = 'f'},
+        {.name = "once",             .has_arg = false, .val = '1'},
+        {.name = "help",             .has_arg = false, .val = 'h'},
+        {NULL},
+    };
+    struct sigaction action = { .sa_handler = handle_signal };
+    struct ts3initd_nl nl;
+    struct pollfd pfd;
+    time_t now, next_rotate, next_metrics, next_retry;
+    int c, i, error;
+
+    while ((c = getopt_long(argc, argv, "s:r:m:i:f1h", options, NULL)) != -1)
+    {
+        switch (c)
+        {
+        case 's':
+            if (!parse_seed_arg(optarg))
+            {
+                fprintf(stderr, "%s: invalid or duplicate seed %s\n", argv[0], optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'r':
+            if (!parse_interval(optarg, &rotate_interval))
+            {
+                fprintf(stderr, "%s: invalid rotate interval %s\n", argv[0], optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'm':
+            metrics_path = optarg;
+            break;
+        case 'i':
+            if (!parse_interval(optarg, &metrics_interval))
+            {
+                fprintf(stderr, "%s: invalid metrics interval %s\n", argv[0], optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'f':
+            foreground = true;
+            break;
+        case '1':
+            once = true;
+            foreground = true;
+            break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (optind != argc || (seed_count == 0 && metrics_path == NULL))
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (rotate_interval && seed_count == 0)
+    {
+        fprintf(stderr, "%s: --rotate requires --seed\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (once && (seed_count == 0 || rotate_interval || metrics_path))
+    {
+        fprintf(stderr, "%s: --once requires --seed, and no --rotate or --metrics-file\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (!foreground)
+        openlog("ts3initd", LOG_PID, LOG_DAEMON);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGHUP, &action, NULL);
+
+    error = nl_open(&nl);
+    if (error)
+    {
+        log_msg(LOG_ERR, "could not open generic netlink socket: %s", strerror(-error));
+        return EXIT_FAILURE;
+    }
+
+    if (once)
+    {
+        error = 0;
+        for (i = 0; i < seed_count; ++i)
+        {
+            load_seed(&nl, &seeds[i]);
+            if (!seeds[i].pushed)
+                error = 1;
+        }
+        close(nl.fd);
+        return error ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    pfd.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    pfd.events = POLLIN;
+    if (pfd.fd < 0 || watch_seeds(pfd.fd) < 0)
+    {
+        log_msg(LOG_ERR, "could not set up inotify: %s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    /* a rotating host creates the seeds it has no file for yet */
+    for (i = 0; i < seed_count; ++i)
+    {
+        if (rotate_interval && access(seeds[i].path, F_OK) < 0)
+            rotate_seed(&seeds[i]);
+        load_seed(&nl, &seeds[i]);
+    }
+
+    now = monotonic_now();
+    next_rotate = now + rotate_interval;
+    next_metrics = now;
+    next_retry = now + RETRY_INTERVAL;
+
+    while (!stop)
+    {
+        time_t deadline;
+
+        now = monotonic_now();
+        if (repush)
+        {
+            repush = 0;
+            for (i = 0; i < seed_count; ++i)
+                seeds[i].pushed = false;
+            next_retry = now;
+        }
+        if (rotate_interval && now >= next_rotate)
+        {
+            for (i = 0; i < seed_count; ++i)
+                rotate_seed(&seeds[i]);
+            next_rotate = now + rotate_interval;
+        }
+        if (metrics_path && now >= next_metrics)
+        {
+            write_metrics(&nl);
+            next_metrics = now + metrics_interval;
+        }
+        if (now >= next_retry)
+        {
+            for (i = 0; i < seed_count; ++i)
+            {
+                if (!seeds[i].pushed)
+                    load_seed(&nl, &seeds[i]);
+            }
+            next_retry = now + RETRY_INTERVAL;
+        }
+
+        deadline = next_retry;
+        if (rotate_interval && next_rotate < deadline)
+            deadline = next_rotate;
+        if (metrics_path && next_metrics < deadline)
+            deadline = next_metrics;
+
+        if (poll(&pfd, 1, deadline > now ? (deadline - now) * 1000 : 0) > 0)
+            handle_inotify(&nl, pfd.fd);
+    }
+
+    close(pfd.fd);
+    close(nl.fd);
+    return EXIT_SUCCESS;
+}